@@ -0,0 +1,1580 @@
+/*!
+ * @file benchmark.cpp
+ * @brief Benchmarks for the Valeris game.
+ * @details Runs each benchmark section and prints the results as a single JSON object, so runs can be diffed and
+ * tracked over time. Build it with -O2 from this file and every source in the helper directory, then run it from the
+ * bench directory so resource paths resolve, writing its output to ../bench_output.txt.
+ */
+
+#include "../lib/dungeon.h"
+#include "../lib/flooranalytics.h"
+#include "../lib/floorexport.h"
+#include "../lib/fogofwar.h"
+#include "../lib/screen.h"
+#include "../lib/toolkit.h"
+#include "../lib/timer.h"
+#include "../lib/ansifilter.h"
+#include "../lib/compression.h"
+#include "../lib/commands.h"
+#include "../lib/menu.h"
+#include "../lib/valerisgame.h"
+#include "../lib/scheduler.h"
+#include "../lib/hibernation.h"
+#include "../lib/floortemplate.h"
+#include "../lib/sharedworld.h"
+#include <algorithm>
+#include <atomic>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <cstdio>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include "../lib/fiber.h"
+#include "../lib/server.h"
+#include <cstring>
+#include <poll.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+/*!
+ * @brief Milliseconds elapsed since a start time.
+ * @param start The time the measurement started.
+ * @return The elapsed time in milliseconds.
+ */
+static double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/*!
+ * @brief Writes floor statistics as a JSON object.
+ * @param out The stream to write to.
+ * @param stats The statistics to write.
+ */
+static void writeStats(std::ostream &out, const FloorStats &stats)
+{
+    out << "\"rooms\": " << stats.roomCount
+        << ", \"links\": " << stats.linkCount
+        << ", \"diameter\": " << stats.diameter
+        << ", \"diameter_exact\": " << (stats.diameterExact ? "true" : "false")
+        << ", \"dead_ends\": " << stats.deadEnds
+        << ", \"average_degree\": " << stats.averageDegree
+        << ", \"articulation_points\": " << stats.articulationPoints;
+}
+
+/*!
+ * @brief Benchmarks floor generation and the floor graph statistics.
+ * @param out The stream to write the JSON value to.
+ * @details Real floors are generated through Dungeon. The synthetic case grows a random grid floor with the same
+ * rules as Dungeon::generateFloor (picking only from rooms that may still have a free side) directly on FloorAnalytics, which reaches sizes that room contents would not allow.
+ */
+static void benchFloorAnalytics(std::ostream &out)
+{
+    out << "{\n    \"generated\": [";
+    const int floorSizes[] = {20, 200, 2000};
+    for (int i = 0; i < 3; i++)
+    {
+        Dungeon dungeon(1000 + i);
+        auto start = std::chrono::steady_clock::now();
+        dungeon.generateFloor(floorSizes[i]);
+        double generateMs = elapsedMs(start);
+        start = std::chrono::steady_clock::now();
+        FloorStats stats = dungeon.getStats();
+        double statsMs = elapsedMs(start);
+
+        out << (i ? ",\n" : "\n") << "      {";
+        writeStats(out, stats);
+        out << ", \"generate_ms\": " << generateMs << ", \"stats_ms\": " << statsMs << "}";
+    }
+    out << "\n    ],\n    \"synthetic\": [";
+
+    const int syntheticSizes[] = {10000, 100000, 1000000};
+    for (int i = 0; i < 3; i++)
+    {
+        int n = syntheticSizes[i];
+        std::mt19937 rng(7 + i);
+        std::unordered_map<long long, int> cells;
+        std::vector<std::pair<int, int>> coords;
+        std::vector<int> frontier; // Rooms that may still have a free side
+        FloorAnalytics analytics;
+        const int dx[] = {0, 0, -1, 1};
+        const int dy[] = {1, -1, 0, 0};
+        auto cellKey = [](int x, int y)
+        { return ((long long)x << 32) ^ (unsigned int)y; };
+
+        auto start = std::chrono::steady_clock::now();
+        analytics.onRoomAdded(0);
+        cells[cellKey(0, 0)] = 0;
+        coords.push_back({0, 0});
+        frontier.push_back(0);
+        while ((int)coords.size() < n)
+        {
+            int slot = std::uniform_int_distribution<>(0, (int)frontier.size() - 1)(rng);
+            int from = frontier[slot];
+            int direction = std::uniform_int_distribution<>(0, 3)(rng);
+            int x = coords[from].first + dx[direction];
+            int y = coords[from].second + dy[direction];
+            if (cells.count(cellKey(x, y)))
+            {
+                bool enclosed = true;
+                for (int d = 0; d < 4; d++)
+                {
+                    enclosed = enclosed && cells.count(cellKey(coords[from].first + dx[d], coords[from].second + dy[d]));
+                }
+                if (enclosed)
+                {
+                    frontier[slot] = frontier.back();
+                    frontier.pop_back();
+                }
+                continue;
+            }
+            int id = (int)coords.size();
+            cells[cellKey(x, y)] = id;
+            coords.push_back({x, y});
+            frontier.push_back(id);
+            analytics.onRoomAdded(id);
+            analytics.onLink(from, id, direction);
+            for (int d = 0; d < 4; d++)
+            {
+                auto it = cells.find(cellKey(x + dx[d], y + dy[d]));
+                if (it != cells.end() && it->second != from)
+                {
+                    analytics.onLink(id, it->second, d);
+                }
+            }
+        }
+        double buildMs = elapsedMs(start);
+        start = std::chrono::steady_clock::now();
+        FloorStats stats = analytics.getStats();
+        double recomputeMs = elapsedMs(start);
+        start = std::chrono::steady_clock::now();
+        analytics.getStats();
+        double cachedMs = elapsedMs(start);
+
+        out << (i ? ",\n" : "\n") << "      {";
+        writeStats(out, stats);
+        out << ", \"build_ms\": " << buildMs << ", \"recompute_ms\": " << recomputeMs << ", \"cached_query_ms\": " << cachedMs << "}";
+    }
+    out << "\n    ]\n  }";
+}
+
+/*!
+ * @brief Benchmarks streaming floor export to disk.
+ * @param out The stream to write the JSON value to.
+ * @details Exports the same floor repeatedly in each format to a scratch file and reports the sustained throughput.
+ * The writer's buffer is the only memory the exporter uses, whatever the floor size.
+ */
+static void benchFloorExport(std::ostream &out)
+{
+    const char *scratch = "floor_export.tmp";
+    const char *formats[] = {"json", "dot"};
+    Dungeon dungeon(2024);
+    dungeon.generateFloor(2000);
+
+    out << "[";
+    for (int f = 0; f < 2; f++)
+    {
+        const int repeats = 200;
+        size_t bytes = 0;
+        std::FILE *file = std::fopen(scratch, "wb");
+        std::setvbuf(file, nullptr, _IONBF, 0);
+        auto start = std::chrono::steady_clock::now();
+        {
+            BufferedWriter writer(file);
+            for (int i = 0; i < repeats; i++)
+            {
+                if (f == 0)
+                {
+                    exportFloorJson(dungeon, writer);
+                }
+                else
+                {
+                    exportFloorDot(dungeon, writer);
+                }
+            }
+            writer.flush();
+            bytes = writer.bytesWritten();
+        }
+        std::fclose(file);
+        double ms = elapsedMs(start);
+
+        out << (f ? ",\n" : "\n") << "    {\"format\": \"" << formats[f] << "\", \"rooms\": " << 2000 * repeats
+            << ", \"bytes\": " << bytes << ", \"ms\": " << ms << ", \"mb_per_s\": " << (bytes / 1e6) / (ms / 1000.0)
+            << ", \"buffer_bytes\": " << (1 << 16) << "}";
+    }
+    out << "\n  ]";
+    std::remove(scratch);
+}
+
+/*!
+ * @brief Benchmarks fog-of-war updates in the densest possible region.
+ * @param out The stream to write the JSON value to.
+ * @details Builds a fully open square floor, where every room links to all four neighbours, and times moveTo to
+ * random rooms for several sight radii.
+ */
+static void benchFogOfWar(std::ostream &out)
+{
+    const int side = 256;
+    std::vector<Room *> rooms(side * side);
+    for (int y = 0; y < side; y++)
+    {
+        for (int x = 0; x < side; x++)
+        {
+            rooms[y * side + x] = new Room();
+            rooms[y * side + x]->roomContent.addCoordinates(x, y);
+        }
+    }
+    for (int y = 0; y < side; y++)
+    {
+        for (int x = 0; x < side; x++)
+        {
+            Room *room = rooms[y * side + x];
+            room->east = x + 1 < side ? rooms[y * side + x + 1] : nullptr;
+            room->west = x > 0 ? rooms[y * side + x - 1] : nullptr;
+            room->north = y + 1 < side ? rooms[(y + 1) * side + x] : nullptr;
+            room->south = y > 0 ? rooms[(y - 1) * side + x] : nullptr;
+        }
+    }
+
+    const int radii[] = {2, 8, 32};
+    out << "[";
+    for (int r = 0; r < 3; r++)
+    {
+        FogOfWar fog(radii[r]);
+        fog.build(rooms);
+        std::mt19937 rng(r);
+        std::uniform_int_distribution<int> coord(0, side - 1);
+        const int moves = 20000;
+        long long seen = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < moves; i++)
+        {
+            fog.moveTo(coord(rng), coord(rng));
+            seen += fog.isVisible(side / 2, side / 2);
+        }
+        double ms = elapsedMs(start);
+        out << (r ? ",\n" : "\n") << "    {\"rooms\": " << side * side << ", \"sight_radius\": " << radii[r]
+            << ", \"moves\": " << moves << ", \"us_per_move\": " << ms * 1000.0 / moves
+            << ", \"visible_from_centre\": " << (fog.moveTo(side / 2, side / 2), fog.visibleCount())
+            << ", \"centre_seen\": " << seen << "}";
+    }
+    out << "\n  ]";
+
+    for (Room *room : rooms)
+    {
+        delete room;
+    }
+}
+
+/*!
+ * @brief Benchmarks the bytes sent per move by the exploration view.
+ * @param out The stream to write the JSON value to.
+ * @details Walks a generated floor and composes the same view the game shows each turn. The full redraw is what the
+ * game used to send (clear the previous 14 lines and print the view again); the diff is what Screen sends.
+ */
+static void benchScreenDiff(std::ostream &out)
+{
+    Dungeon dungeon(77);
+    Room *room = dungeon.generateFloor(200);
+    std::mt19937 rng(3);
+    Screen screen;
+    const int turns = 1000;
+    // Index 0 counts turns that moved to another room, index 1 turns that stayed (a blocked move)
+    size_t fullBytes[2] = {0, 0}, diffBytes[2] = {0, 0}, counted[2] = {0, 0};
+
+    for (int turn = 0; turn < turns; turn++)
+    {
+        std::string view = dungeon.getMap(room) + "\n";
+        view += "\033[36m" + room->roomContent.getRoomDesc() + ".\n\n";
+        view += room->getAvailableDirections();
+        view += "Other Avalible Actions: Q, /help, /heal, /stats, /inventory\nEnter Action : ";
+        room->roomContent.setVisited(true);
+
+        screen.begin();
+        screen.draw(view);
+        std::string diff = screen.present();
+        if (turn > 0)
+        {
+            int kind = turn % 2 == 0;
+            fullBytes[kind] += clearSequence(14).size() + view.size();
+            diffBytes[kind] += diff.size();
+            counted[kind]++;
+        }
+        screen.inputLine();
+        screen.written("\n");
+
+        if (turn % 2 == 0)
+        {
+            std::vector<Room *> exits;
+            for (Room *next : {room->north, room->south, room->east, room->west})
+            {
+                if (next)
+                {
+                    exits.push_back(next);
+                }
+            }
+            room = exits[std::uniform_int_distribution<size_t>(0, exits.size() - 1)(rng)];
+        }
+    }
+
+    const char *kinds[] = {"moved", "stayed"};
+    out << "[";
+    for (int kind = 0; kind < 2; kind++)
+    {
+        out << (kind ? ",\n" : "\n") << "    {\"turn\": \"" << kinds[kind] << "\", \"turns\": " << counted[kind]
+            << ", \"full_bytes_per_turn\": " << (double)fullBytes[kind] / counted[kind]
+            << ", \"diff_bytes_per_turn\": " << (double)diffBytes[kind] / counted[kind]
+            << ", \"reduction\": " << (double)fullBytes[kind] / diffBytes[kind] << "}";
+    }
+    out << "\n  ]";
+}
+
+/*!
+ * @brief Benchmarks the CPU used by a session while it waits.
+ * @param out The stream to write the JSON value to.
+ * @details Compares the busy-wait loop delay() used to run with the sleeping delay() and with a thousand callback
+ * timers spread over the same period on the timer thread. CPU time is for the whole process.
+ */
+static void benchIdleCpu(std::ostream &out)
+{
+    const int waitMs = 500;
+    auto measure = [&](const std::function<void()> &wait)
+    {
+        std::clock_t cpu = std::clock();
+        auto wall = std::chrono::steady_clock::now();
+        wait();
+        double wallMs = elapsedMs(wall);
+        double cpuMs = 1000.0 * (std::clock() - cpu) / CLOCKS_PER_SEC;
+        return std::make_pair(wallMs, cpuMs);
+    };
+
+    auto busyWait = [&]()
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        while (std::chrono::high_resolution_clock::now() - start < std::chrono::milliseconds(waitMs))
+        {
+        }
+    };
+    auto sleeping = [&]()
+    {
+        delay(waitMs);
+    };
+    auto callbacks = [&]()
+    {
+        auto fired = std::make_shared<std::atomic<int>>(0);
+        for (int i = 0; i < 1000; i++)
+        {
+            TimerThread::shared().after(i * waitMs / 1000, [fired]()
+                                        { (*fired)++; });
+        }
+        sleepFor(waitMs + 20);
+    };
+
+    std::vector<std::pair<std::string, std::pair<double, double>>> results = {
+        {"busy_wait", measure(busyWait)},
+        {"delay", measure(sleeping)},
+        {"timer_callbacks", measure(callbacks)},
+    };
+
+    out << "[";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        out << (i ? ",\n" : "\n") << "    {\"wait\": \"" << results[i].first << "\", \"wall_ms\": " << results[i].second.first
+            << ", \"cpu_ms\": " << results[i].second.second
+            << ", \"cpu_percent\": " << 100.0 * results[i].second.second / results[i].second.first << "}";
+    }
+    out << "\n  ]";
+}
+
+/*!
+ * @brief Output sink that only counts bytes and escape sequences.
+ */
+class CountingSink : public OutputSink
+{
+public:
+    unsigned long long bytes = 0;   //!< Bytes written.
+    unsigned long long escapes = 0; //!< Escape sequences started.
+
+    bool write(const char *data, size_t size) override
+    {
+        bytes += size;
+        escapes += std::count(data, data + size, '\033');
+        return true;
+    }
+};
+
+/*!
+ * @brief Output sink that passes every write to two other sinks.
+ */
+class TeeSink : public OutputSink
+{
+public:
+    TeeSink(OutputSink &first, OutputSink &second) : first(first), second(second) {}
+
+    bool write(const char *data, size_t size) override
+    {
+        return first.write(data, size) && second.write(data, size);
+    }
+
+private:
+    OutputSink &first;  //!< The first sink.
+    OutputSink &second; //!< The second sink.
+};
+
+/*!
+ * @brief Minimal terminal the bot reads the game's screen from.
+ * @details Models newlines, carriage returns, the cursor movement and erase-line sequences the game uses, and text.
+ * Colours are ignored. Input the bot sends is applied too, standing in for the echo of a real terminal.
+ */
+class BotTerminal
+{
+public:
+    /*!
+     * @brief Applies output to the screen.
+     * @param bytes The output.
+     */
+    void apply(const std::string &bytes)
+    {
+        for (size_t i = 0; i < bytes.size(); i++)
+        {
+            char c = bytes[i];
+            ensureRow();
+            if (c == '\033' && i + 1 < bytes.size() && bytes[i + 1] == '[')
+            {
+                size_t end = i + 2;
+                while (end < bytes.size() && !(bytes[end] >= 0x40 && bytes[end] <= 0x7e))
+                {
+                    end++;
+                }
+                std::string params = bytes.substr(i + 2, end - i - 2);
+                int n = params.empty() ? 1 : std::max(1, std::atoi(params.c_str()));
+                switch (end < bytes.size() ? bytes[end] : 0)
+                {
+                case 'A':
+                    row = std::max(0, row - n);
+                    break;
+                case 'B':
+                    row += n;
+                    break;
+                case 'C':
+                    col += n;
+                    break;
+                case 'D':
+                    col = std::max(0, col - n);
+                    break;
+                case 'G':
+                    col = n - 1;
+                    break;
+                case 'K':
+                    ensureRow();
+                    lines[row].resize(params == "2" ? 0 : std::min(lines[row].size(), (size_t)col));
+                    break;
+                }
+                i = end;
+            }
+            else if (c == '\n')
+            {
+                row++;
+                col = 0;
+            }
+            else if (c == '\r')
+            {
+                col = 0;
+            }
+            else if ((unsigned char)c >= 0x20)
+            {
+                std::string &line = lines[row];
+                if (line.size() <= (size_t)col)
+                {
+                    line.resize(col + 1, ' ');
+                }
+                line[col++] = c;
+            }
+        }
+    }
+
+    /*!
+     * @brief Gets the line the cursor is on.
+     * @return The line.
+     */
+    std::string cursorLine()
+    {
+        ensureRow();
+        return lines[row];
+    }
+
+    /*!
+     * @brief Finds the last line above the cursor starting with some text.
+     * @param prefix The text.
+     * @return The line, or an empty string.
+     */
+    std::string lastLine(const std::string &prefix)
+    {
+        for (int r = std::min(row, (int)lines.size() - 1); r >= 0; r--)
+        {
+            if (lines[r].compare(0, prefix.size(), prefix) == 0)
+            {
+                return lines[r];
+            }
+        }
+        return "";
+    }
+
+private:
+    void ensureRow()
+    {
+        if (lines.size() <= (size_t)row)
+        {
+            lines.resize(row + 1);
+        }
+    }
+
+    std::vector<std::string> lines; //!< Screen contents.
+    int row = 0;                    //!< Cursor row.
+    int col = 0;                    //!< Cursor column.
+};
+
+/*!
+ * @brief Plays the intro and a scripted game through an in-memory console.
+ * @param observer Receives every write the game makes.
+ * @return The number of actions the bot took.
+ * @details The bot fights every enemy (answering with the optimal move), searches solved rooms, checks its stats and
+ * inventory now and then, and otherwise walks through a random open door.
+ */
+static int botPlaythrough(OutputSink &observer)
+{
+    MemorySource input("", false);
+    MemorySink transcript;
+    TeeSink all(transcript, observer);
+    Console session(input, all);
+
+    std::atomic<bool> finished(false);
+    std::thread game([&]()
+                     {
+                         Console::Binding binding(session);
+                         displayIntro(0, "\033[36m");
+                         ValerisGame valerisGame(session);
+                         valerisGame.start("\033[36m");
+                         finished = true; });
+
+    std::mt19937 rng(11);
+    const int actions = 150;
+    int taken = 0;
+    size_t seen = 0;
+    BotTerminal terminal;
+    input.push("Bot\n");
+    terminal.apply("Bot\n");
+    while (!finished && taken < actions)
+    {
+        if (!input.waiting())
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            continue;
+        }
+        std::string text = transcript.text();
+        terminal.apply(text.substr(seen));
+        seen = text.size();
+
+        std::string prompt = terminal.cursorLine();
+        std::string command;
+        if (prompt.find("Your move:") != std::string::npos)
+        {
+            size_t at = prompt.find("Optimal move: ") + 14;
+            command = prompt.substr(at, prompt.find(' ', at) - at);
+        }
+        else
+        {
+            std::string doorsLine = terminal.lastLine("You can move:");
+            std::string actionsLine = terminal.lastLine("Other Avalible Actions:");
+            std::vector<std::string> doors;
+            for (const char *door : {"North", "South", "East", "West"})
+            {
+                if (doorsLine.find(door) != std::string::npos)
+                {
+                    doors.push_back(std::string(1, door[0]));
+                }
+            }
+            if (actionsLine.find("/fight") != std::string::npos)
+            {
+                command = "/fight";
+            }
+            else if (actionsLine.find("/search") != std::string::npos && taken % 2 == 0)
+            {
+                command = "/search";
+            }
+            else if (taken % 10 == 5 || doors.empty())
+            {
+                command = taken % 20 == 5 ? "/stats" : "/inventory";
+            }
+            else
+            {
+                command = doors[std::uniform_int_distribution<size_t>(0, doors.size() - 1)(rng)];
+            }
+            taken++;
+        }
+        input.push(command + "\n");
+        terminal.apply(command + "\n");
+    }
+    input.close();
+    game.join();
+    return taken;
+}
+
+/*!
+ * @brief Measures the bytes removed by AnsiFilter over a scripted playthrough.
+ * @param out The stream to write the JSON value to.
+ * @details Every write the game makes is counted as it is and after a CoalescingSink.
+ */
+static void benchAnsiCoalescing(std::ostream &out)
+{
+    CountingSink raw;
+    CountingSink coalescedCount;
+    CoalescingSink coalesced(coalescedCount);
+    TeeSink rawAndCoalesced(raw, coalesced);
+    auto start = std::chrono::steady_clock::now();
+    int taken = botPlaythrough(rawAndCoalesced);
+    double ms = elapsedMs(start);
+
+    out << "{\"actions\": " << taken << ", \"elapsed_ms\": " << ms << ", \"raw_bytes\": " << raw.bytes
+        << ", \"coalesced_bytes\": " << coalescedCount.bytes << ", \"raw_escapes\": " << raw.escapes
+        << ", \"coalesced_escapes\": " << coalescedCount.escapes
+        << ", \"reduction\": " << (double)raw.bytes / coalescedCount.bytes << "}";
+}
+
+/*!
+ * @brief Measures compressed session output over a scripted playthrough.
+ * @param out The stream to write the JSON value to.
+ * @details Compression is accepted before the game starts, as if the client had answered DO COMPRESS2, and every
+ * write the game makes is sent as one sync-flushed frame.
+ */
+static void benchSessionCompression(std::ostream &out)
+{
+    CountingSink wire;
+    CompressingSink mccp(wire);
+    mccp.accept();
+    auto start = std::chrono::steady_clock::now();
+    int taken = botPlaythrough(mccp);
+    mccp.end();
+    double ms = elapsedMs(start);
+    CompressionStats stats = mccp.getStats();
+
+    out << "{\"actions\": " << taken << ", \"elapsed_ms\": " << ms << ", \"frames\": " << stats.frames
+        << ", \"raw_bytes\": " << stats.rawBytes << ", \"sent_bytes\": " << stats.sentBytes
+        << ", \"raw_bytes_per_frame\": " << (double)stats.rawBytes / stats.frames
+        << ", \"sent_bytes_per_frame\": " << (double)stats.sentBytes / stats.frames
+        << ", \"ratio\": " << stats.ratio() << "}";
+}
+
+/*!
+ * @brief Compares the old uppercase-and-compare chain with the command registry.
+ * @param out The stream to write the JSON value to.
+ * @details The chain uppercases each line and compares it with every name in turn, as the exploration loop used to.
+ * The registry is timed for the lookup alone, which is what replaced the chain, and for a full dispatch, which also
+ * splits the arguments, checks availability and calls the handler.
+ */
+static void benchCommandDispatch(std::ostream &out)
+{
+    const std::vector<std::string> names = {"N", "S", "E", "W", "Q", "/help", "/heal", "/stats", "/inventory",
+                                            "/fight", "/play", "/search", "/gamble", "/finish"};
+    const std::vector<std::string> typed = {"n", "E", "/inventory", "/Fight", "w", "/search", "s", "/stats", "/FINISH", "/look"};
+    const int rounds = 200000;
+    volatile int handled = 0;
+
+    std::vector<std::string> upperNames;
+    for (const std::string &name : names)
+    {
+        upperNames.push_back(toUpperCase(name));
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++)
+    {
+        std::string upper = toUpperCase(typed[round % typed.size()]);
+        for (const std::string &name : upperNames)
+        {
+            if (upper == name)
+            {
+                handled = handled + 1;
+                break;
+            }
+        }
+    }
+    double chainMs = elapsedMs(start);
+    int chainHandled = handled;
+
+    CommandRegistry registry;
+    for (const std::string &name : names)
+    {
+        registry.add(name, [&handled](const CommandArgs &)
+                     { handled = handled + 1; });
+    }
+    handled = 0;
+    start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++)
+    {
+        if (registry.find(typed[round % typed.size()]) != nullptr)
+        {
+            handled = handled + 1;
+        }
+    }
+    double findMs = elapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++)
+    {
+        registry.dispatch(typed[round % typed.size()]);
+    }
+    double dispatchMs = elapsedMs(start);
+
+    out << "{\"lookups\": " << rounds << ", \"found\": " << chainHandled
+        << ", \"if_chain_ns\": " << chainMs * 1e6 / rounds << ", \"registry_find_ns\": " << findMs * 1e6 / rounds
+        << ", \"registry_dispatch_ns\": " << dispatchMs * 1e6 / rounds << ", \"lookup_speedup\": " << chainMs / findMs << "}";
+}
+
+/*!
+ * @brief Measures the work-stealing scheduler's overhead and how it spreads a lopsided load.
+ * @param out The stream to write the JSON value to.
+ * @details Empty tasks are timed from outside the pool, where they go through an inbox, and from inside a task,
+ * where they go on the worker's own deque. Then floors are generated as jobs that all prefer worker 0, next to a
+ * stream of cheap tasks, and the steals show how much of the load the other workers took.
+ */
+static void benchTaskScheduler(std::ostream &out)
+{
+    const int workers = (int)std::max(2u, std::thread::hardware_concurrency());
+    const int tasks = 200000;
+    Scheduler scheduler(workers);
+
+    std::atomic<int> done(0);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < tasks; i++)
+    {
+        scheduler.submit([&done]
+                         { done++; });
+    }
+    while (done < tasks)
+    {
+        std::this_thread::yield();
+    }
+    double inboxNs = elapsedMs(start) * 1e6 / tasks;
+
+    done = 0;
+    start = std::chrono::steady_clock::now();
+    scheduler.submit([&scheduler, &done]
+                     {
+                         for (int i = 0; i < tasks; i++)
+                         {
+                             scheduler.submit([&done]
+                                              { done++; });
+                         } });
+    while (done < tasks)
+    {
+        std::this_thread::yield();
+    }
+    double dequeNs = elapsedMs(start) * 1e6 / tasks;
+    SchedulerStats before = scheduler.stats();
+
+    const int floors = 64;
+    start = std::chrono::steady_clock::now();
+    std::vector<Job<int>> jobs;
+    for (int i = 0; i < floors; i++)
+    {
+        jobs.push_back(scheduler.spawn([i]
+                                       {
+                                           Dungeon dungeon(7000 + i);
+                                           Room *first = dungeon.generateFloor(40);
+                                           return dungeon.numRooms(first); },
+                                       0));
+        for (int j = 0; j < 50; j++)
+        {
+            scheduler.submit([] {}, 0);
+        }
+    }
+    int rooms = 0;
+    for (Job<int> &job : jobs)
+    {
+        rooms += job.get();
+    }
+    double floorsMs = elapsedMs(start);
+    scheduler.stop();
+    SchedulerStats after = scheduler.stats();
+
+    size_t peak = 0;
+    for (const SchedulerStats::Worker &worker : after.workers)
+    {
+        peak = std::max(peak, worker.peakQueueDepth);
+    }
+    out << "{\"workers\": " << workers << ", \"hardware_threads\": " << std::thread::hardware_concurrency()
+        << ", \"inbox_task_ns\": " << inboxNs << ", \"deque_task_ns\": " << dequeNs
+        << ", \"floors\": " << floors << ", \"floor_rooms\": " << rooms << ", \"lopsided_ms\": " << floorsMs
+        << ", \"lopsided_steals\": " << after.steals - before.steals
+        << ", \"worker0_share\": " << (double)(after.workers[0].executed - before.workers[0].executed) / (after.executed - before.executed)
+        << ", \"peak_queue_depth\": " << peak << "}";
+}
+
+/*!
+ * @brief Benchmarks per-session memory with a private floor each and with one shared floor template.
+ * @param out The stream to write the JSON value to.
+ * @details Each session walks the event floor, fighting in the rooms with enemies and searching a third of the others,
+ * as the game's commands would through FloorOverlay. Memory is the estimate from memoryFootprint, so the two modes are
+ * counted the same way; start time is how long creating every session's floor takes.
+ */
+static void benchSharedFloors(std::ostream &out)
+{
+    const int sessions = 1000;
+    const int rooms = 20;
+    const int moves = 15;
+    const unsigned int seed = 2025;
+
+    auto play = [](FloorOverlay &floor, unsigned int walker)
+    {
+        std::mt19937 rng(walker);
+        const Room *room = floor.getTemplate().getStartRoom();
+        for (int move = 0; move < moves; move++)
+        {
+            floor.setVisited(room->id);
+            if (!room->roomContent.getEnemies().empty())
+            {
+                RoomContent &content = floor.edit(room->id)->roomContent;
+                content.clearEnemies();
+                content.clearText();
+            }
+            else if (rng() % 3 == 0 && !room->roomContent.getItems().empty())
+            {
+                floor.edit(room->id)->roomContent.emptyItems();
+            }
+            std::vector<Room *> exits;
+            for (Room *next : {room->north, room->south, room->east, room->west})
+            {
+                if (next)
+                {
+                    exits.push_back(next);
+                }
+            }
+            room = floor.getRoom(exits[std::uniform_int_distribution<size_t>(0, exits.size() - 1)(rng)]->id);
+        }
+    };
+
+    // Private floors: every session generates its own copy of the same seed
+    std::vector<std::unique_ptr<FloorOverlay>> games;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < sessions; i++)
+    {
+        games.emplace_back(new FloorOverlay(std::make_shared<const FloorTemplate>(seed, rooms)));
+    }
+    double privateMs = elapsedMs(start);
+    size_t privateBytes = 0;
+    for (int i = 0; i < sessions; i++)
+    {
+        play(*games[i], i);
+        privateBytes += games[i]->getTemplate().memoryFootprint() + games[i]->memoryFootprint();
+    }
+    games.clear();
+
+    // Shared floor: one template, an overlay per session
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < sessions; i++)
+    {
+        games.emplace_back(new FloorOverlay(FloorTemplate::shared(seed, rooms)));
+    }
+    double sharedMs = elapsedMs(start);
+    size_t templateBytes = games[0]->getTemplate().memoryFootprint();
+    size_t sharedBytes = templateBytes;
+    size_t changed = 0;
+    for (int i = 0; i < sessions; i++)
+    {
+        play(*games[i], i);
+        sharedBytes += games[i]->memoryFootprint();
+        changed += games[i]->changedRooms();
+    }
+
+    out << "{\"sessions\": " << sessions << ", \"floor_rooms\": " << rooms << ", \"template_bytes\": " << templateBytes
+        << ", \"private_bytes_per_session\": " << privateBytes / sessions
+        << ", \"shared_bytes_per_session\": " << sharedBytes / sessions
+        << ", \"changed_rooms_per_session\": " << (double)changed / sessions
+        << ", \"private_start_ms\": " << privateMs << ", \"shared_start_ms\": " << sharedMs << "}";
+}
+
+/*!
+ * @brief Benchmarks 64 players changing rooms of one shared world at once.
+ * @param out The stream to write the JSON value to.
+ * @details Each player repeatedly restocks their room, clears its enemies, searches it and tells the room about it,
+ * using the same RoomContent and SharedWorld calls as the game. Players spread over their own rooms are compared with
+ * all of them crowding one room, and with the spread players taking one world-wide lock around each action, which is
+ * what the world would cost without per-room locks.
+ */
+static void benchRoomContention(std::ostream &out)
+{
+    const int players = 64;
+    const int actions = 2000;
+    SharedWorld world(64, players);
+    const std::vector<Room *> &rooms = world.getFloor()->getDungeon().getRooms();
+    std::mutex worldLock;
+
+    auto run = [&](bool crowded, bool global)
+    {
+        std::vector<std::unique_ptr<SharedWorld::Member>> members;
+        for (int i = 0; i < players; i++)
+        {
+            members.emplace_back(new SharedWorld::Member("Player " + std::to_string(i)));
+            world.enter(*members.back(), crowded ? 0 : i % (int)rooms.size());
+        }
+        std::vector<std::thread> threads;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < players; i++)
+        {
+            threads.emplace_back([&, i]
+                                 {
+                SharedWorld::Member &self = *members[i];
+                RoomContent &room = rooms[self.getRoom()]->roomContent;
+                std::vector<std::string> taken;
+                int coins = 0;
+                for (int action = 0; action < actions; action++)
+                {
+                    std::unique_lock<std::mutex> hold(worldLock, std::defer_lock);
+                    if (global)
+                    {
+                        hold.lock();
+                    }
+                    room.addEnemy({"Rat", 1, 1});
+                    room.addItem("Bread");
+                    if (room.getEnemies().size() > 4)
+                    {
+                        room.clearEnemies();
+                    }
+                    room.takeLoot(taken, coins);
+                    room.emptyItems();
+                    if (action % 16 == 0)
+                    {
+                        world.broadcast(self.getRoom(), self.getName() + " searched the room.", &self);
+                        self.takeMessages();
+                    }
+                } });
+        }
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+        double ms = elapsedMs(start);
+        for (std::unique_ptr<SharedWorld::Member> &member : members)
+        {
+            world.leave(*member);
+        }
+        return (double)players * actions / (ms / 1000.0);
+    };
+
+    double spread = run(false, false);
+    double crowded = run(true, false);
+    double global = run(false, true);
+    out << "{\"players\": " << players << ", \"actions_per_player\": " << actions
+        << ", \"hardware_threads\": " << std::thread::hardware_concurrency()
+        << ", \"own_rooms_actions_per_sec\": " << spread << ", \"one_room_actions_per_sec\": " << crowded
+        << ", \"world_lock_actions_per_sec\": " << global << "}";
+}
+
+#ifdef __linux__
+/*!
+ * @brief Reads the process's resident memory.
+ * @return Resident bytes, from /proc/self/statm.
+ */
+static long long residentBytes()
+{
+    long long pages = 0, resident = 0;
+    std::FILE *file = std::fopen("/proc/self/statm", "r");
+    if (file != nullptr)
+    {
+        if (std::fscanf(file, "%lld %lld", &pages, &resident) != 2)
+        {
+            resident = 0;
+        }
+        std::fclose(file);
+    }
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+/*!
+ * @brief Runs one section in a new process of this program, so its memory figures start from a fresh heap.
+ * @param section The section's name, which the new process is given as its only argument.
+ * @param out The stream to write the section's JSON value to.
+ */
+static void runInFreshProcess(const std::string &section, std::ostream &out)
+{
+    char self[4096];
+    ssize_t length = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    std::string value;
+    if (length > 0)
+    {
+        self[length] = '\0';
+        std::string command = "'" + std::string(self) + "' " + section;
+        std::FILE *child = popen(command.c_str(), "r");
+        if (child != nullptr)
+        {
+            char buffer[4096];
+            size_t count;
+            while ((count = std::fread(buffer, 1, sizeof(buffer), child)) > 0)
+            {
+                value.append(buffer, count);
+            }
+            if (pclose(child) != 0)
+            {
+                value.clear();
+            }
+        }
+    }
+    while (!value.empty() && value.back() == '\n')
+    {
+        value.pop_back();
+    }
+    out << (value.empty() ? "null" : value);
+}
+
+/*!
+ * @brief Reads from a socket until some text arrives.
+ * @param fd The socket.
+ * @param text The text to wait for.
+ * @return False if the connection ended first.
+ */
+static bool awaitText(int fd, const std::string &text)
+{
+    std::string received;
+    char buffer[2048];
+    while (received.find(text) == std::string::npos)
+    {
+        ssize_t count = recv(fd, buffer, sizeof(buffer), 0);
+        if (count <= 0)
+        {
+            return false;
+        }
+        received.append(buffer, count);
+    }
+    return true;
+}
+
+/*!
+ * @brief Times suspending and resuming a fiber, and starting fibers with and without the stack pool.
+ * @param out The stream to write the JSON value to.
+ * @details A switch round trip is one resume and the suspend that returns from it. Each started fiber touches 8 KiB
+ * of its stack, suspends once and finishes, like a session that connects and leaves.
+ */
+static void benchFiberSwitching(std::ostream &out)
+{
+    const int switches = 1000000;
+    Fiber looping([]
+                  {
+                      for (int i = 0; i < switches; i++)
+                      {
+                          Fiber::suspend();
+                      } });
+    auto start = std::chrono::steady_clock::now();
+    while (looping.resume())
+    {
+    }
+    double switchNs = elapsedMs(start) * 1e6 / switches;
+
+    const int fibers = 20000;
+    auto startFibers = [&]()
+    {
+        auto begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < fibers; i++)
+        {
+            Fiber fiber([]
+                        {
+                            volatile char frame[8192];
+                            frame[0] = 1;
+                            frame[sizeof(frame) - 1] = 1;
+                            Fiber::suspend(); });
+            fiber.resume();
+            fiber.resume();
+        }
+        return elapsedMs(begin) * 1e6 / fibers;
+    };
+    double pooledNs = startFibers();
+    Fiber::setPooledStackLimit(0);
+    double unpooledNs = startFibers();
+    Fiber::setPooledStackLimit(Fiber::DefaultPooledStacks);
+
+    out << "{\"switches\": " << switches << ", \"switch_round_trip_ns\": " << switchNs
+        << ", \"fibers\": " << fibers << ", \"pooled_start_ns\": " << pooledNs
+        << ", \"unpooled_start_ns\": " << unpooledNs
+        << ", \"pool_speedup\": " << unpooledNs / pooledNs << "}";
+}
+
+/*!
+ * @brief Holds many idle players at the main menu of one server and has each of them make a move.
+ * @param out The stream to write the JSON value to.
+ * @details Every client connects and waits for the menu, then memory is measured with all sessions parked. Then
+ * each client in turn asks for the instructions and waits for them, which resumes its session once.
+ */
+static void benchServerSessions(std::ostream &out)
+{
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    const int sessions = (int)std::min<rlim_t>(2000, (limit.rlim_cur - 64) / 2);
+
+    ServerOptions options;
+    options.unixPath = "/tmp/valeris_bench_" + std::to_string(getpid()) + ".sock";
+    options.workers = 1;
+    GameServer server(options);
+    if (!server.start())
+    {
+        out << "null";
+        return;
+    }
+    long long before = residentBytes();
+    auto start = std::chrono::steady_clock::now();
+    std::vector<int> clients;
+    for (int i = 0; i < sessions; i++)
+    {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, options.unixPath.c_str(), sizeof(address.sun_path) - 1);
+        if (connect(fd, (sockaddr *)&address, sizeof(address)) != 0 || !awaitText(fd, "Enter your choice: "))
+        {
+            close(fd);
+            break;
+        }
+        clients.push_back(fd);
+    }
+    double connectMs = elapsedMs(start);
+    long long idleBytes = residentBytes() - before;
+
+    start = std::chrono::steady_clock::now();
+    int answered = 0;
+    for (int fd : clients)
+    {
+        if (send(fd, "2\n", 2, 0) == 2 && awaitText(fd, "Press Enter to continue..."))
+        {
+            answered++;
+        }
+    }
+    double moveMs = elapsedMs(start);
+    ServerStats stats = server.stats();
+    for (int fd : clients)
+    {
+        close(fd);
+    }
+    server.stop();
+
+    size_t idle = std::max<size_t>(1, clients.size());
+    out << "{\"workers\": " << options.workers << ", \"sessions\": " << clients.size()
+        << ", \"peak_connected\": " << stats.peakConnected
+        << ", \"connect_ms_per_session\": " << connectMs / idle
+        << ", \"idle_kib_per_session\": " << idleBytes / 1024.0 / idle
+        << ", \"moves\": " << answered << ", \"move_round_trip_us\": " << moveMs * 1000 / std::max(1, answered)
+        << ", \"resumes\": " << stats.resumes << "}";
+}
+
+/*!
+ * @brief Connects a client to a server's Unix socket.
+ * @param path The socket's path.
+ * @return The connected socket, or -1.
+ */
+static int connectUnix(const std::string &path)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    if (connect(fd, (sockaddr *)&address, sizeof(address)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*!
+ * @brief Starts a game for many players, lets them go idle until they hibernate, then has each of them type again.
+ * @param out The stream to write the JSON value to.
+ * @details Memory is measured once every player is in the dungeon, again once every game has hibernated and the heap
+ * has been trimmed as the idle server would, and again after as many new players have started games. main runs this
+ * section in a process of its own, so the figures are not hidden by memory earlier sections freed. The restore time
+ * is the game's own measurement, from the input arriving to the floor being rebuilt; the round trip also includes
+ * drawing the view and sending it.
+ */
+static void benchSessionHibernation(std::ostream &out)
+{
+    const int sessions = 200;
+    const int idleMs = 1500;
+    HibernationSettings settings;
+    settings.idleMilliseconds = idleMs;
+    settings.directory = "/tmp";
+    setHibernation(settings);
+
+    ServerOptions options;
+    options.unixPath = "/tmp/valeris_bench_" + std::to_string(getpid()) + ".sock";
+    options.workers = 1;
+    GameServer server(options);
+    if (!server.start())
+    {
+        setHibernation(HibernationSettings());
+        out << "null";
+        return;
+    }
+    auto enterDungeon = [&options](std::vector<int> &clients)
+    {
+        for (int i = 0; i < sessions; i++)
+        {
+            int fd = connectUnix(options.unixPath);
+            if (fd < 0)
+            {
+                return;
+            }
+            if (!awaitText(fd, "Enter your choice: ") || send(fd, "1\n", 2, 0) != 2 || !awaitText(fd, "Enter your name: ") ||
+                send(fd, "Bot\n", 4, 0) != 4 || !awaitText(fd, "Enter Action : "))
+            {
+                close(fd);
+                return;
+            }
+            clients.push_back(fd);
+        }
+    };
+
+    long long before = residentBytes();
+    std::vector<int> clients;
+    enterDungeon(clients);
+    long long active = residentBytes();
+    size_t asleepEarly = hibernationStats().sleeping;
+
+    for (int waited = 0; waited < 20 * idleMs && hibernationStats().sleeping < clients.size(); waited += 10)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    HibernationStats asleep = hibernationStats();
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+    long long hibernated = residentBytes();
+
+    std::vector<int> newcomers;
+    enterDungeon(newcomers);
+    long long reused = residentBytes();
+
+    auto start = std::chrono::steady_clock::now();
+    int woken = 0;
+    for (int fd : clients)
+    {
+        if (send(fd, "/inventory\n", 11, 0) == 11 && awaitText(fd, "Enter Action : "))
+        {
+            woken++;
+        }
+    }
+    double wakeMs = elapsedMs(start);
+    HibernationStats after = hibernationStats();
+    for (int fd : clients)
+    {
+        close(fd);
+    }
+    for (int fd : newcomers)
+    {
+        close(fd);
+    }
+    server.stop();
+    setHibernation(HibernationSettings());
+
+    size_t count = std::max<size_t>(1, clients.size());
+    out << "{\"sessions\": " << clients.size() << ", \"idle_ms\": " << idleMs
+        << ", \"hibernated\": " << asleep.sleeping << ", \"hibernated_too_early\": " << asleepEarly
+        << ", \"bytes_on_disk_per_session\": " << asleep.bytesOnDisk / count
+        << ", \"active_kib_per_session\": " << (active - before) / 1024.0 / count
+        << ", \"hibernated_kib_per_session\": " << (hibernated - before) / 1024.0 / count
+        << ", \"new_active_kib_per_session\": " << (reused - hibernated) / 1024.0 / std::max<size_t>(1, newcomers.size())
+        << ", \"woken\": " << woken << ", \"wake_round_trip_us\": " << wakeMs * 1000 / std::max(1, woken)
+        << ", \"last_restore_us\": " << after.lastRestoreMicroseconds
+        << ", \"slowest_restore_us\": " << after.slowestRestoreMicroseconds << "}";
+}
+
+/*!
+ * @brief Has one player write a frame every millisecond while spectators watch, and times the player's writes.
+ * @param out The stream to write the JSON value to.
+ * @details The frames are written with nobody watching, with spectators who read everything, and with spectators who
+ * never read until the game is over. Only the writes are timed, not the waits between them. The player's time per
+ * frame should not depend on who watches; the stalled spectators miss frames and are sent keyframes instead.
+ */
+static void benchSpectatorFanout(std::ostream &out)
+{
+    const int frames = 1000;
+    const int watchers = 100;
+    static std::atomic<long long> playerNs(0);
+
+    auto burst = [&](int spectatorCount, bool reading, ServerStats &stats, long long &spectatorBytes)
+    {
+        ServerOptions options;
+        options.unixPath = "/tmp/valeris_bench_" + std::to_string(getpid()) + ".sock";
+        options.spectatorUnixPath = "/tmp/valeris_bench_watch_" + std::to_string(getpid()) + ".sock";
+        options.workers = 1;
+        GameServer server(options, []
+                          {
+                              getUserInputLine();
+                              std::string frame(1023, '#');
+                              double writing = 0;
+                              for (int i = 0; i < frames; i++)
+                              {
+                                  auto start = std::chrono::steady_clock::now();
+                                  console().out() << frame << "\n" << std::flush;
+                                  writing += elapsedMs(start);
+                                  sleepFor(1);
+                              }
+                              playerNs = (long long)(writing * 1e6);
+                              console().out() << "Done\n" << std::flush; });
+        spectatorBytes = 0;
+        if (!server.start())
+        {
+            return false;
+        }
+        int player = connectUnix(options.unixPath);
+        std::vector<int> spectators;
+        for (int i = 0; i < spectatorCount; i++)
+        {
+            int fd = connectUnix(options.spectatorUnixPath);
+            if (fd < 0 || !awaitText(fd, "session? ") || send(fd, "1\n", 2, 0) != 2 || !awaitText(fd, "\033[2J"))
+            {
+                close(fd);
+                break;
+            }
+            spectators.push_back(fd);
+        }
+        auto readAll = [&spectators, &spectatorBytes]
+        {
+            std::vector<pollfd> open;
+            for (int fd : spectators)
+            {
+                open.push_back({fd, POLLIN, 0});
+            }
+            char buffer[65536];
+            while (!open.empty() && poll(open.data(), open.size(), 5000) > 0)
+            {
+                for (size_t i = 0; i < open.size();)
+                {
+                    ssize_t count = open[i].revents ? recv(open[i].fd, buffer, sizeof(buffer), 0) : 1;
+                    if (count <= 0)
+                    {
+                        open[i] = open.back();
+                        open.pop_back();
+                        continue;
+                    }
+                    if (open[i].revents)
+                    {
+                        spectatorBytes += count;
+                    }
+                    open[i++].revents = 0;
+                }
+            }
+        };
+        std::thread watching(reading ? std::function<void()>(readAll) : std::function<void()>([] {}));
+        bool done = send(player, "go\n", 3, 0) == 3 && awaitText(player, "Done\n");
+        watching.join();
+        if (!reading)
+        {
+            readAll();
+        }
+        stats = server.stats();
+        close(player);
+        for (int fd : spectators)
+        {
+            close(fd);
+        }
+        server.stop();
+        return done && (int)spectators.size() == spectatorCount;
+    };
+
+    ServerStats alone, watched, stalled;
+    long long aloneBytes = 0, watchedBytes = 0, stalledBytes = 0;
+    bool ok = burst(0, false, alone, aloneBytes);
+    double aloneUs = playerNs / 1000.0 / frames;
+    ok = ok && burst(watchers, true, watched, watchedBytes);
+    double watchedUs = playerNs / 1000.0 / frames;
+    ok = ok && burst(watchers, false, stalled, stalledBytes);
+    double stalledUs = playerNs / 1000.0 / frames;
+    if (!ok)
+    {
+        out << "null";
+        return;
+    }
+
+    out << "{\"frames\": " << frames << ", \"frame_bytes\": 1024, \"spectators\": " << watchers
+        << ", \"alone_player_us_per_frame\": " << aloneUs
+        << ", \"watched_player_us_per_frame\": " << watchedUs
+        << ", \"stalled_player_us_per_frame\": " << stalledUs
+        << ", \"watched_mib_sent_to_spectators\": " << watchedBytes / 1048576.0
+        << ", \"watched_dropped\": " << watched.dropped << ", \"watched_keyframes\": " << watched.keyframes
+        << ", \"stalled_mib_sent_to_spectators\": " << stalledBytes / 1048576.0
+        << ", \"stalled_dropped\": " << stalled.dropped << ", \"stalled_keyframes\": " << stalled.keyframes << "}";
+}
+
+/*!
+ * @brief Hands 1000 players' games from one server to another, as a rolling upgrade would, and checks each carried on.
+ * @param out The stream to write the JSON value to.
+ * @details Each bot enters the dungeon on the old server and waits at its next action. The new server saves every game
+ * it restores again and compares the bytes with the state it was sent, and each bot then asks for its stats on the same
+ * connection and must see its own name. The pause is each game's own, from stopping on the old server to being drawn
+ * again on the new one.
+ */
+static void benchSessionMigration(std::ostream &out)
+{
+    const int sessions = 1000;
+    ServerOptions oldOptions;
+    oldOptions.unixPath = "/tmp/valeris_bench_" + std::to_string(getpid()) + ".sock";
+    oldOptions.workers = 1;
+    oldOptions.stackBytes = 128 * 1024;
+    ServerOptions newOptions = oldOptions;
+    newOptions.handoffPath = "/tmp/valeris_bench_handoff_" + std::to_string(getpid()) + ".sock";
+    std::mutex mutex;
+    int resumed = 0;
+    int identical = 0;
+    GameServer oldServer(oldOptions);
+    if (!oldServer.start())
+    {
+        out << "null";
+        return;
+    }
+
+    std::vector<int> bots;
+    for (int i = 0; i < sessions; i++)
+    {
+        int fd = connectUnix(oldOptions.unixPath);
+        std::string name = "Bot" + std::to_string(i) + "\n";
+        if (fd < 0)
+        {
+            break;
+        }
+        if (!awaitText(fd, "Enter your choice: ") || send(fd, "1\n", 2, 0) != 2 || !awaitText(fd, "Enter your name: ") ||
+            send(fd, name.data(), name.size(), 0) != (ssize_t)name.size() || !awaitText(fd, "Enter Action : "))
+        {
+            close(fd);
+            break;
+        }
+        bots.push_back(fd);
+    }
+
+    // Started once the old server holds every player, as the new version would be
+    GameServer newServer(newOptions, nullptr, [&mutex, &resumed, &identical](const std::string &state)
+                         {
+                             ValerisGame game(console());
+                             bool same = game.restoreState(state) && game.saveState() == state;
+                             {
+                                 std::lock_guard<std::mutex> lock(mutex);
+                                 resumed++;
+                                 identical += same ? 1 : 0;
+                             }
+                             if (same)
+                             {
+                                 game.resume();
+                             }
+                             RunMainMenu(); });
+    if (!newServer.start())
+    {
+        for (int fd : bots)
+        {
+            close(fd);
+        }
+        out << "null";
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    int handedOff = oldServer.handOff(newOptions.handoffPath, 60000);
+    double migrateMs = elapsedMs(start);
+    oldServer.stop();
+
+    int carried = 0;
+    for (size_t i = 0; i < bots.size(); i++)
+    {
+        std::string name = "Players Name: Bot" + std::to_string(i) + "\n";
+        if (send(bots[i], "/stats\n", 7, 0) == 7 && awaitText(bots[i], name))
+        {
+            carried++;
+        }
+    }
+    for (int fd : bots)
+    {
+        close(fd);
+    }
+    ServerStats stats = newServer.stats();
+    newServer.stop();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    out << "{\"sessions\": " << bots.size() << ", \"handed_off\": " << handedOff << ", \"adopted\": " << stats.adopted
+        << ", \"state_identical\": " << identical << ", \"carried_on\": " << carried
+        << ", \"migration_ms\": " << migrateMs
+        << ", \"mean_pause_us\": " << stats.totalPauseMicroseconds / std::max<unsigned long long>(1, stats.adopted)
+        << ", \"slowest_pause_us\": " << stats.slowestPauseMicroseconds << ", \"pause_target_us\": 50000}";
+}
+#endif
+
+/*!
+ * @brief Runs every benchmark section and prints the combined JSON object.
+ * @param argc The number of arguments.
+ * @param argv The arguments. Given a section's name, only that section runs and only its value is printed.
+ * @return Returns 0 upon successful execution, or 1 if the named section does not exist.
+ */
+int main(int argc, char **argv)
+{
+    std::vector<std::pair<std::string, std::function<void(std::ostream &)>>> sections = {
+        {"floor_analytics", benchFloorAnalytics},
+        {"floor_export", benchFloorExport},
+        {"fog_of_war", benchFogOfWar},
+        {"screen_diff", benchScreenDiff},
+        {"idle_cpu", benchIdleCpu},
+        {"ansi_coalescing", benchAnsiCoalescing},
+        {"session_compression", benchSessionCompression},
+        {"command_dispatch", benchCommandDispatch},
+        {"task_scheduler", benchTaskScheduler},
+        {"shared_floors", benchSharedFloors},
+        {"room_contention", benchRoomContention},
+#ifdef __linux__
+        {"fiber_switching", benchFiberSwitching},
+        {"server_sessions", benchServerSessions},
+        {"session_hibernation", benchSessionHibernation},
+        {"spectator_fanout", benchSpectatorFanout},
+        {"session_migration", benchSessionMigration},
+#endif
+    };
+    // Sections that measure the process's resident memory, run in a process of their own
+    const std::vector<std::string> fresh = {"session_hibernation"};
+
+    if (argc == 2)
+    {
+        for (auto &section : sections)
+        {
+            if (section.first == argv[1])
+            {
+                section.second(std::cout);
+                std::cout << std::endl;
+                return 0;
+            }
+        }
+        return 1;
+    }
+
+    std::cout << "{";
+    for (size_t i = 0; i < sections.size(); i++)
+    {
+        std::cout << (i ? ",\n" : "\n") << "  \"" << sections[i].first << "\": ";
+#ifdef __linux__
+        if (std::find(fresh.begin(), fresh.end(), sections[i].first) != fresh.end())
+        {
+            runInFreshProcess(sections[i].first, std::cout);
+            continue;
+        }
+#endif
+        sections[i].second(std::cout);
+    }
+    std::cout << "\n}" << std::endl;
+    return 0;
+}
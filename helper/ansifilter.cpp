@@ -0,0 +1,417 @@
+/*!
+@file ansifilter.cpp
+@brief Implements the AnsiFilter and CoalescingSink classes.
+@details Text passes through unchanged. Only SGR sequences and the cursor movements A, B, C, D and G are rewritten;
+every other escape sequence is passed on as it is, after any held-back style and movement.
+*/
+
+#include "../lib/ansifilter.h"
+#include <algorithm>
+#include <vector>
+
+/*!
+@brief Constructor for the AnsiFilter class.
+*/
+AnsiFilter::AnsiFilter()
+{
+    reset();
+}
+
+/*!
+@brief Forget all state.
+*/
+void AnsiFilter::reset()
+{
+    sent = Style();
+    wanted = Style();
+    sentUnknown = false;
+    parse = Parse::Text;
+    sequence.clear();
+    moveFinal = 0;
+    moveCount = 0;
+}
+
+/*!
+@brief Filter a string.
+@param text The text.
+@param out Where the filtered bytes are appended.
+*/
+void AnsiFilter::filter(const std::string &text, std::string &out)
+{
+    filter(text.data(), text.size(), out);
+}
+
+/*!
+@brief Filter output.
+@param data The bytes.
+@param size How many there are.
+@param out Where the filtered bytes are appended.
+*/
+void AnsiFilter::filter(const char *data, size_t size, std::string &out)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        char c = data[i];
+        switch (parse)
+        {
+        case Parse::Text:
+            if (c == '\033')
+            {
+                parse = Parse::Escape;
+                sequence.clear();
+            }
+            else if (c == ' ' || c == '\n' || c == '\t')
+            {
+                flushMove(out);
+                if (wanted != sent && !blankUnaffected())
+                {
+                    flushStyle(out);
+                }
+                out += c;
+            }
+            else if ((unsigned char)c < 0x20 || c == 0x7f)
+            {
+                // Carriage return, backspace and bell draw nothing
+                flushMove(out);
+                out += c;
+            }
+            else
+            {
+                flushMove(out);
+                flushStyle(out);
+                out += c;
+            }
+            break;
+        case Parse::Escape:
+            if (c == '[')
+            {
+                parse = Parse::Csi;
+                break;
+            }
+            // Other escapes (such as save cursor, which also saves the style) see the terminal as the output left it
+            flushMove(out);
+            flushStyle(out);
+            out += '\033';
+            out += c;
+            parse = Parse::Text;
+            break;
+        case Parse::Csi:
+            sequence += c;
+            if (c >= 0x40 && c <= 0x7e)
+            {
+                csi(out);
+                parse = Parse::Text;
+            }
+            else if (sequence.size() > 64)
+            {
+                flushMove(out);
+                flushStyle(out);
+                out += "\033[" + sequence;
+                parse = Parse::Text;
+            }
+            break;
+        }
+    }
+}
+
+/*!
+@brief Send held-back style and cursor movement.
+@param out Where the bytes are appended.
+@details A partly read escape sequence stays held, since nothing may be written in the middle of it.
+*/
+void AnsiFilter::finish(std::string &out)
+{
+    flushMove(out);
+    flushStyle(out);
+}
+
+/*!
+@brief Handle a complete CSI sequence.
+@param out Where bytes are appended.
+*/
+void AnsiFilter::csi(std::string &out)
+{
+    char final = sequence.back();
+    std::string params = sequence.substr(0, sequence.size() - 1);
+    bool numeric = std::all_of(params.begin(), params.end(), [](char p)
+                               { return (p >= '0' && p <= '9') || p == ';'; });
+
+    if (final == 'm')
+    {
+        Style before = wanted;
+        if (numeric && applySgr(params))
+        {
+            return;
+        }
+        // Pass sequences the filter cannot model through, and stop assuming what the terminal's style is
+        Style after = numeric ? wanted : before;
+        wanted = before;
+        flushMove(out);
+        flushStyle(out);
+        out += "\033[" + sequence;
+        wanted = after;
+        sent = after;
+        sentUnknown = true;
+        return;
+    }
+
+    if (numeric && params.find(';') == std::string::npos && std::string("ABCDG").find(final) != std::string::npos)
+    {
+        move(final, params.empty() ? 1 : std::atoi(params.c_str()), out);
+        return;
+    }
+
+    flushMove(out);
+    flushStyle(out);
+    out += "\033[" + sequence;
+}
+
+/*!
+@brief Apply an SGR sequence's parameters to the wanted style.
+@param params The parameters.
+@return False if a parameter is not understood. The parameters that are understood are still applied.
+*/
+bool AnsiFilter::applySgr(const std::string &params)
+{
+    std::vector<int> codes;
+    size_t start = 0;
+    while (true)
+    {
+        size_t end = params.find(';', start);
+        std::string code = params.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        codes.push_back(code.empty() ? 0 : std::atoi(code.c_str()));
+        if (end == std::string::npos)
+        {
+            break;
+        }
+        start = end + 1;
+    }
+
+    static const int onCodes[] = {1, 2, 3, 4, 5, 7, 8, 9};
+    static const unsigned onBits[] = {Bold, Dim, Italic, Underline, Blink, Reverse, Hidden, Strike};
+    bool understood = true;
+    for (size_t i = 0; i < codes.size(); i++)
+    {
+        int code = codes[i];
+        const int *on = std::find(std::begin(onCodes), std::end(onCodes), code);
+        if (code == 0)
+        {
+            wanted = Style();
+        }
+        else if (on != std::end(onCodes))
+        {
+            wanted.attrs |= onBits[on - onCodes];
+        }
+        else if (code == 6)
+        {
+            wanted.attrs |= Blink;
+        }
+        else if (code == 22)
+        {
+            wanted.attrs &= ~(Bold | Dim);
+        }
+        else if (code >= 23 && code <= 29 && code != 26)
+        {
+            const int *off = std::find(std::begin(onCodes), std::end(onCodes), code - 20);
+            wanted.attrs &= ~onBits[off - onCodes];
+        }
+        else if ((code >= 30 && code <= 37) || (code >= 90 && code <= 97))
+        {
+            wanted.fg = std::to_string(code);
+        }
+        else if (code == 39)
+        {
+            wanted.fg.clear();
+        }
+        else if ((code >= 40 && code <= 47) || (code >= 100 && code <= 107))
+        {
+            wanted.bg = std::to_string(code);
+        }
+        else if (code == 49)
+        {
+            wanted.bg.clear();
+        }
+        else if ((code == 38 || code == 48) && i + 2 < codes.size() && codes[i + 1] == 5)
+        {
+            (code == 38 ? wanted.fg : wanted.bg) = std::to_string(code) + ";5;" + std::to_string(codes[i + 2]);
+            i += 2;
+        }
+        else if ((code == 38 || code == 48) && i + 4 < codes.size() && codes[i + 1] == 2)
+        {
+            (code == 38 ? wanted.fg : wanted.bg) = std::to_string(code) + ";2;" + std::to_string(codes[i + 2]) + ";" +
+                                                   std::to_string(codes[i + 3]) + ";" + std::to_string(codes[i + 4]);
+            i += 4;
+        }
+        else
+        {
+            understood = false;
+            if (code == 38 || code == 48)
+            {
+                break;
+            }
+        }
+    }
+    return understood;
+}
+
+/*!
+@brief Queue a cursor movement.
+@param final The sequence's final byte.
+@param count Its parameter.
+@param out Where bytes are appended if the queued movement cannot absorb it.
+@details Moves in the same direction add up, and an absolute column replaces any horizontal movement before it and
+absorbs any after it. A vertical move followed by a horizontal one is sent as two sequences.
+*/
+void AnsiFilter::move(char final, int count, std::string &out)
+{
+    count = std::max(1, count);
+    if (moveFinal == final && final != 'G')
+    {
+        moveCount += count;
+    }
+    else if (final == 'G' && (moveFinal == 'G' || moveFinal == 'C' || moveFinal == 'D'))
+    {
+        moveFinal = 'G';
+        moveCount = count;
+    }
+    else if (moveFinal == 'G' && final == 'C')
+    {
+        moveCount += count;
+    }
+    else if (moveFinal == 'G' && final == 'D')
+    {
+        moveCount = std::max(1, moveCount - count);
+    }
+    else
+    {
+        flushMove(out);
+        moveFinal = final;
+        moveCount = count;
+    }
+}
+
+/*!
+@brief Send the queued cursor movement.
+@param out Where bytes are appended.
+*/
+void AnsiFilter::flushMove(std::string &out)
+{
+    if (moveFinal == 0)
+    {
+        return;
+    }
+    out += "\033[";
+    if (moveCount != 1)
+    {
+        out += std::to_string(moveCount);
+    }
+    out += moveFinal;
+    moveFinal = 0;
+}
+
+/*!
+@brief Bring the terminal's style up to date.
+@param out Where bytes are appended.
+*/
+void AnsiFilter::flushStyle(std::string &out)
+{
+    if (wanted == sent)
+    {
+        return;
+    }
+
+    static const char *const onCodes[] = {"1", "2", "3", "4", "5", "7", "8", "9"};
+    static const char *const offCodes[] = {"22", "22", "23", "24", "25", "27", "28", "29"};
+
+    std::string reset = "0";
+    for (int bit = 0; bit < 8; bit++)
+    {
+        if (wanted.attrs & (1u << bit))
+        {
+            reset += std::string(";") + onCodes[bit];
+        }
+    }
+    if (!wanted.fg.empty())
+    {
+        reset += ";" + wanted.fg;
+    }
+    if (!wanted.bg.empty())
+    {
+        reset += ";" + wanted.bg;
+    }
+
+    std::string change;
+    if (!sentUnknown)
+    {
+        unsigned removed = sent.attrs & ~wanted.attrs;
+        unsigned added = wanted.attrs & ~sent.attrs;
+        if (removed & (Bold | Dim))
+        {
+            // 22 turns off both bold and dim
+            change += ";22";
+            removed &= ~(Bold | Dim);
+            added |= wanted.attrs & (Bold | Dim);
+        }
+        for (int bit = 0; bit < 8; bit++)
+        {
+            if (removed & (1u << bit))
+            {
+                change += std::string(";") + offCodes[bit];
+            }
+        }
+        for (int bit = 0; bit < 8; bit++)
+        {
+            if (added & (1u << bit))
+            {
+                change += std::string(";") + onCodes[bit];
+            }
+        }
+        if (wanted.fg != sent.fg)
+        {
+            change += ";" + (wanted.fg.empty() ? std::string("39") : wanted.fg);
+        }
+        if (wanted.bg != sent.bg)
+        {
+            change += ";" + (wanted.bg.empty() ? std::string("49") : wanted.bg);
+        }
+        change.erase(0, 1);
+    }
+
+    out += "\033[";
+    out += !sentUnknown && change.size() <= reset.size() ? change : reset;
+    out += 'm';
+    sent = wanted;
+    sentUnknown = false;
+}
+
+/*!
+@brief Check whether a blank can be drawn without updating the style.
+@return True if only the foreground colour differs and no attribute that shows on blanks is in use.
+*/
+bool AnsiFilter::blankUnaffected() const
+{
+    return !sentUnknown && sent.bg == wanted.bg && sent.attrs == wanted.attrs &&
+           (wanted.attrs & (Underline | Reverse | Strike)) == 0;
+}
+
+/*!
+@brief Constructor for the CoalescingSink class.
+@param next Where filtered output goes.
+*/
+CoalescingSink::CoalescingSink(OutputSink &next) : next(next)
+{
+}
+
+/*!
+@brief Filter a write and pass it on.
+@param data The bytes.
+@param size How many there are.
+@return False if the next sink failed.
+*/
+bool CoalescingSink::write(const char *data, size_t size)
+{
+    buffer.clear();
+    ansi.filter(data, size, buffer);
+    ansi.finish(buffer);
+    return buffer.empty() || next.write(buffer.data(), buffer.size());
+}
@@ -7,6 +7,9 @@
 #include "../lib/dependencies.h"
 #include "../lib/combat.h"
 #include "../lib/toolkit.h"
+#include "../lib/keyreader.h"
+#include "../lib/timer.h"
+#include <algorithm>
 
 /*!
 @brief Print the current health status of the player and enemy.
@@ -28,7 +31,7 @@ void printHealth(int playerHealth, int enemyHealth, const std::string &name)
     }
 
     // Print the health bar surrounded by asterisks
-    std::cout << width + "\n"
+    console().out() << width + "\n"
               << healthBars << "\n" + width + "\n"
               << std::endl;
 }
@@ -41,6 +44,9 @@ void printHealth(int playerHealth, int enemyHealth, const std::string &name)
 @param name The name of the enemy G.
 @return True if the player wins, false if the player loses.
 @details This combat system involves the player quickly matching directional inputs to attack the enemy. The enemy's attacks decrease the player's health if the player fails to respond correctly or quickly enough.
+A turn ends by itself once the time for a good answer has passed, so waiting out the prompt counts as too slow.
+Answers are read key by key, and the time to the first key and to Enter are recorded on the session's console when
+the combat ends. If VALERIS_REACTION_LOG names a file, the record is also appended to it as one line of JSON.
 */
 bool combatV1(int *playerHealth, int enemyHealth, int difficulty, const std::string &name, int playerDamage, int enemyDamage, int resistance)
 {
@@ -49,18 +55,39 @@ bool combatV1(int *playerHealth, int enemyHealth, int difficulty, const std::str
     const std::string keyBoardEquivalent[] = {"q", "a", "z", "4", "5", "6", "7", "o", "k", "m", "parry", "dodge", "counter", "roll", "pause", "punch", "kick"};
     std::srand(static_cast<unsigned int>(std::time(nullptr))); // Seed for randomness
     printHealth(*playerHealth, enemyHealth, name);
+    CombatLatency latency;
+    latency.enemy = name;
+    KeyReader reader;
     // Combat loop: continue while both player and enemy have health
     while (*playerHealth > 0 && enemyHealth > 0)
     {
         int random_number = std::rand() % 17;                                                   // Select a random direction
-        std::cout << "Optimal move: " + moves[random_number] + "    Your move: " << std::flush; // Display the move symbol
+        console().out() << "Optimal move: " + moves[random_number] + "    Your move: " << std::flush; // Display the move symbol
 
-        auto start = std::chrono::high_resolution_clock::now(); // Start timer for user input
-        std::string inputStr;
+        long long start = monotonicNanos();                                // Start timer for user input
+        Reaction reaction = reader.read(std::max(difficulty, 1100));       // Get user input, or give up once no answer can hit
+        long long taken = reaction.completeNanos >= 0 ? reaction.completeNanos : monotonicNanos() - start;
+        std::chrono::duration<double> elapsed = std::chrono::nanoseconds(taken); // Time from prompt to Enter
 
-        std::getline(std::cin, inputStr);                     // Get user input
-        auto now = std::chrono::high_resolution_clock::now(); // Capture current time
-        std::chrono::duration<double> elapsed = now - start;  // Calculate elapsed time
+        latency.turns++;
+        if (reaction.firstKeyNanos >= 0)
+        {
+            latency.firstKey.add(reaction.firstKeyNanos);
+        }
+        if (reaction.completeNanos >= 0)
+        {
+            latency.complete.add(reaction.completeNanos);
+        }
+        if (reaction.closed)
+        {
+            endOfInputCheck();
+        }
+        else if (reaction.timedOut)
+        {
+            latency.timeouts++;
+            console().out() << "\n"; // Stand in for the Enter the player never pressed, so clear removes the right lines
+        }
+        std::string inputStr = reaction.answer;
 
         // Check if user input matches and is within the allowed time
         if (inputStr == keyBoardEquivalent[random_number] && ((elapsed.count() < difficulty / 1000.0) || (elapsed.count() < 1.1)))
@@ -84,17 +111,22 @@ bool combatV1(int *playerHealth, int enemyHealth, int difficulty, const std::str
             difficulty += 50;
         }
     }
-
+    console().combatLatency() = latency;
+    const char *log = std::getenv("VALERIS_REACTION_LOG");
+    if (log != nullptr)
+    {
+        appendCombatLatency(log, latency);
+    }
     // Print win or lose message based on remaining health
     if (*playerHealth > 0)
     {
-        std::cout << "You Win!" << std::endl;
+        console().out() << "You Win!" << std::endl;
         delay(500);
         return true;
     }
     else
     {
-        std::cout << "You Died!\nThanks for playing!" << std::endl;
+        console().out() << "You Died!\nThanks for playing!" << std::endl;
         delay(1500);
         return false;
     }
@@ -118,7 +150,7 @@ void combatV2(int playerHealth, int enemyHealth)
     // Combat loop: continue while both player and enemy have health
     while (playerHealth > 0 && enemyHealth > 0)
     {
-        std::cout << "Please select an attack type";
+        console().out() << "Please select an attack type";
         // Further implementation for player choices and combat resolution needed here
     }
 }
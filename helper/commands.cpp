@@ -0,0 +1,684 @@
+/*!
+@file commands.cpp
+@brief Implementation of the command registry.
+@details This file contains the implementation of the CommandArgs, CommandHandler, FunctionCommand,
+CommandRegistry and CommandQueue classes. The hash is FNV-1a over lowercased bytes, mixed with a seed; with a table at least twice the
+number of commands a working seed is usually found within a few hundred tries.
+*/
+
+#include "../lib/commands.h"
+#include <climits>
+
+namespace
+{
+    /*!
+    @brief Lowercase an ASCII letter.
+    @param c The character.
+    @return The lowercase letter, or c unchanged.
+    */
+    char lower(char c)
+    {
+        return c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : c;
+    }
+
+    /*!
+    @brief Check for a blank.
+    @param c The character.
+    @return True for a space, tab, carriage return or newline.
+    */
+    bool blank(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    /*!
+    @brief Compare two names without regard to case.
+    @param a The first name.
+    @param b The second name.
+    @return True if they are equal ignoring case.
+    */
+    bool sameName(std::string_view a, std::string_view b)
+    {
+        if (a.size() != b.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); i++)
+        {
+            if (lower(a[i]) != lower(b[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*!
+    @brief Remove blanks from both ends.
+    @param text The text.
+    @return The text without leading or trailing blanks.
+    */
+    std::string_view trim(std::string_view text)
+    {
+        while (!text.empty() && blank(text.front()))
+        {
+            text.remove_prefix(1);
+        }
+        while (!text.empty() && blank(text.back()))
+        {
+            text.remove_suffix(1);
+        }
+        return text;
+    }
+
+    /*!
+    @brief Lowercase a name.
+    @param name The name.
+    @return The name in lowercase.
+    */
+    std::string fold(std::string_view name)
+    {
+        std::string folded(name);
+        for (char &c : folded)
+        {
+            c = lower(c);
+        }
+        return folded;
+    }
+}
+
+/*!
+@brief Split a line on spaces and tabs.
+@param line The line.
+*/
+CommandArgs::CommandArgs(std::string_view line) : CommandArgs(line, commandEnd(line))
+{
+}
+
+/*!
+@brief Find where the command word ends.
+@param line The line.
+@return The index just past the command word.
+*/
+size_t CommandArgs::commandEnd(std::string_view line)
+{
+    size_t at = 0;
+    while (at < line.size() && blank(line[at]))
+    {
+        at++;
+    }
+    while (at < line.size() && !blank(line[at]))
+    {
+        at++;
+    }
+    return at;
+}
+
+/*!
+@brief Split a line whose command word has already been found.
+@param line The line.
+@param end The index just past the command word.
+@details The arguments are walked once, word by word; the rest of the line runs from the first argument to the end of
+the last.
+*/
+CommandArgs::CommandArgs(std::string_view line, size_t end) : total(0)
+{
+    size_t start = 0;
+    while (start < end && blank(line[start]))
+    {
+        start++;
+    }
+    name = line.substr(start, end - start);
+
+    size_t at = end;
+    auto skipBlanks = [&]
+    {
+        while (at < line.size() && blank(line[at]))
+        {
+            at++;
+        }
+    };
+    skipBlanks();
+    size_t restStart = at;
+    size_t restEnd = at;
+    while (at < line.size())
+    {
+        size_t wordStart = at;
+        while (at < line.size() && !blank(line[at]))
+        {
+            at++;
+        }
+        if (total < MaxArguments)
+        {
+            arguments[total] = line.substr(wordStart, at - wordStart);
+        }
+        total++;
+        restEnd = at;
+        skipBlanks();
+    }
+    remainder = line.substr(restStart, restEnd - restStart);
+}
+
+/*!
+@brief Get the command word.
+@return The first word.
+*/
+std::string_view CommandArgs::command() const
+{
+    return name;
+}
+
+/*!
+@brief Get the number of arguments after the command.
+@return The count.
+*/
+int CommandArgs::count() const
+{
+    return total;
+}
+
+/*!
+@brief Get an argument.
+@param index The argument's position after the command.
+@return The argument, or an empty view.
+*/
+std::string_view CommandArgs::operator[](int index) const
+{
+    return index >= 0 && index < total && index < MaxArguments ? arguments[index] : std::string_view();
+}
+
+/*!
+@brief Get everything after the command.
+@return The rest of the line.
+*/
+std::string_view CommandArgs::rest() const
+{
+    return remainder;
+}
+
+/*!
+@brief Read an argument as a whole number.
+@param index The argument's position after the command.
+@param value Set to the number.
+@return True if the argument is a number that fits in an int.
+*/
+bool CommandArgs::integer(int index, int &value) const
+{
+    std::string_view text = (*this)[index];
+    bool negative = !text.empty() && text[0] == '-';
+    if (!text.empty() && (text[0] == '-' || text[0] == '+'))
+    {
+        text.remove_prefix(1);
+    }
+    if (text.empty())
+    {
+        return false;
+    }
+    long long number = 0;
+    for (char c : text)
+    {
+        if (c < '0' || c > '9')
+        {
+            return false;
+        }
+        number = number * 10 + (c - '0');
+        if (number > (long long)INT_MAX + 1)
+        {
+            return false;
+        }
+    }
+    number = negative ? -number : number;
+    if (number > INT_MAX || number < INT_MIN)
+    {
+        return false;
+    }
+    value = (int)number;
+    return true;
+}
+
+/*!
+@brief Check whether the command can be used right now.
+@return True.
+*/
+bool CommandHandler::available() const
+{
+    return true;
+}
+
+/*!
+@brief Check whether the command should be offered right now.
+@return Whether it is available.
+*/
+bool CommandHandler::listed() const
+{
+    return available();
+}
+
+/*!
+@brief Constructor for the FunctionCommand class.
+@param action Runs the command.
+@param availableWhen Says whether the command can be used, or nullptr.
+@param listedWhen Says whether the command is offered, or nullptr.
+*/
+FunctionCommand::FunctionCommand(std::function<void(const CommandArgs &)> action,
+                                 std::function<bool()> availableWhen,
+                                 std::function<bool()> listedWhen)
+    : action(std::move(action)), availableWhen(std::move(availableWhen)), listedWhen(std::move(listedWhen))
+{
+}
+
+/*!
+@brief Check whether the command can be used right now.
+@return The predicate's answer, or true without one.
+*/
+bool FunctionCommand::available() const
+{
+    return !availableWhen || availableWhen();
+}
+
+/*!
+@brief Check whether the command should be offered right now.
+@return The listing predicate's answer, or whether the command is available without one.
+*/
+bool FunctionCommand::listed() const
+{
+    return listedWhen ? listedWhen() : available();
+}
+
+/*!
+@brief Run the command.
+@param args The typed line.
+*/
+void FunctionCommand::run(const CommandArgs &args)
+{
+    action(args);
+}
+
+/*!
+@brief Add a command, replacing any with the same name.
+@param name The name typed to use it.
+@param handler What it does.
+@param minArguments The fewest arguments it accepts.
+@param maxArguments The most arguments it accepts.
+*/
+void CommandRegistry::add(const std::string &name, std::unique_ptr<CommandHandler> handler, int minArguments, int maxArguments)
+{
+    for (Entry &entry : entries)
+    {
+        if (sameName(entry.name, name))
+        {
+            entry.handler = std::move(handler);
+            entry.minArguments = minArguments;
+            entry.maxArguments = maxArguments;
+            return;
+        }
+    }
+    entries.push_back(Entry{name, fold(name), std::move(handler), minArguments, maxArguments});
+    rebuild();
+}
+
+/*!
+@brief Add a command made from functions, replacing any with the same name.
+@param name The name typed to use it.
+@param action Runs the command.
+@param availableWhen Says whether the command can be used, or nullptr.
+@param listedWhen Says whether the command is offered, or nullptr.
+*/
+void CommandRegistry::add(const std::string &name, std::function<void(const CommandArgs &)> action,
+                          std::function<bool()> availableWhen, std::function<bool()> listedWhen)
+{
+    add(name, std::unique_ptr<CommandHandler>(new FunctionCommand(std::move(action), std::move(availableWhen), std::move(listedWhen))));
+}
+
+/*!
+@brief Hash a name without regard to case.
+@param name The name.
+@param seed Varies the hash.
+@return The hash.
+@details lookup computes the same hash inline while it lowercases the name.
+*/
+unsigned int CommandRegistry::hash(std::string_view name, unsigned int seed)
+{
+    unsigned int value = 2166136261u ^ (seed * 0x9e3779b9u);
+    for (char c : name)
+    {
+        value ^= (unsigned char)lower(c);
+        value *= 16777619u;
+    }
+    value ^= value >> 15;
+    return value;
+}
+
+/*!
+@brief Find a seed and table size that give every name its own slot.
+@details The table starts at the smallest power of two at least twice the number of commands and doubles if no seed
+within a bound works.
+*/
+void CommandRegistry::rebuild()
+{
+    size_t size = 1;
+    while (size < entries.size() * 2)
+    {
+        size *= 2;
+    }
+    while (true)
+    {
+        for (unsigned int candidate = 1; candidate <= 4096; candidate++)
+        {
+            std::vector<int> table(size, -1);
+            bool perfect = true;
+            for (size_t i = 0; i < entries.size() && perfect; i++)
+            {
+                int &slot = table[hash(entries[i].name, candidate) & (size - 1)];
+                perfect = slot < 0;
+                slot = (int)i;
+            }
+            if (perfect)
+            {
+                slots.swap(table);
+                seed = candidate;
+                return;
+            }
+        }
+        size *= 2;
+    }
+}
+
+/*!
+@brief Find a command's entry.
+@param name The name in any case.
+@return The entry, or nullptr.
+@details Short names are lowercased into a stack buffer in the same pass that hashes them, so the one candidate is
+checked with a plain comparison against its stored lowercase name.
+*/
+const CommandRegistry::Entry *CommandRegistry::lookup(std::string_view name) const
+{
+    if (slots.empty())
+    {
+        return nullptr;
+    }
+    char folded[32];
+    if (name.size() > sizeof(folded))
+    {
+        int index = slots[hash(name, seed) & (slots.size() - 1)];
+        return index >= 0 && sameName(entries[index].folded, name) ? &entries[index] : nullptr;
+    }
+    unsigned int value = 2166136261u ^ (seed * 0x9e3779b9u);
+    for (size_t i = 0; i < name.size(); i++)
+    {
+        folded[i] = lower(name[i]);
+        value ^= (unsigned char)folded[i];
+        value *= 16777619u;
+    }
+    value ^= value >> 15;
+    int index = slots[value & (slots.size() - 1)];
+    if (index < 0 || entries[index].folded != std::string_view(folded, name.size()))
+    {
+        return nullptr;
+    }
+    return &entries[index];
+}
+
+/*!
+@brief Find a command.
+@param name The name in any case.
+@return The handler, or nullptr.
+*/
+CommandHandler *CommandRegistry::find(std::string_view name) const
+{
+    const Entry *entry = lookup(name);
+    return entry ? entry->handler.get() : nullptr;
+}
+
+/*!
+@brief Run the command a line asks for.
+@param line The typed line.
+@return What happened.
+*/
+CommandRegistry::Result CommandRegistry::dispatch(std::string_view line) const
+{
+    size_t end = CommandArgs::commandEnd(line);
+    size_t start = 0;
+    while (start < end && blank(line[start]))
+    {
+        start++;
+    }
+    if (start == end)
+    {
+        return Result::Empty;
+    }
+    const Entry *entry = lookup(line.substr(start, end - start));
+    if (entry == nullptr)
+    {
+        return Result::Unknown;
+    }
+    if (!entry->handler->available())
+    {
+        return Result::Unavailable;
+    }
+    CommandArgs args(line, end);
+    if (args.count() < entry->minArguments || args.count() > entry->maxArguments)
+    {
+        return Result::BadArguments;
+    }
+    entry->handler->run(args);
+    return Result::Ran;
+}
+
+/*!
+@brief List the commands on offer.
+@param separator Put between names.
+@return The names of the listed commands.
+*/
+std::string CommandRegistry::listed(const std::string &separator) const
+{
+    std::string names;
+    for (const Entry &entry : entries)
+    {
+        if (entry.handler->listed())
+        {
+            names += (names.empty() ? "" : separator) + entry.name;
+        }
+    }
+    return names;
+}
+
+/*!
+@brief Get the number of commands.
+@return The count.
+*/
+size_t CommandRegistry::size() const
+{
+    return entries.size();
+}
+
+/*!
+@brief Constructor for the CommandQueue class.
+@param commands The commands, so macros cannot hide one.
+*/
+CommandQueue::CommandQueue(const CommandRegistry &commands) : commands(commands)
+{
+}
+
+/*!
+@brief Queue a typed line, or define a macro.
+@param line The line.
+@return What was done with it.
+@details The line is walked once: the first word is read up to a blank, an equals sign or a separator, and if an
+equals sign follows it the rest of the line is a macro's steps. Otherwise the line is split on separators, with each
+step that names a macro replaced by the macro's steps.
+*/
+CommandQueue::Pushed CommandQueue::push(std::string_view line)
+{
+    line = trim(line);
+    size_t end = 0;
+    while (end < line.size() && !blank(line[end]) && line[end] != '=' && line[end] != Separator)
+    {
+        end++;
+    }
+    std::string_view after = trim(line.substr(end));
+    if (!after.empty() && after.front() == '=')
+    {
+        std::string_view name = line.substr(0, end);
+        std::string_view body = trim(after.substr(1));
+        if (body.empty())
+        {
+            return undefine(name) ? Pushed::Removed : Pushed::Rejected;
+        }
+        return define(name, body) ? Pushed::Defined : Pushed::Rejected;
+    }
+
+    std::vector<std::string> expanded;
+    if (!expand(line, 0, expanded) || steps.size() + expanded.size() > MaxSteps)
+    {
+        return Pushed::TooLong;
+    }
+    for (std::string &step : expanded)
+    {
+        steps.push_back(std::move(step));
+    }
+    return Pushed::Queued;
+}
+
+/*!
+@brief Split steps and append them to a list, expanding macros.
+@param text The steps.
+@param depth How many macros are being expanded already.
+@param out Where the steps go.
+@return False if the steps go past MaxSteps or MaxDepth.
+*/
+bool CommandQueue::expand(std::string_view text, int depth, std::vector<std::string> &out) const
+{
+    while (!text.empty())
+    {
+        size_t cut = text.find(Separator);
+        std::string_view step = trim(text.substr(0, cut));
+        text = cut == std::string_view::npos ? std::string_view() : text.substr(cut + 1);
+        if (step.empty())
+        {
+            continue;
+        }
+        const std::string *body = macro(step);
+        if (body != nullptr)
+        {
+            if (depth >= MaxDepth || !expand(*body, depth + 1, out))
+            {
+                return false;
+            }
+            continue;
+        }
+        if (out.size() >= MaxSteps)
+        {
+            return false;
+        }
+        out.emplace_back(step);
+    }
+    return true;
+}
+
+/*!
+@brief Check whether any steps are waiting.
+@return True if none are.
+*/
+bool CommandQueue::empty() const
+{
+    return steps.empty();
+}
+
+/*!
+@brief Get the number of steps waiting.
+@return The count.
+*/
+size_t CommandQueue::size() const
+{
+    return steps.size();
+}
+
+/*!
+@brief Take the next step.
+@return The step, or an empty string.
+*/
+std::string CommandQueue::pop()
+{
+    if (steps.empty())
+    {
+        return "";
+    }
+    std::string step = std::move(steps.front());
+    steps.pop_front();
+    return step;
+}
+
+/*!
+@brief Drop every waiting step.
+@return How many were dropped.
+*/
+size_t CommandQueue::clear()
+{
+    size_t dropped = steps.size();
+    steps.clear();
+    return dropped;
+}
+
+/*!
+@brief Define a macro, replacing any with the same name.
+@param name The name typed to use it.
+@param body The steps.
+@return False if the name is a command or not a single word.
+*/
+bool CommandQueue::define(std::string_view name, std::string_view body)
+{
+    name = trim(name);
+    if (name.empty() || commands.find(name) != nullptr)
+    {
+        return false;
+    }
+    for (char c : name)
+    {
+        if (blank(c) || c == '=' || c == Separator)
+        {
+            return false;
+        }
+    }
+    defined[fold(name)] = Macro{std::string(name), std::string(trim(body))};
+    return true;
+}
+
+/*!
+@brief Remove a macro.
+@param name The macro's name.
+@return True if there was one.
+*/
+bool CommandQueue::undefine(std::string_view name)
+{
+    return defined.erase(fold(trim(name))) > 0;
+}
+
+/*!
+@brief Find a macro.
+@param name The macro's name.
+@return Its steps, or nullptr.
+*/
+const std::string *CommandQueue::macro(std::string_view name) const
+{
+    if (defined.empty())
+    {
+        return nullptr;
+    }
+    auto found = defined.find(fold(name));
+    return found == defined.end() ? nullptr : &found->second.body;
+}
+
+/*!
+@brief List the macros.
+@return One line for each.
+*/
+std::string CommandQueue::macros() const
+{
+    std::string list;
+    for (const auto &entry : defined)
+    {
+        list += entry.second.name + " = " + entry.second.body + "\n";
+    }
+    return list;
+}
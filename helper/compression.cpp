@@ -0,0 +1,511 @@
+/*!
+@file compression.cpp
+@brief Implements compressed output for remote sessions.
+@details The encoder follows RFC 1950 and RFC 1951 closely enough for any zlib inflater: a two-byte zlib header,
+fixed-Huffman blocks made of literals and length/distance pairs, an empty stored block after each frame, and an
+Adler-32 trailer when the stream ends.
+*/
+
+#include "../lib/compression.h"
+#include <algorithm>
+
+namespace
+{
+    const size_t WindowSize = 32768; //!< Largest distance deflate can refer back.
+    const int MinMatch = 3;          //!< Shortest match deflate can code.
+    const int MaxMatch = 258;        //!< Longest match deflate can code.
+    const int MaxChain = 64;         //!< Most candidates tried for each position.
+    const int HashBits = 15;         //!< Size of the hash table, as a power of two.
+
+    const int lengthBase[] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    const int lengthExtra[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    const int distanceBase[] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+    const int distanceExtra[] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+}
+
+/*!
+@brief Constructor for the Deflater class.
+@details The match tables take half a megabyte, so they are allocated by the first frame rather than here; a server
+holding many sessions pays for them only in sessions that turn compression on.
+*/
+Deflater::Deflater()
+    : base(0), bitBuffer(0), bitCount(0), adlerA(1), adlerB(0),
+      started(false), finished(false)
+{
+}
+
+/*!
+@brief Compress bytes and end them with a sync flush.
+@param data The bytes.
+@param size How many there are.
+@param out Where compressed bytes are appended.
+*/
+void Deflater::frame(const char *data, size_t size, std::string &out)
+{
+    if (finished)
+    {
+        return;
+    }
+    if (!started)
+    {
+        // CMF: deflate with a 32 KiB window; FLG: fastest level, no dictionary, check bits
+        out += (char)0x78;
+        out += (char)0x01;
+        started = true;
+        head.assign((size_t)1 << HashBits, -1);
+        chain.assign(WindowSize, -1);
+    }
+
+    for (size_t i = 0; i < size; i++)
+    {
+        adlerA = (adlerA + (unsigned char)data[i]) % 65521;
+        adlerB = (adlerB + adlerA) % 65521;
+    }
+
+    // Keep one window of history before the new data
+    if (window.size() > 2 * WindowSize)
+    {
+        size_t drop = window.size() - WindowSize;
+        window.erase(0, drop);
+        base += drop;
+    }
+    size_t position = base + window.size();
+    window.append(data, size);
+    size_t end = base + window.size();
+
+    putBits(0, 1, out); // Not the final block
+    putBits(1, 2, out); // Fixed Huffman codes
+    while (position < end)
+    {
+        int bestLength = 0;
+        size_t bestFrom = 0;
+        if (end - position >= (size_t)MinMatch)
+        {
+            int limit = (int)std::min<size_t>(MaxMatch, end - position);
+            const char *here = &window[position - base];
+            int64_t candidate = head[hashAt(position)];
+            for (int tries = 0; candidate >= 0 && tries < MaxChain; tries++)
+            {
+                size_t from = (size_t)candidate;
+                if (from >= position || position - from > WindowSize || from < base)
+                {
+                    break;
+                }
+                const char *there = &window[from - base];
+                if (there[bestLength] == here[bestLength])
+                {
+                    int length = 0;
+                    while (length < limit && there[length] == here[length])
+                    {
+                        length++;
+                    }
+                    if (length > bestLength)
+                    {
+                        bestLength = length;
+                        bestFrom = from;
+                        if (length == limit)
+                        {
+                            break;
+                        }
+                    }
+                }
+                candidate = chain[from % WindowSize];
+            }
+        }
+
+        if (bestLength >= MinMatch)
+        {
+            putMatch(bestLength, (int)(position - bestFrom), out);
+            for (int i = 0; i < bestLength; i++)
+            {
+                insert(position + i);
+            }
+            position += bestLength;
+        }
+        else
+        {
+            putLiteral((unsigned char)window[position - base], out);
+            insert(position);
+            position++;
+        }
+    }
+    putLiteral(256, out);
+
+    // Sync flush: an empty stored block ends on a byte boundary, so the receiver can decode everything so far
+    putBits(0, 1, out);
+    putBits(0, 2, out);
+    alignToByte(out);
+    out += std::string("\x00\x00\xff\xff", 4);
+}
+
+/*!
+@brief End the stream with a final block and the Adler-32 checksum.
+@param out Where the bytes are appended.
+*/
+void Deflater::finish(std::string &out)
+{
+    if (finished)
+    {
+        return;
+    }
+    if (!started)
+    {
+        out += (char)0x78;
+        out += (char)0x01;
+        started = true;
+    }
+    putBits(1, 1, out);
+    putBits(1, 2, out);
+    putLiteral(256, out);
+    alignToByte(out);
+    uint32_t adler = (adlerB << 16) | adlerA;
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+        out += (char)((adler >> shift) & 0xff);
+    }
+    finished = true;
+}
+
+/*!
+@brief Append bits, least significant first.
+@param value The bits.
+@param count How many.
+@param out Where whole bytes are appended.
+*/
+void Deflater::putBits(uint32_t value, int count, std::string &out)
+{
+    bitBuffer |= value << bitCount;
+    bitCount += count;
+    while (bitCount >= 8)
+    {
+        out += (char)(bitBuffer & 0xff);
+        bitBuffer >>= 8;
+        bitCount -= 8;
+    }
+}
+
+/*!
+@brief Append a Huffman code.
+@param code The code.
+@param length Its length in bits.
+@param out Where whole bytes are appended.
+*/
+void Deflater::putCode(uint32_t code, int length, std::string &out)
+{
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; i++)
+    {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    putBits(reversed, length, out);
+}
+
+/*!
+@brief Append a literal/length symbol using the fixed Huffman code.
+@param symbol The symbol, 0 to 287.
+@param out Where whole bytes are appended.
+*/
+void Deflater::putLiteral(int symbol, std::string &out)
+{
+    if (symbol < 144)
+    {
+        putCode(0x30 + symbol, 8, out);
+    }
+    else if (symbol < 256)
+    {
+        putCode(0x190 + symbol - 144, 9, out);
+    }
+    else if (symbol < 280)
+    {
+        putCode(symbol - 256, 7, out);
+    }
+    else
+    {
+        putCode(0xc0 + symbol - 280, 8, out);
+    }
+}
+
+/*!
+@brief Append a length and distance pair.
+@param length The match length, 3 to 258.
+@param distance How far back the match starts, 1 to 32768.
+@param out Where whole bytes are appended.
+*/
+void Deflater::putMatch(int length, int distance, std::string &out)
+{
+    int code = (int)(std::upper_bound(std::begin(lengthBase), std::end(lengthBase), length) - std::begin(lengthBase)) - 1;
+    putLiteral(257 + code, out);
+    putBits(length - lengthBase[code], lengthExtra[code], out);
+
+    code = (int)(std::upper_bound(std::begin(distanceBase), std::end(distanceBase), distance) - std::begin(distanceBase)) - 1;
+    putCode(code, 5, out);
+    putBits(distance - distanceBase[code], distanceExtra[code], out);
+}
+
+/*!
+@brief Pad to a byte boundary with zero bits.
+@param out Where the last partial byte is appended.
+*/
+void Deflater::alignToByte(std::string &out)
+{
+    if (bitCount > 0)
+    {
+        putBits(0, 8 - bitCount, out);
+    }
+}
+
+/*!
+@brief Hash the three bytes at an absolute position.
+@param position The position. Three bytes must be available there.
+@return The hash.
+*/
+uint32_t Deflater::hashAt(size_t position) const
+{
+    const unsigned char *p = (const unsigned char *)&window[position - base];
+    return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & ((1u << HashBits) - 1);
+}
+
+/*!
+@brief Record an absolute position in the hash chains.
+@param position The position. Positions without three bytes after them are skipped.
+*/
+void Deflater::insert(size_t position)
+{
+    if (position + MinMatch > base + window.size())
+    {
+        return;
+    }
+    uint32_t hash = hashAt(position);
+    chain[position % WindowSize] = head[hash];
+    head[hash] = (int64_t)position;
+}
+
+/*!
+@brief Constructor for the CompressingSink class.
+@param next Where output goes.
+*/
+CompressingSink::CompressingSink(OutputSink &next) : next(next), active(false), offered(false)
+{
+}
+
+/*!
+@brief Destructor for the CompressingSink class.
+*/
+CompressingSink::~CompressingSink()
+{
+    end();
+}
+
+/*!
+@brief Offer compression to the client.
+*/
+void CompressingSink::offer()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (active || offered)
+    {
+        return;
+    }
+    offered = true;
+    send(std::string({(char)IAC, (char)WILL, (char)COMPRESS2}));
+}
+
+/*!
+@brief Start compressing.
+@details The subnegotiation that marks the start of the zlib stream is the last uncompressed output.
+*/
+void CompressingSink::accept()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (active)
+    {
+        return;
+    }
+    offered = false;
+    send(std::string({(char)IAC, (char)SB, (char)COMPRESS2, (char)IAC, (char)SE}));
+    deflater = Deflater();
+    active = true;
+}
+
+/*!
+@brief Record that the client refused compression.
+*/
+void CompressingSink::decline()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    offered = false;
+}
+
+/*!
+@brief End the compressed stream.
+*/
+void CompressingSink::end()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!active)
+    {
+        return;
+    }
+    buffer.clear();
+    deflater.finish(buffer);
+    send(buffer);
+    active = false;
+}
+
+/*!
+@brief Check whether output is being compressed.
+@return True while compressing.
+*/
+bool CompressingSink::compressing()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return active;
+}
+
+/*!
+@brief Get the byte counts.
+@return The counts so far.
+*/
+CompressionStats CompressingSink::getStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+/*!
+@brief Write output, compressed as one frame if compression is on.
+@param data The bytes.
+@param size How many there are.
+@return False if the next sink failed.
+*/
+bool CompressingSink::write(const char *data, size_t size)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (size == 0)
+    {
+        return true;
+    }
+    stats.rawBytes += size;
+    if (!active)
+    {
+        return send(std::string(data, size));
+    }
+    buffer.clear();
+    deflater.frame(data, size, buffer);
+    stats.frames++;
+    return send(buffer);
+}
+
+/*!
+@brief Pass bytes on and count them.
+@param bytes The bytes.
+@return False if the next sink failed.
+*/
+bool CompressingSink::send(const std::string &bytes)
+{
+    stats.sentBytes += bytes.size();
+    return next.write(bytes.data(), bytes.size());
+}
+
+/*!
+@brief Constructor for the TelnetSource class.
+@param next Where the client's bytes come from.
+@param compression The sink to tell about compression answers.
+*/
+TelnetSource::TelnetSource(InputSource &next, CompressingSink &compression)
+    : next(next), compression(compression), parse(Parse::Data), verb(0)
+{
+}
+
+/*!
+@brief Wait for the client to send something.
+@param milliseconds The longest to wait, or -1 to wait indefinitely.
+@return False if the time ran out first. Bytes that turn out to be only commands still count as input.
+*/
+bool TelnetSource::wait(int milliseconds)
+{
+    return next.wait(milliseconds);
+}
+
+/*!
+@brief Read the client's input without Telnet commands.
+@param buffer Where to put it.
+@param size The most to read.
+@return The number of bytes read, or 0 at end of input.
+@details Reads that contain only commands are retried, so 0 still means the client has gone.
+*/
+size_t TelnetSource::read(char *buffer, size_t size)
+{
+    while (true)
+    {
+        size_t count = next.read(buffer, size);
+        if (count == 0)
+        {
+            return 0;
+        }
+
+        size_t kept = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            unsigned char c = (unsigned char)buffer[i];
+            switch (parse)
+            {
+            case Parse::Data:
+                if (c == CompressingSink::IAC)
+                {
+                    parse = Parse::Command;
+                }
+                else if (c != '\r' && c != '\0')
+                {
+                    buffer[kept++] = (char)c;
+                }
+                break;
+            case Parse::Command:
+                if (c == CompressingSink::IAC)
+                {
+                    buffer[kept++] = (char)c;
+                    parse = Parse::Data;
+                }
+                else if (c >= CompressingSink::WILL)
+                {
+                    verb = c;
+                    parse = Parse::Option;
+                }
+                else if (c == CompressingSink::SB)
+                {
+                    parse = Parse::Subnegotiate;
+                }
+                else
+                {
+                    parse = Parse::Data;
+                }
+                break;
+            case Parse::Option:
+                if (c == CompressingSink::COMPRESS2 && verb == CompressingSink::DO)
+                {
+                    compression.accept();
+                }
+                else if (c == CompressingSink::COMPRESS2 && verb == CompressingSink::DONT)
+                {
+                    compression.decline();
+                    compression.end();
+                }
+                parse = Parse::Data;
+                break;
+            case Parse::Subnegotiate:
+                if (c == CompressingSink::IAC)
+                {
+                    parse = Parse::SubIac;
+                }
+                break;
+            case Parse::SubIac:
+                parse = c == CompressingSink::SE ? Parse::Data : Parse::Subnegotiate;
+                break;
+            }
+        }
+        if (kept > 0)
+        {
+            return kept;
+        }
+    }
+}
@@ -0,0 +1,630 @@
+/*!
+@file console.cpp
+@brief Implements the input and output abstraction used by game sessions.
+@details Consoles other than the standard one are built from two small streambufs. Output is collected in a buffer
+and handed to the sink when it fills, on flush, and before input is read; input is read from the source a buffer at
+a time.
+*/
+
+#include "../lib/console.h"
+#include "../lib/keyreader.h"
+#include "../lib/renderer.h"
+#include <algorithm>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <poll.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    thread_local Console *bound = nullptr; //!< The calling thread's console, or nullptr for the standard one.
+
+#ifndef _WIN32
+    /*!
+    @brief Wait for a descriptor to become readable.
+    @param fd The descriptor.
+    @param milliseconds The longest to wait, or -1 to wait indefinitely.
+    @return False if the time ran out. Errors report the descriptor as readable, so the read that follows reports them.
+    */
+    bool pollReadable(int fd, int milliseconds)
+    {
+        pollfd entry = {fd, POLLIN, 0};
+        int ready;
+        do
+        {
+            ready = ::poll(&entry, 1, milliseconds);
+        } while (ready < 0 && errno == EINTR);
+        return ready != 0;
+    }
+#endif
+}
+
+/*!
+@brief Wait until a read would not block.
+@param milliseconds The longest to wait.
+@return Always true, since a source without its own wait cannot tell.
+*/
+bool InputSource::wait(int /*milliseconds*/)
+{
+    return true;
+}
+
+/*!
+@brief Collect bytes written to the sink.
+@param data The bytes.
+@param size How many there are.
+@return Always true.
+*/
+bool MemorySink::write(const char *data, size_t size)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    collected.append(data, size);
+    return true;
+}
+
+/*!
+@brief Get everything written so far.
+@return The text.
+*/
+std::string MemorySink::text() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return collected;
+}
+
+/*!
+@brief Constructor for the MemorySource class.
+@param script Input available immediately.
+@param closed True if no more input will be pushed.
+*/
+MemorySource::MemorySource(const std::string &script, bool closed) : pending(script), closed(closed)
+{
+}
+
+/*!
+@brief Read pushed input, waiting for some if there is none yet.
+@param buffer Where to put it.
+@param size The most to read.
+@return The number of bytes read, or 0 once the source is closed and empty.
+*/
+size_t MemorySource::read(char *buffer, size_t size)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    readers++;
+    available.wait(lock, [this]
+                   { return !pending.empty() || closed; });
+    readers--;
+    size_t count = std::min(size, pending.size());
+    pending.copy(buffer, count);
+    pending.erase(0, count);
+    return count;
+}
+
+/*!
+@brief Wait for input to be pushed or the source to be closed.
+@param milliseconds The longest to wait, or -1 to wait indefinitely.
+@return False if the time ran out first.
+@details A wait counts as a blocked read, so waiting() reports a session that is polling for input.
+*/
+bool MemorySource::wait(int milliseconds)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    auto ready = [this]
+    { return !pending.empty() || closed; };
+    readers++;
+    bool arrived;
+    if (milliseconds < 0)
+    {
+        available.wait(lock, ready);
+        arrived = true;
+    }
+    else
+    {
+        arrived = available.wait_for(lock, std::chrono::milliseconds(milliseconds), ready);
+    }
+    readers--;
+    return arrived;
+}
+
+/*!
+@brief Add input.
+@param text The text.
+*/
+void MemorySource::push(const std::string &text)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending += text;
+    }
+    available.notify_all();
+}
+
+/*!
+@brief End the input once what has been pushed is read.
+*/
+void MemorySource::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+    }
+    available.notify_all();
+}
+
+/*!
+@brief Check whether a read is blocked waiting for input.
+@return True while a read is waiting.
+*/
+bool MemorySource::waiting()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return readers > 0 && pending.empty();
+}
+
+#ifndef _WIN32
+/*!
+@brief Constructor for the SocketSink class.
+@param fd The socket.
+*/
+SocketSink::SocketSink(int fd) : fd(fd)
+{
+}
+
+/*!
+@brief Send bytes, retrying partial and interrupted sends.
+@param data The bytes.
+@param size How many there are.
+@return False if the connection has failed.
+*/
+bool SocketSink::write(const char *data, size_t size)
+{
+    while (size > 0)
+    {
+#ifdef MSG_NOSIGNAL
+        ssize_t sent = ::send(fd, data, size, MSG_NOSIGNAL);
+#else
+        ssize_t sent = ::send(fd, data, size, 0);
+#endif
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+/*!
+@brief Constructor for the SocketSource class.
+@param fd The socket.
+*/
+SocketSource::SocketSource(int fd) : fd(fd)
+{
+}
+
+/*!
+@brief Receive bytes, waiting for some to arrive.
+@param buffer Where to put them.
+@param size The most to read.
+@return The number of bytes read, or 0 when the peer has closed the connection or it has failed.
+*/
+size_t SocketSource::read(char *buffer, size_t size)
+{
+    while (true)
+    {
+        ssize_t received = ::recv(fd, buffer, size, 0);
+        if (received >= 0)
+        {
+            return received;
+        }
+        if (errno != EINTR)
+        {
+            return 0;
+        }
+    }
+}
+
+/*!
+@brief Wait for bytes to arrive on the socket.
+@param milliseconds The longest to wait, or -1 to wait indefinitely.
+@return False if the time ran out first.
+*/
+bool SocketSource::wait(int milliseconds)
+{
+    return pollReadable(fd, milliseconds);
+}
+#endif
+
+/*!
+@class Console::SinkBuffer
+@brief Stream buffer that passes output to an OutputSink.
+*/
+class Console::SinkBuffer : public std::streambuf
+{
+public:
+    /*!
+    @brief Constructor for the SinkBuffer class.
+    @param sink Where output goes.
+    */
+    explicit SinkBuffer(OutputSink &sink) : sink(sink), buffer(4096)
+    {
+        setp(buffer.data(), buffer.data() + buffer.size());
+    }
+
+protected:
+    /*!
+    @brief Send the buffer when it is full, then store the character.
+    @param ch The character.
+    @return The character, or eof if the sink failed.
+    */
+    int_type overflow(int_type ch) override
+    {
+        if (sync() != 0)
+        {
+            return traits_type::eof();
+        }
+        if (!traits_type::eq_int_type(ch, traits_type::eof()))
+        {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    /*!
+    @brief Send the buffered output.
+    @return 0 on success, -1 if the sink failed.
+    */
+    int sync() override
+    {
+        size_t size = pptr() - pbase();
+        setp(buffer.data(), buffer.data() + buffer.size());
+        return size == 0 || sink.write(buffer.data(), size) ? 0 : -1;
+    }
+
+private:
+    OutputSink &sink;         //!< Where output goes.
+    std::vector<char> buffer; //!< Output not yet sent.
+};
+
+/*!
+@class Console::SourceBuffer
+@brief Stream buffer that reads input from an InputSource.
+*/
+class Console::SourceBuffer : public std::streambuf
+{
+public:
+    /*!
+    @brief Constructor for the SourceBuffer class.
+    @param source Where input comes from.
+    */
+    explicit SourceBuffer(InputSource &source) : source(source), buffer(1024)
+    {
+        setg(buffer.data(), buffer.data(), buffer.data());
+    }
+
+    /*!
+    @brief Wait until a character can be read without blocking.
+    @param milliseconds The longest to wait, or -1 to wait indefinitely.
+    @return False if the time ran out first.
+    */
+    bool wait(int milliseconds)
+    {
+        return gptr() < egptr() || source.wait(milliseconds);
+    }
+
+protected:
+    /*!
+    @brief Read more input once the buffer is used up.
+    @return The next character, or eof at end of input.
+    */
+    int_type underflow() override
+    {
+        size_t count = source.read(buffer.data(), buffer.size());
+        if (count == 0)
+        {
+            return traits_type::eof();
+        }
+        setg(buffer.data(), buffer.data(), buffer.data() + count);
+        return traits_type::to_int_type(buffer[0]);
+    }
+
+private:
+    InputSource &source;      //!< Where input comes from.
+    std::vector<char> buffer; //!< Input read but not yet consumed.
+};
+
+/*!
+@brief Constructor for the standard console.
+*/
+Console::Console() : input(&std::cin), output(&std::cout)
+{
+}
+
+/*!
+@brief Constructor for the Console class.
+@param source Where input comes from.
+@param sink Where output goes.
+*/
+Console::Console(InputSource &source, OutputSink &sink)
+    : sinkBuffer(new SinkBuffer(sink)),
+      sourceBuffer(new SourceBuffer(source)),
+      ownOut(new std::ostream(sinkBuffer.get())),
+      ownIn(new std::istream(sourceBuffer.get()))
+{
+    ownIn->tie(ownOut.get());
+    input = ownIn.get();
+    output = ownOut.get();
+}
+
+/*!
+@brief Destructor for the Console class.
+*/
+Console::~Console()
+{
+    if (ownOut)
+    {
+        ownOut->flush();
+    }
+}
+
+/*!
+@brief Get the console over the process's standard streams.
+@return The standard console.
+*/
+Console &Console::standard()
+{
+    static Console console;
+    return console;
+}
+
+/*!
+@brief Check whether this is the standard console.
+@return True for the standard console.
+*/
+bool Console::isStandard() const
+{
+    return this == &standard();
+}
+
+/*!
+@brief Get the input stream.
+@return The input stream.
+*/
+std::istream &Console::in()
+{
+    return *input;
+}
+
+/*!
+@brief Get the output stream.
+@return The output stream.
+*/
+std::ostream &Console::out()
+{
+    return *output;
+}
+
+/*!
+@brief Get the stream for error messages.
+@return std::cerr for the standard console, and the output stream otherwise.
+*/
+std::ostream &Console::err()
+{
+    return isStandard() ? std::cerr : *output;
+}
+
+/*!
+@brief Send everything written so far to the player.
+@details The standard console's output is held by the renderer, so its frame is presented; other consoles flush.
+*/
+void Console::present()
+{
+    if (isStandard())
+    {
+        presentFrame();
+    }
+    else
+    {
+        output->flush();
+    }
+}
+
+/*!
+@brief Wait until input can be read without blocking.
+@param milliseconds The longest to wait, or -1 to wait indefinitely.
+@return False if the time ran out first.
+@details The standard console polls standard input only when it is a terminal. std::cin may also have been pointed
+at another buffer, as the tests do, in which case that buffer is asked instead.
+*/
+bool Console::waitForInput(int milliseconds)
+{
+    if (sourceBuffer)
+    {
+        return sourceBuffer->wait(milliseconds);
+    }
+    if (std::cin.rdbuf()->in_avail() != 0)
+    {
+        return true;
+    }
+#ifndef _WIN32
+    if (isatty(STDIN_FILENO))
+    {
+        return pollReadable(STDIN_FILENO, milliseconds);
+    }
+#endif
+    return true;
+}
+
+/*!
+@brief Wait for input at a point where the session could be handed to another process.
+@param milliseconds The longest to wait, or -1 to wait indefinitely.
+@return False if the time ran out first.
+@details A requested handoff is checked before waiting, so one requested while the game was busy is not missed.
+*/
+bool Console::waitForTurn(int milliseconds)
+{
+    if (handoff)
+    {
+        return true;
+    }
+    turn = true;
+    bool ready = waitForInput(milliseconds);
+    turn = false;
+    return ready || handoff;
+}
+
+/*!
+@brief Ask the game to stop at its next turn.
+*/
+void Console::requestHandoff()
+{
+    handoff = true;
+}
+
+/*!
+@brief Check whether a handoff has been requested.
+@return True if one has.
+*/
+bool Console::handoffRequested() const
+{
+    return handoff;
+}
+
+/*!
+@brief Check whether the game is waiting in waitForTurn.
+@return True while it is.
+*/
+bool Console::atTurn() const
+{
+    return turn;
+}
+
+/*!
+@brief Take the input read from the source but not by the game.
+@return The input.
+*/
+std::string Console::takeBufferedInput()
+{
+    std::string unread;
+    if (!sourceBuffer)
+    {
+        return unread;
+    }
+    std::streamsize ready = sourceBuffer->in_avail();
+    if (ready > 0)
+    {
+        unread.resize((size_t)ready);
+        unread.resize((size_t)sourceBuffer->sgetn(&unread[0], ready));
+    }
+    return unread;
+}
+
+/*!
+@brief Get the latencies of the session's most recent combat.
+@return The record.
+*/
+CombatLatency &Console::combatLatency()
+{
+    if (!combat)
+    {
+        combat.reset(new CombatLatency());
+    }
+    return *combat;
+}
+
+/*!
+@brief Read whatever input has arrived, blocking only if there is none.
+@param buffer Where to put it.
+@param size The most to read.
+@return The number of bytes read, or 0 at end of input, which also sets the input stream's eof flag.
+@details A terminal is read directly, so bytes are never left in stdio's buffer where poll cannot see them.
+*/
+size_t Console::readAvailable(char *buffer, size_t size)
+{
+    std::streambuf *source = input->rdbuf();
+#ifndef _WIN32
+    if (isStandard() && source->in_avail() == 0 && isatty(STDIN_FILENO))
+    {
+        ssize_t count;
+        do
+        {
+            count = ::read(STDIN_FILENO, buffer, size);
+        } while (count < 0 && errno == EINTR);
+        if (count <= 0)
+        {
+            input->setstate(std::ios::eofbit);
+            return 0;
+        }
+        return count;
+    }
+#endif
+    if (std::streambuf::traits_type::eq_int_type(source->sgetc(), std::streambuf::traits_type::eof()))
+    {
+        input->setstate(std::ios::eofbit);
+        return 0;
+    }
+    std::streamsize ready = std::max<std::streamsize>(1, source->in_avail());
+    return source->sgetn(buffer, std::min<std::streamsize>(ready, size));
+}
+
+/*!
+@brief Throw away anything typed at the terminal that has not been read yet.
+*/
+void Console::discardInput()
+{
+#ifndef _WIN32
+    if (isStandard() && std::cin.rdbuf()->in_avail() == 0 && isatty(STDIN_FILENO))
+    {
+        tcflush(STDIN_FILENO, TCIFLUSH);
+    }
+#endif
+}
+
+/*!
+@brief Bind a console to the calling thread.
+@param console The console.
+*/
+Console::Binding::Binding(Console &console) : previous(bound)
+{
+    bound = &console;
+}
+
+/*!
+@brief Restore the console that was bound before.
+*/
+Console::Binding::~Binding()
+{
+    bound = previous;
+}
+
+/*!
+@brief Get the console bound to the calling thread.
+@return The bound console, or the standard console.
+*/
+Console &console()
+{
+    return bound != nullptr ? *bound : Console::standard();
+}
+
+/*!
+@brief Replace the calling thread's console binding.
+@param console The console to bind, or nullptr.
+@return The binding it replaced.
+*/
+Console *exchangeBoundConsole(Console *console)
+{
+    Console *previous = bound;
+    bound = console;
+    return previous;
+}
@@ -13,7 +13,13 @@
 @brief Constructor for the Dungeon class.
 @details Initializes the random number generator with the current time to ensure different dungeon layouts each time.
 */
-Dungeon::Dungeon() : rng(static_cast<unsigned int>(std::time(0))) {}
+Dungeon::Dungeon() : Dungeon(static_cast<unsigned int>(std::time(0))) {}
+
+/*!
+@brief Constructor for a reproducible Dungeon.
+@param seed The seed used to generate the floor layout and room contents.
+*/
+Dungeon::Dungeon(unsigned int seed) : rng(seed), seed(seed), startRoom(nullptr) {}
 
 /*!
 @brief Destructor for the Dungeon class.
@@ -36,8 +42,11 @@ Dungeon::~Dungeon()
 Room *Dungeon::generateRoom(int x, int y)
 {
     Room *newRoom = new Room();
+    newRoom->id = (int)rooms.size();
     newRoom->roomContent.addCoordinates(x, y);
     rooms.push_back(newRoom);
+    analytics.onRoomAdded(newRoom->id);
+    index.insert(newRoom);
     return newRoom;
 }
 
@@ -68,6 +77,11 @@ void Dungeon::linkRooms(Room *room1, Room *room2, int direction)
         room2->west = room1;
         break;
     }
+
+    if (getRoom(room1->id) == room1 && getRoom(room2->id) == room2)
+    {
+        analytics.onLink(room1->id, room2->id, direction);
+    }
 }
 
 /*!
@@ -106,13 +120,36 @@ void Dungeon::checkAndLink(Room *newRoom, int x, int y, std::map<std::pair<int,
 @param room The room to center the map on.
 @return A string representing the map of the dungeon.
 @details The map displays a 5x5 grid centered on the given room, with visited rooms marked with '*', unvisited rooms with 'X', and the current room in blue.
+On a generated floor the fog-of-war viewpoint moves to the room first, and only rooms in sight or seen before are drawn. Rooms
+that are not part of the generated floor fall back to showing every room linked to the centre within the grid.
 */
 std::string Dungeon::getMap(Room *room)
 {
-    //room->roomContent.setVisited(true);
-    std::queue<Room *> roomQueue;
+    std::vector<bool> visited(rooms.size());
+    for (size_t i = 0; i < rooms.size(); i++)
+    {
+        visited[i] = rooms[i]->roomContent.getVisited();
+    }
+    return getMap(room, fog, visited);
+}
+
+/*!
+@brief Generate a map of the floor as one player sees it.
+@param room The room to center the map on.
+@param view The player's fog-of-war layer, built for this floor. Its viewpoint is moved to the room.
+@param visited The rooms the player has entered, indexed by room id.
+@return A string representing the map of the dungeon.
+@details Nothing on the floor is changed, so players sharing a floor can each keep their own view of it. Rooms without
+an id on this floor fall back to their own visited flag.
+*/
+std::string Dungeon::getMap(const Room *room, FogOfWar &view, const std::vector<bool> &visited) const
+{
+    auto wasVisited = [&visited](const Room *other)
+    {
+        return other->id >= 0 && other->id < (int)visited.size() ? (bool)visited[other->id] : other->roomContent.getVisited();
+    };
+    std::queue<const Room *> roomQueue;
     std::set<std::pair<int, int>> visitedRooms;
-    roomQueue.push(room);
 
     int originX = room->roomContent.getCoordinates().first;
     int originY = room->roomContent.getCoordinates().second;
@@ -120,14 +157,33 @@ std::string Dungeon::getMap(Room *room)
     std::map<std::pair<int, int>, bool> roomsForMap;
     std::map<std::pair<int, int>, bool> roomsVisited;
 
-    for (int i = 0; i < (int)rooms.size(); i++)
+    if (view.contains(originX, originY) && index.at(originX, originY) == room)
     {
-        roomsVisited[rooms[i]->roomContent.getCoordinates()] = rooms[i]->roomContent.getVisited();
+        view.moveTo(originX, originY);
+        for (int y = originY - 2; y <= originY + 2; y++)
+        {
+            for (int x = originX - 2; x <= originX + 2; x++)
+            {
+                if (view.contains(x, y) && (view.isVisible(x, y) || view.isExplored(x, y)))
+                {
+                    roomsForMap[{x, y}] = true;
+                    roomsVisited[{x, y}] = wasVisited(index.at(x, y));
+                }
+            }
+        }
+    }
+    else
+    {
+        for (int i = 0; i < (int)rooms.size(); i++)
+        {
+            roomsVisited[rooms[i]->roomContent.getCoordinates()] = wasVisited(rooms[i]);
+        }
+        roomQueue.push(room);
     }
 
     while (!roomQueue.empty())
     {
-        Room *currentRoom = roomQueue.front();
+        const Room *currentRoom = roomQueue.front();
         roomQueue.pop();
 
         int currX = currentRoom->roomContent.getCoordinates().first;
@@ -145,7 +201,7 @@ std::string Dungeon::getMap(Room *room)
 
         roomsForMap[currentRoom->roomContent.getCoordinates()] = true;
         visitedRooms.insert(currentRoom->roomContent.getCoordinates());
-        roomsVisited[currentRoom->roomContent.getCoordinates()] = currentRoom->roomContent.getVisited();
+        roomsVisited[currentRoom->roomContent.getCoordinates()] = wasVisited(currentRoom);
 
         if (currentRoom->north)
         {
@@ -213,9 +269,13 @@ Room *Dungeon::generateFloor(int numRooms)
         return nullptr;
     }
 
-    Room *startRoom = generateRoom(0, 0);
+    // Room contents draw from the shared engine, so seed it as well to make the whole floor reproducible
+    rng.seed(seed);
+    seedRandom(seed);
+
+    Room *firstRoom = generateRoom(0, 0);
     std::map<std::pair<int, int>, Room *> roomMap;
-    roomMap[{0, 0}] = startRoom;
+    roomMap[{0, 0}] = firstRoom;
 
     for (int i = 1; i < numRooms; ++i)
     {
@@ -262,7 +322,155 @@ Room *Dungeon::generateFloor(int numRooms)
         checkAndLink(newRoom, newX, newY, roomMap);
     }
 
-    return rooms[std::uniform_int_distribution<>(0, (int)rooms.size() - 1)(rng)];
+    startRoom = rooms[std::uniform_int_distribution<>(0, (int)rooms.size() - 1)(rng)];
+    fog.build(rooms);
+    reseedRandom();
+    return startRoom;
+}
+
+/*!
+@brief Get the seed used to generate the dungeon.
+@return The generation seed.
+*/
+unsigned int Dungeon::getSeed() const
+{
+    return seed;
+}
+
+/*!
+@brief Get every room on the floor.
+@return The rooms in generation order, so rooms[i]->id == i.
+*/
+const std::vector<Room *> &Dungeon::getRooms() const
+{
+    return rooms;
+}
+
+/*!
+@brief Get a room by its generation index.
+@param id The id of the room.
+@return A pointer to the room, or nullptr if there is no room with that id.
+*/
+Room *Dungeon::getRoom(int id) const
+{
+    if (id < 0 || id >= (int)rooms.size())
+    {
+        return nullptr;
+    }
+    return rooms[id];
+}
+
+/*!
+@brief Get the starting room chosen by generateFloor.
+@return A pointer to the starting room.
+*/
+Room *Dungeon::getStartRoom() const
+{
+    return startRoom;
+}
+
+/*!
+@brief Record the player's changes to the floor.
+@return A FloorDelta holding one bit per room for each kind of change.
+*/
+FloorDelta Dungeon::captureDelta()
+{
+    FloorDelta delta;
+    delta.visited.resize(rooms.size());
+    delta.cleared.resize(rooms.size());
+    delta.looted.resize(rooms.size());
+    delta.solved.resize(rooms.size());
+
+    for (size_t i = 0; i < rooms.size(); i++)
+    {
+        RoomContent &content = rooms[i]->roomContent;
+        delta.visited[i] = content.getVisited();
+        delta.cleared[i] = content.getCleared();
+        delta.looted[i] = content.getLooted();
+        delta.solved[i] = content.getSolved();
+    }
+    return delta;
+}
+
+/*!
+@brief Reapply recorded changes to the floor.
+@param delta The changes to apply. Bits for rooms that do not exist on this floor are ignored.
+@details Cleared rooms lose their enemies and get the cleared description, looted rooms lose their items and coins,
+and solved safes are marked as cracked.
+*/
+void Dungeon::applyDelta(const FloorDelta &delta)
+{
+    for (size_t i = 0; i < rooms.size(); i++)
+    {
+        RoomContent &content = rooms[i]->roomContent;
+        if (i < delta.visited.size() && delta.visited[i])
+        {
+            content.setVisited(true);
+        }
+        if (i < delta.cleared.size() && delta.cleared[i])
+        {
+            content.clearEnemies();
+            content.clearText();
+        }
+        if (i < delta.looted.size() && delta.looted[i])
+        {
+            content.emptyItems();
+            content.getCoins();
+        }
+        if (i < delta.solved.size() && delta.solved[i])
+        {
+            content.setSolved(true);
+        }
+    }
+    // Rebuild so the restored visited rooms show up as explored
+    fog.build(rooms);
+}
+
+/*!
+@brief Get graph statistics for the floor.
+@return The current FloorStats. Cheap counts are always current; the diameter and articulation points are recomputed only if a loop has been closed since the last query.
+*/
+FloorStats Dungeon::getStats()
+{
+    return analytics.getStats();
+}
+
+/*!
+@brief Get the spatial index over the floor's rooms.
+@return A reference to the index.
+*/
+const RoomIndex &Dungeon::getIndex() const
+{
+    return index;
+}
+
+/*!
+@brief Get the fog-of-war layer for the floor.
+@return A reference to the layer.
+*/
+const FogOfWar &Dungeon::getFog() const
+{
+    return fog;
+}
+
+/*!
+@brief Estimate the memory used by the floor.
+@return The approximate number of bytes held by the rooms, their descriptions, items and enemies.
+@details The estimate ignores allocator overhead and the internals of mini-game objects, which is accurate enough to compare the memory of floors.
+*/
+size_t Dungeon::memoryFootprint()
+{
+    size_t bytes = sizeof(Dungeon) + rooms.capacity() * sizeof(Room *);
+    for (Room *room : rooms)
+    {
+        bytes += sizeof(Room) + room->roomContent.getRoomDesc().capacity();
+        for (const std::string &item : room->roomContent.getItems())
+        {
+            bytes += sizeof(std::string) + item.capacity();
+        }
+        bytes += room->roomContent.getEnemies().size() * sizeof(EnemyStruct);
+    }
+    return bytes;
 }
 
 /*!
@@ -0,0 +1,246 @@
+/*!
+@file eventloop.cpp
+@brief Implementation of the EventLoop class.
+@details This file contains the implementation of the EventLoop class. Input is read in whatever chunks the console
+delivers and handed out one character at a time, so a chunk holding several lines is reported line by line. Every
+character of a chunk is stamped with the time the chunk was read, not the time its event was handed out.
+*/
+
+#include "../lib/eventloop.h"
+
+/*!
+@brief Constructor for the EventLoop class.
+@param io The console to read.
+*/
+EventLoop::EventLoop(Console &io) : io(io)
+{
+}
+
+/*!
+@brief Schedule a callback on the loop's thread.
+@param milliseconds How long from now the callback should run.
+@param callback The function to run.
+@return The timer's id.
+*/
+TimerQueue::TimerId EventLoop::after(int milliseconds, std::function<void()> callback)
+{
+    return timers.scheduleAfter(milliseconds, std::move(callback));
+}
+
+/*!
+@brief Cancel a timer.
+@param id The timer's id.
+@return True if the timer had not run yet.
+*/
+bool EventLoop::cancel(TimerQueue::TimerId id)
+{
+    return timers.cancel(id);
+}
+
+/*!
+@brief Add background work to run while no input is waiting.
+@param task Runs one slice of work and returns true while there is more to do.
+*/
+void EventLoop::whenIdle(std::function<bool()> task)
+{
+    idle.push_back(std::move(task));
+}
+
+/*!
+@brief Get the number of idle tasks that still have work to do.
+@return The number of tasks.
+*/
+size_t EventLoop::idleTasks() const
+{
+    return idle.size();
+}
+
+/*!
+@brief Wait for the next key, line or timeout.
+@param milliseconds The longest to wait, or -1 to wait indefinitely.
+@return The event.
+*/
+InputEvent EventLoop::next(int milliseconds)
+{
+    return nextBefore(milliseconds >= 0, TimerQueue::Clock::now() + std::chrono::milliseconds(milliseconds));
+}
+
+/*!
+@brief Wait for a whole line, skipping the keys that make it up.
+@param milliseconds The longest to wait for the line to be finished, or -1 to wait indefinitely.
+@return A Line, Timeout or Closed event.
+*/
+InputEvent EventLoop::nextLine(int milliseconds)
+{
+    TimerQueue::Clock::time_point deadline = TimerQueue::Clock::now() + std::chrono::milliseconds(milliseconds);
+    while (true)
+    {
+        InputEvent event = nextBefore(milliseconds >= 0, deadline);
+        if (event.type != InputEvent::Key)
+        {
+            return event;
+        }
+    }
+}
+
+/*!
+@brief Wait for the next key, line or timeout.
+@param limited Whether there is a deadline.
+@param deadline When to give up, if limited.
+@return The event.
+@details Input that has already arrived is reported even if the time has run out, so a line typed just before the
+deadline is not lost.
+*/
+InputEvent EventLoop::nextBefore(bool limited, TimerQueue::Clock::time_point deadline)
+{
+    while (true)
+    {
+        for (std::function<void()> &callback : timers.takeDue(TimerQueue::Clock::now()))
+        {
+            callback();
+        }
+
+        InputEvent event;
+        while (receivedAt < received.size())
+        {
+            if (takeCharacter(event))
+            {
+                event.at = receivedTime;
+                return event;
+            }
+        }
+        received.clear();
+        receivedAt = 0;
+
+        if (closed)
+        {
+            // A last line without a newline still counts as a line
+            event.type = line.empty() ? InputEvent::Closed : InputEvent::Line;
+            event.line.swap(line);
+            event.at = monotonicNanos();
+            return event;
+        }
+
+        TimerQueue::Clock::time_point now = TimerQueue::Clock::now();
+        int wait = -1;
+        if (limited)
+        {
+            if (now >= deadline)
+            {
+                event.type = InputEvent::Timeout;
+                event.at = monotonicNanos();
+                return event;
+            }
+            wait = (int)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now + std::chrono::nanoseconds(999999)).count();
+        }
+        int timer = timers.nextTimeout(now);
+        if (timer >= 0 && (wait < 0 || timer < wait))
+        {
+            wait = timer;
+        }
+
+        bool ready;
+        if (!idle.empty())
+        {
+            ready = io.waitForInput(0);
+            if (!ready)
+            {
+                runIdleSlice();
+                continue;
+            }
+        }
+        else
+        {
+            io.present();
+            ready = io.waitForInput(wait);
+        }
+
+        if (ready)
+        {
+            char buffer[256];
+            size_t count = io.readAvailable(buffer, sizeof(buffer));
+            receivedTime = monotonicNanos();
+            if (count == 0)
+            {
+                closed = true;
+            }
+            else
+            {
+                received.assign(buffer, count);
+            }
+        }
+    }
+}
+
+/*!
+@brief Throw away the unfinished line and anything typed ahead at the terminal.
+*/
+void EventLoop::discardInput()
+{
+    received.clear();
+    receivedAt = 0;
+    line.clear();
+    lastWasReturn = false;
+    io.discardInput();
+}
+
+/*!
+@brief Turn the next received character into an event.
+@param event Set to the event, if the character makes one.
+@return False if the character was consumed without an event.
+@details Lines may end in LF, CR or CR LF. Backspace and delete remove the last character of the line, which only
+matters in raw mode; in line mode the terminal has already applied them.
+*/
+bool EventLoop::takeCharacter(InputEvent &event)
+{
+    char c = received[receivedAt++];
+    if (c == '\n' && lastWasReturn)
+    {
+        lastWasReturn = false;
+        return false;
+    }
+    lastWasReturn = c == '\r';
+    if (c == '\r' || c == '\n')
+    {
+        event.type = InputEvent::Line;
+        event.line.swap(line);
+        line.clear();
+        return true;
+    }
+    if (c == '\b' || c == 127)
+    {
+        if (!line.empty())
+        {
+            line.pop_back();
+        }
+    }
+    else
+    {
+        line += c;
+    }
+    event.type = InputEvent::Key;
+    event.key = c;
+    return true;
+}
+
+/*!
+@brief Run one slice of the next idle task.
+@details Tasks take turns, and a task that reports it is finished is removed. The task is copied before it runs in
+case it adds another task.
+*/
+void EventLoop::runIdleSlice()
+{
+    if (nextIdle >= idle.size())
+    {
+        nextIdle = 0;
+    }
+    std::function<bool()> task = idle[nextIdle];
+    if (task())
+    {
+        nextIdle++;
+    }
+    else
+    {
+        idle.erase(idle.begin() + nextIdle);
+    }
+}
@@ -0,0 +1,458 @@
+/*!
+@file fiber.cpp
+@brief Implementation of the Fiber class.
+@details Each stack is an anonymous mapping with an inaccessible page below it, so an overflow faults instead of
+corrupting the next fiber, and the kernel only backs the pages a fiber has touched. Stacks are kept in a pool when their
+fiber is destroyed. Their pages below the top HotStackBytes are given back to the kernel, so a pooled stack costs little
+memory and the next fiber starts without any system calls.
+
+On x86-64 fibers switch with a few lines of assembly that save the callee-saved registers and the floating point
+control words on the stack being left, then load the other stack's. Unlike swapcontext it does not save the signal
+mask, which would take two system calls per switch; the game never changes it. Other architectures use makecontext and
+swapcontext.
+*/
+
+#ifdef __linux__
+
+#include "../lib/fiber.h"
+#include "../lib/console.h"
+#include <cstdint>
+#include <cstring>
+#include <cxxabi.h>
+#include <mutex>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#ifdef __x86_64__
+/*!
+@brief Switch stacks.
+@param from Where to save the stack pointer of the stack being left.
+@param to The saved stack pointer of the stack to carry on.
+@details Returns when something switches back to from.
+*/
+extern "C" void valeris_switch_fiber(void **from, void *to);
+
+asm(".text\n"
+    ".globl valeris_switch_fiber\n"
+    ".hidden valeris_switch_fiber\n"
+    ".type valeris_switch_fiber, @function\n"
+    "valeris_switch_fiber:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    subq $8, %rsp\n"
+    "    stmxcsr (%rsp)\n"
+    "    fnstcw 4(%rsp)\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    ldmxcsr (%rsp)\n"
+    "    fldcw 4(%rsp)\n"
+    "    addq $8, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size valeris_switch_fiber, .-valeris_switch_fiber\n");
+#endif
+
+namespace
+{
+    thread_local Fiber *running = nullptr; //!< The fiber running on this thread.
+    thread_local Fiber *starting = nullptr; //!< The fiber whose trampoline is about to run.
+
+    /*!
+    @struct ExceptionGlobals
+    @brief The per-thread exception handling state kept by the C++ runtime.
+    @details Both libstdc++ and libc++abi begin __cxa_eh_globals with these two fields. They are swapped on every
+    switch, so a fiber suspended inside a catch block does not hand its exception to whichever fiber runs next.
+    */
+    struct ExceptionGlobals
+    {
+        void *caughtExceptions;          //!< Exceptions being handled, innermost first.
+        unsigned int uncaughtExceptions; //!< Exceptions thrown and not yet caught.
+    };
+
+    /*!
+    @brief Get the calling thread's exception handling state.
+    @return The runtime's structure.
+    */
+    ExceptionGlobals *exceptionGlobals()
+    {
+        return reinterpret_cast<ExceptionGlobals *>(abi::__cxa_get_globals());
+    }
+
+    /*!
+    @struct StackPool
+    @brief Free fiber stacks, shared by every thread.
+    */
+    struct StackPool
+    {
+        std::mutex mutex;                                //!< Guards the fields below.
+        std::vector<std::pair<char *, size_t>> stacks;   //!< Free mappings and their sizes, most recently freed last.
+        size_t limit = Fiber::DefaultPooledStacks;       //!< The most stacks to keep.
+    };
+
+    /*!
+    @brief Get the stack pool.
+    @return The pool. It is never destroyed, so fibers destroyed during exit can still return their stacks.
+    */
+    StackPool &stackPool()
+    {
+        static StackPool *pool = new StackPool();
+        return *pool;
+    }
+
+    /*!
+    @brief Get the size of a page.
+    @return The size in bytes.
+    */
+    size_t pageBytes()
+    {
+        static const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        return page;
+    }
+
+    /*!
+    @brief Take a stack from the pool, or map a new one.
+    @param mappedBytes The size of the mapping, including the guard page.
+    @return The start of the mapping.
+    */
+    char *takeStack(size_t mappedBytes)
+    {
+        StackPool &pool = stackPool();
+        {
+            std::lock_guard<std::mutex> lock(pool.mutex);
+            for (size_t i = pool.stacks.size(); i-- > 0;)
+            {
+                if (pool.stacks[i].second == mappedBytes)
+                {
+                    char *stack = pool.stacks[i].first;
+                    pool.stacks.erase(pool.stacks.begin() + i);
+                    return stack;
+                }
+            }
+        }
+        void *mapping = mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+        if (mapping == MAP_FAILED)
+        {
+            throw std::runtime_error("Could not map a fiber stack.");
+        }
+        mprotect(mapping, pageBytes(), PROT_NONE);
+        return static_cast<char *>(mapping);
+    }
+
+    /*!
+    @brief Return a stack to the pool, or unmap it if the pool is full.
+    @param stack The start of the mapping.
+    @param mappedBytes The size of the mapping.
+    */
+    void giveStack(char *stack, size_t mappedBytes)
+    {
+        StackPool &pool = stackPool();
+        {
+            std::lock_guard<std::mutex> lock(pool.mutex);
+            if (pool.stacks.size() < pool.limit)
+            {
+                size_t usable = mappedBytes - pageBytes();
+                if (usable > Fiber::HotStackBytes)
+                {
+                    madvise(stack + pageBytes(), usable - Fiber::HotStackBytes, MADV_DONTNEED);
+                }
+                pool.stacks.emplace_back(stack, mappedBytes);
+                return;
+            }
+        }
+        munmap(stack, mappedBytes);
+    }
+}
+
+/*!
+@brief Constructor for the Fiber class.
+@param body The function to run.
+@param stackBytes The stack to reserve.
+*/
+Fiber::Fiber(std::function<void()> body, size_t stackBytes)
+    : body(std::move(body)), stack(nullptr), mappedBytes(0), started(false), done(false), timed(false),
+      console(nullptr), caughtExceptions(nullptr), uncaughtExceptions(0), outer(nullptr)
+{
+    size_t page = pageBytes();
+    size_t stackPages = (stackBytes + page - 1) / page;
+    mappedBytes = (stackPages + 1) * page;
+    stack = takeStack(mappedBytes);
+
+#ifdef __x86_64__
+    // Lay out the stack as valeris_switch_fiber leaves it, so the first switch returns into the trampoline as if it
+    // had been called from a function with a null return address, which also ends unwinding there
+    void **top = reinterpret_cast<void **>(stack + mappedBytes);
+    top[-1] = nullptr;
+    top[-2] = reinterpret_cast<void *>(&Fiber::trampoline);
+    for (int i = 3; i <= 8; i++)
+    {
+        top[-i] = nullptr;
+    }
+    unsigned int controlWords[2] = {0, 0};
+    asm volatile("stmxcsr %0" : "=m"(controlWords[0]));
+    asm volatile("fnstcw %0" : "=m"(controlWords[1]));
+    std::memcpy(&top[-9], controlWords, sizeof(void *));
+    context = &top[-9];
+#else
+    getcontext(&context);
+    context.uc_stack.ss_sp = stack + page;
+    context.uc_stack.ss_size = mappedBytes - page;
+    context.uc_link = nullptr;
+    makecontext(&context, &Fiber::trampoline, 0);
+#endif
+}
+
+/*!
+@brief Destructor for the Fiber class.
+*/
+Fiber::~Fiber()
+{
+    if (stack != nullptr)
+    {
+        giveStack(stack, mappedBytes);
+    }
+}
+
+/*!
+@brief Run the function on the fiber's stack.
+@details The fiber is passed through a thread_local, since makecontext can only pass int arguments portably. It never
+returns: once the fiber is done it switches out for the last time.
+*/
+void Fiber::trampoline()
+{
+    Fiber *self = starting;
+    starting = nullptr;
+    try
+    {
+        self->body();
+    }
+    catch (...)
+    {
+        self->failure = std::current_exception();
+    }
+    self->done = true;
+    self->switchOut();
+}
+
+/*!
+@brief Run the fiber until it suspends or finishes.
+@return True if it can be resumed again.
+*/
+bool Fiber::resume()
+{
+    if (done)
+    {
+        return false;
+    }
+    outer = running;
+    running = this;
+    timed = false;
+    if (!started)
+    {
+        started = true;
+        starting = this;
+    }
+    swapThreadState();
+#ifdef __x86_64__
+    valeris_switch_fiber(&caller, context);
+#else
+    swapcontext(&caller, &context);
+#endif
+    swapThreadState();
+    running = outer;
+    outer = nullptr;
+    if (done && failure)
+    {
+        std::exception_ptr escaped = failure;
+        failure = nullptr;
+        std::rethrow_exception(escaped);
+    }
+    return !done;
+}
+
+/*!
+@brief Exchange the thread's per-session state with the fiber's.
+@details Called on the resuming thread's side of every switch, before entering the fiber and again after it comes
+back, so the fiber's state is installed while it runs and the thread's own state is put back afterwards.
+*/
+void Fiber::swapThreadState()
+{
+    console = exchangeBoundConsole(console);
+    ExceptionGlobals *globals = exceptionGlobals();
+    std::swap(globals->caughtExceptions, caughtExceptions);
+    std::swap(globals->uncaughtExceptions, uncaughtExceptions);
+}
+
+/*!
+@brief Switch from the fiber back to the thread that resumed it.
+*/
+void Fiber::switchOut()
+{
+#ifdef __x86_64__
+    valeris_switch_fiber(&context, caller);
+#else
+    swapcontext(&context, &caller);
+#endif
+}
+
+/*!
+@brief Check whether the function has returned.
+@return True once it has.
+*/
+bool Fiber::finished() const
+{
+    return done;
+}
+
+/*!
+@brief Get when the fiber asked to be resumed.
+@param due Set to the time, if there was one.
+@return False if no time was given.
+*/
+bool Fiber::wakeTime(TimerQueue::Clock::time_point &due) const
+{
+    if (timed)
+    {
+        due = this->due;
+    }
+    return timed;
+}
+
+/*!
+@brief Get the fiber running on the calling thread.
+@return The fiber, or nullptr.
+*/
+Fiber *Fiber::current()
+{
+    return running;
+}
+
+/*!
+@brief Set what resumes the fiber when something other than time wakes it.
+@param waker The function.
+*/
+void Fiber::setWaker(std::function<void()> waker)
+{
+    this->waker = std::move(waker);
+}
+
+/*!
+@brief Get what resumes the running fiber.
+@return The function, or an empty one.
+*/
+std::function<void()> Fiber::currentWaker()
+{
+    return running != nullptr ? running->waker : std::function<void()>();
+}
+
+/*!
+@brief Suspend the running fiber until it is resumed.
+*/
+void Fiber::suspend()
+{
+    Fiber *self = running;
+    if (self == nullptr)
+    {
+        return;
+    }
+    self->timed = false;
+    self->switchOut();
+}
+
+/*!
+@brief Suspend the running fiber, asking to be resumed at a time.
+@param due When to resume it.
+*/
+void Fiber::suspendUntil(TimerQueue::Clock::time_point due)
+{
+    Fiber *self = running;
+    if (self == nullptr)
+    {
+        return;
+    }
+    self->timed = true;
+    self->due = due;
+    self->switchOut();
+}
+
+/*!
+@brief Suspend the running fiber until a time has passed.
+@param due When to carry on.
+*/
+void Fiber::sleepUntil(TimerQueue::Clock::time_point due)
+{
+    while (TimerQueue::Clock::now() < due)
+    {
+        suspendUntil(due);
+    }
+}
+
+/*!
+@brief Set how many free stacks are kept for reuse.
+@param stacks The most to keep.
+*/
+void Fiber::setPooledStackLimit(size_t stacks)
+{
+    std::vector<std::pair<char *, size_t>> extra;
+    {
+        StackPool &pool = stackPool();
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.limit = stacks;
+        if (pool.stacks.size() > stacks)
+        {
+            extra.assign(pool.stacks.begin(), pool.stacks.end() - stacks);
+            pool.stacks.erase(pool.stacks.begin(), pool.stacks.end() - stacks);
+        }
+    }
+    for (const std::pair<char *, size_t> &mapping : extra)
+    {
+        munmap(mapping.first, mapping.second);
+    }
+}
+
+/*!
+@brief Get how many free stacks are waiting to be reused.
+@return The number of stacks in the pool.
+*/
+size_t Fiber::pooledStacks()
+{
+    StackPool &pool = stackPool();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    return pool.stacks.size();
+}
+
+/*!
+@brief Give back the running fiber's stack pages below the caller's frame.
+@return The number of bytes given back.
+@details A page below the caller's stack pointer is kept, since the call to madvise itself needs some stack.
+*/
+size_t Fiber::trimStack()
+{
+    Fiber *fiber = current();
+    if (fiber == nullptr)
+    {
+        return 0;
+    }
+    char here;
+    char *lowest = fiber->stack + pageBytes();
+    char *keep = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(&here) & ~(uintptr_t)(pageBytes() - 1)) - pageBytes());
+    if (keep <= lowest)
+    {
+        return 0;
+    }
+    size_t bytes = (size_t)(keep - lowest);
+    return madvise(lowest, bytes, MADV_DONTNEED) == 0 ? bytes : 0;
+}
+
+#endif // __linux__
@@ -0,0 +1,614 @@
+/*!
+@file flooranalytics.cpp
+@brief Implementation of the FloorAnalytics class.
+@details This file contains the implementation of the FloorAnalytics class. Cheap statistics are maintained on every
+room and link, while the diameter and articulation points fall back to a full recompute only after a link closes a loop,
+and the diameter also when a new room lengthens it from anywhere but one of its endpoints.
+*/
+
+#include "../lib/flooranalytics.h"
+#include <algorithm>
+#include <cstdint>
+#include <queue>
+#include <thread>
+
+/*!
+@brief Constructor for the FloorAnalytics class.
+@param exactDiameterLimit Largest floor, in rooms, whose diameter is recomputed exactly.
+*/
+FloorAnalytics::FloorAnalytics(int exactDiameterLimit)
+    : links(0),
+      deadEnds(0),
+      articulationCount(0),
+      diameter(0),
+      diameterExact(true),
+      endA(-1),
+      endB(-1),
+      diameterDirty(false),
+      articulationDirty(false),
+      exactDiameterLimit(exactDiameterLimit) {}
+
+/*!
+@brief Record a newly generated room.
+@param id The id of the room.
+@details A new room starts without doors. The first room of a floor is the trivial diameter endpoint.
+*/
+void FloorAnalytics::onRoomAdded(int id)
+{
+    if (id < 0)
+    {
+        return;
+    }
+    if (id >= (int)neighbours.size())
+    {
+        neighbours.resize(id + 1, {-1, -1, -1, -1});
+        degree.resize(id + 1, 0);
+        articulation.resize(id + 1, false);
+        distA.resize(id + 1, -1);
+        distB.resize(id + 1, -1);
+    }
+    if (neighbours.size() == 1)
+    {
+        endA = endB = id;
+        distA[id] = distB[id] = 0;
+    }
+}
+
+/*!
+@brief Record a link between two rooms.
+@param from The id of the first room.
+@param to The id of the second room.
+@param direction The direction from the first room to the second.
+@details Relinking a door that already leads somewhere else removes the old link first. Hanging a doorless room off
+the floor is handled incrementally; any other link may close a loop and marks the expensive statistics for recompute.
+*/
+void FloorAnalytics::onLink(int from, int to, int direction)
+{
+    static const int opposite[] = {1, 0, 3, 2};
+    if (from < 0 || to < 0 || from == to || direction < 0 || direction > 3 ||
+        from >= (int)neighbours.size() || to >= (int)neighbours.size())
+    {
+        return;
+    }
+    int back = opposite[direction];
+    if (neighbours[from][direction] == to && neighbours[to][back] == from)
+    {
+        return;
+    }
+
+    bool removed = false;
+    int oldFrom = neighbours[from][direction];
+    if (oldFrom != -1)
+    {
+        if (neighbours[oldFrom][back] == from)
+        {
+            neighbours[oldFrom][back] = -1;
+            adjustDegree(oldFrom, -1);
+        }
+        adjustDegree(from, -1);
+        links--;
+        removed = true;
+    }
+    int oldTo = neighbours[to][back];
+    if (oldTo != -1)
+    {
+        if (neighbours[oldTo][direction] == to)
+        {
+            neighbours[oldTo][direction] = -1;
+            adjustDegree(oldTo, -1);
+        }
+        adjustDegree(to, -1);
+        links--;
+        removed = true;
+    }
+
+    int fromDegree = degree[from];
+    int toDegree = degree[to];
+    neighbours[from][direction] = to;
+    neighbours[to][back] = from;
+    adjustDegree(from, 1);
+    adjustDegree(to, 1);
+    links++;
+
+    if (removed)
+    {
+        diameterDirty = articulationDirty = true;
+    }
+    else if (links == 1)
+    {
+        // The first door of the floor: the two rooms are the diameter
+        std::fill(distA.begin(), distA.end(), -1);
+        std::fill(distB.begin(), distB.end(), -1);
+        endA = from;
+        endB = to;
+        distA[from] = 0;
+        distA[to] = 1;
+        distB[from] = 1;
+        distB[to] = 0;
+        diameter = 1;
+        diameterExact = true;
+    }
+    else if (toDegree == 0 && fromDegree > 0)
+    {
+        attachLeaf(from, to);
+    }
+    else if (fromDegree == 0 && toDegree > 0)
+    {
+        attachLeaf(to, from);
+    }
+    else
+    {
+        diameterDirty = articulationDirty = true;
+    }
+}
+
+/*!
+@brief Update the degree of a room and the dead-end count.
+@param id The room.
+@param change +1 for a new door, -1 for a removed one.
+*/
+void FloorAnalytics::adjustDegree(int id, int change)
+{
+    if (degree[id] == 1)
+    {
+        deadEnds--;
+    }
+    degree[id] += change;
+    if (degree[id] == 1)
+    {
+        deadEnds++;
+    }
+}
+
+/*!
+@brief Update the expensive statistics after a new room was hung off an existing one.
+@param parent The existing room.
+@param leaf The new room, which now has a single door.
+@details A new dead end turns its parent into an articulation point, including a parent that was itself a dead end
+before, since that room's only door now leads on to the leaf. On a tree the new diameter is the larger of the old one
+and the leaf's distance to either old endpoint. When the leaf lengthens it, the leaf hangs off a room as far from one
+endpoint as the other endpoint is; if that room is the other endpoint, the leaf replaces it and its distances are the
+parent's plus one, and otherwise the diameter is recomputed on the next query.
+*/
+void FloorAnalytics::attachLeaf(int parent, int leaf)
+{
+    if (!articulationDirty && degree[parent] >= 2 && !articulation[parent])
+    {
+        articulation[parent] = true;
+        articulationCount++;
+    }
+
+    if (diameterDirty || distA[parent] < 0 || distB[parent] < 0)
+    {
+        diameterDirty = true;
+        return;
+    }
+
+    distA[leaf] = distA[parent] + 1;
+    distB[leaf] = distB[parent] + 1;
+    if (distA[leaf] <= diameter && distB[leaf] <= diameter)
+    {
+        return;
+    }
+    diameter++;
+    if (parent != endA && parent != endB)
+    {
+        diameterDirty = true;
+        return;
+    }
+    std::vector<int> &fromParent = parent == endA ? distA : distB;
+    for (int &distance : fromParent)
+    {
+        if (distance >= 0)
+        {
+            distance++;
+        }
+    }
+    fromParent[leaf] = 0;
+    if (parent == endA)
+    {
+        endA = leaf;
+    }
+    else
+    {
+        endB = leaf;
+    }
+}
+
+/*!
+@brief Get the floor statistics.
+@return The statistics, with anything invalidated by a loop recomputed first.
+*/
+FloorStats FloorAnalytics::getStats()
+{
+    if (articulationDirty)
+    {
+        recomputeArticulation();
+    }
+    if (diameterDirty)
+    {
+        recomputeDiameter();
+    }
+
+    FloorStats stats;
+    stats.roomCount = (int)neighbours.size();
+    stats.linkCount = links;
+    stats.diameter = diameter;
+    stats.diameterExact = diameterExact;
+    stats.deadEnds = deadEnds;
+    stats.averageDegree = stats.roomCount == 0 ? 0.0 : 2.0 * links / stats.roomCount;
+    stats.articulationPoints = articulationCount;
+    return stats;
+}
+
+/*!
+@brief Force a full recompute of the diameter and articulation points.
+*/
+void FloorAnalytics::recompute()
+{
+    recomputeArticulation();
+    recomputeDiameter();
+}
+
+/*!
+@brief Check whether a query will trigger a recompute.
+@return True if the diameter or articulation points are stale.
+*/
+bool FloorAnalytics::needsRecompute() const
+{
+    return diameterDirty || articulationDirty;
+}
+
+/*!
+@brief Recompute the articulation points.
+@details An iterative version of Tarjan's low-link algorithm, so very deep floors cannot overflow the call stack.
+*/
+void FloorAnalytics::recomputeArticulation()
+{
+    int n = (int)neighbours.size();
+    std::vector<int> discovered(n, -1);
+    std::vector<int> low(n, 0);
+    std::vector<int> parent(n, -1);
+    std::vector<int> nextEdge(n, 0);
+    std::vector<int> stack;
+    articulation.assign(n, false);
+    articulationCount = 0;
+    int time = 0;
+
+    for (int root = 0; root < n; root++)
+    {
+        if (discovered[root] != -1)
+        {
+            continue;
+        }
+        int rootChildren = 0;
+        discovered[root] = low[root] = time++;
+        stack.push_back(root);
+
+        while (!stack.empty())
+        {
+            int v = stack.back();
+            if (nextEdge[v] < 4)
+            {
+                int u = neighbours[v][nextEdge[v]++];
+                if (u == -1)
+                {
+                    continue;
+                }
+                if (discovered[u] == -1)
+                {
+                    parent[u] = v;
+                    discovered[u] = low[u] = time++;
+                    stack.push_back(u);
+                    if (v == root)
+                    {
+                        rootChildren++;
+                    }
+                }
+                else if (u != parent[v])
+                {
+                    low[v] = std::min(low[v], discovered[u]);
+                }
+                continue;
+            }
+
+            stack.pop_back();
+            int p = parent[v];
+            if (p != -1)
+            {
+                low[p] = std::min(low[p], low[v]);
+                if (p != root && low[v] >= discovered[p] && !articulation[p])
+                {
+                    articulation[p] = true;
+                    articulationCount++;
+                }
+            }
+        }
+
+        if (rootChildren > 1)
+        {
+            articulation[root] = true;
+            articulationCount++;
+        }
+    }
+    articulationDirty = false;
+}
+
+/*!
+@brief Recompute the diameter.
+@details Floors up to the exact limit run a bit-parallel BFS from every room. Larger floors run iFUB on each connected
+part, sharing a budget of BFS sources, and report a lower bound only if that budget runs out. If the floor is a tree,
+the double sweep endpoints are kept so that later leaf additions stay incremental.
+*/
+void FloorAnalytics::recomputeDiameter()
+{
+    int n = (int)neighbours.size();
+    diameterDirty = false;
+    if (n == 0)
+    {
+        diameter = 0;
+        diameterExact = true;
+        return;
+    }
+
+    std::vector<int> dist;
+    int start = 0;
+    while (start < n && degree[start] == 0 && n > 1)
+    {
+        start++;
+    }
+    if (start == n)
+    {
+        start = 0;
+    }
+    endA = bfs(start, dist);
+    endB = bfs(endA, distA);
+    bfs(endB, distB);
+    int sweep = distA[endB];
+
+    bool tree = true;
+    int linked = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (distA[i] >= 0)
+        {
+            linked++;
+        }
+    }
+    tree = links == linked - 1;
+
+    if (tree)
+    {
+        diameter = sweep;
+        diameterExact = true;
+        return;
+    }
+
+    diameterExact = true;
+    if (n <= exactDiameterLimit)
+    {
+        std::vector<int> sources;
+        for (int i = 0; i < n; i++)
+        {
+            sources.push_back(i);
+        }
+        diameter = std::max(sweep, multiSourceEccentricity(sources));
+    }
+    else
+    {
+        int budget = 256 * std::max(1, (int)std::thread::hardware_concurrency());
+        std::vector<bool> reached(n, false);
+        diameter = 0;
+        for (int i = 0; i < n; i++)
+        {
+            if (!reached[i] && degree[i] > 0)
+            {
+                diameter = std::max(diameter, componentDiameter(i, reached, budget, diameterExact));
+            }
+        }
+    }
+
+    // Loops break the tree update rule, so every later link waits for a recompute
+    distA.assign(n, -1);
+    distB.assign(n, -1);
+}
+
+/*!
+@brief Find the diameter of one connected part of the floor.
+@param start A room in that part.
+@param reached Marks the rooms of that part.
+@param budget The BFS sources left, reduced by those used here.
+@param exact Cleared if the budget runs out first.
+@return The diameter, or a lower bound if the budget ran out.
+@details A double sweep gives a lower bound and a room halfway along its path, whose eccentricity e bounds the
+diameter by 2e. Rooms at distance e from that centre are then taken level by level, several levels at a time so the
+bit-parallel BFS runs full batches: once every room at level k or beyond has its eccentricity, any longer path would
+join two rooms within k - 1 of the centre, so the diameter is at most 2(k - 1). Most floors settle after a batch or two.
+*/
+int FloorAnalytics::componentDiameter(int start, std::vector<bool> &reached, int &budget, bool &exact) const
+{
+    std::vector<int> fromA, fromB, fromCentre;
+    int a = bfs(start, fromA);
+    int b = bfs(a, fromA);
+    bfs(b, fromB);
+    int lower = fromA[b];
+
+    int centre = a;
+    for (int i = 0; i < (int)neighbours.size(); i++)
+    {
+        if (fromA[i] == lower / 2 && fromB[i] == lower - lower / 2)
+        {
+            centre = i;
+            break;
+        }
+    }
+    bfs(centre, fromCentre);
+
+    std::vector<std::vector<int>> levels;
+    for (int i = 0; i < (int)fromCentre.size(); i++)
+    {
+        if (fromCentre[i] < 0)
+        {
+            continue;
+        }
+        reached[i] = true;
+        if (fromCentre[i] >= (int)levels.size())
+        {
+            levels.resize(fromCentre[i] + 1);
+        }
+        levels[fromCentre[i]].push_back(i);
+    }
+    int eccentricity = (int)levels.size() - 1;
+    lower = std::max(lower, eccentricity);
+    int upper = 2 * eccentricity;
+
+    int batch = 64 * std::max(1, (int)std::thread::hardware_concurrency());
+    int level = eccentricity;
+    std::vector<int> sources;
+    while (lower < upper)
+    {
+        if (budget <= 0)
+        {
+            exact = false;
+            break;
+        }
+        sources.clear();
+        while (level > 0 && (int)sources.size() < std::min(batch, budget))
+        {
+            sources.insert(sources.end(), levels[level].begin(), levels[level].end());
+            level--;
+        }
+        budget -= (int)sources.size();
+        lower = std::max(lower, multiSourceEccentricity(sources));
+        upper = std::min(upper, 2 * level);
+    }
+    return lower;
+}
+
+/*!
+@brief Breadth-first search from a single room.
+@param source The room to start from.
+@param dist Receives the distance of every room from the source, -1 if unreachable.
+@return A room at the largest distance from the source.
+*/
+int FloorAnalytics::bfs(int source, std::vector<int> &dist) const
+{
+    dist.assign(neighbours.size(), -1);
+    std::queue<int> q;
+    q.push(source);
+    dist[source] = 0;
+    int farthest = source;
+
+    while (!q.empty())
+    {
+        int v = q.front();
+        q.pop();
+        if (dist[v] > dist[farthest])
+        {
+            farthest = v;
+        }
+        for (int u : neighbours[v])
+        {
+            if (u != -1 && dist[u] == -1)
+            {
+                dist[u] = dist[v] + 1;
+                q.push(u);
+            }
+        }
+    }
+    return farthest;
+}
+
+/*!
+@brief Bit-parallel breadth-first search from many sources.
+@param sources The rooms to start from.
+@return The largest eccentricity of any source.
+@details Sources are processed in batches of 64, one bit per source in a 64-bit word per room, so a single pass over
+the frontier advances 64 searches at once. Batches are shared out between hardware threads.
+*/
+int FloorAnalytics::multiSourceEccentricity(const std::vector<int> &sources) const
+{
+    int n = (int)neighbours.size();
+    int batches = ((int)sources.size() + 63) / 64;
+    int threadCount = std::max(1, std::min(batches, (int)std::thread::hardware_concurrency()));
+    std::vector<int> results(threadCount, 0);
+
+    auto worker = [&](int t)
+    {
+        std::vector<uint64_t> seen(n), visit(n), visitNext(n);
+        std::vector<int> frontier, nextFrontier;
+        for (int batch = t; batch < batches; batch += threadCount)
+        {
+            std::fill(seen.begin(), seen.end(), 0);
+            std::fill(visit.begin(), visit.end(), 0);
+            frontier.clear();
+
+            int first = batch * 64;
+            int last = std::min((int)sources.size(), first + 64);
+            for (int i = first; i < last; i++)
+            {
+                int s = sources[i];
+                if (visit[s] == 0)
+                {
+                    frontier.push_back(s);
+                }
+                seen[s] |= 1ULL << (i - first);
+                visit[s] |= 1ULL << (i - first);
+            }
+
+            int level = 0;
+            while (true)
+            {
+                nextFrontier.clear();
+                for (int v : frontier)
+                {
+                    for (int u : neighbours[v])
+                    {
+                        if (u == -1)
+                        {
+                            continue;
+                        }
+                        uint64_t reached = visit[v] & ~seen[u];
+                        if (reached)
+                        {
+                            if (visitNext[u] == 0)
+                            {
+                                nextFrontier.push_back(u);
+                            }
+                            visitNext[u] |= reached;
+                            seen[u] |= reached;
+                        }
+                    }
+                }
+                for (int v : frontier)
+                {
+                    visit[v] = 0;
+                }
+                if (nextFrontier.empty())
+                {
+                    break;
+                }
+                level++;
+                for (int u : nextFrontier)
+                {
+                    visit[u] = visitNext[u];
+                    visitNext[u] = 0;
+                }
+                frontier.swap(nextFrontier);
+            }
+            results[t] = std::max(results[t], level);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 1; t < threadCount; t++)
+    {
+        threads.emplace_back(worker, t);
+    }
+    worker(0);
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    return *std::max_element(results.begin(), results.end());
+}
@@ -0,0 +1,337 @@
+/*!
+@file floorexport.cpp
+@brief Implementation of the floor exporter.
+@details This file contains the BufferedWriter class and the DOT and JSON floor exporters. Rooms are visited one at a
+time and written straight into the writer's buffer, so exporting a floor never builds its text in memory.
+*/
+
+#include "../lib/floorexport.h"
+#include <charconv>
+#include <cstring>
+
+/*!
+@brief Constructor for the BufferedWriter class.
+@param file The file to write to.
+@param capacity The buffer size in bytes.
+*/
+BufferedWriter::BufferedWriter(std::FILE *file, size_t capacity)
+    : file(file), buffer(capacity < 64 ? 64 : capacity), used(0), total(0), ok(file != nullptr) {}
+
+/*!
+@brief Destructor for the BufferedWriter class.
+*/
+BufferedWriter::~BufferedWriter()
+{
+    flush();
+}
+
+/*!
+@brief Write raw bytes, flushing whenever the buffer fills.
+@param data The bytes to write.
+@param size The number of bytes.
+@details Writes larger than the buffer go straight to the file once the buffer is drained.
+*/
+void BufferedWriter::write(const char *data, size_t size)
+{
+    total += size;
+    if (used + size > buffer.size())
+    {
+        flush();
+        if (size >= buffer.size())
+        {
+            ok = ok && std::fwrite(data, 1, size, file) == size;
+            return;
+        }
+    }
+    std::memcpy(buffer.data() + used, data, size);
+    used += size;
+}
+
+/*!
+@brief Write a string.
+@param text The string to write.
+*/
+void BufferedWriter::write(const std::string &text)
+{
+    write(text.data(), text.size());
+}
+
+/*!
+@brief Write a null-terminated string.
+@param text The string to write.
+*/
+void BufferedWriter::write(const char *text)
+{
+    write(text, std::strlen(text));
+}
+
+/*!
+@brief Write a single character.
+@param c The character to write.
+*/
+void BufferedWriter::put(char c)
+{
+    if (used == buffer.size())
+    {
+        flush();
+    }
+    buffer[used++] = c;
+    total++;
+}
+
+/*!
+@brief Write an integer in decimal.
+@param value The integer to write.
+*/
+void BufferedWriter::writeInt(long long value)
+{
+    char digits[24];
+    std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), value);
+    write(digits, result.ptr - digits);
+}
+
+/*!
+@brief Write text with quotes, backslashes and control characters escaped.
+@param text The text to write.
+@param length The number of characters to write.
+@details The escapes used are valid in both JSON strings and DOT quoted strings.
+*/
+void BufferedWriter::writeEscaped(const char *text, size_t length)
+{
+    size_t start = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        unsigned char c = (unsigned char)text[i];
+        if (c != '"' && c != '\\' && c >= 0x20)
+        {
+            continue;
+        }
+        write(text + start, i - start);
+        start = i + 1;
+        if (c == '"' || c == '\\')
+        {
+            put('\\');
+            put((char)c);
+        }
+        else if (c == '\n')
+        {
+            write("\\n", 2);
+        }
+        // Other control characters are dropped
+    }
+    write(text + start, length - start);
+}
+
+/*!
+@brief Hand the buffered bytes to the file.
+@return True if all writes have succeeded.
+*/
+bool BufferedWriter::flush()
+{
+    if (used > 0 && file)
+    {
+        ok = ok && std::fwrite(buffer.data(), 1, used, file) == used;
+    }
+    used = 0;
+    return ok;
+}
+
+/*!
+@brief Get the total number of bytes written.
+@return The byte count.
+*/
+size_t BufferedWriter::bytesWritten() const
+{
+    return total;
+}
+
+/*!
+@brief Get a printable name for a room type.
+@param roomType The room type returned by RoomContent::getRoomType.
+@return The name of the room type.
+*/
+static const char *roomTypeName(int roomType)
+{
+    switch (roomType)
+    {
+    case 0:
+        return "enemy";
+    case 1:
+        return "gambling";
+    case 2:
+        return "locked";
+    default:
+        return "unknown";
+    }
+}
+
+/*!
+@brief Write the name part of an item string.
+@param writer The writer.
+@param item An item string of the form name:rarity:score:type.
+*/
+static void writeItemName(BufferedWriter &writer, const std::string &item)
+{
+    size_t end = item.find(':');
+    writer.writeEscaped(item.data(), end == std::string::npos ? item.size() : end);
+}
+
+/*!
+@brief Export a floor as a Graphviz DOT graph.
+@param dungeon The floor to export.
+@param writer The destination writer.
+@details Only the north and east doors of each room are written so every door appears exactly once. Node positions
+use Graphviz's pinned pos attribute so neato renders the floor in its grid layout.
+*/
+void exportFloorDot(Dungeon &dungeon, BufferedWriter &writer)
+{
+    writer.write("graph floor {\n  node [shape=box];\n");
+    for (Room *room : dungeon.getRooms())
+    {
+        RoomContent &content = room->roomContent;
+        std::pair<int, int> cords = content.getCoordinates();
+
+        writer.write("  r", 3);
+        writer.writeInt(room->id);
+        writer.write(" [pos=\"", 7);
+        writer.writeInt(cords.first);
+        writer.put(',');
+        writer.writeInt(cords.second);
+        writer.write("!\" label=\"", 10);
+        writer.writeInt(room->id);
+        writer.write(" (", 2);
+        writer.writeInt(cords.first);
+        writer.put(',');
+        writer.writeInt(cords.second);
+        writer.write(")\\n", 3);
+        writer.write(roomTypeName(content.getRoomType()));
+        content.forEachEnemy([&writer](const EnemyStruct &enemy)
+                             {
+                                 writer.write("\\n", 2);
+                                 writer.writeEscaped(enemy.name.data(), enemy.name.size()); });
+        content.forEachItem([&writer](const std::string &item)
+                            {
+                                writer.write("\\n+", 3);
+                                writeItemName(writer, item); });
+        writer.write(content.getVisited() ? "\" style=filled];\n" : "\"];\n");
+
+        if (room->north)
+        {
+            writer.write("  r", 3);
+            writer.writeInt(room->id);
+            writer.write(" -- r", 5);
+            writer.writeInt(room->north->id);
+            writer.write(";\n", 2);
+        }
+        if (room->east)
+        {
+            writer.write("  r", 3);
+            writer.writeInt(room->id);
+            writer.write(" -- r", 5);
+            writer.writeInt(room->east->id);
+            writer.write(";\n", 2);
+        }
+    }
+    writer.write("}\n", 2);
+}
+
+/*!
+@brief Export a floor as newline-delimited JSON.
+@param dungeon The floor to export.
+@param writer The destination writer.
+*/
+void exportFloorJson(Dungeon &dungeon, BufferedWriter &writer)
+{
+    const char *directionNames[] = {"north", "south", "west", "east"};
+    for (Room *room : dungeon.getRooms())
+    {
+        RoomContent &content = room->roomContent;
+        std::pair<int, int> cords = content.getCoordinates();
+
+        writer.write("{\"id\":", 6);
+        writer.writeInt(room->id);
+        writer.write(",\"x\":", 5);
+        writer.writeInt(cords.first);
+        writer.write(",\"y\":", 5);
+        writer.writeInt(cords.second);
+        writer.write(",\"type\":\"", 9);
+        writer.write(roomTypeName(content.getRoomType()));
+        writer.write(content.getVisited() ? "\",\"visited\":true" : "\",\"visited\":false");
+
+        writer.write(",\"enemies\":[", 12);
+        bool first = true;
+        content.forEachEnemy([&writer, &first](const EnemyStruct &enemy)
+                             {
+                                 writer.write(first ? "{\"name\":\"" : ",{\"name\":\"");
+                                 writer.writeEscaped(enemy.name.data(), enemy.name.size());
+                                 writer.write("\",\"health\":", 11);
+                                 writer.writeInt(enemy.health);
+                                 writer.write(",\"attack\":", 10);
+                                 writer.writeInt(enemy.attack);
+                                 writer.put('}');
+                                 first = false; });
+
+        writer.write("],\"items\":[", 11);
+        first = true;
+        content.forEachItem([&writer, &first](const std::string &item)
+                            {
+                                writer.write(first ? "\"" : ",\"");
+                                writeItemName(writer, item);
+                                writer.put('"');
+                                first = false; });
+
+        writer.write("],\"links\":{", 11);
+        Room *links[] = {room->north, room->south, room->west, room->east};
+        first = true;
+        for (int d = 0; d < 4; d++)
+        {
+            if (!links[d])
+            {
+                continue;
+            }
+            writer.write(first ? "\"" : ",\"");
+            writer.write(directionNames[d]);
+            writer.write("\":", 2);
+            writer.writeInt(links[d]->id);
+            first = false;
+        }
+        writer.write("}}\n", 3);
+    }
+}
+
+/*!
+@brief Export a floor to a file in the given format.
+@param dungeon The floor to export.
+@param fileName The file to create or overwrite.
+@param format "dot" for Graphviz or "json" for newline-delimited JSON.
+@return True if the file was written completely.
+@details The file is opened unbuffered because BufferedWriter already batches the output.
+*/
+bool exportFloor(Dungeon &dungeon, const std::string &fileName, const std::string &format)
+{
+    if (format != "dot" && format != "json")
+    {
+        return false;
+    }
+    std::FILE *file = std::fopen(fileName.c_str(), "wb");
+    if (!file)
+    {
+        return false;
+    }
+    std::setvbuf(file, nullptr, _IONBF, 0);
+
+    bool ok;
+    {
+        BufferedWriter writer(file);
+        if (format == "dot")
+        {
+            exportFloorDot(dungeon, writer);
+        }
+        else
+        {
+            exportFloorJson(dungeon, writer);
+        }
+        ok = writer.flush();
+    }
+    return std::fclose(file) == 0 && ok;
+}
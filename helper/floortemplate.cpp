@@ -0,0 +1,355 @@
+/*!
+@file floortemplate.cpp
+@brief Implementation of the FloorTemplate and FloorOverlay classes.
+@details The registry holds weak pointers, so a template is freed with the last game on it and a later event on the
+same seed generates it again.
+*/
+
+#include "../lib/floortemplate.h"
+#include <mutex>
+#include <utility>
+
+namespace
+{
+    std::mutex eventMutex;      //!< Guards the event's seed.
+    bool eventRunning = false;  //!< Whether new games share a floor.
+    unsigned int eventSeed = 0; //!< The shared floor's seed.
+
+    /*!
+    @brief Estimate the memory used by a room.
+    @param room The room.
+    @return The approximate number of bytes held by the room, its description, items and enemies.
+    */
+    size_t roomFootprint(Room *room)
+    {
+        size_t bytes = sizeof(Room) + room->roomContent.getRoomDesc().capacity();
+        for (const std::string &item : room->roomContent.getItems())
+        {
+            bytes += sizeof(std::string) + item.capacity();
+        }
+        return bytes + room->roomContent.getEnemies().size() * sizeof(EnemyStruct);
+    }
+}
+
+/*!
+@brief Constructor for the FloorTemplate class.
+@param seed The seed to generate the floor from.
+@param numRooms The number of rooms to generate.
+*/
+FloorTemplate::FloorTemplate(unsigned int seed, int numRooms) : dungeon(new Dungeon(seed)), numRooms(numRooms)
+{
+    dungeon->generateFloor(numRooms);
+}
+
+/*!
+@brief Get the template for a seed, generating it if no game holds it yet.
+@param seed The seed.
+@param numRooms The number of rooms.
+@return The shared template.
+@details The floor is generated under the registry's lock, so games starting together wait for one generation rather
+than each running their own. The registry is never destroyed, so games may still be ending while the program exits.
+*/
+std::shared_ptr<const FloorTemplate> FloorTemplate::shared(unsigned int seed, int numRooms)
+{
+    static std::mutex *registryMutex = new std::mutex();
+    static auto *registry = new std::map<std::pair<unsigned int, int>, std::weak_ptr<const FloorTemplate>>();
+
+    std::lock_guard<std::mutex> lock(*registryMutex);
+    for (auto it = registry->begin(); it != registry->end();)
+    {
+        it = it->second.expired() ? registry->erase(it) : std::next(it);
+    }
+    std::weak_ptr<const FloorTemplate> &entry = (*registry)[{seed, numRooms}];
+    std::shared_ptr<const FloorTemplate> floor = entry.lock();
+    if (!floor)
+    {
+        floor = std::make_shared<const FloorTemplate>(seed, numRooms);
+        entry = floor;
+    }
+    return floor;
+}
+
+/*!
+@brief Get a room by its id.
+@param id The room's id.
+@return The room, or nullptr.
+*/
+const Room *FloorTemplate::getRoom(int id) const
+{
+    return dungeon->getRoom(id);
+}
+
+/*!
+@brief Get a room to change in place.
+@param id The room's id.
+@return The room, or nullptr.
+*/
+Room *FloorTemplate::editRoom(int id)
+{
+    return dungeon->getRoom(id);
+}
+
+/*!
+@brief Get the room every player starts in.
+@return The starting room.
+*/
+const Room *FloorTemplate::getStartRoom() const
+{
+    return dungeon->getStartRoom();
+}
+
+/*!
+@brief Get the seed the floor was generated from.
+@return The seed.
+*/
+unsigned int FloorTemplate::getSeed() const
+{
+    return dungeon->getSeed();
+}
+
+/*!
+@brief Get the number of rooms the floor was asked for.
+@return The number of rooms.
+*/
+int FloorTemplate::getNumRooms() const
+{
+    return numRooms;
+}
+
+/*!
+@brief Get the generated floor.
+@return The floor.
+*/
+const Dungeon &FloorTemplate::getDungeon() const
+{
+    return *dungeon;
+}
+
+/*!
+@brief Estimate the memory used by the floor.
+@return The approximate number of bytes.
+*/
+size_t FloorTemplate::memoryFootprint() const
+{
+    return sizeof(FloorTemplate) + dungeon->memoryFootprint();
+}
+
+/*!
+@brief Constructor for the FloorOverlay class.
+@param floor The template.
+@details The fog of war starts as a copy of the template's, which has never had a viewpoint.
+*/
+FloorOverlay::FloorOverlay(std::shared_ptr<const FloorTemplate> floor)
+    : floor(std::move(floor)), fog(this->floor->getDungeon().getFog())
+{
+    visited.resize(this->floor->getDungeon().getRooms().size());
+}
+
+/*!
+@brief Constructor for the FloorOverlay class, for a floor the player may change.
+@param floor The template.
+@param writeThrough Whether changes go to the template's rooms.
+*/
+FloorOverlay::FloorOverlay(std::shared_ptr<FloorTemplate> floor, bool writeThrough)
+    : FloorOverlay(std::shared_ptr<const FloorTemplate>(floor))
+{
+    if (writeThrough)
+    {
+        target = std::move(floor);
+    }
+}
+
+/*!
+@brief Get the template.
+@return The template.
+*/
+const FloorTemplate &FloorOverlay::getTemplate() const
+{
+    return *floor;
+}
+
+/*!
+@brief Get a room as the player sees it.
+@param id The room's id.
+@return The player's copy, the template's room, or nullptr.
+*/
+const Room *FloorOverlay::getRoom(int id) const
+{
+    auto it = changed.find(id);
+    return it != changed.end() ? it->second.get() : floor->getRoom(id);
+}
+
+/*!
+@brief Get a room the player is about to change, copying it on first use.
+@param id The room's id.
+@return The player's copy, or nullptr.
+*/
+Room *FloorOverlay::edit(int id)
+{
+    if (target)
+    {
+        return target->editRoom(id);
+    }
+    auto it = changed.find(id);
+    if (it != changed.end())
+    {
+        return it->second.get();
+    }
+    const Room *original = floor->getRoom(id);
+    if (original == nullptr)
+    {
+        return nullptr;
+    }
+    Room *copy = new Room(*original);
+    changed[id].reset(copy);
+    return copy;
+}
+
+/*!
+@brief Check whether the player has entered a room.
+@param id The room's id.
+@return True if they have.
+*/
+bool FloorOverlay::getVisited(int id) const
+{
+    return id >= 0 && id < (int)visited.size() && visited[id];
+}
+
+/*!
+@brief Record that the player has entered a room.
+@param id The room's id.
+*/
+void FloorOverlay::setVisited(int id)
+{
+    if (id >= 0 && id < (int)visited.size())
+    {
+        visited[id] = true;
+    }
+}
+
+/*!
+@brief Get a map of the rooms around a room as the player sees them.
+@param room The room to center the map on.
+@return The map.
+@details The template's room is drawn in place of the player's copy, since the floor's index points at the template's.
+*/
+std::string FloorOverlay::getMap(const Room *room)
+{
+    const Room *original = floor->getRoom(room->id);
+    return floor->getDungeon().getMap(original != nullptr ? original : room, fog, visited);
+}
+
+/*!
+@brief Record the player's changes.
+@return The changes.
+*/
+FloorDelta FloorOverlay::captureDelta() const
+{
+    FloorDelta delta;
+    delta.visited = visited;
+    delta.cleared.resize(visited.size());
+    delta.looted.resize(visited.size());
+    delta.solved.resize(visited.size());
+    for (const auto &entry : changed)
+    {
+        RoomContent &content = entry.second->roomContent;
+        delta.cleared[entry.first] = content.getCleared();
+        delta.looted[entry.first] = content.getLooted();
+        delta.solved[entry.first] = content.getSolved();
+    }
+    return delta;
+}
+
+/*!
+@brief Reapply recorded changes.
+@param delta The changes.
+@details Only rooms with something besides a visit to reapply are copied. Visited rooms are revealed in the fog of war.
+*/
+void FloorOverlay::applyDelta(const FloorDelta &delta)
+{
+    for (int id = 0; id < (int)visited.size(); id++)
+    {
+        if (id < (int)delta.visited.size() && delta.visited[id])
+        {
+            visited[id] = true;
+            std::pair<int, int> cords = floor->getRoom(id)->roomContent.getCoordinates();
+            fog.reveal(cords.first, cords.second);
+        }
+        if (id < (int)delta.cleared.size() && delta.cleared[id])
+        {
+            RoomContent &content = edit(id)->roomContent;
+            content.clearEnemies();
+            content.clearText();
+        }
+        if (id < (int)delta.looted.size() && delta.looted[id])
+        {
+            RoomContent &content = edit(id)->roomContent;
+            content.emptyItems();
+            content.getCoins();
+        }
+        if (id < (int)delta.solved.size() && delta.solved[id])
+        {
+            edit(id)->roomContent.setSolved(true);
+        }
+    }
+}
+
+/*!
+@brief Get the number of rooms the player has their own copy of.
+@return The number of copies.
+*/
+size_t FloorOverlay::changedRooms() const
+{
+    return changed.size();
+}
+
+/*!
+@brief Estimate the memory used by the player's changes.
+@return The approximate number of bytes.
+@details Like Dungeon::memoryFootprint this ignores allocator overhead and the internals of mini-games. The fog of
+war is counted by its size alone, since its rows are a few words for a floor of this size.
+*/
+size_t FloorOverlay::memoryFootprint() const
+{
+    size_t bytes = sizeof(FloorOverlay) + (visited.size() + 7) / 8;
+    for (const auto &entry : changed)
+    {
+        bytes += roomFootprint(entry.second.get());
+    }
+    return bytes;
+}
+
+/*!
+@brief Make every new game play the shared floor for a seed.
+@param seed The event's seed.
+*/
+void setEventSeed(unsigned int seed)
+{
+    std::lock_guard<std::mutex> lock(eventMutex);
+    eventRunning = true;
+    eventSeed = seed;
+}
+
+/*!
+@brief Make every new game generate its own floor again.
+*/
+void clearEventSeed()
+{
+    std::lock_guard<std::mutex> lock(eventMutex);
+    eventRunning = false;
+}
+
+/*!
+@brief Get the event's seed.
+@param seed Set to the seed if there is an event.
+@return True if there is an event.
+*/
+bool getEventSeed(unsigned int &seed)
+{
+    std::lock_guard<std::mutex> lock(eventMutex);
+    if (eventRunning)
+    {
+        seed = eventSeed;
+    }
+    return eventRunning;
+}
@@ -0,0 +1,342 @@
+/*!
+@file fogofwar.cpp
+@brief Implementation of the FogOfWar class.
+@details This file contains the implementation of the FogOfWar class. Each row of the floor is a run of 64-bit words,
+so spreading sight one room east or west is a shift of the row and spreading it north or south is an AND with the
+door row.
+*/
+
+#include "../lib/fogofwar.h"
+#include <algorithm>
+#include <bitset>
+#include <climits>
+
+/*!
+@brief Constructor for the FogOfWar class.
+@param sightRadius How many rooms away the player can see along each axis.
+*/
+FogOfWar::FogOfWar(int sightRadius)
+    : sightRadius(sightRadius < 0 ? 0 : sightRadius), minX(0), minY(0), width(0), height(0), wordsPerRow(0),
+      hasView(false), viewRow(0), viewCol(0)
+{
+}
+
+/*!
+@brief Build the occupancy and door rows for a floor.
+@param rooms The rooms of the floor.
+*/
+void FogOfWar::build(const std::vector<Room *> &rooms)
+{
+    int maxX = INT_MIN, maxY = INT_MIN;
+    minX = INT_MAX;
+    minY = INT_MAX;
+    for (Room *room : rooms)
+    {
+        std::pair<int, int> cords = room->roomContent.getCoordinates();
+        minX = std::min(minX, cords.first);
+        minY = std::min(minY, cords.second);
+        maxX = std::max(maxX, cords.first);
+        maxY = std::max(maxY, cords.second);
+    }
+    if (rooms.empty())
+    {
+        minX = minY = 0;
+        maxX = maxY = -1;
+    }
+
+    width = maxX - minX + 1;
+    height = maxY - minY + 1;
+    wordsPerRow = (width + 63) / 64;
+    size_t words = (size_t)wordsPerRow * height;
+    occupied.assign(words, 0);
+    openEast.assign(words, 0);
+    openNorth.assign(words, 0);
+    visible.assign(words, 0);
+    explored.assign(words, 0);
+    hasView = false;
+
+    auto set = [this](std::vector<uint64_t> &bits, int row, int col)
+    {
+        if (row >= 0 && row < height && col >= 0 && col < width)
+        {
+            bits[(size_t)row * wordsPerRow + col / 64] |= 1ULL << (col % 64);
+        }
+    };
+
+    for (Room *room : rooms)
+    {
+        std::pair<int, int> cords = room->roomContent.getCoordinates();
+        int row = cords.second - minY;
+        int col = cords.first - minX;
+        set(occupied, row, col);
+        if (room->east)
+        {
+            set(openEast, row, col);
+        }
+        if (room->west)
+        {
+            set(openEast, row, col - 1);
+        }
+        if (room->north)
+        {
+            set(openNorth, row, col);
+        }
+        if (room->south)
+        {
+            set(openNorth, row - 1, col);
+        }
+        if (room->roomContent.getVisited())
+        {
+            set(explored, row, col);
+        }
+    }
+}
+
+/*!
+@brief Convert a coordinate to a row and column in the bounding box.
+@param x The x-coordinate.
+@param y The y-coordinate.
+@param row Set to the row.
+@param col Set to the column.
+@return False if the coordinate is outside the bounding box.
+*/
+bool FogOfWar::locate(int x, int y, int &row, int &col) const
+{
+    row = y - minY;
+    col = x - minX;
+    return row >= 0 && row < height && col >= 0 && col < width;
+}
+
+/*!
+@brief Check whether a coordinate holds a room.
+@param x The x-coordinate.
+@param y The y-coordinate.
+@return True if a room was there when the layer was built.
+*/
+bool FogOfWar::contains(int x, int y) const
+{
+    int row, col;
+    return locate(x, y, row, col) && ((occupied[(size_t)row * wordsPerRow + col / 64] >> (col % 64)) & 1);
+}
+
+/*!
+@brief Check whether a room is currently in sight.
+@param x The x-coordinate.
+@param y The y-coordinate.
+@return True if the room is visible.
+*/
+bool FogOfWar::isVisible(int x, int y) const
+{
+    int row, col;
+    return locate(x, y, row, col) && ((visible[(size_t)row * wordsPerRow + col / 64] >> (col % 64)) & 1);
+}
+
+/*!
+@brief Check whether a room has ever been in sight.
+@param x The x-coordinate.
+@param y The y-coordinate.
+@return True if the room has been seen.
+*/
+bool FogOfWar::isExplored(int x, int y) const
+{
+    int row, col;
+    return locate(x, y, row, col) && ((explored[(size_t)row * wordsPerRow + col / 64] >> (col % 64)) & 1);
+}
+
+/*!
+@brief Mark a room as explored.
+@param x The x-coordinate.
+@param y The y-coordinate.
+*/
+void FogOfWar::reveal(int x, int y)
+{
+    int row, col;
+    if (locate(x, y, row, col))
+    {
+        explored[(size_t)row * wordsPerRow + col / 64] |= 1ULL << (col % 64);
+    }
+}
+
+/*!
+@brief Count the rooms currently in sight.
+@return The number of visible rooms.
+@details Visible bits only ever lie in the window around the viewpoint, so only that window is counted.
+*/
+int FogOfWar::visibleCount() const
+{
+    if (!hasView)
+    {
+        return 0;
+    }
+    int count = 0;
+    int fromRow = std::max(0, viewRow - sightRadius), toRow = std::min(height - 1, viewRow + sightRadius);
+    int fromWord = std::max(0, viewCol - sightRadius) / 64, toWord = std::min(width - 1, viewCol + sightRadius) / 64;
+    for (int row = fromRow; row <= toRow; row++)
+    {
+        for (int word = fromWord; word <= toWord; word++)
+        {
+            count += (int)std::bitset<64>(visible[(size_t)row * wordsPerRow + word]).count();
+        }
+    }
+    return count;
+}
+
+/*!
+@brief Get the sight radius.
+@return How many rooms away the player can see along each axis.
+*/
+int FogOfWar::getSightRadius() const
+{
+    return sightRadius;
+}
+
+/*!
+@brief Clear the visible bits around a viewpoint.
+@param row The viewpoint row.
+@param col The viewpoint column.
+*/
+void FogOfWar::clearWindow(int row, int col)
+{
+    int fromRow = std::max(0, row - sightRadius), toRow = std::min(height - 1, row + sightRadius);
+    int fromWord = std::max(0, col - sightRadius) / 64, toWord = std::min(width - 1, col + sightRadius) / 64;
+    for (int r = fromRow; r <= toRow; r++)
+    {
+        std::fill(visible.begin() + (size_t)r * wordsPerRow + fromWord, visible.begin() + (size_t)r * wordsPerRow + toWord + 1, 0);
+    }
+}
+
+/*!
+@brief Spread sight into one quadrant of the window.
+@param row The viewpoint row.
+@param col The viewpoint column.
+@param stepX 1 to spread east, -1 to spread west.
+@param stepY 1 to spread north, -1 to spread south.
+@details Works row by row away from the viewpoint. Within a row, the reached bits are shifted one column at a time
+through the east doors until nothing new is reached. Moving to the next row keeps only the bits with a door in
+that direction. Sight never moves back towards the viewpoint, so a room is only seen along a path that heads
+steadily away from the player.
+*/
+void FogOfWar::castQuadrant(int row, int col, int stepX, int stepY)
+{
+    int fromCol = std::max(0, col - sightRadius), toCol = std::min(width - 1, col + sightRadius);
+    int fromWord = fromCol / 64;
+    int words = toCol / 64 - fromWord + 1;
+    int lastRow = stepY > 0 ? std::min(height - 1, row + sightRadius) : std::max(0, row - sightRadius);
+
+    reach.assign(words, 0);
+    spread.assign(words, 0);
+    reach[col / 64 - fromWord] = 1ULL << (col % 64);
+
+    auto windowMask = [&](int i)
+    {
+        int first = (fromWord + i) * 64;
+        int lo = std::max(fromCol - first, 0), hi = std::min(toCol - first, 63);
+        uint64_t upper = hi == 63 ? ~0ULL : ((1ULL << (hi + 1)) - 1);
+        return upper & ~((1ULL << lo) - 1);
+    };
+
+    for (int r = row;; r += stepY)
+    {
+        size_t base = (size_t)r * wordsPerRow + fromWord;
+        if (r != row)
+        {
+            // Doors between rows r - 1 and r are stored on row r - 1
+            size_t doors = (size_t)(stepY > 0 ? r - 1 : r) * wordsPerRow + fromWord;
+            bool any = false;
+            for (int i = 0; i < words; i++)
+            {
+                reach[i] &= openNorth[doors + i];
+                any = any || reach[i];
+            }
+            if (!any)
+            {
+                return;
+            }
+        }
+
+        for (int step = 0; step < sightRadius; step++)
+        {
+            bool grew = false;
+            for (int i = 0; i < words; i++)
+            {
+                uint64_t moved;
+                if (stepX > 0)
+                {
+                    moved = (reach[i] & openEast[base + i]) << 1;
+                    if (i > 0)
+                    {
+                        moved |= (reach[i - 1] & openEast[base + i - 1]) >> 63;
+                    }
+                }
+                else
+                {
+                    moved = reach[i] >> 1;
+                    if (i + 1 < words)
+                    {
+                        moved |= reach[i + 1] << 63;
+                    }
+                    moved &= openEast[base + i];
+                }
+                spread[i] = moved & windowMask(i) & ~reach[i];
+                grew = grew || spread[i];
+            }
+            if (!grew)
+            {
+                break;
+            }
+            for (int i = 0; i < words; i++)
+            {
+                reach[i] |= spread[i];
+            }
+        }
+
+        for (int i = 0; i < words; i++)
+        {
+            visible[base + i] |= reach[i];
+        }
+        if (r == lastRow)
+        {
+            return;
+        }
+    }
+}
+
+/*!
+@brief Move the viewpoint and update what is visible and explored.
+@param x The x-coordinate of the player's room.
+@param y The y-coordinate of the player's room.
+@details Only the windows around the old and new viewpoints are touched, so the cost depends on the sight radius
+and not on the size of the floor.
+*/
+void FogOfWar::moveTo(int x, int y)
+{
+    if (hasView)
+    {
+        clearWindow(viewRow, viewCol);
+    }
+    int row, col;
+    if (!locate(x, y, row, col))
+    {
+        hasView = false;
+        return;
+    }
+
+    castQuadrant(row, col, 1, 1);
+    castQuadrant(row, col, -1, 1);
+    castQuadrant(row, col, 1, -1);
+    castQuadrant(row, col, -1, -1);
+
+    int fromRow = std::max(0, row - sightRadius), toRow = std::min(height - 1, row + sightRadius);
+    int fromWord = std::max(0, col - sightRadius) / 64, toWord = std::min(width - 1, col + sightRadius) / 64;
+    for (int r = fromRow; r <= toRow; r++)
+    {
+        for (int word = fromWord; word <= toWord; word++)
+        {
+            explored[(size_t)r * wordsPerRow + word] |= visible[(size_t)r * wordsPerRow + word];
+        }
+    }
+
+    hasView = true;
+    viewRow = row;
+    viewCol = col;
+}
@@ -0,0 +1,225 @@
+/*!
+@file framefeed.cpp
+@brief Implementation of the FrameFeed and FeedSink classes.
+@details The feed's lock is held only to copy a write into a frame and to hand out pointers to frames, never while
+anything is sent, so the player's worker and the reactor sending to spectators wait for each other at most that long.
+*/
+
+#include "../lib/framefeed.h"
+
+namespace
+{
+    const char ClearScreen[] = "\033[2J\033[H"; //!< Starts every keyframe.
+}
+
+/*!
+@brief Constructor for the FrameFeed class.
+@param maxFrames The most frames kept.
+@param maxBytes The most bytes of frames kept.
+@param historyBytes How much output a keyframe redraws.
+*/
+FrameFeed::FrameFeed(size_t maxFrames, size_t maxBytes, size_t historyBytes)
+    : maxFrames(maxFrames > 0 ? maxFrames : 1), maxBytes(maxBytes), historyBytes(historyBytes)
+{
+}
+
+/*!
+@brief Publish output the player has been sent.
+@param data The bytes.
+@param size How many there are.
+@details The recent output is trimmed only once it is twice as long as a keyframe needs, so trimming costs nothing
+per write on average.
+*/
+void FrameFeed::publish(const char *data, size_t size)
+{
+    bool watched;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        counts.published++;
+        history.append(data, size);
+        if (history.size() > 2 * historyBytes)
+        {
+            history.erase(0, history.size() - historyBytes);
+        }
+        next++;
+        watched = spectators > 0;
+        if (watched)
+        {
+            frames.push_back(std::make_shared<const std::string>(data, size));
+            frameBytes += size;
+            counts.frames++;
+            while (frames.size() > maxFrames || (frames.size() > 1 && frameBytes > maxBytes))
+            {
+                frameBytes -= frames.front()->size();
+                frames.pop_front();
+            }
+        }
+    }
+    if (watched && listener)
+    {
+        listener();
+    }
+}
+
+/*!
+@brief Add a spectator.
+@param keyframe Set to a keyframe of the recent output.
+@return The spectator's cursor.
+*/
+unsigned long long FrameFeed::join(Frame &keyframe)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    spectators++;
+    keyframe = this->keyframe();
+    return next;
+}
+
+/*!
+@brief Remove a spectator.
+@details The frames kept are dropped with the last spectator, since nobody is left to be sent them.
+*/
+void FrameFeed::leave()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (spectators > 0 && --spectators == 0)
+    {
+        frames.clear();
+        frameBytes = 0;
+    }
+}
+
+/*!
+@brief Take the frames a spectator has not been sent.
+@param cursor The spectator's cursor.
+@param out Where the frames are appended.
+@param most The most frames to take.
+@return The number of frames missed.
+@details A spectator behind the oldest frame kept is sent a keyframe of everything so far and moved to the newest
+frame, so every spectator resynchronised before the player writes again shares one keyframe.
+*/
+size_t FrameFeed::collect(unsigned long long &cursor, std::vector<Frame> &out, size_t most)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    unsigned long long first = next - frames.size();
+    if (cursor < first)
+    {
+        size_t missed = (size_t)(first - cursor);
+        counts.dropped += missed;
+        out.push_back(keyframe());
+        cursor = next;
+        return missed;
+    }
+    for (; cursor < next && most > 0; cursor++, most--)
+    {
+        out.push_back(frames[(size_t)(cursor - first)]);
+    }
+    return 0;
+}
+
+/*!
+@brief Get the sequence number the next frame will have.
+@return The sequence number.
+*/
+unsigned long long FrameFeed::head() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return next;
+}
+
+/*!
+@brief Get the number of spectators.
+@return The number of spectators.
+*/
+size_t FrameFeed::watchers() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return spectators;
+}
+
+/*!
+@brief Set what to call after a watched publish.
+@param listener The function.
+*/
+void FrameFeed::setListener(std::function<void()> listener)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    this->listener = std::move(listener);
+}
+
+/*!
+@brief Mark the feed as finished.
+*/
+void FrameFeed::close()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    ended = true;
+}
+
+/*!
+@brief Check whether the session has ended.
+@return True if it has.
+*/
+bool FrameFeed::closed() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return ended;
+}
+
+/*!
+@brief Get the feed's counts.
+@return A copy of the counts.
+*/
+FeedStats FrameFeed::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return counts;
+}
+
+/*!
+@brief Get a keyframe for the output so far.
+@return The keyframe.
+@details Once the recent output has been trimmed the keyframe starts at a line, so it does not begin halfway through
+a colour code.
+*/
+FrameFeed::Frame FrameFeed::keyframe()
+{
+    if (cached && cachedAt == next)
+    {
+        return cached;
+    }
+    size_t start = 0;
+    if (history.size() > historyBytes)
+    {
+        start = history.size() - historyBytes;
+        size_t line = history.find('\n', start);
+        start = line == std::string::npos ? start : line + 1;
+    }
+    std::string frame = ClearScreen;
+    frame.append(history, start, std::string::npos);
+    cached = std::make_shared<const std::string>(std::move(frame));
+    cachedAt = next;
+    counts.keyframes++;
+    return cached;
+}
+
+/*!
+@brief Constructor for the FeedSink class.
+@param next Where output goes to the player.
+@param feed The feed.
+*/
+FeedSink::FeedSink(OutputSink &next, FrameFeed &feed) : next(next), feed(feed)
+{
+}
+
+/*!
+@brief Write bytes to the player and publish them.
+@param data The bytes.
+@param size How many there are.
+@return What writing them to the player returned.
+*/
+bool FeedSink::write(const char *data, size_t size)
+{
+    bool written = next.write(data, size);
+    feed.publish(data, size);
+    return written;
+}
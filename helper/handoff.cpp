@@ -0,0 +1,212 @@
+/*!
+@file handoff.cpp
+@brief Implementation of session handoff records and the socket they travel on.
+@details A descriptor sent with SCM_RIGHTS arrives with the first byte of the sendmsg that carried it, and a stream
+socket never joins bytes sent with a descriptor onto bytes read before it, so each record's descriptor is read before
+the record is whole. The reader queues descriptors as they come and gives each to the next record completed.
+*/
+
+#include "../lib/handoff.h"
+#include "../lib/hibernation.h"
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const unsigned long long RecordVersion = 1;    //!< The first field of a record, changed whenever the layout changes.
+    const size_t MaxRecordBytes = 16 * 1024 * 1024; //!< The largest record accepted, so a bad length is not allocated.
+    const size_t MaxFdsPerRead = 16;               //!< Descriptors made room for in each read.
+}
+
+/*!
+@brief Write a record.
+@param record The record.
+@return The blob.
+*/
+std::string encodeHandoff(const HandoffRecord &record)
+{
+    BlobWriter out;
+    out.putUnsigned(RecordVersion);
+    out.putString(record.state);
+    out.putString(record.input);
+    out.putString(record.output);
+    out.putUnsigned(record.compressed ? 1 : 0);
+    out.putInt(record.pausedAt);
+    return out.data();
+}
+
+/*!
+@brief Read a record.
+@param bytes The blob.
+@param record Set to the record.
+@return False if the blob is malformed.
+*/
+bool decodeHandoff(const std::string &bytes, HandoffRecord &record)
+{
+    BlobReader in(bytes);
+    if (in.getUnsigned() != RecordVersion)
+    {
+        return false;
+    }
+    HandoffRecord read;
+    read.state = in.getString();
+    read.input = in.getString();
+    read.output = in.getString();
+    read.compressed = in.getUnsigned() != 0;
+    read.pausedAt = in.getInt();
+    if (!in.ok() || !in.atEnd())
+    {
+        return false;
+    }
+    read.fd = record.fd;
+    record = read;
+    return true;
+}
+
+#ifdef __linux__
+/*!
+@brief Send a record and its descriptor.
+@param channel The socket.
+@param record The record.
+@return False if it could not be sent.
+@details The descriptor goes with the first sendmsg. A stream socket may take the rest in further calls, which carry
+no descriptor.
+*/
+bool sendHandoff(int channel, const HandoffRecord &record)
+{
+    std::string payload = encodeHandoff(record);
+    std::string frame(4, '\0');
+    for (int i = 0; i < 4; i++)
+    {
+        frame[i] = (char)((payload.size() >> (8 * i)) & 0xFF);
+    }
+    frame += payload;
+
+    size_t sent = 0;
+    while (sent < frame.size())
+    {
+        iovec part = {(void *)(frame.data() + sent), frame.size() - sent};
+        msghdr message = {};
+        message.msg_iov = &part;
+        message.msg_iovlen = 1;
+        char control[CMSG_SPACE(sizeof(int))] = {};
+        if (sent == 0)
+        {
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+            cmsghdr *header = CMSG_FIRSTHDR(&message);
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SCM_RIGHTS;
+            header->cmsg_len = CMSG_LEN(sizeof(int));
+            std::memcpy(CMSG_DATA(header), &record.fd, sizeof(int));
+        }
+        ssize_t count = ::sendmsg(channel, &message, MSG_NOSIGNAL);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            return false;
+        }
+        sent += count;
+    }
+    return true;
+}
+
+/*!
+@brief Destructor for the HandoffReader class.
+*/
+HandoffReader::~HandoffReader()
+{
+    for (int fd : fds)
+    {
+        ::close(fd);
+    }
+}
+
+/*!
+@brief Read what has arrived.
+@param channel The socket.
+@param records Where whole records are appended.
+@return False once the socket has closed or sent something malformed.
+*/
+bool HandoffReader::receive(int channel, std::vector<HandoffRecord> &records)
+{
+    bool open = true;
+    char chunk[65536];
+    while (true)
+    {
+        iovec part = {chunk, sizeof(chunk)};
+        char control[CMSG_SPACE(sizeof(int) * MaxFdsPerRead)];
+        msghdr message = {};
+        message.msg_iov = &part;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        ssize_t count = ::recvmsg(channel, &message, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+        for (cmsghdr *header = count >= 0 ? CMSG_FIRSTHDR(&message) : nullptr; header != nullptr; header = CMSG_NXTHDR(&message, header))
+        {
+            if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS)
+            {
+                size_t received = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                for (size_t i = 0; i < received; i++)
+                {
+                    int fd;
+                    std::memcpy(&fd, CMSG_DATA(header) + i * sizeof(int), sizeof(int));
+                    fds.push_back(fd);
+                }
+            }
+        }
+        if (count <= 0 || (message.msg_flags & MSG_CTRUNC))
+        {
+            open = false;
+            break;
+        }
+        buffer.append(chunk, count);
+    }
+
+    size_t used = 0;
+    while (buffer.size() - used >= 4)
+    {
+        size_t length = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            length |= (size_t)(unsigned char)buffer[used + i] << (8 * i);
+        }
+        if (length > MaxRecordBytes || fds.empty())
+        {
+            return false;
+        }
+        if (buffer.size() - used - 4 < length)
+        {
+            break;
+        }
+        HandoffRecord record;
+        record.fd = fds.front();
+        fds.pop_front();
+        if (!decodeHandoff(buffer.substr(used + 4, length), record))
+        {
+            ::close(record.fd);
+            return false;
+        }
+        records.push_back(record);
+        used += 4 + length;
+    }
+    buffer.erase(0, used);
+    return open;
+}
+#endif
@@ -0,0 +1,171 @@
+/*!
+@file headless.cpp
+@brief Implements headless mode for the Valeris game.
+@details The headless flag is process-wide and read on every delay and clear, so it is atomic. The sink filters escape
+sequences with a three-state parser that survives sequences split across writes.
+*/
+
+#include "../lib/headless.h"
+#include <atomic>
+
+namespace
+{
+    std::atomic<bool> headless(false); //!< Whether the game is running headless.
+}
+
+/*!
+@brief Turns headless mode on or off for the whole process.
+@param on True to run headless.
+*/
+void setHeadless(bool on)
+{
+    headless.store(on, std::memory_order_relaxed);
+}
+
+/*!
+@brief Checks whether the game is running headless.
+@return True in headless mode.
+*/
+bool isHeadless()
+{
+    return headless.load(std::memory_order_relaxed);
+}
+
+/*!
+@brief Constructor for the HeadlessSink class.
+@param target Where plain text is forwarded, or nullptr to discard all output.
+*/
+HeadlessSink::HeadlessSink(std::streambuf *target)
+    : target(target), previous(nullptr), parse(Parse::Text), bytesIn(0), bytesOut(0)
+{
+}
+
+/*!
+@brief Destructor for the HeadlessSink class.
+*/
+HeadlessSink::~HeadlessSink()
+{
+    uninstall();
+}
+
+/*!
+@brief Turns on headless mode and routes std::cout through the sink.
+*/
+void HeadlessSink::install()
+{
+    setHeadless(true);
+    if (previous == nullptr)
+    {
+        previous = std::cout.rdbuf(this);
+    }
+}
+
+/*!
+@brief Restores std::cout.
+*/
+void HeadlessSink::uninstall()
+{
+    if (previous != nullptr)
+    {
+        std::cout.rdbuf(previous);
+        previous = nullptr;
+    }
+    sync();
+}
+
+/*!
+@brief Gets the number of bytes written to the sink.
+@return Bytes received.
+*/
+unsigned long long HeadlessSink::received() const
+{
+    return bytesIn;
+}
+
+/*!
+@brief Gets the number of bytes passed on to the target.
+@return Bytes forwarded.
+*/
+unsigned long long HeadlessSink::forwarded() const
+{
+    return bytesOut;
+}
+
+/*!
+@brief Accepts one character.
+@param ch The character.
+@return The character, or eof if the target failed.
+*/
+HeadlessSink::int_type HeadlessSink::overflow(int_type ch)
+{
+    if (traits_type::eq_int_type(ch, traits_type::eof()))
+    {
+        return traits_type::not_eof(ch);
+    }
+    char c = traits_type::to_char_type(ch);
+    return xsputn(&c, 1) == 1 ? ch : traits_type::eof();
+}
+
+/*!
+@brief Accepts a run of characters.
+@param s The characters.
+@param count How many there are.
+@return count, or 0 if the target failed.
+*/
+std::streamsize HeadlessSink::xsputn(const char *s, std::streamsize count)
+{
+    bytesIn += count;
+    if (target == nullptr)
+    {
+        return count;
+    }
+
+    std::streamsize runStart = 0;
+    for (std::streamsize i = 0; i < count; i++)
+    {
+        char c = s[i];
+        switch (parse)
+        {
+        case Parse::Text:
+            if (c == '\033')
+            {
+                if (i > runStart && target->sputn(s + runStart, i - runStart) != i - runStart)
+                {
+                    return 0;
+                }
+                bytesOut += i - runStart;
+                parse = Parse::Escape;
+            }
+            break;
+        case Parse::Escape:
+            parse = c == '[' ? Parse::Csi : Parse::Text;
+            runStart = i + 1;
+            break;
+        case Parse::Csi:
+            if (c >= 0x40 && c <= 0x7e)
+            {
+                parse = Parse::Text;
+            }
+            runStart = i + 1;
+            break;
+        }
+    }
+    if (parse == Parse::Text && count > runStart)
+    {
+        if (target->sputn(s + runStart, count - runStart) != count - runStart)
+        {
+            return 0;
+        }
+        bytesOut += count - runStart;
+    }
+    return count;
+}
+
+/*!
+@brief Flushes the target.
+@return 0 on success, -1 on failure.
+*/
+int HeadlessSink::sync()
+{
+    return target == nullptr ? 0 : target->pubsync();
+}
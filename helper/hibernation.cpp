@@ -0,0 +1,304 @@
+/*!
+@file hibernation.cpp
+@brief Implementation of session hibernation.
+@details Files are named from a per-process random tag and a counter, so several servers can share a directory, and
+each file is deleted as soon as its game has been read back.
+*/
+
+#include "../lib/hibernation.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <random>
+
+namespace
+{
+    std::mutex stateMutex;       //!< Guards settings and stats.
+    HibernationSettings settings; //!< The process's settings.
+    HibernationStats stats;       //!< The process's counts.
+
+    /*!
+    @brief Get the tag that keeps this process's file names apart from other processes'.
+    @return Sixteen hex digits.
+    */
+    const std::string &processTag()
+    {
+        static const std::string tag = []
+        {
+            std::random_device device;
+            unsigned long long value = ((unsigned long long)device() << 32) ^ device();
+            char text[17];
+            std::snprintf(text, sizeof(text), "%016llx", value);
+            return std::string(text);
+        }();
+        return tag;
+    }
+}
+
+/*!
+@brief Write an unsigned integer as a varint.
+@param value The value.
+*/
+void BlobWriter::putUnsigned(unsigned long long value)
+{
+    while (value >= 0x80)
+    {
+        bytes.push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back((char)value);
+}
+
+/*!
+@brief Write a signed integer, zigzag encoded so small negative values stay short.
+@param value The value.
+*/
+void BlobWriter::putInt(long long value)
+{
+    putUnsigned(((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63));
+}
+
+/*!
+@brief Write a length-prefixed string.
+@param value The string.
+*/
+void BlobWriter::putString(const std::string &value)
+{
+    putUnsigned(value.size());
+    bytes += value;
+}
+
+/*!
+@brief Write a count followed by the flags packed eight to a byte.
+@param flags The flags.
+*/
+void BlobWriter::putFlags(const std::vector<bool> &flags)
+{
+    putUnsigned(flags.size());
+    for (size_t i = 0; i < flags.size(); i += 8)
+    {
+        unsigned char packed = 0;
+        for (size_t bit = 0; bit < 8 && i + bit < flags.size(); bit++)
+        {
+            packed |= (unsigned char)(flags[i + bit] ? 1 : 0) << bit;
+        }
+        bytes.push_back((char)packed);
+    }
+}
+
+/*!
+@brief Get the record.
+@return The bytes written so far.
+*/
+const std::string &BlobWriter::data() const
+{
+    return bytes;
+}
+
+/*!
+@brief Constructor for the BlobReader class.
+@param bytes The record.
+*/
+BlobReader::BlobReader(const std::string &bytes) : bytes(bytes), position(0), failed(false)
+{
+}
+
+/*!
+@brief Read a varint.
+@return The value, or 0 if the record ends first or the value is too long.
+*/
+unsigned long long BlobReader::getUnsigned()
+{
+    unsigned long long value = 0;
+    for (int shift = 0; !failed && shift < 64; shift += 7)
+    {
+        if (position >= bytes.size())
+        {
+            break;
+        }
+        unsigned char byte = (unsigned char)bytes[position++];
+        value |= (unsigned long long)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return value;
+        }
+    }
+    failed = true;
+    return 0;
+}
+
+/*!
+@brief Read a zigzag-encoded integer.
+@return The value, or 0 on failure.
+*/
+long long BlobReader::getInt()
+{
+    unsigned long long value = getUnsigned();
+    return (long long)(value >> 1) ^ -(long long)(value & 1);
+}
+
+/*!
+@brief Read a length-prefixed string.
+@return The string, or an empty one if the record is too short.
+*/
+std::string BlobReader::getString()
+{
+    unsigned long long size = getUnsigned();
+    if (failed || size > bytes.size() - position)
+    {
+        failed = true;
+        return "";
+    }
+    std::string value = bytes.substr(position, (size_t)size);
+    position += (size_t)size;
+    return value;
+}
+
+/*!
+@brief Read packed flags.
+@return The flags, or an empty list if the record is too short.
+*/
+std::vector<bool> BlobReader::getFlags()
+{
+    unsigned long long count = getUnsigned();
+    if (failed || (count + 7) / 8 > bytes.size() - position)
+    {
+        failed = true;
+        return {};
+    }
+    std::vector<bool> flags((size_t)count);
+    for (size_t i = 0; i < flags.size(); i++)
+    {
+        flags[i] = ((unsigned char)bytes[position + i / 8] >> (i % 8)) & 1;
+    }
+    position += (size_t)(count + 7) / 8;
+    return flags;
+}
+
+/*!
+@brief Check whether every read succeeded.
+@return False once one has failed.
+*/
+bool BlobReader::ok() const
+{
+    return !failed;
+}
+
+/*!
+@brief Check whether the record has been read to the end.
+@return True if no bytes are left.
+*/
+bool BlobReader::atEnd() const
+{
+    return position >= bytes.size();
+}
+
+/*!
+@brief Set the hibernation settings.
+@param newSettings The settings.
+*/
+void setHibernation(const HibernationSettings &newSettings)
+{
+    std::lock_guard<std::mutex> lock(stateMutex);
+    settings = newSettings;
+}
+
+/*!
+@brief Get the hibernation settings.
+@return A copy of them.
+*/
+HibernationSettings getHibernation()
+{
+    std::lock_guard<std::mutex> lock(stateMutex);
+    return settings;
+}
+
+/*!
+@brief Get the hibernation counts.
+@return A snapshot of them.
+*/
+HibernationStats hibernationStats()
+{
+    std::lock_guard<std::mutex> lock(stateMutex);
+    return stats;
+}
+
+/*!
+@brief Write a hibernated game to a file of its own.
+@param blob The game's state.
+@return The file's path, or an empty string on failure.
+*/
+std::string storeHibernated(const std::string &blob)
+{
+    static std::atomic<unsigned long long> counter(0);
+    std::string path = getHibernation().directory + "/valeris-" + processTag() + "-" + std::to_string(++counter) + ".hib";
+
+    std::FILE *file = std::fopen(path.c_str(), "wb");
+    bool written = file != nullptr && std::fwrite(blob.data(), 1, blob.size(), file) == blob.size();
+    if (file != nullptr && std::fclose(file) != 0)
+    {
+        written = false;
+    }
+
+    std::lock_guard<std::mutex> lock(stateMutex);
+    if (!written)
+    {
+        std::remove(path.c_str());
+        stats.failed++;
+        return "";
+    }
+    stats.hibernated++;
+    stats.sleeping++;
+    stats.bytesOnDisk += blob.size();
+    return path;
+}
+
+/*!
+@brief Read a hibernated game and delete its file.
+@param path The file's path.
+@param blob Set to the game's state.
+@return False if the file could not be read.
+*/
+bool takeHibernated(const std::string &path, std::string &blob)
+{
+    blob.clear();
+    std::FILE *file = std::fopen(path.c_str(), "rb");
+    bool read = file != nullptr;
+    if (read)
+    {
+        char buffer[4096];
+        size_t count;
+        while ((count = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+        {
+            blob.append(buffer, count);
+        }
+        read = std::ferror(file) == 0;
+        std::fclose(file);
+        std::remove(path.c_str());
+    }
+
+    std::lock_guard<std::mutex> lock(stateMutex);
+    if (stats.sleeping > 0)
+    {
+        stats.sleeping--;
+    }
+    stats.bytesOnDisk -= std::min(stats.bytesOnDisk, blob.size());
+    if (!read)
+    {
+        stats.failed++;
+    }
+    return read;
+}
+
+/*!
+@brief Record how long a restore took.
+@param microseconds The time taken.
+*/
+void recordRestore(long long microseconds)
+{
+    std::lock_guard<std::mutex> lock(stateMutex);
+    stats.restored++;
+    stats.lastRestoreMicroseconds = microseconds;
+    stats.slowestRestoreMicroseconds = std::max(stats.slowestRestoreMicroseconds, microseconds);
+}
@@ -0,0 +1,288 @@
+/*!
+@file keyreader.cpp
+@brief Implementation of the raw-mode key reader and reaction timing.
+@details This file contains the implementation of the KeyReader, LatencyHistogram and CombatLatency types. Keys are
+timed from the stamps the event loop takes when it reads them, so time spent echoing and drawing is not counted.
+*/
+
+#include "../lib/keyreader.h"
+#include "../lib/headless.h"
+#include "../lib/toolkit.h"
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+/*!
+@brief Constructor for the KeyReader class.
+@param io The console to read.
+@details Raw mode is used only for the standard console on a terminal outside headless mode. Windows keeps line mode,
+since its console cannot be polled the same way.
+*/
+KeyReader::KeyReader(Console &io) : io(io), loop(io), rawMode(false)
+{
+#ifndef _WIN32
+    if (io.isStandard() && !isHeadless() && isatty(STDIN_FILENO))
+    {
+        disableInput();
+        rawMode = true;
+    }
+#endif
+}
+
+/*!
+@brief Destructor for the KeyReader class.
+*/
+KeyReader::~KeyReader()
+{
+    if (rawMode)
+    {
+        enableInput();
+    }
+}
+
+/*!
+@brief Read one answer.
+@param milliseconds The longest to wait for Enter, or -1 to wait indefinitely.
+@return The answer and its timings.
+@details In raw mode each key is echoed as it arrives, with backspace rubbing out the last character.
+*/
+Reaction KeyReader::read(int milliseconds)
+{
+    Reaction reaction;
+    long long start = monotonicNanos();
+    size_t typed = 0;
+    while (true)
+    {
+        int wait = -1;
+        if (milliseconds >= 0)
+        {
+            long long left = start + milliseconds * 1000000LL - monotonicNanos();
+            wait = left > 0 ? (int)((left + 999999) / 1000000) : 0;
+        }
+        InputEvent event = loop.next(wait);
+        switch (event.type)
+        {
+        case InputEvent::Key:
+            if (reaction.firstKeyNanos < 0)
+            {
+                reaction.firstKeyNanos = event.at - start;
+            }
+            if (rawMode)
+            {
+                if (event.key == '\b' || event.key == 127)
+                {
+                    if (typed > 0)
+                    {
+                        typed--;
+                        io.out() << "\b \b";
+                    }
+                }
+                else
+                {
+                    typed++;
+                    io.out() << event.key;
+                }
+                io.present();
+            }
+            break;
+        case InputEvent::Line:
+            reaction.answer = event.line;
+            reaction.completeNanos = event.at - start;
+            if (rawMode)
+            {
+                io.out() << "\n";
+            }
+            return reaction;
+        case InputEvent::Timeout:
+            reaction.timedOut = true;
+            loop.discardInput();
+            return reaction;
+        case InputEvent::Closed:
+            reaction.closed = true;
+            return reaction;
+        }
+    }
+}
+
+/*!
+@brief Check whether the terminal is in raw mode.
+@return True if keys are read and echoed one at a time.
+*/
+bool KeyReader::raw() const
+{
+    return rawMode;
+}
+
+/*!
+@brief Get the event loop the reader waits in.
+@return The loop.
+*/
+EventLoop &KeyReader::events()
+{
+    return loop;
+}
+
+/*!
+@brief Constructor for the LatencyHistogram class.
+@param bucketMilliseconds The width of each bucket.
+@param buckets The number of buckets.
+*/
+LatencyHistogram::LatencyHistogram(int bucketMilliseconds, int buckets)
+    : width(bucketMilliseconds), counts(buckets, 0)
+{
+}
+
+/*!
+@brief Record a latency.
+@param nanos The latency in nanoseconds.
+*/
+void LatencyHistogram::add(long long nanos)
+{
+    nanos = std::max(0LL, nanos);
+    long long index = nanos / (width * 1000000LL);
+    if (index < (long long)counts.size())
+    {
+        counts[index]++;
+    }
+    else
+    {
+        over++;
+    }
+    total++;
+    sumNanos += nanos;
+    largestNanos = std::max(largestNanos, nanos);
+}
+
+/*!
+@brief Get the number of latencies recorded.
+@return The count.
+*/
+unsigned long long LatencyHistogram::count() const
+{
+    return total;
+}
+
+/*!
+@brief Get a bucket's count.
+@param bucket The bucket's index.
+@return The count, or 0 for an index outside the histogram.
+*/
+unsigned long long LatencyHistogram::bucket(int bucket) const
+{
+    return bucket >= 0 && bucket < (int)counts.size() ? counts[bucket] : 0;
+}
+
+/*!
+@brief Get the number of latencies past the last bucket.
+@return The overflow count.
+*/
+unsigned long long LatencyHistogram::overflow() const
+{
+    return over;
+}
+
+/*!
+@brief Get the mean latency.
+@return The mean in milliseconds.
+*/
+double LatencyHistogram::meanMilliseconds() const
+{
+    return total == 0 ? 0 : sumNanos / 1e6 / total;
+}
+
+/*!
+@brief Estimate a percentile from the buckets.
+@param fraction The percentile as a fraction.
+@return The upper edge of the bucket holding it, in milliseconds.
+*/
+double LatencyHistogram::percentileMilliseconds(double fraction) const
+{
+    if (total == 0)
+    {
+        return 0;
+    }
+    unsigned long long rank = (unsigned long long)(fraction * total + 0.999999);
+    rank = std::max(1ULL, std::min(rank, total));
+    unsigned long long seen = 0;
+    for (size_t i = 0; i < counts.size(); i++)
+    {
+        seen += counts[i];
+        if (seen >= rank)
+        {
+            return (double)(i + 1) * width;
+        }
+    }
+    return largestNanos / 1e6;
+}
+
+/*!
+@brief Format the histogram as a JSON object.
+@return The object.
+*/
+std::string LatencyHistogram::toJson() const
+{
+    size_t used = counts.size();
+    while (used > 0 && counts[used - 1] == 0)
+    {
+        used--;
+    }
+    std::ostringstream json;
+    json << "{\"bucket_ms\": " << width << ", \"counts\": [";
+    for (size_t i = 0; i < used; i++)
+    {
+        json << (i == 0 ? "" : ", ") << counts[i];
+    }
+    json << "], \"overflow\": " << over
+         << ", \"count\": " << total
+         << ", \"mean_ms\": " << meanMilliseconds()
+         << ", \"p50_ms\": " << percentileMilliseconds(0.5)
+         << ", \"p95_ms\": " << percentileMilliseconds(0.95)
+         << ", \"max_ms\": " << largestNanos / 1e6 << "}";
+    return json.str();
+}
+
+/*!
+@brief Format the record as one line of JSON.
+@return The line.
+*/
+std::string CombatLatency::toJson() const
+{
+    std::string name;
+    for (char c : enemy)
+    {
+        if (c == '"' || c == '\\')
+        {
+            name += '\\';
+        }
+        if ((unsigned char)c >= 0x20)
+        {
+            name += c;
+        }
+    }
+    std::ostringstream json;
+    json << "{\"enemy\": \"" << name << "\", \"turns\": " << turns << ", \"timeouts\": " << timeouts
+         << ", \"first_key\": " << firstKey.toJson() << ", \"complete\": " << complete.toJson() << "}";
+    return json.str();
+}
+
+/*!
+@brief Append a combat's latencies to a newline-delimited JSON file.
+@param path The file to append to.
+@param latency The record.
+@return True if the line was written.
+*/
+bool appendCombatLatency(const std::string &path, const CombatLatency &latency)
+{
+    std::FILE *file = std::fopen(path.c_str(), "a");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    std::string line = latency.toJson() + "\n";
+    bool written = std::fwrite(line.data(), 1, line.size(), file) == line.size();
+    return std::fclose(file) == 0 && written;
+}
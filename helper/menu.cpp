@@ -9,25 +9,38 @@
 #include "../lib/dungeon.h"
 #include "../lib/menu.h"
 #include "../lib/valerisgame.h"
+#include "../lib/typewriter.h"
+#include "../lib/scheduler.h"
+#include <memory>
 #include <iomanip>
 
 /*!
 @brief Display the game introduction.
 @param delayTime The delay time between printing each character.
 @param color The color code for the text.
-@details The introduction is read from a file and printed with a delay and color for dramatic effect.
+@param whileAnimating Work to run on the calling thread while the text animates, or nullptr.
+@details The introduction is read from a file and printed with a delay and color for dramatic effect. The text animates
+on the timer thread, so whileAnimating runs alongside it; it must not write to console().out(). A keypress skips the animation.
 */
-void displayIntro(int delayTime, const std::string &color)
+void displayIntro(int delayTime, const std::string &color, const std::function<void()> &whileAnimating)
 {
     std::vector<std::string> intro = split(getFileContent("../reasources/intro.txt"), '@');
 
+    Typewriter typewriter;
     for (int i = 0; i < 3; i++)
     {
-        typePrint(intro[i], delayTime, color);
-        std::cout << std::endl;
+        typewriter.append(intro[i], delayTime, color);
+        typewriter.append("\n", 0);
     }
-    typePrint(intro[intro.size() - 1], 0, color);
-    std::cout << std::endl;
+    typewriter.append(intro[intro.size() - 1], 0, color);
+    typewriter.append("\n", 0);
+
+    typewriter.start();
+    if (whileAnimating)
+    {
+        whileAnimating();
+    }
+    typewriter.wait();
 }
 
 /*!
@@ -37,14 +50,14 @@ void displayIntro(int delayTime, const std::string &color)
 void Displayj()
 {
 
-    std::cout << "\033[37m" << "==========================================================" << std::endl;
-    std::cout << std::setw(15) << " " << "VALERIS GAME MENU" << std::endl;
-    std::cout << "==========================================================" << std::endl;
-    std::cout << "1. Start New Game" << std::endl;
-    std::cout << "2. Instructions" << std::endl;
-    std::cout << "3. Accessibility" << std::endl;
-    std::cout << "4. Exit" << std::endl;
-    std::cout << "==========================================================" << std::endl;
+    console().out() << "\033[37m" << "==========================================================" << std::endl;
+    console().out() << std::setw(15) << " " << "VALERIS GAME MENU" << std::endl;
+    console().out() << "==========================================================" << std::endl;
+    console().out() << "1. Start New Game" << std::endl;
+    console().out() << "2. Instructions" << std::endl;
+    console().out() << "3. Accessibility" << std::endl;
+    console().out() << "4. Exit" << std::endl;
+    console().out() << "==========================================================" << std::endl;
 }
 
 // LCOV_EXCL_START
@@ -54,21 +67,118 @@ void Displayj()
 */
 void StartGame(const std::string &color)
 {
-    ValerisGame valerisGame;
+    ValerisGame valerisGame(console());
     valerisGame.start(color);
 }
 
+/*!
+@brief Display the introduction and start a new game of Valeris.
+@param delayTime The delay time between printing each character of the introduction.
+@param color The color code for the text.
+@details The dungeon is generated as a background job while the introduction is still typing, so the game is ready as
+soon as it ends. In a server session the job is queued on the session's worker, where an idle worker can take it, and
+the session's fiber is suspended while the introduction types. The game plays on the calling thread's console.
+*/
+void StartGameWithIntro(int delayTime, const std::string &color)
+{
+    Console &io = console();
+    Job<std::unique_ptr<ValerisGame>> pregenerated = Scheduler::nearest().spawn([&io]
+                                                                                 { return std::unique_ptr<ValerisGame>(new ValerisGame(io)); });
+    displayIntro(delayTime, color);
+    std::unique_ptr<ValerisGame> valerisGame = pregenerated.get();
+    valerisGame->start(color);
+}
+
+/*!
+@brief Run the main menu until the player exits.
+@details Each choice is read from the calling thread's console, so the menu serves the local player or a remote session
+alike. A session whose input closes ends with InputClosed. Waiting for a choice is a turn, where a remote session can
+be handed to another process with nothing to carry over.
+*/
+void RunMainMenu()
+{
+    int delayTime = 0;              //!< Delay time for displaying text.
+    std::string color = "\033[36m"; //!< Color code for text display.
+    bool running = true;            //!< Controls the menu loop.
+
+    while (running)
+    {
+        Displayj(); //!< Display the main menu.
+        int j = readInt([]
+                        {
+                            if (!console().isStandard())
+                            {
+                                console().present();
+                                console().waitForTurn(-1);
+                                if (console().handoffRequested())
+                                {
+                                    throw SessionHandoff(std::string());
+                                }
+                            } }); //!< Read user's menu selection.
+
+        switch (j)
+        {
+        case 1:
+            clear(10);
+            StartGameWithIntro(delayTime, color); //!< Display the introduction while a new game is generated, then start it.
+            break;
+        case 2:
+            clear(11);
+            DisplayInstructionsText(); //!< Display the instructions for the game.
+            break;
+        case 3:
+            clear(10);
+            Accessiblity(delayTime, color); //!< Access and modify accessibility options.
+            break;
+        case 4:
+            console().out() << "Exiting Game. We hope you enjoyed the Game Play." << std::endl;
+            running = false; //!< Exit the menu loop.
+            break;
+        default:
+            console().out() << "Error: An invalid choice has been entered. Please try again." << std::endl;
+            delay(2000);
+            clear(12);
+            break;
+        }
+
+        console().out() << std::endl;
+    }
+}
+
+/*!
+@brief Carry on a session handed over from another process, then run the main menu.
+@param state The game's saved state, or empty if the player was at the main menu.
+@details A game that cannot be restored, such as one from a shared world this process does not have, is dropped with
+a message rather than ending the session.
+*/
+void ResumeMainMenu(const std::string &state)
+{
+    if (!state.empty())
+    {
+        ValerisGame valerisGame(console());
+        if (valerisGame.restoreState(state))
+        {
+            valerisGame.resume();
+        }
+        else
+        {
+            console().out() << "Your game could not be carried over." << std::endl;
+        }
+    }
+    RunMainMenu();
+}
+
 /*!
  * @brief Load a saved game.
  * @details This function simulates loading a saved game. The actual loading functionality is not implemented.
  */
 void LoadSavedGame()
 {
-    std::cout << "\033[37m" << "==========================================================" << std::endl;
-    std::cout << std::setw(15) << " " << "COMING SOON" << std::endl;
-    std::cout << "==========================================================" << std::endl;
-    std::cout << "This feature is not available yet. Stay tuned" << std::endl;
-    std::cout << "==========================================================" << std::endl;
+    console().out() << "\033[37m" << "==========================================================" << std::endl;
+    console().out() << std::setw(15) << " " << "COMING SOON" << std::endl;
+    console().out() << "==========================================================" << std::endl;
+    console().out() << "This feature is not available yet. Stay tuned" << std::endl;
+    console().out() << "==========================================================" << std::endl;
 
     waitForEnter();
     clear(6);
@@ -91,7 +201,7 @@ Instructions:
 6. At any point during the traversal of the map use /help to get help
 7. At any point during the traversal of the map use Q to quit the game
 )";
-    std::cout << "\033[37m" << instructions << std::endl;
+    console().out() << "\033[37m" << instructions << std::endl;
 
     waitForEnter();
     clear(10);
@@ -124,7 +234,7 @@ std::string getColor(int colorChoice, const std::string &color)
         newColor = "\033[36m";
         break;
     default:
-        std::cout << "\033[91m" << "Invalid choice. Keeping current color." << "\033[37m" << std::endl;
+        console().out() << "\033[91m" << "Invalid choice. Keeping current color." << "\033[37m" << std::endl;
         delay(2000);
         clear(1);
         break;
@@ -140,10 +250,10 @@ std::string getColor(int colorChoice, const std::string &color)
  */
 void Accessiblity(int &delayTime, std::string &color)
 {
-    std::cout << "\033[37m" << "Accessibility Options:" << std::endl;
-    std::cout << "1. Text Speed (current: " << delayTime << " ms)" << std::endl;
-    std::cout << "2. Text Color (current: " << color << "color" << "\033[37m" << ")" << std::endl;
-    std::cout << "3. Return to Main Menu" << std::endl;
+    console().out() << "\033[37m" << "Accessibility Options:" << std::endl;
+    console().out() << "1. Text Speed (current: " << delayTime << " ms)" << std::endl;
+    console().out() << "2. Text Color (current: " << color << "color" << "\033[37m" << ")" << std::endl;
+    console().out() << "3. Return to Main Menu" << std::endl;
 
     int j = readInt();
     int colorChoice;
@@ -151,19 +261,19 @@ void Accessiblity(int &delayTime, std::string &color)
     switch (j)
     {
     case 1:
-        std::cout << "Enter new text speed in milliseconds: ";
+        console().out() << "Enter new text speed in milliseconds: ";
         delayTime = readInt();
         clear(6);
         Accessiblity(delayTime, color); // Recursive call
         break;
 
     case 2:
-        std::cout << "Select text color:" << std::endl;
-        std::cout << "1. Green" << std::endl;
-        std::cout << "2. Blue" << std::endl;
-        std::cout << "3. Red" << std::endl;
-        std::cout << "4. Yellow" << std::endl;
-        std::cout << "5. Default Cyan" << std::endl;
+        console().out() << "Select text color:" << std::endl;
+        console().out() << "1. Green" << std::endl;
+        console().out() << "2. Blue" << std::endl;
+        console().out() << "3. Red" << std::endl;
+        console().out() << "4. Yellow" << std::endl;
+        console().out() << "5. Default Cyan" << std::endl;
         colorChoice = readInt();
         color = getColor(colorChoice, color);
         clear(12);
@@ -175,7 +285,7 @@ void Accessiblity(int &delayTime, std::string &color)
         return;
 
     default:
-        std::cout << "\033[91m" << "Invalid choice. Returning to Accessibility Options." << "\033[37m" << std::endl;
+        console().out() << "\033[91m" << "Invalid choice. Returning to Accessibility Options." << "\033[37m" << std::endl;
         delay(2000);
         clear(6);
         Accessiblity(delayTime, color); // Recursive call
@@ -21,6 +21,15 @@ std::string TicTacToe::getGameName()
     return "TicTacToe";
 }
 
+/*!
+@brief Copy the TicTacToe game.
+@return The copy.
+*/
+std::unique_ptr<Game> TicTacToe::clone() const
+{
+    return std::make_unique<TicTacToe>(*this);
+}
+
 /*!
 @brief Print the current state of the TicTacToe board.
 @details Displays the current state of the TicTacToe board, showing the positions of 'X', 'O', and empty spaces.
@@ -33,8 +42,8 @@ void TicTacToe::printBoard()
     std::string middle = std::string("\n ") + squares[1][0] + " | " + squares[1][1] + " | " + squares[1][2] + " ";
     std::string bottom = std::string("\n ") + squares[2][0] + " | " + squares[2][1] + " | " + squares[2][2] + " ";
 
-    std::cout << arr[0] + top + arr[1] + arr[0] + middle + arr[1] + arr[0] + bottom + arr[0] << std::endl;
-    std::cout.flush();
+    console().out() << arr[0] + top + arr[1] + arr[0] + middle + arr[1] + arr[0] + bottom + arr[0] << std::endl;
+    console().out().flush();
 }
 
 /*!
@@ -79,7 +88,7 @@ void TicTacToe::computerTurn()
             break;
         }
     }
-    std::cout << "\n\n";
+    console().out() << "\n\n";
     clear(12);
     printBoard();
 }
@@ -196,20 +205,20 @@ bool TicTacToe::handlePlayerTurn()
 
 bool TicTacToe::getPlayerMove(int &row, int &col)
 {
-    std::cout << "\nEnter your move (row and column separated by a space, e.g., '1 1'): ";
-    std::cin >> row >> col;
+    console().out() << "\nEnter your move (row and column separated by a space, e.g., '1 1'): ";
+    console().in() >> row >> col;
 
-    if (std::cin.fail() || !isValidMove(row, col))
+    if (console().in().fail() || !isValidMove(row, col))
     {
-        std::cin.clear();            // Clear error flag on cin
-        std::cin.ignore(1000, '\n'); // Discard invalid input
-        std::cout << "Invalid input. Please enter numbers between 1 and 3." << std::endl;
+        console().in().clear();            // Clear error flag on cin
+        console().in().ignore(1000, '\n'); // Discard invalid input
+        console().out() << "Invalid input. Please enter numbers between 1 and 3." << std::endl;
         return false;
     }
 
     if (squares[row - 1][col - 1] != ' ')
     {
-        std::cout << "That square is already taken. Please choose another one." << std::endl;
+        console().out() << "That square is already taken. Please choose another one." << std::endl;
         return false;
     }
 
@@ -230,7 +239,7 @@ bool TicTacToe::isGameOver(int moveCount)
 {
     if (checkForWin())
     {
-        std::cout << (moveCount % 2 == 1 ? "You win!" : "You lose!") << std::endl;
+        console().out() << (moveCount % 2 == 1 ? "You win!" : "You lose!") << std::endl;
         delay(1000);
         clear(11);
         return true;
@@ -238,7 +247,7 @@ bool TicTacToe::isGameOver(int moveCount)
 
     if (moveCount == 9)
     {
-        std::cout << "Draw!" << std::endl;
+        console().out() << "Draw!" << std::endl;
         delay(1000);
         clear(11);
         return true;
@@ -256,7 +265,7 @@ bool TicTacToe::processComputerTurn()
 
     if (checkForWin())
     {
-        std::cout << "You lose!" << std::endl;
+        console().out() << "You lose!" << std::endl;
         delay(1000);
         clear(11);
         return false;
@@ -268,11 +277,7 @@ bool TicTacToe::processComputerTurn()
 // LCOV_EXCL_START
 void TicTacToe::delayTurn()
 {
-#ifdef _WIN32
-    Sleep(1); // Sleep for 1 second on Windows
-#else
-    sleep(1);
-#endif
+    delay(1000); // Suspends instead of blocking when the game runs in a server session
 }
 // LCOV_EXCL_STOP
 
@@ -287,6 +292,15 @@ std::string CodeGuesser::getGameName()
     return "Code Guesser";
 }
 
+/*!
+@brief Copy the CodeGuesser game.
+@return The copy.
+*/
+std::unique_ptr<Game> CodeGuesser::clone() const
+{
+    return std::make_unique<CodeGuesser>(*this);
+}
+
 /*!
 @brief Generate a random index for selecting a word.
 @param size The size of the list of words.
@@ -299,10 +313,8 @@ int CodeGuesser::generateRandomIndex(size_t size)
     {
         throw std::invalid_argument("Size of words vector must be greater than 0");
     }
-    std::random_device rd;                            // Seed
-    std::mt19937 gen(rd());                           // Mersenne Twister engine
     std::uniform_int_distribution<> dis(0, (int)size - 1); // Distribution range
-    return dis(gen);
+    return dis(randomEngine());
 }
 
 /*!
@@ -310,7 +322,7 @@ int CodeGuesser::generateRandomIndex(size_t size)
 @details Initializes the word list and randomly selects one word for the game.
 */
 CodeGuesser::CodeGuesser()
-    : words(split(getFileContent("../reasources/cg_words.txt"), '\n')),
+    : words(getFileLines("../reasources/cg_words.txt")),
       index(generateRandomIndex(words.size())) {}
 
 /*!
@@ -326,7 +338,7 @@ bool CodeGuesser::start()
     index = generateRandomIndex(words.size());
     while (count < 5)
     {
-        std::cout << "Please enter the five lettered passcode: " + std::to_string(5 - count) + " guesses remaining\n\n";
+        console().out() << "Please enter the five lettered passcode: " + std::to_string(5 - count) + " guesses remaining\n\n";
         printGuesses();
 
         if (addGuess())
@@ -340,14 +352,14 @@ bool CodeGuesser::start()
 
     if (success)
     {
-        std::cout << "Passcode Accepted!" << std::endl;
+        console().out() << "Passcode Accepted!" << std::endl;
         delay(2000);
         clear(5 + count);
         return true;
     }
     else
     {
-        std::cout << "Too many failed attempts! Please restart" << std::endl;
+        console().out() << "Too many failed attempts! Please restart" << std::endl;
         delay(2000);
         clear(5 + count);
         return false;
@@ -364,11 +376,11 @@ bool CodeGuesser::addGuess()
     // Yellow, Green, Reset
     std::string colorCodes[] = {"\033[43m", "\033[42m", "\033[0m"};
     std::string guess, coloredGuess;
-    std::cin >> guess;
+    console().in() >> guess;
 
     if (guess.length() != 5)
     {
-        std::cout << "Please enter a 5-letter word." << std::endl;
+        console().out() << "Please enter a 5-letter word." << std::endl;
         return false;
     }
 
@@ -414,9 +426,9 @@ void CodeGuesser::printGuesses()
 {
     for (const auto &guess : guesses)
     {
-        std::cout << guess << "\n";
+        console().out() << guess << "\n";
     }
-    std::cout << +"\npasscode: ";
+    console().out() << +"\npasscode: ";
 }
 
 /*!
@@ -426,7 +438,7 @@ void CodeGuesser::printWords()
 {
     for (int i = 0; i < words.size(); i++)
     {
-        std::cout << words.at(i) + "\n";
+        console().out() << words.at(i) + "\n";
     }
 }
 
@@ -479,6 +491,15 @@ std::string BlackJack::getGameName()
     return "Black Jack";
 }
 
+/*!
+@brief Copy the BlackJack game.
+@return The copy.
+*/
+std::unique_ptr<Game> BlackJack::clone() const
+{
+    return std::make_unique<BlackJack>(*this);
+}
+
 /*!
 @brief Start the BlackJack game.
 @return True if the player wins, false otherwise.
@@ -497,7 +518,7 @@ bool BlackJack::start()
     while (rounds < maxRounds)
     {
         displayState(false);
-        std::cout << "Hit or Stand?\n";
+        console().out() << "Hit or Stand?\n";
         std::string hit = getUserInputToken();
         bool wasHit = false;
         if (toLowerCase(hit) == "hit")
@@ -517,9 +538,9 @@ bool BlackJack::start()
             }
             rounds++;
             displayState(true);
-            std::cout << "Round " << rounds << ": Round lost.\n";
-            std::cout << "Rounds left: " << (maxRounds - rounds) << std::endl;
-            std::cout << "Total rounds won: " << totalWins << std::endl;
+            console().out() << "Round " << rounds << ": Round lost.\n";
+            console().out() << "Rounds left: " << (maxRounds - rounds) << std::endl;
+            console().out() << "Total rounds won: " << totalWins << std::endl;
             waitForEnter();
             clear(11);
             initDecks();
@@ -533,9 +554,9 @@ bool BlackJack::start()
             rounds++;
             totalWins++;
             displayState(true);
-            std::cout << "Round " << rounds << ": Round won.\n";
-            std::cout << "Rounds left: " << (maxRounds - rounds) << std::endl;
-            std::cout << "Total rounds won: " << totalWins << std::endl;
+            console().out() << "Round " << rounds << ": Round won.\n";
+            console().out() << "Rounds left: " << (maxRounds - rounds) << std::endl;
+            console().out() << "Total rounds won: " << totalWins << std::endl;
             waitForEnter();
             clear(11);
             initDecks();
@@ -544,14 +565,14 @@ bool BlackJack::start()
 
     if (totalWins == 1)
     {
-        std::cout << "Game Over You Win!" << std::endl;
+        console().out() << "Game Over You Win!" << std::endl;
         delay(1000);
         clear(1);
         return true;
     }
     else
     {
-        std::cout << "Game Over You Lose!" << std::endl;
+        console().out() << "Game Over You Lose!" << std::endl;
         delay(1000);
         clear(1);
         return false;
@@ -685,9 +706,9 @@ void BlackJack::displayState(bool printAll)
     }
 
     // Print dealer's cards
-    std::cout << std::setw((terminalWidth - 16) / 2) << "" << "Dealer's Cards\n";
-    std::cout << line << "\n";
-    std::cout << std::setw((terminalWidth - 4) / 2) << dealer[0] << " " + dealersSecond + "\n\n";
+    console().out() << std::setw((terminalWidth - 16) / 2) << "" << "Dealer's Cards\n";
+    console().out() << line << "\n";
+    console().out() << std::setw((terminalWidth - 4) / 2) << dealer[0] << " " + dealersSecond + "\n\n";
 
     // Print player's cards
     std::string playerCardsLine;
@@ -701,7 +722,7 @@ void BlackJack::displayState(bool printAll)
         playerCardsLine.pop_back();
     }
 
-    std::cout << std::setw((terminalWidth - 16) / 2) << "" << "Player's Cards\n";
-    std::cout << line << "\n";
-    std::cout << std::setw((terminalWidth - playerCardsLine.length()) / 2 - 1) << "" << playerCardsLine << "\n";
+    console().out() << std::setw((terminalWidth - 16) / 2) << "" << "Player's Cards\n";
+    console().out() << line << "\n";
+    console().out() << std::setw((terminalWidth - playerCardsLine.length()) / 2 - 1) << "" << playerCardsLine << "\n";
 }
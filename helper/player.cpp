@@ -6,6 +6,7 @@
 
 #include "../lib/dependencies.h"
 #include "../lib/player.h"
+#include "../lib/hibernation.h"
 
 /*!
 @brief Constructor for the Player class.
@@ -15,13 +16,29 @@
 Player::Player()
     : maxHealth(100),
       currHealth(100),
-      resistance(0)
+      resistance(0),
+      coins(0)
 {
     getNameFromUser();
     setDamage(5);
     clear(2);
 }
 
+/*!
+@brief Constructor for the Player class that does not prompt.
+@param name The player's name.
+@details Used when the player is created before the terminal is free, such as while the introduction is typing.
+*/
+Player::Player(const std::string &name)
+    : maxHealth(100),
+      currHealth(100),
+      resistance(0),
+      coins(0)
+{
+    firstName = name;
+    setDamage(5);
+}
+
 /*!
 @brief Destructor for the Player class.
 @details Cleans up resources when the Player object is destroyed.
@@ -37,7 +54,7 @@ Player::~Player()
 */
 void Player::getNameFromUser()
 {
-    std::cout << "Enter your name: ";
+    console().out() << "Enter your name: ";
     firstName = getUserInputToken();
 }
 
@@ -47,7 +64,7 @@ void Player::getNameFromUser()
 */
 void Player::getClassFromUser()
 {
-    std::cout << "Enter your class type: ";
+    console().out() << "Enter your class type: ";
     classType = getUserInputToken();
 }
 
@@ -120,7 +137,7 @@ void Player::removeFromInventory(std::string item)
             return;
         }
     }
-    std::cout << "Item not found in inventory.\n";
+    console().out() << "Item not found in inventory.\n";
 }
 
 /*!
@@ -181,7 +198,7 @@ void Player::removeBuff(std::string buff)
     }
     else
     {
-        std::cout << "Buff not found." << std::endl;
+        console().out() << "Buff not found." << std::endl;
     }
 }
 
@@ -264,29 +281,29 @@ std::vector<std::string> Player::getBuffs()
 
 bool Player::printInventory()
 {
-    std::cout << "\033[4m" << firstName << "'s Inventory" << "\033[0m" << std::endl;
+    console().out() << "\033[4m" << firstName << "'s Inventory" << "\033[0m" << std::endl;
     if (inventory.size() == 0)
     {
-        std::cout << "No Items, Inventory is Empty" << std::endl;
+        console().out() << "No Items, Inventory is Empty" << std::endl;
     }
 
     bool wasEmpty = inventory.size() > 0;
     for (size_t i = 0; i < inventory.size(); i++)
     {
-        std::cout << i + 1 << ". " << split(inventory[i], ':')[0] << " x " << getNum()[i] << std::endl;
+        console().out() << i + 1 << ". " << split(inventory[i], ':')[0] << " x " << getNum()[i] << std::endl;
     }
-    std::cout << std::endl;
+    console().out() << std::endl;
     return wasEmpty;
 }
 
 bool Player::displayStats()
 {
-    std::cout << "Players Name: " << firstName << std::endl;
-    std::cout << "Damage: " << damage << std::endl;
-    std::cout << "Health: " << currHealth << std::endl;
-    std::cout << "Max Health: " << maxHealth << std::endl;
-    std::cout << "Resistance: " << resistance << std::endl;
-    std::cout << "Coins: " << coins << std::endl;
+    console().out() << "Players Name: " << firstName << std::endl;
+    console().out() << "Damage: " << damage << std::endl;
+    console().out() << "Health: " << currHealth << std::endl;
+    console().out() << "Max Health: " << maxHealth << std::endl;
+    console().out() << "Resistance: " << resistance << std::endl;
+    console().out() << "Coins: " << coins << std::endl;
     return true;
 }
 
@@ -357,4 +374,63 @@ void Player::heal()
 int Player::getCoins()
 {
     return coins;
-}
\ No newline at end of file
+}
+
+/*!
+@brief Write the player to a record.
+@param out The record.
+*/
+void Player::save(BlobWriter &out) const
+{
+    out.putString(firstName);
+    out.putString(classType);
+    out.putInt(maxHealth);
+    out.putInt(currHealth);
+    out.putInt(resistance);
+    out.putInt(damage);
+    out.putInt(coins);
+    out.putUnsigned(inventory.size());
+    for (size_t i = 0; i < inventory.size(); i++)
+    {
+        out.putString(inventory[i]);
+        out.putInt(i < numberItems.size() ? numberItems[i] : 1);
+    }
+    out.putUnsigned(buffs.size());
+    for (const std::string &buff : buffs)
+    {
+        out.putString(buff);
+    }
+}
+
+/*!
+@brief Read the player from a record written by save.
+@param in The record.
+@return False if it was malformed.
+*/
+bool Player::load(BlobReader &in)
+{
+    Player loaded(in.getString());
+    loaded.classType = in.getString();
+    loaded.maxHealth = (int)in.getInt();
+    loaded.currHealth = (int)in.getInt();
+    loaded.resistance = (int)in.getInt();
+    loaded.damage = (int)in.getInt();
+    loaded.coins = (int)in.getInt();
+    unsigned long long items = in.getUnsigned();
+    for (unsigned long long i = 0; i < items && in.ok(); i++)
+    {
+        loaded.inventory.push_back(in.getString());
+        loaded.numberItems.push_back((int)in.getInt());
+    }
+    unsigned long long buffCount = in.getUnsigned();
+    for (unsigned long long i = 0; i < buffCount && in.ok(); i++)
+    {
+        loaded.buffs.push_back(in.getString());
+    }
+    if (!in.ok())
+    {
+        return false;
+    }
+    *this = loaded;
+    return true;
+}
@@ -0,0 +1,245 @@
+/*!
+@file renderer.cpp
+@brief Implementation of the Renderer class.
+@details This file contains the implementation of the Renderer class, which buffers std::cout into frames and
+writes each frame to the terminal in one system call.
+*/
+
+#include "../lib/renderer.h"
+#include <cerrno>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+Renderer *Renderer::current = nullptr;
+
+/*!
+@brief Constructor for the Renderer class.
+@param fd The file descriptor frames are written to.
+*/
+Renderer::Renderer(int fd)
+    : fd(fd), coalescing(true), presenter(*this), presentStream(&presenter), previousCout(nullptr), previousCinTie(nullptr),
+      previousCerrTie(nullptr), installed(false)
+{
+    frame.reserve(16384);
+}
+
+/*!
+@brief Destructor for the Renderer class.
+*/
+Renderer::~Renderer()
+{
+    uninstall();
+    present();
+}
+
+/*!
+@brief Route std::cout through the renderer.
+@details std::cin and std::cerr are tied to a stream that presents the frame, so prompts and errors still appear
+before the game blocks on input or writes to stderr.
+*/
+void Renderer::install()
+{
+    if (installed)
+    {
+        return;
+    }
+    std::cout.flush();
+    previousCout = std::cout.rdbuf(this);
+    previousCinTie = std::cin.tie(&presentStream);
+    previousCerrTie = std::cerr.tie(&presentStream);
+    installed = true;
+    current = this;
+}
+
+/*!
+@brief Restore std::cout and the stream ties.
+*/
+void Renderer::uninstall()
+{
+    if (!installed)
+    {
+        return;
+    }
+    present();
+    std::cout.rdbuf(previousCout);
+    std::cin.tie(previousCinTie);
+    std::cerr.tie(previousCerrTie);
+    installed = false;
+    if (current == this)
+    {
+        current = nullptr;
+    }
+}
+
+/*!
+@brief Write the pending frame.
+@return False if the write failed.
+@details The frame normally leaves in a single write call. Short writes (a full pipe or socket) are continued with
+further calls, and each call is counted so the per-frame syscall counter shows when that happens.
+Unless coalescing is off, redundant escape sequences are removed from the frame first.
+*/
+bool Renderer::present()
+{
+    if (frame.empty())
+    {
+        return true;
+    }
+
+    const std::string *out = &frame;
+    if (coalescing)
+    {
+        filtered.clear();
+        ansi.filter(frame, filtered);
+        ansi.finish(filtered);
+        out = &filtered;
+    }
+    stats.rawBytes += frame.size();
+
+    const char *data = out->data();
+    size_t left = out->size();
+    int calls = 0;
+    bool ok = true;
+    while (left > 0)
+    {
+#ifdef _WIN32
+        long written = _write(fd, data, (unsigned int)left);
+#else
+        ssize_t written = ::write(fd, data, left);
+#endif
+        calls++;
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            ok = false;
+            break;
+        }
+        data += written;
+        left -= written;
+    }
+
+    stats.frames++;
+    stats.bytes += out->size() - left;
+    stats.syscalls += calls;
+    stats.lastFrameBytes = out->size() - left;
+    stats.lastFrameSyscalls = calls;
+    if (stats.lastFrameBytes > stats.largestFrameBytes)
+    {
+        stats.largestFrameBytes = stats.lastFrameBytes;
+    }
+    frame.clear();
+    return ok;
+}
+
+/*!
+@brief Turn removal of redundant escape sequences on or off.
+@param on True to filter frames.
+*/
+void Renderer::setCoalescing(bool on)
+{
+    coalescing = on;
+}
+
+/*!
+@brief Get the number of bytes waiting to be presented.
+@return The size of the pending frame.
+*/
+size_t Renderer::pending() const
+{
+    return frame.size();
+}
+
+/*!
+@brief Get the frame counters.
+@return The counters.
+*/
+const FrameStats &Renderer::getStats() const
+{
+    return stats;
+}
+
+/*!
+@brief Reset the frame counters.
+*/
+void Renderer::resetStats()
+{
+    stats = FrameStats();
+}
+
+/*!
+@brief Get the installed renderer.
+@return The renderer, or nullptr.
+*/
+Renderer *Renderer::active()
+{
+    return current;
+}
+
+/*!
+@brief Append a character to the frame.
+@param ch The character.
+@return The character, or eof for eof.
+*/
+Renderer::int_type Renderer::overflow(int_type ch)
+{
+    if (traits_type::eq_int_type(ch, traits_type::eof()))
+    {
+        return traits_type::not_eof(ch);
+    }
+    frame.push_back(traits_type::to_char_type(ch));
+    return ch;
+}
+
+/*!
+@brief Append characters to the frame.
+@param s The characters.
+@param n The number of characters.
+@return n.
+*/
+std::streamsize Renderer::xsputn(const char *s, std::streamsize n)
+{
+    frame.append(s, (size_t)n);
+    return n;
+}
+
+/*!
+@brief Ignore a flush of std::cout.
+@return 0.
+*/
+int Renderer::sync()
+{
+    return 0;
+}
+
+/*!
+@brief Constructor for the Presenter class.
+@param owner The renderer to present on flush.
+*/
+Renderer::Presenter::Presenter(Renderer &owner) : owner(owner) {}
+
+/*!
+@brief Present the owner's frame.
+@return 0.
+*/
+int Renderer::Presenter::sync()
+{
+    owner.present();
+    return 0;
+}
+
+/*!
+@brief Present the installed renderer's frame, if there is one.
+*/
+void presentFrame()
+{
+    if (Renderer::active())
+    {
+        Renderer::active()->present();
+    }
+}
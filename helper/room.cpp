@@ -21,7 +21,10 @@ RoomContent::RoomContent()
     : roomType(generateRandomNumber(0, 3)),
       passcode(false),
       visited(false),
-      coins(0)
+      coins(0),
+      cleared(false),
+      looted(false),
+      solved(false)
 {
     switch (roomType)
     {
@@ -80,34 +83,56 @@ RoomContent::RoomContent()
     }
 }
 
+/*!
+@brief Copy constructor for RoomContent class.
+@param other The room content to copy.
+@details Mini-games are cloned, so a game played in the copy leaves the original's untouched.
+*/
+RoomContent::RoomContent(const RoomContent &other)
+    : passcode(other.passcode),
+      roomType(other.roomType),
+      cords(other.cords),
+      visited(other.visited.load()),
+      nonGambilingGame(other.nonGambilingGame ? other.nonGambilingGame->clone() : nullptr),
+      cleared(other.cleared.load()),
+      looted(other.looted.load()),
+      solved(other.solved.load())
+{
+    std::lock_guard<std::mutex> hold(other.lock);
+    items = other.items;
+    enemies = other.enemies;
+    roomDesc = other.roomDesc;
+    coins = other.coins;
+    npc.name = other.npc.name;
+    npc.gamblingGame = other.npc.gamblingGame ? other.npc.gamblingGame->clone() : nullptr;
+    npc.skillLevel = other.npc.skillLevel;
+}
+
 /*!
 @brief Get the description of the room.
 @return A string describing the room and its contents.
 */
-std::string RoomContent::getRoomDesc()
+std::string RoomContent::getRoomDesc() const
 {
+    std::lock_guard<std::mutex> hold(lock);
     return roomDesc;
 }
 
 int selectIndex(const std::vector<int> &probabilities)
 {
-    // Random device to seed the random number generator
-    std::random_device rd;
-    std::mt19937 gen(rd());
-
     // Create a discrete distribution based on the probabilities vector
     std::discrete_distribution<> dist(probabilities.begin(), probabilities.end());
 
-    // Generate and return the index
-    return dist(gen);
+    // Generate and return the index from the shared engine so seeded floors are reproducible
+    return dist(randomEngine());
 }
 
 void RoomContent::lockedRoom()
 {
     nonGambilingGame = std::make_unique<CodeGuesser>();
-    std::vector<std::string> health_items = split(getFileContent("../reasources/health_items.txt"), '\n');
-    std::vector<std::string> weapon_items = split(getFileContent("../reasources/weapon_items.txt"), '\n');
-    std::vector<std::string> armour_items = split(getFileContent("../reasources/armour_items.txt"), '\n');
+    const std::vector<std::string> &health_items = getFileLines("../reasources/health_items.txt");
+    const std::vector<std::string> &weapon_items = getFileLines("../reasources/weapon_items.txt");
+    const std::vector<std::string> &armour_items = getFileLines("../reasources/armour_items.txt");
 
     // for (int i = 0; i < armour_items.size(); i++)
     // {
@@ -159,10 +184,10 @@ void RoomContent::gamblingRoom()
         newNPC.gamblingGame = std::make_unique<BlackJack>();
     }
 
-    std::vector<std::string> npcNames = split(getFileContent("../reasources/npc.txt"), '\n');
+    const std::vector<std::string> &npcNames = getFileLines("../reasources/npc.txt");
     if (npcNames.empty())
     {
-        std::cerr << "Error: NPC names list is empty.\n";
+        console().err() << "Error: NPC names list is empty.\n";
         return; // Exit the function if there are no NPC names
     }
 
@@ -178,8 +203,8 @@ void RoomContent::gamblingRoom()
 */
 void RoomContent::enemyRoom()
 {
-    std::vector<std::string> listOfEnemies = split(getFileContent("../reasources/enemies.txt"), '\n');
-    std::vector<std::string> listOfItems = split(getFileContent("../reasources/weapon_items.txt"), '\n');
+    const std::vector<std::string> &listOfEnemies = getFileLines("../reasources/enemies.txt");
+    const std::vector<std::string> &listOfItems = getFileLines("../reasources/weapon_items.txt");
     std::vector<std::string> listRoomItems;
     std::vector<EnemyStruct> listOfRoomEnemies;
 
@@ -228,6 +253,7 @@ void RoomContent::enemyRoom()
 */
 void RoomContent::addItem(const std::string &item)
 {
+    std::lock_guard<std::mutex> hold(lock);
     items.push_back(item);
 }
 
@@ -237,6 +263,7 @@ void RoomContent::addItem(const std::string &item)
 */
 void RoomContent::addEnemy(const EnemyStruct &enemy)
 {
+    std::lock_guard<std::mutex> hold(lock);
     enemies.push_back(enemy);
 }
 
@@ -244,7 +271,7 @@ void RoomContent::addEnemy(const EnemyStruct &enemy)
 @brief Get the type of the room.
 @return An integer representing the room type (0 for empty room, 1 for gambling room).
 */
-int RoomContent::getRoomType()
+int RoomContent::getRoomType() const
 {
     return this->roomType;
 }
@@ -260,24 +287,37 @@ NPC &RoomContent::getNPC()
 
 /*!
 @brief Get the list of enemies in the room.
-@return A vector of EnemyStructs representing the enemies in the room.
+@return A copy of the EnemyStructs representing the enemies in the room.
 */
-std::vector<EnemyStruct> RoomContent::getEnemies()
+std::vector<EnemyStruct> RoomContent::getEnemies() const
 {
+    std::lock_guard<std::mutex> hold(lock);
     return enemies;
 }
 
-void RoomContent::clearEnemies()
+/*!
+@brief Remove the enemies from the room.
+@return True if this call cleared them.
+*/
+bool RoomContent::clearEnemies()
 {
+    std::lock_guard<std::mutex> hold(lock);
     enemies.clear();
+    return !cleared.exchange(true);
 }
 
 void RoomContent::clearText(){
+    std::lock_guard<std::mutex> hold(lock);
     roomDesc = "Here lies the remains of enemies.";
 }
 
-std::vector<std::string> RoomContent::getItems()
+/*!
+@brief Get the items in the room.
+@return A copy of the item strings in the room.
+*/
+std::vector<std::string> RoomContent::getItems() const
 {
+    std::lock_guard<std::mutex> hold(lock);
     return items;
 }
 
@@ -288,42 +328,43 @@ std::vector<std::string> RoomContent::getItems()
 // LCOV_EXCL_START
 void RoomContent::displayContent() const
 {
-    std::cout << "cords: " << "(" << cords.first << ", " << cords.second << ")" << std::endl;
+    std::lock_guard<std::mutex> hold(lock);
+    console().out() << "cords: " << "(" << cords.first << ", " << cords.second << ")" << std::endl;
 
-    std::cout << visited << std::endl;
+    console().out() << visited << std::endl;
 
     if (roomType == 0)
     {
         // Display items
-        std::cout << "Items: ";
+        console().out() << "Items: ";
         for (size_t i = 0; i < items.size(); ++i)
         {
-            std::cout << items[i];
+            console().out() << items[i];
             if (i < items.size() - 1) // Check if it's not the last item
             {
-                std::cout << ", ";
+                console().out() << ", ";
             }
         }
-        std::cout << std::endl;
+        console().out() << std::endl;
 
         // Display enemies
-        std::cout << "Enemies: ";
+        console().out() << "Enemies: ";
         for (size_t i = 0; i < enemies.size(); ++i)
         {
-            std::cout << enemies[i].name;
+            console().out() << enemies[i].name;
             if (i < enemies.size() - 1) // Check if it's not the last enemy
             {
-                std::cout << ", ";
+                console().out() << ", ";
             }
         }
-        std::cout << std::endl;
+        console().out() << std::endl;
     }
     else if (roomType == 1)
     {
-        std::cout << "NPC Details:" << std::endl;
-        std::cout << "Name: " << npc.name << std::endl;
-        std::cout << "Gambling Game: " << npc.gamblingGame->getGameName() << std::endl;
-        std::cout << "Skill Level: " << npc.skillLevel << std::endl;
+        console().out() << "NPC Details:" << std::endl;
+        console().out() << "Name: " << npc.name << std::endl;
+        console().out() << "Gambling Game: " << npc.gamblingGame->getGameName() << std::endl;
+        console().out() << "Skill Level: " << npc.skillLevel << std::endl;
     }
 }
 // LCOV_EXCL_STOP
@@ -332,13 +373,22 @@ void RoomContent::displayContent() const
 @brief Constructor for the Room class.
 @details Initializes a Room object with null pointers for all directions and an empty RoomContent.
 */
-Room::Room() : north(nullptr), south(nullptr), west(nullptr), east(nullptr), roomContent() {}
+Room::Room() : north(nullptr), south(nullptr), west(nullptr), east(nullptr), roomContent(), id(-1) {}
 
 /*!
 @brief Display the available directions the player can move to.
 @details Checks the neighboring rooms and lists the possible directions the player can move in.
 */
 void Room::displayAvailableDirections()
+{
+    console().out() << getAvailableDirections() << std::flush;
+}
+
+/*!
+@brief Describe the available directions the player can move to.
+@return The line listing the possible directions, ending in a newline.
+*/
+std::string Room::getAvailableDirections() const
 {
     std::vector<std::string> directions;
 
@@ -351,41 +401,49 @@ void Room::displayAvailableDirections()
     if (east)
         directions.push_back("East");
 
-    std::cout << "You can move: ";
+    std::string text = "You can move: ";
     for (size_t i = 0; i < directions.size(); ++i)
     {
-        std::cout << directions[i];
+        text += directions[i];
         if (i < directions.size() - 1)
         {
-            std::cout << ", ";
+            text += ", ";
         }
     }
-    std::cout << std::endl;
+    return text + "\n";
 }
 
 void RoomContent::displayRoomItems()
 {
+    std::vector<std::string> items;
+    int coins;
+    {
+        std::lock_guard<std::mutex> hold(lock);
+        items = this->items;
+        coins = this->coins;
+    }
     if (items.size() == 0)
     {
-        std::cout << "There are currently no items available in this room" << std::endl;
+        console().out() << "There are currently no items available in this room" << std::endl;
         return;
     }
 
-    std::cout << "Available Items\n"
+    console().out() << "Available Items\n"
               << std::endl;
     for (size_t i = 0; i < items.size(); i++)
     {
-        std::cout << i + 1 << ". " << split(items[i], ':')[0] << std::endl;
+        console().out() << i + 1 << ". " << split(items[i], ':')[0] << std::endl;
     }
     if (coins > 0)
     {
-        std::cout << "Coins" << ": " << coins << std::endl;
+        console().out() << "Coins" << ": " << coins << std::endl;
     }
-    std::cout << std::endl;
+    console().out() << std::endl;
 }
 
 int RoomContent::getCoins()
 {
+    std::lock_guard<std::mutex> hold(lock);
     int c = coins;
     coins = 0;
     return c;
@@ -393,17 +451,45 @@ int RoomContent::getCoins()
 
 bool RoomContent::collect(Player *player)
 {
-    bool done = !items.empty();
+    std::vector<std::string> taken;
+    {
+        std::lock_guard<std::mutex> hold(lock);
+        taken.swap(items);
+        looted = true;
+    }
+    bool done = !taken.empty();
 
-    while (!items.empty())
+    while (!taken.empty())
     {
-        std::string newS = items.back();
+        std::string newS = taken.back();
         player->addToInventory(newS);
-        items.pop_back();
+        taken.pop_back();
     }
     return done;
 }
 
+/*!
+@brief Take the room's items and coins unless the room has already been looted.
+@param taken Set to the items, or left empty.
+@param takenCoins Set to the coins, or 0.
+@return True if this call looted the room.
+*/
+bool RoomContent::takeLoot(std::vector<std::string> &taken, int &takenCoins)
+{
+    taken.clear();
+    takenCoins = 0;
+    std::lock_guard<std::mutex> hold(lock);
+    if (looted)
+    {
+        return false;
+    }
+    taken.swap(items);
+    takenCoins = coins;
+    coins = 0;
+    looted = true;
+    return true;
+}
+
 /*!
 @brief Add coordinates to the room.
 @param x The x-coordinate of the room.
@@ -418,7 +504,7 @@ void RoomContent::addCoordinates(int x, int y)
 @brief Get the coordinates of the room.
 @return A pair of integers representing the x and y coordinates of the room.
 */
-std::pair<int, int> RoomContent::getCoordinates()
+std::pair<int, int> RoomContent::getCoordinates() const
 {
     return cords;
 }
@@ -427,7 +513,7 @@ std::pair<int, int> RoomContent::getCoordinates()
 @brief Check if the room has been visited.
 @return True if the room has been visited, false otherwise.
 */
-bool RoomContent::getVisited()
+bool RoomContent::getVisited() const
 {
     return visited;
 }
@@ -448,6 +534,44 @@ Game *RoomContent::getNonGamblingGame()
 
 bool RoomContent::emptyItems()
 {
+    std::lock_guard<std::mutex> hold(lock);
     items.clear();
+    looted = true;
     return items.empty();
 }
+
+/*!
+@brief Check if the enemies in the room have been cleared.
+@return True if clearEnemies has been called on this room.
+*/
+bool RoomContent::getCleared() const
+{
+    return cleared;
+}
+
+/*!
+@brief Check if the room has been looted.
+@return True if the room's items have been emptied or collected.
+*/
+bool RoomContent::getLooted() const
+{
+    return looted;
+}
+
+/*!
+@brief Check if the safe in the room has been cracked.
+@return True if the passcode has been guessed.
+*/
+bool RoomContent::getSolved() const
+{
+    return solved;
+}
+
+/*!
+@brief Set whether the safe in the room has been cracked.
+@param isSolved Boolean value to set the solved status.
+*/
+void RoomContent::setSolved(bool isSolved)
+{
+    solved = isSolved;
+}
@@ -0,0 +1,355 @@
+/*!
+@file roomindex.cpp
+@brief Implementation of the RoomIndex class.
+@details This file contains the implementation of the RoomIndex class. Queries only visit the grid cells that can
+contain an answer, so their cost depends on the area searched rather than the size of the floor.
+*/
+
+#include "../lib/roomindex.h"
+#include <algorithm>
+#include <queue>
+#include <utility>
+
+/*!
+@brief Constructor for the RoomIndex class.
+@param cellSize The width and height of a grid cell in rooms.
+*/
+RoomIndex::RoomIndex(int cellSize) : cellSize(cellSize < 1 ? 1 : cellSize) {}
+
+/*!
+@brief Pack two coordinates into one hash key.
+@param x The first coordinate.
+@param y The second coordinate.
+@return The combined key.
+*/
+long long RoomIndex::key(int x, int y)
+{
+    return (long long)(((unsigned long long)(unsigned int)x << 32) | (unsigned int)y);
+}
+
+/*!
+@brief Get the cell column or row of a coordinate.
+@param v The coordinate.
+@return The cell index, rounding towards negative infinity so negative coordinates get their own cells.
+*/
+int RoomIndex::cellOf(int v) const
+{
+    return v >= 0 ? v / cellSize : -((-v - 1) / cellSize) - 1;
+}
+
+/*!
+@brief Add an entry to a grid and widen the grid's bounds.
+@param grid The grid.
+@param entry The room and its coordinates.
+*/
+void RoomIndex::add(Grid &grid, const Entry &entry)
+{
+    int cx = cellOf(entry.x);
+    int cy = cellOf(entry.y);
+    if (grid.cells.empty())
+    {
+        grid.minCellX = grid.maxCellX = cx;
+        grid.minCellY = grid.maxCellY = cy;
+    }
+    grid.minCellX = std::min(grid.minCellX, cx);
+    grid.maxCellX = std::max(grid.maxCellX, cx);
+    grid.minCellY = std::min(grid.minCellY, cy);
+    grid.maxCellY = std::max(grid.maxCellY, cy);
+    grid.cells[key(cx, cy)].push_back(entry);
+}
+
+/*!
+@brief Add a room to the index.
+@param room The room to add.
+*/
+void RoomIndex::insert(Room *room)
+{
+    std::pair<int, int> cords = room->roomContent.getCoordinates();
+    Entry entry = {room, cords.first, cords.second};
+    add(all, entry);
+
+    int type = room->roomContent.getRoomType();
+    if (type >= 0)
+    {
+        if (type >= (int)byType.size())
+        {
+            byType.resize(type + 1);
+        }
+        add(byType[type], entry);
+    }
+    byCoord[key(cords.first, cords.second)] = room;
+}
+
+/*!
+@brief Remove every room from the index.
+*/
+void RoomIndex::clear()
+{
+    all = Grid();
+    byType.clear();
+    byCoord.clear();
+}
+
+/*!
+@brief Get the number of indexed rooms.
+@return The room count.
+*/
+size_t RoomIndex::size() const
+{
+    return byCoord.size();
+}
+
+/*!
+@brief Get the room at a coordinate.
+@param x The x-coordinate.
+@param y The y-coordinate.
+@return The room, or nullptr.
+*/
+Room *RoomIndex::at(int x, int y) const
+{
+    auto it = byCoord.find(key(x, y));
+    return it == byCoord.end() ? nullptr : it->second;
+}
+
+/*!
+@brief Check a room's type and current state against a query.
+@param room The room.
+@param query The conditions.
+@return True if every condition holds.
+*/
+bool RoomIndex::matches(Room *room, const RoomQuery &query)
+{
+    RoomContent &content = room->roomContent;
+    if (query.roomType >= 0 && content.getRoomType() != query.roomType)
+    {
+        return false;
+    }
+    if ((query.filters & WithEnemies) && content.getEnemies().empty())
+    {
+        return false;
+    }
+    if ((query.filters & Unvisited) && content.getVisited())
+    {
+        return false;
+    }
+    if ((query.filters & Visited) && !content.getVisited())
+    {
+        return false;
+    }
+    if ((query.filters & Unsolved) && content.getSolved())
+    {
+        return false;
+    }
+    if ((query.filters & WithItems) && content.getItems().empty())
+    {
+        return false;
+    }
+    return true;
+}
+
+/*!
+@brief Pick the grid that holds every candidate for a query.
+@param query The query.
+@return The type's grid when a type is given, otherwise the grid of all rooms. Returns nullptr if no room has the type.
+*/
+const RoomIndex::Grid *RoomIndex::gridFor(const RoomQuery &query) const
+{
+    if (query.roomType < 0)
+    {
+        return &all;
+    }
+    if (query.roomType >= (int)byType.size() || byType[query.roomType].cells.empty())
+    {
+        return nullptr;
+    }
+    return &byType[query.roomType];
+}
+
+/*!
+@brief Find rooms inside a rectangle.
+@param minX Smallest x-coordinate.
+@param minY Smallest y-coordinate.
+@param maxX Largest x-coordinate.
+@param maxY Largest y-coordinate.
+@param query Room type and state conditions.
+@return The matching rooms.
+@details Only the cells overlapping the rectangle are visited. If the rectangle covers more cells than are occupied,
+the occupied cells are walked instead.
+*/
+std::vector<Room *> RoomIndex::inRect(int minX, int minY, int maxX, int maxY, const RoomQuery &query) const
+{
+    std::vector<Room *> result;
+    const Grid *grid = gridFor(query);
+    if (!grid || minX > maxX || minY > maxY)
+    {
+        return result;
+    }
+
+    auto visit = [&](const std::vector<Entry> &entries)
+    {
+        for (const Entry &entry : entries)
+        {
+            if (entry.x >= minX && entry.x <= maxX && entry.y >= minY && entry.y <= maxY && matches(entry.room, query))
+            {
+                result.push_back(entry.room);
+            }
+        }
+    };
+
+    int fromX = std::max(cellOf(minX), grid->minCellX);
+    int toX = std::min(cellOf(maxX), grid->maxCellX);
+    int fromY = std::max(cellOf(minY), grid->minCellY);
+    int toY = std::min(cellOf(maxY), grid->maxCellY);
+    if (fromX > toX || fromY > toY)
+    {
+        return result;
+    }
+
+    if ((long long)(toX - fromX + 1) * (toY - fromY + 1) > (long long)grid->cells.size())
+    {
+        for (const auto &cell : grid->cells)
+        {
+            visit(cell.second);
+        }
+        return result;
+    }
+
+    for (int cx = fromX; cx <= toX; cx++)
+    {
+        for (int cy = fromY; cy <= toY; cy++)
+        {
+            auto it = grid->cells.find(key(cx, cy));
+            if (it != grid->cells.end())
+            {
+                visit(it->second);
+            }
+        }
+    }
+    return result;
+}
+
+/*!
+@brief Find rooms within a radius.
+@param x Centre x-coordinate.
+@param y Centre y-coordinate.
+@param radius Largest Euclidean distance to include.
+@param query Room type and state conditions.
+@return The matching rooms, nearest first.
+*/
+std::vector<Room *> RoomIndex::withinRadius(int x, int y, int radius, const RoomQuery &query) const
+{
+    std::vector<Room *> box = inRect(x - radius, y - radius, x + radius, y + radius, query);
+    std::vector<std::pair<long long, Room *>> found;
+    long long limit = (long long)radius * radius;
+    for (Room *room : box)
+    {
+        std::pair<int, int> cords = room->roomContent.getCoordinates();
+        long long dx = cords.first - x;
+        long long dy = cords.second - y;
+        if (dx * dx + dy * dy <= limit)
+        {
+            found.push_back({dx * dx + dy * dy, room});
+        }
+    }
+    std::sort(found.begin(), found.end(), [](const std::pair<long long, Room *> &a, const std::pair<long long, Room *> &b)
+              { return a.first < b.first || (a.first == b.first && a.second->id < b.second->id); });
+
+    std::vector<Room *> result;
+    for (const auto &pair : found)
+    {
+        result.push_back(pair.second);
+    }
+    return result;
+}
+
+/*!
+@brief Find the k rooms nearest to a point.
+@param x Point x-coordinate.
+@param y Point y-coordinate.
+@param k Number of rooms to return.
+@param query Room type and state conditions.
+@return Up to k matching rooms, nearest first.
+@details Searches square rings of cells outwards from the point's cell, keeping the best k in a max-heap. The search
+stops once the nearest possible room in the next ring is farther than the current k-th best, or the grid runs out.
+*/
+std::vector<Room *> RoomIndex::nearest(int x, int y, int k, const RoomQuery &query) const
+{
+    std::vector<Room *> result;
+    const Grid *grid = gridFor(query);
+    if (!grid || k <= 0)
+    {
+        return result;
+    }
+
+    typedef std::pair<long long, Room *> Candidate;
+    auto closer = [](const Candidate &a, const Candidate &b)
+    { return a.first < b.first || (a.first == b.first && a.second->id < b.second->id); };
+    std::priority_queue<Candidate, std::vector<Candidate>, decltype(closer)> best(closer);
+
+    int cx = cellOf(x);
+    int cy = cellOf(y);
+    int maxRing = std::max(std::max(cx - grid->minCellX, grid->maxCellX - cx), std::max(cy - grid->minCellY, grid->maxCellY - cy));
+
+    auto visitCell = [&](int cellX, int cellY)
+    {
+        auto it = grid->cells.find(key(cellX, cellY));
+        if (it == grid->cells.end())
+        {
+            return;
+        }
+        for (const Entry &entry : it->second)
+        {
+            if (!matches(entry.room, query))
+            {
+                continue;
+            }
+            long long dx = entry.x - x;
+            long long dy = entry.y - y;
+            Candidate candidate(dx * dx + dy * dy, entry.room);
+            if ((int)best.size() < k)
+            {
+                best.push(candidate);
+            }
+            else if (closer(candidate, best.top()))
+            {
+                best.pop();
+                best.push(candidate);
+            }
+        }
+    };
+
+    for (int ring = 0; ring <= maxRing; ring++)
+    {
+        if ((int)best.size() == k && ring > 0)
+        {
+            long long gap = (long long)(ring - 1) * cellSize + 1;
+            if (gap * gap > best.top().first)
+            {
+                break;
+            }
+        }
+        if (ring == 0)
+        {
+            visitCell(cx, cy);
+            continue;
+        }
+        for (int d = -ring; d <= ring; d++)
+        {
+            visitCell(cx + d, cy - ring);
+            visitCell(cx + d, cy + ring);
+        }
+        for (int d = -ring + 1; d <= ring - 1; d++)
+        {
+            visitCell(cx - ring, cy + d);
+            visitCell(cx + ring, cy + d);
+        }
+    }
+
+    result.resize(best.size());
+    for (int i = (int)best.size() - 1; i >= 0; i--)
+    {
+        result[i] = best.top().second;
+        best.pop();
+    }
+    return result;
+}
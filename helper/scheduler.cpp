@@ -0,0 +1,413 @@
+/*!
+@file scheduler.cpp
+@brief Implementation of the Scheduler class.
+@details Workers sleep on their own condition variable, so a task with an affinity wakes the worker it is meant for.
+A submitter counts the task as pending before checking for sleepers, and a worker marks itself sleeping before checking
+for pending tasks, so however the two interleave one of them sees the other and no task is left with every worker
+asleep.
+*/
+
+#include "../lib/scheduler.h"
+#include <algorithm>
+
+#ifdef __linux__
+#include "../lib/fiber.h"
+#endif
+
+namespace
+{
+    thread_local Scheduler *owner = nullptr; //!< The scheduler the calling thread works for.
+    thread_local int ownIndex = -1;          //!< The calling worker's index in it.
+
+    /*!
+    @brief Raise a running maximum.
+    @param peak The maximum.
+    @param value The new value.
+    */
+    void raise(std::atomic<size_t> &peak, size_t value)
+    {
+        size_t seen = peak.load(std::memory_order_relaxed);
+        while (value > seen && !peak.compare_exchange_weak(seen, value, std::memory_order_relaxed))
+        {
+        }
+    }
+}
+
+/*!
+@class Scheduler::Worker
+@brief A worker thread and its queues.
+@details The counters are written only by the worker itself, except the inbox peak, and read by stats.
+*/
+class Scheduler::Worker
+{
+public:
+    WorkStealingDeque<Task> deque;                   //!< Tasks submitted by the worker's own tasks.
+    std::mutex inboxMutex;                           //!< Guards inbox.
+    std::deque<Task *> inbox;                        //!< Tasks submitted from other threads for this worker.
+    std::atomic<size_t> inboxSize{0};                //!< The inbox's size, readable without the lock.
+    std::mutex sleepMutex;                           //!< Guards woken.
+    std::condition_variable wakeup;                  //!< Signalled to wake the worker.
+    bool woken = false;                              //!< Whether the worker has been asked to wake.
+    std::atomic<bool> sleeping{false};               //!< Whether the worker is sleeping or about to.
+    std::atomic<unsigned long long> executed{0};     //!< Tasks run.
+    std::atomic<unsigned long long> stolen{0};       //!< Tasks taken from other workers.
+    std::atomic<unsigned long long> failedSteals{0}; //!< Searches that found nothing.
+    std::atomic<size_t> peakDepth{0};                //!< The most tasks queued at once.
+    unsigned victimSeed = 0;                         //!< Picks where each search starts.
+    std::thread thread;                              //!< Runs Scheduler::work.
+
+    /*!
+    @brief Get the number of tasks waiting for this worker.
+    @return The deque's and the inbox's sizes together.
+    */
+    size_t depth() const
+    {
+        return deque.size() + inboxSize.load(std::memory_order_relaxed);
+    }
+};
+
+/*!
+@brief Constructor for the Scheduler class.
+@param workers The number of worker threads.
+*/
+Scheduler::Scheduler(int workers)
+    : pending(0), sleepers(0), submitted(0), nextWorker(0), stopping(false)
+{
+    int count = std::max(1, workers);
+    for (int i = 0; i < count; i++)
+    {
+        this->workers.emplace_back(new Worker());
+        this->workers.back()->victimSeed = (unsigned)i * 2654435761u + 1;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        this->workers[i]->thread = std::thread(&Scheduler::work, this, i);
+    }
+}
+
+/*!
+@brief Destructor for the Scheduler class.
+*/
+Scheduler::~Scheduler()
+{
+    stop();
+}
+
+/*!
+@brief Queue a task.
+@param task The function to run.
+@param affinity The worker to prefer, or -1.
+@details A worker's own tasks go on its deque without a lock. Everything else goes to an inbox: the preferred worker's,
+or the next in turn.
+*/
+void Scheduler::submit(std::function<void()> task, int affinity)
+{
+    Task *queued = new Task{std::move(task)};
+    int count = (int)workers.size();
+    int self = owner == this ? ownIndex : -1;
+    submitted.fetch_add(1, std::memory_order_relaxed);
+    pending.fetch_add(1);
+
+    if (self >= 0 && (affinity < 0 || affinity % count == self))
+    {
+        Worker &worker = *workers[self];
+        worker.deque.push(queued);
+        raise(worker.peakDepth, worker.depth());
+        wakeAny();
+        return;
+    }
+
+    int target = affinity >= 0 ? affinity % count : (int)(nextWorker.fetch_add(1, std::memory_order_relaxed) % count);
+    Worker &worker = *workers[target];
+    {
+        std::lock_guard<std::mutex> lock(worker.inboxMutex);
+        worker.inbox.push_back(queued);
+        worker.inboxSize.store(worker.inbox.size(), std::memory_order_relaxed);
+    }
+    raise(worker.peakDepth, worker.depth());
+    if (!wake(target))
+    {
+        wakeAny();
+    }
+}
+
+/*!
+@brief Run the queued tasks, then stop the workers.
+*/
+void Scheduler::stop()
+{
+    std::lock_guard<std::mutex> guard(stopMutex);
+    stopping = true;
+    for (int i = 0; i < (int)workers.size(); i++)
+    {
+        {
+            std::lock_guard<std::mutex> lock(workers[i]->sleepMutex);
+            workers[i]->woken = true;
+        }
+        workers[i]->wakeup.notify_one();
+    }
+    for (std::unique_ptr<Worker> &worker : workers)
+    {
+        if (worker->thread.joinable())
+        {
+            worker->thread.join();
+        }
+    }
+}
+
+/*!
+@brief Get the number of workers.
+@return The number of worker threads.
+*/
+int Scheduler::workerCount() const
+{
+    return (int)workers.size();
+}
+
+/*!
+@brief Get the scheduler's counts.
+@return A snapshot of the counts.
+*/
+SchedulerStats Scheduler::stats() const
+{
+    SchedulerStats stats;
+    stats.submitted = submitted.load();
+    for (const std::unique_ptr<Worker> &worker : workers)
+    {
+        SchedulerStats::Worker counts;
+        counts.executed = worker->executed.load();
+        counts.stolen = worker->stolen.load();
+        counts.failedSteals = worker->failedSteals.load();
+        counts.queueDepth = worker->depth();
+        counts.peakQueueDepth = worker->peakDepth.load();
+        stats.executed += counts.executed;
+        stats.steals += counts.stolen;
+        stats.queued += counts.queueDepth;
+        stats.workers.push_back(counts);
+    }
+    return stats;
+}
+
+/*!
+@brief Get the scheduler whose worker is the calling thread.
+@return The scheduler, or nullptr.
+*/
+Scheduler *Scheduler::current()
+{
+    return owner;
+}
+
+/*!
+@brief Get the index of the calling worker.
+@return The index, or -1.
+*/
+int Scheduler::currentWorker()
+{
+    return ownIndex;
+}
+
+/*!
+@brief Get the scheduler for background work started by the calling thread.
+@return The current scheduler, or the shared one.
+@details The shared scheduler is never destroyed, so background work may still be finishing while the program exits.
+*/
+Scheduler &Scheduler::nearest()
+{
+    if (owner != nullptr)
+    {
+        return *owner;
+    }
+    static Scheduler *shared = new Scheduler((int)std::max(1u, std::thread::hardware_concurrency()));
+    return *shared;
+}
+
+/*!
+@brief Get what resumes the calling fiber once a job has finished.
+@return The fiber's waker, or an empty function.
+*/
+std::function<void()> Scheduler::jobWaker()
+{
+#ifdef __linux__
+    return Fiber::currentWaker();
+#else
+    return std::function<void()>();
+#endif
+}
+
+/*!
+@brief Suspend the calling fiber until its waker resumes it.
+*/
+void Scheduler::parkForJob()
+{
+#ifdef __linux__
+    Fiber::suspend();
+#endif
+}
+
+/*!
+@brief Run tasks on a worker thread until the scheduler stops.
+@param index The worker's index.
+*/
+void Scheduler::work(int index)
+{
+    owner = this;
+    ownIndex = index;
+    Worker &self = *workers[index];
+    while (true)
+    {
+        Task *task = find(index);
+        if (task != nullptr)
+        {
+            pending.fetch_sub(1);
+            task->run();
+            delete task;
+            self.executed.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        if (stopping && pending.load() == 0)
+        {
+            break;
+        }
+        if (pending.load() > 0)
+        {
+            // Another worker is between taking a task and counting it, or won a race for one
+            std::this_thread::yield();
+            continue;
+        }
+        idle(index);
+    }
+    owner = nullptr;
+    ownIndex = -1;
+}
+
+/*!
+@brief Find a task for a worker.
+@param index The worker's index.
+@return The task, or nullptr.
+@details Other workers are searched from a different starting point each time, so thieves spread over their victims.
+Each victim's deque is tried before its inbox, since the deque holds the work its own tasks have split off.
+*/
+Scheduler::Task *Scheduler::find(int index)
+{
+    Worker &self = *workers[index];
+    Task *task = self.deque.pop();
+    if (task != nullptr)
+    {
+        return task;
+    }
+    if (self.inboxSize.load(std::memory_order_relaxed) > 0)
+    {
+        std::lock_guard<std::mutex> lock(self.inboxMutex);
+        if (!self.inbox.empty())
+        {
+            task = self.inbox.front();
+            self.inbox.pop_front();
+            self.inboxSize.store(self.inbox.size(), std::memory_order_relaxed);
+            return task;
+        }
+    }
+
+    int count = (int)workers.size();
+    if (count == 1 || pending.load() == 0)
+    {
+        return nullptr;
+    }
+    self.victimSeed = self.victimSeed * 1103515245u + 12345u;
+    int start = (int)((self.victimSeed >> 16) % (unsigned)count);
+    for (int i = 0; i < count; i++)
+    {
+        int victim = (start + i) % count;
+        if (victim == index)
+        {
+            continue;
+        }
+        Worker &other = *workers[victim];
+        task = other.deque.steal();
+        if (task == nullptr && other.inboxSize.load(std::memory_order_relaxed) > 0)
+        {
+            std::lock_guard<std::mutex> lock(other.inboxMutex);
+            if (!other.inbox.empty())
+            {
+                task = other.inbox.front();
+                other.inbox.pop_front();
+                other.inboxSize.store(other.inbox.size(), std::memory_order_relaxed);
+            }
+        }
+        if (task != nullptr)
+        {
+            self.stolen.fetch_add(1, std::memory_order_relaxed);
+            return task;
+        }
+    }
+    self.failedSteals.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+}
+
+/*!
+@brief Sleep a worker until it is woken, unless there is work.
+@param index The worker's index.
+*/
+void Scheduler::idle(int index)
+{
+    Worker &self = *workers[index];
+    std::unique_lock<std::mutex> lock(self.sleepMutex);
+    self.sleeping.store(true);
+    sleepers.fetch_add(1);
+    if (pending.load() == 0)
+    {
+        while (!self.woken && !stopping)
+        {
+            self.wakeup.wait(lock);
+        }
+    }
+    self.woken = false;
+    sleepers.fetch_sub(1);
+    self.sleeping.store(false);
+}
+
+/*!
+@brief Wake a worker if it is sleeping.
+@param index The worker's index.
+@return True if it was, and had not already been asked to wake.
+@details A worker that has been woken but not yet scheduled still looks asleep. It is not counted again, so a burst of
+submissions wakes one more worker each until all are awake, rather than waking the same one over and over.
+*/
+bool Scheduler::wake(int index)
+{
+    Worker &worker = *workers[index];
+    if (!worker.sleeping.load())
+    {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(worker.sleepMutex);
+        if (worker.woken)
+        {
+            return false;
+        }
+        worker.woken = true;
+    }
+    worker.wakeup.notify_one();
+    return true;
+}
+
+/*!
+@brief Wake one sleeping worker, if there is one.
+*/
+void Scheduler::wakeAny()
+{
+    if (sleepers.load() == 0)
+    {
+        return;
+    }
+    for (int i = 0; i < (int)workers.size(); i++)
+    {
+        if (i != ownIndex || owner != this)
+        {
+            if (wake(i))
+            {
+                return;
+            }
+        }
+    }
+}
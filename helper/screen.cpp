@@ -0,0 +1,623 @@
+/*!
+@file screen.cpp
+@brief Implementation of the Screen class.
+@details This file contains the implementation of the Screen class. Both buffers are filled by the same small
+terminal model, so text drawn into the back buffer and text reported as already written to the terminal are
+interpreted the same way.
+*/
+
+#include "../lib/screen.h"
+#include "../lib/headless.h"
+#include <algorithm>
+#include <sstream>
+
+/*!
+@brief Constructor for the Screen class.
+@param width The terminal width in columns.
+*/
+Screen::Screen(int width) : width(width < 1 ? 1 : width), cursorStyleKnown(false), rowsOnTerminal(0), valid(false)
+{
+    styles.push_back({"", "", 0, "\033[0m"});
+}
+
+/*!
+@brief Start a new frame.
+*/
+void Screen::begin()
+{
+    back.clear();
+    backPen = Pen();
+}
+
+/*!
+@brief Draw text into the back buffer.
+@param text The text to draw. Sequences the screen cannot model are skipped.
+*/
+void Screen::draw(const std::string &text)
+{
+    apply(back, backPen, text, false);
+}
+
+/*!
+@brief Report text written to the terminal outside present.
+@param text The text.
+@details If the text contains something the screen cannot model, the screen is invalidated instead.
+*/
+void Screen::written(const std::string &text)
+{
+    if (valid && !apply(front, cursor, text, true))
+    {
+        invalidate();
+    }
+}
+
+/*!
+@brief Report that the player typed a line of input.
+@details The terminal echoed an unknown amount of text at the cursor and then moved to the next line.
+*/
+void Screen::inputLine()
+{
+    if (!valid)
+    {
+        return;
+    }
+    if ((int)front.size() <= cursor.row)
+    {
+        front.resize(cursor.row + 1);
+    }
+    std::vector<Cell> &row = front[cursor.row];
+    int from = std::min(cursor.col, width);
+    row.resize(width, blank());
+    std::fill(row.begin() + from, row.end(), Cell{Unknown, 0});
+    cursor.row++;
+    cursor.col = 0;
+    rowsOnTerminal = std::max(rowsOnTerminal, cursor.row + 1);
+    if ((int)front.size() <= cursor.row)
+    {
+        front.resize(cursor.row + 1);
+    }
+}
+
+/*!
+@brief Forget the terminal contents.
+*/
+void Screen::invalidate()
+{
+    valid = false;
+}
+
+/*!
+@brief Get the terminal width.
+@return The width in columns.
+*/
+int Screen::getWidth() const
+{
+    return width;
+}
+
+/*!
+@brief Get a blank cell.
+@return A space in the default style.
+*/
+Screen::Cell Screen::blank()
+{
+    return Cell{U' ', 0};
+}
+
+/*!
+@brief Check whether a style changes how a blank cell looks.
+@param style The style index.
+@return True if the style has a background colour or is reversed.
+*/
+bool Screen::paintsBlank(unsigned short style) const
+{
+    return !styles[style].bg.empty() || (styles[style].attrs & (1u << 7));
+}
+
+/*!
+@brief Check whether a cell looks right when written in the terminal's current style.
+@param cell The cell.
+@return True if the cell has the current style, or is a plain space and the current style leaves spaces plain.
+*/
+bool Screen::inCursorStyle(const Cell &cell) const
+{
+    if (!cursorStyleKnown)
+    {
+        return false;
+    }
+    return cell.style == cursor.style || (cell.ch == U' ' && !paintsBlank(cell.style) && !paintsBlank(cursor.style));
+}
+
+/*!
+@brief Apply an SGR parameter list to a style.
+@param style The current style.
+@param params The parameters between "\033[" and "m".
+@return The index of the resulting style, added to the table if it is new.
+*/
+unsigned short Screen::applySgr(unsigned short style, const std::string &params)
+{
+    Style next = styles[style];
+    std::vector<std::string> parts;
+    std::stringstream stream(params);
+    std::string part;
+    while (std::getline(stream, part, ';'))
+    {
+        parts.push_back(part);
+    }
+    if (parts.empty())
+    {
+        parts.push_back("0");
+    }
+
+    for (size_t i = 0; i < parts.size(); i++)
+    {
+        int code = parts[i].empty() ? 0 : std::atoi(parts[i].c_str());
+        if (code == 0)
+        {
+            next.fg.clear();
+            next.bg.clear();
+            next.attrs = 0;
+        }
+        else if (code >= 1 && code <= 9)
+        {
+            next.attrs |= 1u << code;
+        }
+        else if (code == 21 || code == 22)
+        {
+            next.attrs &= ~((1u << 1) | (1u << 2));
+        }
+        else if (code >= 23 && code <= 29)
+        {
+            next.attrs &= ~(1u << (code - 20));
+        }
+        else if ((code >= 30 && code <= 37) || (code >= 90 && code <= 97))
+        {
+            next.fg = parts[i];
+        }
+        else if (code == 39)
+        {
+            next.fg.clear();
+        }
+        else if ((code >= 40 && code <= 47) || (code >= 100 && code <= 107))
+        {
+            next.bg = parts[i];
+        }
+        else if (code == 49)
+        {
+            next.bg.clear();
+        }
+        else if ((code == 38 || code == 48) && i + 1 < parts.size())
+        {
+            // Extended colours: 38;5;n or 38;2;r;g;b
+            size_t count = parts[i + 1] == "5" ? 2 : 4;
+            std::string colour = parts[i];
+            for (size_t j = 1; j <= count && i + j < parts.size(); j++)
+            {
+                colour += ";" + parts[i + j];
+            }
+            (code == 38 ? next.fg : next.bg) = colour;
+            i += count;
+        }
+    }
+
+    next.sgr = "\033[0";
+    for (int attr = 1; attr <= 9; attr++)
+    {
+        if (next.attrs & (1u << attr))
+        {
+            next.sgr += ";" + std::to_string(attr);
+        }
+    }
+    if (!next.fg.empty())
+    {
+        next.sgr += ";" + next.fg;
+    }
+    if (!next.bg.empty())
+    {
+        next.sgr += ";" + next.bg;
+    }
+    next.sgr += "m";
+    if (next.sgr == "\033[0m")
+    {
+        return 0;
+    }
+
+    for (size_t i = 0; i < styles.size(); i++)
+    {
+        if (styles[i].sgr == next.sgr)
+        {
+            return (unsigned short)i;
+        }
+    }
+    styles.push_back(next);
+    return (unsigned short)(styles.size() - 1);
+}
+
+/*!
+@brief Apply text to a buffer as a terminal would.
+@param buffer The buffer to change.
+@param pen The position and style to write with, updated as the text is applied.
+@param text The text.
+@param terminal True if the buffer is the front buffer.
+@return False if the text contained a sequence the screen cannot model. Everything else in the text is still applied.
+@details Lines are broken by "\n" (which also returns to the first column, as the terminal's output processing
+does) and wrap at the terminal width. SGR sequences change the pen's style. Cursor up, down, forward, back and
+column sequences move the pen, and erase-line sequences blank part of a line.
+*/
+bool Screen::apply(Buffer &buffer, Pen &pen, const std::string &text, bool terminal)
+{
+    bool modelled = true;
+    auto ensureRow = [&]()
+    {
+        if ((int)buffer.size() <= pen.row)
+        {
+            buffer.resize(pen.row + 1);
+        }
+        if (terminal)
+        {
+            rowsOnTerminal = std::max(rowsOnTerminal, pen.row + 1);
+        }
+    };
+    ensureRow();
+
+    size_t i = 0;
+    while (i < text.size())
+    {
+        unsigned char c = (unsigned char)text[i];
+        if (c == 0x1b)
+        {
+            if (i + 1 >= text.size() || text[i + 1] != '[')
+            {
+                modelled = false;
+                i += 2;
+                continue;
+            }
+            size_t end = i + 2;
+            while (end < text.size() && !(text[end] >= 0x40 && text[end] <= 0x7e))
+            {
+                end++;
+            }
+            if (end >= text.size())
+            {
+                return false;
+            }
+            std::string params = text.substr(i + 2, end - i - 2);
+            int n = params.empty() ? 1 : std::max(1, std::atoi(params.c_str()));
+            int col = std::min(pen.col, width - 1);
+            switch (text[end])
+            {
+            case 'm':
+                pen.style = applySgr(pen.style, params);
+                break;
+            case 'A':
+                pen.row = std::max(0, pen.row - n);
+                pen.col = col;
+                break;
+            case 'B':
+                pen.row += n;
+                pen.col = col;
+                ensureRow();
+                break;
+            case 'C':
+                pen.col = std::min(width - 1, col + n);
+                break;
+            case 'D':
+                pen.col = std::max(0, col - n);
+                break;
+            case 'G':
+                pen.col = std::min(width - 1, n - 1);
+                break;
+            case 'K':
+            {
+                std::vector<Cell> &row = buffer[pen.row];
+                int mode = params.empty() ? 0 : std::atoi(params.c_str());
+                if (mode == 0)
+                {
+                    if ((int)row.size() > col)
+                    {
+                        row.resize(col);
+                    }
+                }
+                else
+                {
+                    int upTo = mode == 1 ? std::min(col + 1, (int)row.size()) : (int)row.size();
+                    std::fill(row.begin(), row.begin() + upTo, blank());
+                }
+                break;
+            }
+            default:
+                modelled = false;
+                break;
+            }
+            i = end + 1;
+            continue;
+        }
+
+        if (c == '\n')
+        {
+            pen.row++;
+            pen.col = 0;
+            ensureRow();
+            i++;
+            continue;
+        }
+        if (c == '\r')
+        {
+            pen.col = 0;
+            i++;
+            continue;
+        }
+        if (c == '\b')
+        {
+            pen.col = std::max(0, std::min(pen.col, width - 1) - 1);
+            i++;
+            continue;
+        }
+        if (c == '\t')
+        {
+            pen.col = std::min(width - 1, (pen.col / 8 + 1) * 8);
+            i++;
+            continue;
+        }
+        if (c < 0x20 || c == 0x7f)
+        {
+            i++;
+            continue;
+        }
+
+        // Decode one UTF-8 character
+        char32_t ch = c;
+        int extra = c >= 0xf0 ? 3 : c >= 0xe0 ? 2 : c >= 0xc0 ? 1 : 0;
+        if (extra)
+        {
+            ch = c & (0x3f >> extra);
+            for (int k = 1; k <= extra && i + k < text.size(); k++)
+            {
+                ch = (ch << 6) | ((unsigned char)text[i + k] & 0x3f);
+            }
+        }
+        i += 1 + extra;
+
+        if (pen.col >= width)
+        {
+            pen.row++;
+            pen.col = 0;
+            ensureRow();
+        }
+        std::vector<Cell> &row = buffer[pen.row];
+        if ((int)row.size() <= pen.col)
+        {
+            row.resize(pen.col + 1, blank());
+        }
+        unsigned short style = (ch == U' ' && !paintsBlank(pen.style)) ? 0 : pen.style;
+        row[pen.col] = Cell{ch, style};
+        pen.col++;
+    }
+    return modelled;
+}
+
+/*!
+@brief Move the terminal cursor.
+@param out The bytes to send.
+@param row The target line.
+@param col The target column.
+@details Moves up with cursor-up and down with cursor-down while the line exists on the terminal; beyond that,
+newlines create the lines. Columns are reached with a carriage return or an absolute column sequence.
+*/
+void Screen::moveTo(std::string &out, int row, int col)
+{
+    if (row < cursor.row)
+    {
+        int n = cursor.row - row;
+        out += n == 1 ? "\033[A" : "\033[" + std::to_string(n) + "A";
+        cursor.row = row;
+    }
+    else if (row > cursor.row)
+    {
+        int existing = std::min(row, rowsOnTerminal - 1);
+        if (existing > cursor.row)
+        {
+            int n = existing - cursor.row;
+            out += n == 1 ? "\033[B" : "\033[" + std::to_string(n) + "B";
+            cursor.row = existing;
+        }
+        while (cursor.row < row)
+        {
+            out += '\n';
+            cursor.row++;
+            cursor.col = 0;
+        }
+        rowsOnTerminal = std::max(rowsOnTerminal, row + 1);
+    }
+
+    if (col != cursor.col)
+    {
+        out += col == 0 ? "\r" : "\033[" + std::to_string(col + 1) + "G";
+        cursor.col = col;
+    }
+}
+
+/*!
+@brief Move the terminal cursor to a cell in the back buffer.
+@param out The bytes to send.
+@param row The target line.
+@param col The target column.
+@details A short gap on the cursor's line is crossed by rewriting the back buffer's cells when they need no style
+change, which is cheaper than a column sequence. Otherwise moveTo is used.
+*/
+void Screen::advanceTo(std::string &out, int row, int col)
+{
+    if (cursor.row == row && cursor.col < col && col - cursor.col <= 3 && row < (int)back.size())
+    {
+        const std::vector<Cell> &line = back[row];
+        bool bridged = true;
+        for (int g = cursor.col; g < col && bridged; g++)
+        {
+            bridged = inCursorStyle(g < (int)line.size() ? line[g] : blank());
+        }
+        if (bridged)
+        {
+            for (int g = cursor.col; g < col; g++)
+            {
+                put(out, g < (int)line.size() ? line[g] : blank());
+            }
+            return;
+        }
+    }
+    moveTo(out, row, col);
+}
+
+/*!
+@brief Set the terminal style.
+@param out The bytes to send.
+@param style The style index.
+*/
+void Screen::setStyle(std::string &out, unsigned short style)
+{
+    if (!cursorStyleKnown || cursor.style != style)
+    {
+        out += styles[style].sgr;
+        cursor.style = style;
+        cursorStyleKnown = true;
+    }
+}
+
+/*!
+@brief Send a character and advance the cursor.
+@param out The bytes to send.
+@param cell The cell to send. Its style must already be set.
+*/
+void Screen::put(std::string &out, const Cell &cell)
+{
+    encode(out, cell.ch);
+    cursor.col++;
+}
+
+/*!
+@brief Append a character as UTF-8.
+@param out The bytes to append to.
+@param ch The character.
+*/
+void Screen::encode(std::string &out, char32_t ch)
+{
+    if (ch < 0x80)
+    {
+        out += (char)ch;
+    }
+    else if (ch < 0x800)
+    {
+        out += (char)(0xc0 | (ch >> 6));
+        out += (char)(0x80 | (ch & 0x3f));
+    }
+    else if (ch < 0x10000)
+    {
+        out += (char)(0xe0 | (ch >> 12));
+        out += (char)(0x80 | ((ch >> 6) & 0x3f));
+        out += (char)(0x80 | (ch & 0x3f));
+    }
+    else
+    {
+        out += (char)(0xf0 | (ch >> 18));
+        out += (char)(0x80 | ((ch >> 12) & 0x3f));
+        out += (char)(0x80 | ((ch >> 6) & 0x3f));
+        out += (char)(0x80 | (ch & 0x3f));
+    }
+}
+
+/*!
+@brief End the frame and produce the update.
+@return The bytes that bring the terminal from the front buffer to the back buffer.
+@details Each line is compared cell by cell. Changed cells are written after moving the cursor to them, except that
+a short run of unchanged cells in the current style is rewritten when that is cheaper than a cursor sequence. Once
+the rest of a line is blank in the back buffer, it is cleared with a single erase-line sequence.
+In headless mode the frame is returned as plain text instead, with no colours or cursor movement.
+*/
+std::string Screen::present()
+{
+    std::string out;
+    if (isHeadless())
+    {
+        for (size_t r = 0; r < back.size(); r++)
+        {
+            size_t end = back[r].size();
+            while (end > 0 && (back[r][end - 1].ch == U' ' || back[r][end - 1].ch == Unknown))
+            {
+                end--;
+            }
+            for (size_t c = 0; c < end; c++)
+            {
+                encode(out, back[r][c].ch == Unknown ? U' ' : back[r][c].ch);
+            }
+            if (r + 1 < back.size())
+            {
+                out += '\n';
+            }
+        }
+        valid = false;
+        return out;
+    }
+    if (!valid)
+    {
+        // Start a fresh region at the cursor's line; nothing on it is known
+        out += '\r';
+        cursor = Pen();
+        cursorStyleKnown = false;
+        rowsOnTerminal = 1;
+        front.assign(1, std::vector<Cell>(width, Cell{Unknown, 0}));
+        valid = true;
+    }
+
+    size_t rows = std::max(front.size(), back.size());
+    static const std::vector<Cell> empty;
+    for (size_t r = 0; r < rows; r++)
+    {
+        const std::vector<Cell> &b = r < back.size() ? back[r] : empty;
+        const std::vector<Cell> &f = r < front.size() ? front[r] : empty;
+
+        int lastBack = (int)b.size() - 1;
+        while (lastBack >= 0 && b[lastBack] == blank())
+        {
+            lastBack--;
+        }
+        int cols = (int)std::max(b.size(), f.size());
+        auto backAt = [&](int c)
+        { return c < (int)b.size() ? b[c] : blank(); };
+        auto frontAt = [&](int c)
+        { return c < (int)f.size() ? f[c] : blank(); };
+
+        for (int c = 0; c < cols; c++)
+        {
+            if (backAt(c) == frontAt(c))
+            {
+                continue;
+            }
+            if (c > lastBack)
+            {
+                moveTo(out, (int)r, c);
+                if (!cursorStyleKnown || paintsBlank(cursor.style))
+                {
+                    setStyle(out, 0);
+                }
+                out += "\033[K";
+                break;
+            }
+
+            advanceTo(out, (int)r, c);
+            if (!inCursorStyle(backAt(c)))
+            {
+                setStyle(out, backAt(c).style);
+            }
+            put(out, backAt(c));
+        }
+    }
+
+    advanceTo(out, backPen.row, std::min(backPen.col, width - 1));
+    setStyle(out, backPen.style);
+
+    front = back;
+    if ((int)front.size() < rowsOnTerminal)
+    {
+        front.resize(rowsOnTerminal);
+    }
+    return out;
+}
@@ -0,0 +1,1695 @@
+/*!
+@file server.cpp
+@brief Implementation of the multi-session game server.
+@details This file contains the implementation of the GameServer class and its Session helper. Sockets are
+non-blocking and watched with level-triggered epoll by the reactor thread. A session's fiber is resumed by a task on
+the server's Scheduler when its input arrives or its timer is due; the fiber runs until the game next waits, then the
+worker moves on to its next task. Spectators are handled by the reactor alone and have no fiber. A session handed off
+ends its fiber like any other, and the reactor sends it on instead of closing it.
+*/
+
+#ifdef __linux__
+
+#include "../lib/server.h"
+#include "../lib/compression.h"
+#include "../lib/console.h"
+#include "../lib/framefeed.h"
+#include "../lib/hibernation.h"
+#include "../lib/menu.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+    const size_t MaxPendingInput = 64 * 1024; //!< Unread input allowed before a client is treated as flooding.
+    const int StopGraceMs = 2000;            //!< How long stop waits for sessions to end once their input is closed.
+    const size_t MaxChoiceInput = 256;       //!< Input allowed from a spectator before they have chosen a session.
+    const size_t FramesPerSend = 16;         //!< Most frames given to one sendmsg call for a spectator.
+    const size_t SessionsListed = 20;        //!< Most sessions listed for a spectator to choose from.
+    const size_t HandoffWindow = 8;          //!< Most sessions stopped for a handoff and not yet sent at once.
+    const int HandoffSendTimeoutSeconds = 5; //!< How long sending a record may block before the other server is given up on.
+    const int IdleTrimMs = 10000;            //!< How long the reactor must go without events before it trims the heap.
+
+    /*!
+    @brief Get the time on the steady clock, which every process on the machine shares.
+    @return The time in nanoseconds.
+    */
+    long long steadyNanoseconds()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /*!
+    @brief Send a short message to a client without waiting, dropping whatever the socket will not take.
+    @param fd The socket.
+    @param text The message.
+    */
+    void sendText(int fd, const std::string &text)
+    {
+        ssize_t ignored = ::send(fd, text.data(), text.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+        (void)ignored;
+    }
+
+    /*!
+    @brief Get the epoll events to watch a client's socket for.
+    @param output Whether to watch for room to write as well as for input.
+    @return The events.
+    */
+    uint32_t watchedEvents(bool output)
+    {
+        return EPOLLIN | EPOLLRDHUP | (output ? (uint32_t)EPOLLOUT : 0u);
+    }
+
+    /*!
+    @enum RunState
+    @brief Where a session is between the scheduler and its fiber. Only one task may resume a fiber at a time.
+    */
+    enum RunState
+    {
+        Idle,    //!< Waiting for input or a timer.
+        Queued,  //!< A task to resume it is queued.
+        Running, //!< A task is resuming it.
+        RunAgain //!< A task is resuming it and it was woken meanwhile, so it is queued again afterwards.
+    };
+}
+
+/*!
+@class GameServer::Session
+@brief One player's connection and game.
+@details The session is the input source and output sink under its console. Input is read by the reactor into the
+inbox; a fiber that finds the inbox empty parks itself until the reactor wakes it. Output is sent straight away when
+the socket has room and otherwise left in the outbox for the reactor to send when epoll says it can. On its way the
+output is published to the session's feed, which asks the reactor to send it to spectators when there are any.
+*/
+class GameServer::Session : public InputSource, public OutputSink
+{
+public:
+    /*!
+    @brief Constructor for the Session class.
+    @param server The server.
+    @param fd The connected socket.
+    @param home The worker the session should run on.
+    @param id The number spectators choose the session by.
+    */
+    Session(GameServer &server, int fd, int home, unsigned long long id)
+        : server(server), fd(fd), id(id), home(home), runState(Idle), compression(*this),
+          feed(std::make_shared<FrameFeed>(server.options.spectatorFrames)), tee(compression, *feed), telnet(*this, compression),
+          console(telnet, tee)
+    {
+        feed->setListener([this]
+                          { this->server.notify(self.lock()); });
+    }
+
+    /*!
+    @brief Read input, parking the fiber until some arrives.
+    @param buffer Where to put it.
+    @param size The most to read.
+    @return The number of bytes read, or 0 once the client has gone.
+    */
+    size_t read(char *buffer, size_t size) override
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (inbox.empty() && !peerClosed)
+        {
+            parked = true;
+            lock.unlock();
+            Fiber::suspend();
+            lock.lock();
+        }
+        parked = false;
+        size_t count = std::min(size, inbox.size());
+        inbox.copy(buffer, count);
+        inbox.erase(0, count);
+        return count;
+    }
+
+    /*!
+    @brief Wait for input, parking the fiber until some arrives or the time runs out.
+    @param milliseconds The longest to wait, or -1 to wait indefinitely.
+    @return False if the time ran out first.
+    */
+    bool wait(int milliseconds) override
+    {
+        auto due = TimerQueue::Clock::now() + std::chrono::milliseconds(std::max(0, milliseconds));
+        std::unique_lock<std::mutex> lock(mutex);
+        while (inbox.empty() && !peerClosed && !(console.handoffRequested() && console.atTurn()))
+        {
+            if (milliseconds >= 0 && TimerQueue::Clock::now() >= due)
+            {
+                parked = false;
+                return false;
+            }
+            parked = true;
+            lock.unlock();
+            if (milliseconds < 0)
+            {
+                Fiber::suspend();
+            }
+            else
+            {
+                Fiber::suspendUntil(due);
+            }
+            lock.lock();
+        }
+        parked = false;
+        return true;
+    }
+
+    /*!
+    @brief Get the session ready to be sent to another server, once its game has stopped for a handoff.
+    @param state The state the game stopped with.
+    @param stopped When it stopped, in steady clock nanoseconds.
+    @details A compressed stream is ended here, so the other server can start a new one, and input the console had read
+    but the game had not is put back in front of the inbox.
+    */
+    void stopForHandoff(const std::string &state, long long stopped)
+    {
+        bool compressed = compression.compressing();
+        compression.end();
+        std::string unread = console.takeBufferedInput();
+        std::lock_guard<std::mutex> lock(mutex);
+        handedOff = true;
+        handoffState = state;
+        wasCompressing = compressed;
+        stoppedAt = stopped;
+        inbox.insert(0, unread);
+    }
+
+    /*!
+    @brief Send output, keeping what the socket will not take yet.
+    @param data The bytes.
+    @param size How many there are.
+    @return False if the client has gone or has fallen too far behind.
+    */
+    bool write(const char *data, size_t size) override
+    {
+        bool wake = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (fd < 0 || lost)
+            {
+                return false;
+            }
+            while (outbox.empty() && size > 0)
+            {
+                ssize_t sent = ::send(fd, data, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+                if (sent < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+                {
+                    lost = true;
+                    peerClosed = true;
+                    return false;
+                }
+                if (sent < 0)
+                {
+                    break;
+                }
+                data += sent;
+                size -= sent;
+            }
+            if (size > 0)
+            {
+                if (outbox.size() + size > server.options.maxPendingOutput)
+                {
+                    lost = true;
+                    peerClosed = true;
+                    return false;
+                }
+                outbox.append(data, size);
+                wake = true;
+            }
+        }
+        if (wake)
+        {
+            server.notify(self.lock());
+        }
+        return true;
+    }
+
+    GameServer &server;              //!< The server.
+    int fd;                          //!< The socket, or -1 once closed.
+    unsigned long long id;           //!< The number spectators choose the session by.
+    std::atomic<int> home;           //!< The worker that last ran the session, given as its affinity.
+    std::atomic<int> runState;       //!< A RunState.
+    std::weak_ptr<Session> self;     //!< The session's own shared pointer, for notify.
+    TimerQueue::TimerId wakeTimer = 0; //!< The timer that ends the fiber's sleep, or 0. Used only by run.
+    std::mutex mutex;                //!< Guards the fields below, between the reactor, the worker and timer threads.
+    std::string inbox;               //!< Input read from the socket but not by the game.
+    std::string outbox;              //!< Output the socket has not taken yet.
+    bool peerClosed = false;         //!< Whether no more input will arrive.
+    bool lost = false;               //!< Whether output can no longer be delivered.
+    bool parked = false;             //!< Whether the fiber is waiting for input.
+    bool watchingOutput = false;     //!< Whether epoll is watching for room to write.
+    bool watchingInput = true;       //!< Whether the socket is still registered with epoll.
+    bool ended = false;              //!< Whether the game has finished.
+    bool notified = false;           //!< Whether the session is in the reactor's pending list. Guarded by pendingMutex.
+    bool handedOff = false;          //!< Whether the game stopped to be handed to another server.
+    std::string handoffState;        //!< The state it stopped with.
+    bool wasCompressing = false;     //!< Whether its output was compressed when it stopped.
+    long long stoppedAt = 0;         //!< When it stopped, in steady clock nanoseconds.
+    long long carriedFrom = 0;       //!< When an adopted session's game stopped on the other server, until it runs here.
+    bool inFlight = false;           //!< Whether it was asked to stop and counts against the handoff window, until sent.
+    std::weak_ptr<Channel> adoptedFrom; //!< The connection an adopted session came on, until it has run here.
+    std::vector<int> watchers;       //!< The sockets of the session's spectators, used only by the reactor.
+    CompressingSink compression;     //!< Compresses output once a Telnet client agrees.
+    std::shared_ptr<FrameFeed> feed; //!< The output as spectators are sent it, kept by them after the session closes.
+    FeedSink tee;                    //!< Publishes output to the feed before it is compressed.
+    TelnetSource telnet;             //!< Strips Telnet commands from input.
+    Console console;                 //!< The session's streams.
+    std::unique_ptr<Fiber> fiber;    //!< Runs the session's game.
+};
+
+/*!
+@struct GameServer::Spectator
+@brief One spectator's connection, used only by the reactor.
+@details The frames being sent are the feed's own shared frames, so a spectator holds pointers rather than copies
+while their socket catches up.
+*/
+struct GameServer::Spectator
+{
+    int fd = -1;                               //!< The socket.
+    std::string typed;                         //!< What they have typed before choosing a session.
+    std::weak_ptr<Session> session;            //!< The session watched, while it is open.
+    std::shared_ptr<FrameFeed> feed;           //!< The session's feed, or nullptr before they choose.
+    unsigned long long cursor = 0;             //!< The sequence number of the next frame to take from the feed.
+    std::vector<FrameFeed::Frame> sending;     //!< Frames taken from the feed and not all sent yet.
+    size_t frame = 0;                          //!< The first frame in sending not all sent.
+    size_t offset = 0;                         //!< The bytes of that frame already sent.
+    bool watchingOutput = false;               //!< Whether epoll is watching for room to write.
+};
+
+/*!
+@struct GameServer::Channel
+@brief A connection from a server handing sessions off.
+@details An adopted session keeps a weak pointer to the connection it came on, and its worker acknowledges it there
+once it has run. The socket is closed only when the last pointer goes, so an acknowledgement is never sent to a socket
+that has been closed and its number reused.
+*/
+struct GameServer::Channel
+{
+    /*!
+    @brief Constructor for the Channel struct.
+    @param fd The connection.
+    */
+    explicit Channel(int fd) : fd(fd)
+    {
+    }
+
+    /*!
+    @brief Destructor for the Channel struct. Closes the connection.
+    */
+    ~Channel()
+    {
+        ::close(fd);
+    }
+
+    int fd;               //!< The connection.
+    HandoffReader reader; //!< Reads the records sent on it.
+};
+
+/*!
+@brief Constructor for the GameServer class.
+@param options How to listen and run sessions.
+@param session The code each session runs, or nullptr for the main menu.
+@param resume The code each adopted session runs, or nullptr to carry on its game and then run the main menu.
+*/
+GameServer::GameServer(const ServerOptions &options, std::function<void()> session, std::function<void(const std::string &)> resume)
+    : options(options), session(session ? std::move(session) : std::function<void()>(RunMainMenu)),
+      resume(resume ? std::move(resume) : std::function<void(const std::string &)>(ResumeMainMenu)), listener(-1),
+      epoll(-1), wakeup(-1), boundPort(0), spectatorListener(-1), boundSpectatorPort(0), handoffListener(-1),
+      handoffChannel(-1), handoffsInFlight(0), handingOff(false), handoffAsked(false), stopping(false), stopped(false),
+      nextWorker(0), lastSession(0), trimmedAfter(0)
+{
+    this->options.workers = std::max(1, this->options.workers);
+}
+
+/*!
+@brief Destructor for the GameServer class.
+*/
+GameServer::~GameServer()
+{
+    stop();
+}
+
+/*!
+@brief Open a listening socket.
+@param unixPath The Unix socket, or empty for TCP.
+@param port The TCP port.
+@param bound Set to the TCP port bound.
+@return The socket, or -1.
+*/
+int GameServer::openListener(const std::string &unixPath, int port, int &bound)
+{
+    bool unixSocket = !unixPath.empty();
+    int fd = ::socket(unixSocket ? AF_UNIX : AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int result = -1;
+    if (fd >= 0 && unixSocket)
+    {
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, unixPath.c_str(), sizeof(address.sun_path) - 1);
+        ::unlink(unixPath.c_str());
+        result = ::bind(fd, (sockaddr *)&address, sizeof(address));
+    }
+    else if (fd >= 0)
+    {
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (options.sharePort)
+        {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
+        }
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons((uint16_t)port);
+        if (inet_pton(AF_INET, options.host.c_str(), &address.sin_addr) == 1)
+        {
+            result = ::bind(fd, (sockaddr *)&address, sizeof(address));
+        }
+        socklen_t length = sizeof(address);
+        if (result == 0 && getsockname(fd, (sockaddr *)&address, &length) == 0)
+        {
+            bound = ntohs(address.sin_port);
+        }
+    }
+    if (result != 0 || ::listen(fd, SOMAXCONN) != 0)
+    {
+        std::cerr << "Could not listen on " << (unixSocket ? unixPath : options.host + ":" + std::to_string(port))
+                  << ": " << std::strerror(errno) << std::endl;
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+/*!
+@brief Open the listening sockets and start the threads.
+@return False if a socket could not be opened.
+*/
+bool GameServer::start()
+{
+    listener = openListener(options.unixPath, options.port, boundPort);
+    if (listener < 0)
+    {
+        return false;
+    }
+    if (!options.spectatorUnixPath.empty() || options.spectatorPort >= 0)
+    {
+        spectatorListener = openListener(options.spectatorUnixPath, options.spectatorPort, boundSpectatorPort);
+        if (spectatorListener < 0)
+        {
+            ::close(listener);
+            listener = -1;
+            return false;
+        }
+    }
+    if (!options.handoffPath.empty())
+    {
+        int unused = 0;
+        handoffListener = openListener(options.handoffPath, 0, unused);
+        if (handoffListener < 0)
+        {
+            ::close(listener);
+            if (spectatorListener >= 0)
+            {
+                ::close(spectatorListener);
+            }
+            listener = spectatorListener = -1;
+            return false;
+        }
+    }
+
+    epoll = epoll_create1(EPOLL_CLOEXEC);
+    wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    for (int fd : {listener, wakeup, spectatorListener, handoffListener})
+    {
+        if (fd < 0)
+        {
+            continue;
+        }
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
+    }
+    scheduler.reset(new Scheduler(options.workers));
+    timers.reset(new TimerThread());
+    reactor = std::thread(&GameServer::react, this);
+    return true;
+}
+
+/*!
+@brief Wait until the server is stopped.
+*/
+void GameServer::wait()
+{
+    std::unique_lock<std::mutex> lock(stateMutex);
+    stateChanged.wait(lock, [this]
+                      { return stopped; });
+}
+
+/*!
+@brief Close every connection and stop the threads.
+@details Once the reactor has stopped, every session's input is closed so its game ends with InputClosed at its next
+read. Sessions that are still running after a grace period, such as one in the middle of a long delay, are abandoned
+rather than destroyed, since their fibers still refer to them. The scheduler stops before the timers, since a session
+run until then may still set a timer; a timer firing afterwards only queues a task the stopped scheduler never runs.
+*/
+void GameServer::stop()
+{
+    if (!reactor.joinable())
+    {
+        return;
+    }
+    stopping = true;
+    uint64_t one = 1;
+    ssize_t ignored = ::write(wakeup, &one, sizeof(one));
+    (void)ignored;
+    reactor.join();
+
+    for (auto &entry : sessions)
+    {
+        std::shared_ptr<Session> &open = entry.second;
+        std::lock_guard<std::mutex> lock(open->mutex);
+        open->peerClosed = true;
+        if (open->parked)
+        {
+            open->parked = false;
+            post(open);
+        }
+    }
+    auto giveUp = TimerQueue::Clock::now() + std::chrono::milliseconds(StopGraceMs);
+    while (TimerQueue::Clock::now() < giveUp)
+    {
+        bool running = false;
+        for (auto &entry : sessions)
+        {
+            std::lock_guard<std::mutex> lock(entry.second->mutex);
+            running = running || !entry.second->ended;
+        }
+        if (!running)
+        {
+            break;
+        }
+        sleepFor(10);
+    }
+    scheduler->stop();
+    timers.reset();
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        lastSchedulerStats = scheduler->stats();
+    }
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        scheduler.reset();
+    }
+
+    static std::vector<std::shared_ptr<Session>> *abandoned = new std::vector<std::shared_ptr<Session>>();
+    for (auto &entry : sessions)
+    {
+        std::lock_guard<std::mutex> lock(entry.second->mutex);
+        ::close(entry.second->fd);
+        entry.second->fd = -1;
+        if (!entry.second->ended)
+        {
+            abandoned->push_back(entry.second);
+        }
+    }
+    sessions.clear();
+    pending.clear();
+    for (auto &entry : spectators)
+    {
+        ::close(entry.first);
+    }
+    spectators.clear();
+    channels.clear();
+    handoffQueue.clear();
+    for (int fd : {listener, epoll, wakeup, spectatorListener, handoffListener, handoffChannel.load()})
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+    }
+    listener = epoll = wakeup = spectatorListener = handoffListener = handoffChannel = -1;
+    // After a handoff the sockets' paths belong to the server that took over
+    if (!options.unixPath.empty() && !handingOff)
+    {
+        ::unlink(options.unixPath.c_str());
+    }
+    if (!options.spectatorUnixPath.empty() && !handingOff)
+    {
+        ::unlink(options.spectatorUnixPath.c_str());
+    }
+    if (!options.handoffPath.empty())
+    {
+        ::unlink(options.handoffPath.c_str());
+    }
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        stopped = true;
+    }
+    stateChanged.notify_all();
+}
+
+/*!
+@brief Hand every live session off to another server.
+@param path The other server's handoff socket.
+@param timeoutMs The longest to wait.
+@return The number of sessions handed off, or -1.
+@details The reactor is woken to begin the handoff, and this waits until no session is left. Records are sent on a
+blocking socket by the reactor, with a send timeout so a stuck server cannot hold it forever. The connection is
+published to the reactor atomically, since the reactor may be comparing descriptors against it at that moment, and
+only the first call gets to publish one.
+*/
+int GameServer::handOff(const std::string &path, int timeoutMs)
+{
+    if (!reactor.joinable() || handoffChannel >= 0)
+    {
+        return -1;
+    }
+    int channel = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    if (channel < 0 || ::connect(channel, (sockaddr *)&address, sizeof(address)) != 0)
+    {
+        std::cerr << "Could not connect to " << path << ": " << std::strerror(errno) << std::endl;
+        if (channel >= 0)
+        {
+            ::close(channel);
+        }
+        return -1;
+    }
+    timeval patience = {HandoffSendTimeoutSeconds, 0};
+    setsockopt(channel, SOL_SOCKET, SO_SNDTIMEO, &patience, sizeof(patience));
+
+    unsigned long long before = stats().handedOff;
+    int none = -1;
+    if (!handoffChannel.compare_exchange_strong(none, channel))
+    {
+        ::close(channel);
+        return -1;
+    }
+    handoffAsked = true;
+    uint64_t one = 1;
+    ssize_t ignored = ::write(wakeup, &one, sizeof(one));
+    (void)ignored;
+
+    auto giveUp = TimerQueue::Clock::now() + std::chrono::milliseconds(std::max(0, timeoutMs));
+    while (stats().connected > 0 && TimerQueue::Clock::now() < giveUp)
+    {
+        sleepFor(5);
+    }
+    return (int)(stats().handedOff - before);
+}
+
+/*!
+@brief Get the TCP port the server is listening on.
+@return The port, or 0.
+*/
+int GameServer::port() const
+{
+    return boundPort;
+}
+
+/*!
+@brief Get the TCP port spectators connect to.
+@return The port, or 0.
+*/
+int GameServer::spectatorPort() const
+{
+    return boundSpectatorPort;
+}
+
+/*!
+@brief Get the server's counts.
+@return A copy of the counts.
+*/
+ServerStats GameServer::stats() const
+{
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return counts;
+}
+
+/*!
+@brief Get the counts of the scheduler running the sessions.
+@return A snapshot of the counts.
+*/
+SchedulerStats GameServer::schedulerStats() const
+{
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return scheduler ? scheduler->stats() : lastSchedulerStats;
+}
+
+/*!
+@brief Count a fiber resume.
+*/
+void GameServer::countResume()
+{
+    std::lock_guard<std::mutex> lock(statsMutex);
+    counts.resumes++;
+}
+
+/*!
+@brief Queue a session to be resumed, from any thread.
+@param session The session.
+@details A session already queued is not queued twice, and one being resumed is queued again once it suspends, so its
+fiber only ever runs on one worker at a time.
+*/
+void GameServer::post(const std::shared_ptr<Session> &session)
+{
+    int state = session->runState.load();
+    while (true)
+    {
+        if (state == Queued || state == RunAgain)
+        {
+            return;
+        }
+        if (session->runState.compare_exchange_weak(state, state == Idle ? Queued : RunAgain))
+        {
+            break;
+        }
+    }
+    if (state == Idle)
+    {
+        scheduler->submit([this, session]
+                          { run(session); },
+                          session->home);
+    }
+}
+
+/*!
+@brief Resume a session's fiber until it next waits, on a worker.
+@param session The session.
+@details The worker becomes the session's home, so its next resume is queued where its stack and game state are
+likely still cached. A fiber that asked to sleep is posted again by the server's timer thread when its time comes.
+Whatever resumes it first, input, a handoff or that timer, its timer is cancelled here, and a new one is set only if
+it sleeps again, so a session never has more than one.
+*/
+void GameServer::run(const std::shared_ptr<Session> &session)
+{
+    session->runState.store(Running);
+    if (session->wakeTimer != 0)
+    {
+        timers->cancel(session->wakeTimer);
+        session->wakeTimer = 0;
+    }
+    if (session->fiber->finished())
+    {
+        session->runState.store(Idle);
+        return;
+    }
+    session->home = Scheduler::currentWorker();
+
+    bool more = false;
+    try
+    {
+        more = session->fiber->resume();
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Session ended with an error: " << e.what() << std::endl;
+    }
+    countResume();
+    if (session->carriedFrom != 0)
+    {
+        long long paused = std::max(0LL, steadyNanoseconds() - session->carriedFrom) / 1000;
+        session->carriedFrom = 0;
+        std::lock_guard<std::mutex> lock(statsMutex);
+        counts.slowestPauseMicroseconds = std::max(counts.slowestPauseMicroseconds, (unsigned long long)paused);
+        counts.totalPauseMicroseconds += paused;
+    }
+    if (std::shared_ptr<Channel> channel = session->adoptedFrom.lock())
+    {
+        sendText(channel->fd, std::string(1, HandoffAck));
+        session->adoptedFrom.reset();
+    }
+    TimerQueue::Clock::time_point due;
+    if (more && session->fiber->wakeTime(due))
+    {
+        std::weak_ptr<Session> sleeper = session;
+        session->wakeTimer = timers->at(due, [this, sleeper]
+                                        {
+                                            if (std::shared_ptr<Session> woken = sleeper.lock())
+                                            {
+                                                post(woken);
+                                            } });
+    }
+    if (!more)
+    {
+        {
+            std::lock_guard<std::mutex> sessionLock(session->mutex);
+            session->ended = true;
+        }
+        sessionEnded(session);
+    }
+
+    int state = Running;
+    if (!session->runState.compare_exchange_strong(state, Idle))
+    {
+        session->runState.store(Queued);
+        scheduler->submit([this, session]
+                          { run(session); },
+                          session->home);
+    }
+}
+
+/*!
+@brief Record that a session's game has ended and ask the reactor to close it once its output is sent.
+@param session The session. One handed off is sent on instead, and its game has not finished.
+*/
+void GameServer::sessionEnded(const std::shared_ptr<Session> &session)
+{
+    bool handedOff;
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        handedOff = session->handedOff;
+    }
+    if (!handedOff)
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        counts.finished++;
+    }
+    notify(session);
+}
+
+/*!
+@brief Run the reactor until the server stops.
+@details A wait that times out means nothing happened for IdleTrimMs, so the heap is trimmed then and at most that
+often.
+*/
+void GameServer::react()
+{
+    epoll_event events[64];
+    while (!stopping)
+    {
+        int ready = epoll_wait(epoll, events, 64, IdleTrimMs);
+        if (ready == 0)
+        {
+            trimHeap();
+            continue;
+        }
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            std::cerr << "epoll_wait failed: " << std::strerror(errno) << std::endl;
+            return;
+        }
+        for (int i = 0; i < ready && !stopping; i++)
+        {
+            int fd = events[i].data.fd;
+            if (fd == listener)
+            {
+                acceptAll();
+            }
+            else if (fd == spectatorListener)
+            {
+                acceptSpectators();
+            }
+            else if (fd == wakeup)
+            {
+                uint64_t count;
+                while (::read(wakeup, &count, sizeof(count)) > 0)
+                {
+                }
+                if (handoffAsked.exchange(false))
+                {
+                    beginHandoff();
+                }
+                std::vector<std::shared_ptr<Session>> asked;
+                {
+                    std::lock_guard<std::mutex> lock(pendingMutex);
+                    asked.swap(pending);
+                    for (const std::shared_ptr<Session> &session : asked)
+                    {
+                        session->notified = false;
+                    }
+                }
+                for (const std::shared_ptr<Session> &session : asked)
+                {
+                    flush(session);
+                }
+            }
+            else
+            {
+                auto found = sessions.find(fd);
+                if (found == sessions.end() && fd == handoffListener)
+                {
+                    acceptHandoffs();
+                    continue;
+                }
+                if (found == sessions.end() && fd == handoffChannel)
+                {
+                    receiveAcks();
+                    continue;
+                }
+                if (found == sessions.end() && channels.count(fd) != 0)
+                {
+                    receiveHandoffs(fd);
+                    continue;
+                }
+                if (found == sessions.end())
+                {
+                    if (spectators.count(fd) != 0 && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR | EPOLLRDHUP)))
+                    {
+                        receiveSpectator(fd);
+                    }
+                    auto watching = spectators.find(fd);
+                    if (watching != spectators.end() && (events[i].events & EPOLLOUT))
+                    {
+                        watching->second->watchingOutput = false;
+                        pump(fd);
+                    }
+                    continue;
+                }
+                std::shared_ptr<Session> session = found->second;
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR | EPOLLRDHUP))
+                {
+                    receive(session);
+                }
+                if (events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+                {
+                    flush(session);
+                }
+            }
+        }
+    }
+}
+
+/*!
+@brief Give memory freed by hibernated games back to the kernel.
+@details glibc keeps freed memory for reuse, so the pages a hibernating game frees stay resident until trimmed.
+Trimming walks the whole heap, so it is done here on the idle reactor rather than by each game as it hibernates.
+*/
+void GameServer::trimHeap()
+{
+    unsigned long long hibernated = hibernationStats().hibernated;
+    if (hibernated == trimmedAfter)
+    {
+        return;
+    }
+    trimmedAfter = hibernated;
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+}
+
+/*!
+@brief Accept every waiting connection.
+@details Each session's home is the next worker in turn, and its fiber is queued at once so the player sees the menu.
+*/
+void GameServer::acceptAll()
+{
+    while (true)
+    {
+        int fd = ::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                std::cerr << "accept failed: " << std::strerror(errno) << std::endl;
+            }
+            return;
+        }
+
+        std::shared_ptr<Session> session = openSession(fd, this->session);
+        {
+            std::lock_guard<std::mutex> lock(statsMutex);
+            counts.accepted++;
+        }
+        if (options.compression)
+        {
+            session->compression.offer();
+        }
+        post(session);
+    }
+}
+
+/*!
+@brief Make a session for a connected socket.
+@param fd The socket.
+@param body The code its fiber runs.
+@return The session.
+@details A game that stops for a handoff ends its fiber with the state to carry on from, once its output is written.
+A job the game waits for posts the session when it finishes, unless the server has stopped by then.
+*/
+std::shared_ptr<GameServer::Session> GameServer::openSession(int fd, std::function<void()> body)
+{
+    std::shared_ptr<Session> session = std::make_shared<Session>(*this, fd, (int)nextWorker, ++lastSession);
+    nextWorker = (nextWorker + 1) % options.workers;
+    session->self = session;
+    Session *raw = session.get();
+    session->fiber.reset(new Fiber([raw, body]
+                                   {
+                                       Console::Binding binding(raw->console);
+                                       bool handedOff = false;
+                                       std::string state;
+                                       long long stopped = 0;
+                                       try
+                                       {
+                                           body();
+                                       }
+                                       catch (const InputClosed &)
+                                       {
+                                           // The player went away; only this session ends
+                                       }
+                                       catch (const SessionHandoff &handoff)
+                                       {
+                                           handedOff = true;
+                                           state = handoff.state();
+                                           stopped = steadyNanoseconds();
+                                       }
+                                       raw->console.present();
+                                       if (handedOff)
+                                       {
+                                           raw->stopForHandoff(state, stopped);
+                                       } },
+                                   options.stackBytes));
+    std::weak_ptr<Session> waiting = session;
+    session->fiber->setWaker([this, waiting]
+                             {
+                                 std::shared_ptr<Session> woken = waiting.lock();
+                                 std::lock_guard<std::mutex> lock(stateMutex);
+                                 if (woken && scheduler)
+                                 {
+                                     post(woken);
+                                 } });
+
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.fd = fd;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
+    sessions[fd] = session;
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        counts.connected = sessions.size();
+        counts.peakConnected = std::max(counts.peakConnected, counts.connected);
+    }
+    return session;
+}
+
+/*!
+@brief Read everything waiting on a session's socket.
+@param session The session.
+@details A parked fiber is woken once for everything read. When the client hangs up the socket is taken out of epoll,
+and the session is closed once its game has seen the end of its input and finished.
+*/
+void GameServer::receive(const std::shared_ptr<Session> &session)
+{
+    char buffer[4096];
+    bool wake = false;
+    bool closeNow = false;
+    bool transferNow = false;
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        while (!session->peerClosed)
+        {
+            ssize_t count = ::recv(session->fd, buffer, sizeof(buffer), 0);
+            if (count > 0)
+            {
+                session->inbox.append(buffer, count);
+                wake = true;
+                if (session->inbox.size() > MaxPendingInput)
+                {
+                    session->peerClosed = true;
+                    session->inbox.clear();
+                }
+                continue;
+            }
+            if (count < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                break;
+            }
+            session->peerClosed = true;
+            wake = true;
+        }
+        if (session->peerClosed && session->watchingInput)
+        {
+            epoll_ctl(epoll, EPOLL_CTL_DEL, session->fd, nullptr);
+            session->watchingInput = false;
+            session->watchingOutput = false;
+        }
+        if (wake && session->parked)
+        {
+            session->parked = false;
+            post(session);
+        }
+        transferNow = session->ended && session->handedOff;
+        closeNow = session->ended && !transferNow && (session->outbox.empty() || session->peerClosed);
+    }
+    if (transferNow)
+    {
+        transfer(session);
+    }
+    else if (closeNow)
+    {
+        close(session);
+    }
+}
+
+/*!
+@brief Send as much of a session's output as the socket will take.
+@param session The session.
+@details epoll watches for room to write only while output is waiting, so an idle session costs no wakeups. A session
+whose game has ended is closed once its output is sent. One handed off is sent on straight away, with its output unsent.
+*/
+void GameServer::flush(const std::shared_ptr<Session> &session)
+{
+    bool transferNow = false;
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        if (session->fd < 0)
+        {
+            return;
+        }
+        transferNow = session->ended && session->handedOff;
+    }
+    if (transferNow)
+    {
+        transfer(session);
+        return;
+    }
+    bool closeNow = false;
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        if (session->fd < 0)
+        {
+            return;
+        }
+        while (!session->outbox.empty() && !session->lost)
+        {
+            ssize_t sent = ::send(session->fd, session->outbox.data(), session->outbox.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (sent > 0)
+            {
+                session->outbox.erase(0, sent);
+                continue;
+            }
+            if (sent < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                break;
+            }
+            session->lost = true;
+            session->peerClosed = true;
+        }
+        if (session->lost)
+        {
+            session->outbox.clear();
+            if (session->parked)
+            {
+                session->parked = false;
+                post(session);
+            }
+        }
+        bool wantOutput = !session->outbox.empty();
+        if (session->watchingInput && wantOutput != session->watchingOutput)
+        {
+            epoll_event event = {};
+            event.events = watchedEvents(wantOutput);
+            event.data.fd = session->fd;
+            epoll_ctl(epoll, EPOLL_CTL_MOD, session->fd, &event);
+            session->watchingOutput = wantOutput;
+        }
+        closeNow = session->ended && (session->outbox.empty() || session->peerClosed);
+    }
+    if (closeNow)
+    {
+        close(session);
+    }
+    pumpWatchers(session);
+}
+
+/*!
+@brief Close a session's socket and forget it.
+@param session The session.
+*/
+void GameServer::close(const std::shared_ptr<Session> &session)
+{
+    int fd;
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        fd = session->fd;
+        if (fd < 0)
+        {
+            return;
+        }
+        if (session->watchingInput)
+        {
+            epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+            session->watchingInput = false;
+        }
+        session->fd = -1;
+    }
+    sessions.erase(fd);
+    if (session->inFlight)
+    {
+        session->inFlight = false;
+        handoffsInFlight--;
+        askForHandoffs();
+    }
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        counts.connected = sessions.size();
+    }
+    // Closed last, so a client that sees the connection end also sees the counts updated
+    ::close(fd);
+    session->feed->close();
+    pumpWatchers(session);
+}
+
+/*!
+@brief Stop accepting players and start asking sessions to stop for a handoff.
+@details Connections already waiting are accepted first and handed off from the main menu with the rest. The oldest
+sessions are asked first.
+*/
+void GameServer::beginHandoff()
+{
+    if (handingOff)
+    {
+        return;
+    }
+    handingOff = true;
+    acceptAll();
+    for (int *fd : {&listener, &spectatorListener})
+    {
+        if (*fd >= 0)
+        {
+            epoll_ctl(epoll, EPOLL_CTL_DEL, *fd, nullptr);
+            ::close(*fd);
+            *fd = -1;
+        }
+    }
+    std::vector<std::shared_ptr<Session>> open;
+    for (const auto &entry : sessions)
+    {
+        open.push_back(entry.second);
+    }
+    std::sort(open.begin(), open.end(), [](const std::shared_ptr<Session> &a, const std::shared_ptr<Session> &b)
+              { return a->id < b->id; });
+    handoffQueue.assign(open.begin(), open.end());
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.fd = handoffChannel;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, handoffChannel, &event);
+    askForHandoffs();
+}
+
+/*!
+@brief Ask the next sessions in line to stop for a handoff.
+@details A session waiting at its turn is woken to stop, and counts against the window until the other server has
+acknowledged it, so no session waits behind more than a few others. One busy elsewhere, such as in a battle, is only
+asked and does not count until it is sent: it stops on its own at its next turn.
+*/
+void GameServer::askForHandoffs()
+{
+    while (handoffsInFlight < HandoffWindow && !handoffQueue.empty())
+    {
+        std::shared_ptr<Session> session = handoffQueue.front().lock();
+        handoffQueue.pop_front();
+        if (!session)
+        {
+            continue;
+        }
+        session->console.requestHandoff();
+        std::lock_guard<std::mutex> lock(session->mutex);
+        if (session->fd >= 0 && session->parked && session->console.atTurn())
+        {
+            session->parked = false;
+            session->inFlight = true;
+            handoffsInFlight++;
+            post(session);
+        }
+    }
+}
+
+/*!
+@brief Send a session whose game has stopped for a handoff to the other server.
+@param session The session.
+@details The record carries the socket itself, so the player's connection stays open in the other server once this
+one closes its copy. A player who has already gone is just closed.
+*/
+void GameServer::transfer(const std::shared_ptr<Session> &session)
+{
+    HandoffRecord record;
+    bool gone;
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        if (session->fd < 0)
+        {
+            return;
+        }
+        gone = session->lost || session->peerClosed;
+        record.fd = session->fd;
+        record.state = session->handoffState;
+        record.input = session->inbox;
+        record.output = session->outbox;
+        record.compressed = session->wasCompressing;
+        record.pausedAt = session->stoppedAt;
+    }
+    if (!gone && handoffChannel >= 0 && sendHandoff(handoffChannel, record))
+    {
+        // Now counted until acknowledged rather than until sent
+        handoffsInFlight += session->inFlight ? 0 : 1;
+        session->inFlight = false;
+        std::lock_guard<std::mutex> lock(statsMutex);
+        counts.handedOff++;
+    }
+    else if (!gone)
+    {
+        std::cerr << "Could not hand off session " << session->id << ": " << std::strerror(errno) << std::endl;
+    }
+    close(session);
+}
+
+/*!
+@brief Read the acknowledgements the other server has sent.
+@details Each one makes room in the window for the next session. If the other server goes away the window is opened,
+so the remaining sessions are asked at once and closed when their records cannot be sent.
+*/
+void GameServer::receiveAcks()
+{
+    char buffer[256];
+    while (true)
+    {
+        ssize_t count = ::recv(handoffChannel, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+        if (count <= 0)
+        {
+            epoll_ctl(epoll, EPOLL_CTL_DEL, handoffChannel, nullptr);
+            handoffsInFlight = 0;
+            break;
+        }
+        size_t acknowledged = std::count(buffer, buffer + count, HandoffAck);
+        handoffsInFlight -= std::min(handoffsInFlight, acknowledged);
+    }
+    askForHandoffs();
+}
+
+/*!
+@brief Accept every waiting connection from a server handing sessions off.
+*/
+void GameServer::acceptHandoffs()
+{
+    while (true)
+    {
+        int fd = ::accept4(handoffListener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                std::cerr << "accept failed: " << std::strerror(errno) << std::endl;
+            }
+            return;
+        }
+        epoll_event event = {};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.fd = fd;
+        epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
+        channels[fd] = std::make_shared<Channel>(fd);
+    }
+}
+
+/*!
+@brief Read the records waiting on a handoff connection.
+@param fd The connection.
+*/
+void GameServer::receiveHandoffs(int fd)
+{
+    std::shared_ptr<Channel> channel = channels[fd];
+    std::vector<HandoffRecord> records;
+    bool open = channel->reader.receive(fd, records);
+    for (const HandoffRecord &record : records)
+    {
+        adopt(record, channel);
+    }
+    if (!open)
+    {
+        epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+        channels.erase(fd);
+    }
+}
+
+/*!
+@brief Carry on a session handed off by another server.
+@param record The session's record.
+@param channel The connection it came on.
+@details The output the other server had not sent yet goes first, then the start of a new compressed stream if the
+client was compressing, and the game carries on from its state with the input it had not read.
+*/
+void GameServer::adopt(const HandoffRecord &record, const std::shared_ptr<Channel> &channel)
+{
+    int flags = fcntl(record.fd, F_GETFL);
+    fcntl(record.fd, F_SETFL, flags | O_NONBLOCK);
+    std::function<void(const std::string &)> carryOn = resume;
+    std::string state = record.state;
+    std::shared_ptr<Session> session = openSession(record.fd, [carryOn, state]
+                                                   { carryOn(state); });
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        session->inbox = record.input;
+        session->outbox = record.output;
+        session->carriedFrom = record.pausedAt;
+    }
+    session->adoptedFrom = channel;
+    if (record.compressed)
+    {
+        session->compression.accept();
+    }
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        counts.adopted++;
+    }
+    post(session);
+    flush(session);
+}
+
+/*!
+@brief Ask the reactor to look at a session.
+@param session The session.
+*/
+void GameServer::notify(const std::shared_ptr<Session> &session)
+{
+    if (!session)
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        if (session->notified)
+        {
+            return;
+        }
+        session->notified = true;
+        pending.push_back(session);
+    }
+    uint64_t one = 1;
+    ssize_t ignored = ::write(wakeup, &one, sizeof(one));
+    (void)ignored;
+}
+
+/*!
+@brief Accept every waiting spectator.
+@details Each spectator is listed the newest live sessions and asked to choose one.
+*/
+void GameServer::acceptSpectators()
+{
+    while (true)
+    {
+        int fd = ::accept4(spectatorListener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                std::cerr << "accept failed: " << std::strerror(errno) << std::endl;
+            }
+            return;
+        }
+
+        std::unique_ptr<Spectator> spectator(new Spectator());
+        spectator->fd = fd;
+        epoll_event event = {};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.fd = fd;
+        epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
+        spectators[fd] = std::move(spectator);
+
+        std::vector<unsigned long long> live;
+        for (const auto &entry : sessions)
+        {
+            live.push_back(entry.second->id);
+        }
+        std::sort(live.begin(), live.end());
+        std::string text = live.empty() ? "No sessions are live yet." : "Live sessions:";
+        for (size_t i = live.size() > SessionsListed ? live.size() - SessionsListed : 0; i < live.size(); i++)
+        {
+            text += " " + std::to_string(live[i]);
+        }
+        sendText(fd, text + "\r\nWatch which session? ");
+    }
+}
+
+/*!
+@brief Read everything waiting on a spectator's socket.
+@param fd The spectator's socket.
+@details Until the spectator has chosen a session their input is collected into lines; afterwards it is read and
+thrown away, so a spectator can never send anything to the game.
+*/
+void GameServer::receiveSpectator(int fd)
+{
+    auto found = spectators.find(fd);
+    if (found == spectators.end())
+    {
+        return;
+    }
+    Spectator &spectator = *found->second;
+    char buffer[1024];
+    while (true)
+    {
+        ssize_t count = ::recv(fd, buffer, sizeof(buffer), 0);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+        if (count <= 0)
+        {
+            dropSpectator(fd);
+            return;
+        }
+        if (!spectator.feed)
+        {
+            spectator.typed.append(buffer, count);
+        }
+    }
+
+    size_t end;
+    while (!spectator.feed && (end = spectator.typed.find('\n')) != std::string::npos)
+    {
+        std::string line = spectator.typed.substr(0, end);
+        spectator.typed.erase(0, end + 1);
+        unsigned long long id = std::strtoull(line.c_str(), nullptr, 10);
+        for (const auto &entry : sessions)
+        {
+            if (entry.second->id == id && id != 0)
+            {
+                FrameFeed::Frame keyframe;
+                spectator.session = entry.second;
+                spectator.feed = entry.second->feed;
+                spectator.cursor = spectator.feed->join(keyframe);
+                spectator.sending.push_back(keyframe);
+                entry.second->watchers.push_back(fd);
+                std::lock_guard<std::mutex> lock(statsMutex);
+                counts.spectators++;
+                counts.keyframes++;
+                break;
+            }
+        }
+        if (!spectator.feed)
+        {
+            sendText(fd, "There is no live session " + std::to_string(id) + ".\r\nWatch which session? ");
+        }
+    }
+    if (spectator.feed)
+    {
+        spectator.typed.clear();
+        pump(fd);
+    }
+    else if (spectator.typed.size() > MaxChoiceInput)
+    {
+        dropSpectator(fd);
+    }
+}
+
+/*!
+@brief Send a spectator as many frames as their socket will take.
+@param fd The spectator's socket.
+@details Frames are gathered into one sendmsg straight from the feed's buffers. When the socket is full the spectator
+is left alone until epoll says it has room; by then the feed may have moved on without them, and collect hands them a
+keyframe instead of the frames they missed.
+*/
+void GameServer::pump(int fd)
+{
+    auto found = spectators.find(fd);
+    if (found == spectators.end() || !found->second->feed)
+    {
+        return;
+    }
+    Spectator &spectator = *found->second;
+    bool gone = false;
+    while (true)
+    {
+        if (spectator.frame == spectator.sending.size())
+        {
+            spectator.sending.clear();
+            spectator.frame = spectator.offset = 0;
+            size_t missed = spectator.feed->collect(spectator.cursor, spectator.sending, FramesPerSend);
+            if (missed > 0)
+            {
+                std::lock_guard<std::mutex> lock(statsMutex);
+                counts.dropped += missed;
+                counts.keyframes++;
+            }
+            if (spectator.sending.empty())
+            {
+                break;
+            }
+        }
+
+        iovec parts[FramesPerSend];
+        size_t count = 0;
+        for (size_t i = spectator.frame; i < spectator.sending.size() && count < FramesPerSend; i++, count++)
+        {
+            size_t skip = i == spectator.frame ? spectator.offset : 0;
+            parts[count].iov_base = (void *)(spectator.sending[i]->data() + skip);
+            parts[count].iov_len = spectator.sending[i]->size() - skip;
+        }
+        msghdr message = {};
+        message.msg_iov = parts;
+        message.msg_iovlen = count;
+        ssize_t sent = ::sendmsg(fd, &message, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+        if (sent < 0)
+        {
+            gone = true;
+            break;
+        }
+        size_t left = sent;
+        while (spectator.frame < spectator.sending.size())
+        {
+            size_t rest = spectator.sending[spectator.frame]->size() - spectator.offset;
+            if (left < rest)
+            {
+                spectator.offset += left;
+                break;
+            }
+            left -= rest;
+            spectator.frame++;
+            spectator.offset = 0;
+        }
+    }
+
+    bool behind = spectator.frame < spectator.sending.size();
+    if (gone || (!behind && spectator.feed->closed() && spectator.cursor == spectator.feed->head()))
+    {
+        dropSpectator(fd);
+        return;
+    }
+    if (behind != spectator.watchingOutput)
+    {
+        epoll_event event = {};
+        event.events = watchedEvents(behind);
+        event.data.fd = fd;
+        epoll_ctl(epoll, EPOLL_CTL_MOD, fd, &event);
+        spectator.watchingOutput = behind;
+    }
+}
+
+/*!
+@brief Send frames to every spectator of a session who is not waiting for room to write.
+@param session The session.
+@details A spectator waiting for room is skipped rather than tried again for every frame, so a slow spectator costs
+the reactor nothing until their socket drains.
+*/
+void GameServer::pumpWatchers(const std::shared_ptr<Session> &session)
+{
+    std::vector<int> watching = session->watchers;
+    for (int fd : watching)
+    {
+        auto found = spectators.find(fd);
+        if (found != spectators.end() && !found->second->watchingOutput)
+        {
+            pump(fd);
+        }
+    }
+}
+
+/*!
+@brief Close a spectator's socket and forget them.
+@param fd The spectator's socket.
+*/
+void GameServer::dropSpectator(int fd)
+{
+    auto found = spectators.find(fd);
+    if (found == spectators.end())
+    {
+        return;
+    }
+    std::unique_ptr<Spectator> spectator = std::move(found->second);
+    spectators.erase(found);
+    if (spectator->feed)
+    {
+        spectator->feed->leave();
+        if (std::shared_ptr<Session> watched = spectator->session.lock())
+        {
+            std::vector<int> &watchers = watched->watchers;
+            watchers.erase(std::remove(watchers.begin(), watchers.end(), fd), watchers.end());
+        }
+        std::lock_guard<std::mutex> lock(statsMutex);
+        counts.spectators--;
+    }
+    epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+    ::close(fd);
+}
+
+#endif // __linux__
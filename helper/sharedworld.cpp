@@ -0,0 +1,207 @@
+/*!
+@file sharedworld.cpp
+@brief Implementation of the SharedWorld class.
+@details A room's lock is held only while its list of players is read or changed and messages are queued, and never
+together with another room's, so moving between rooms cannot deadlock.
+*/
+
+#include "../lib/sharedworld.h"
+#include <algorithm>
+
+namespace
+{
+    std::mutex worldMutex;               //!< Guards current.
+    std::shared_ptr<SharedWorld> current; //!< The world new games join.
+}
+
+/*!
+@brief Constructor for the Member class.
+@param name The player's name.
+*/
+SharedWorld::Member::Member(const std::string &name) : name(name), room(-1)
+{
+}
+
+/*!
+@brief Get the player's name.
+@return The name.
+*/
+const std::string &SharedWorld::Member::getName() const
+{
+    return name;
+}
+
+/*!
+@brief Get the room the player is in.
+@return The room's id, or -1.
+*/
+int SharedWorld::Member::getRoom() const
+{
+    return room.load();
+}
+
+/*!
+@brief Take the player's queued messages.
+@return The messages.
+*/
+std::vector<std::string> SharedWorld::Member::takeMessages()
+{
+    std::vector<std::string> messages;
+    std::lock_guard<std::mutex> lock(inboxLock);
+    messages.swap(inbox);
+    return messages;
+}
+
+/*!
+@brief Queue a message for the player.
+@param message The message.
+*/
+void SharedWorld::Member::deliver(const std::string &message)
+{
+    std::lock_guard<std::mutex> lock(inboxLock);
+    inbox.push_back(message);
+}
+
+/*!
+@brief Constructor for the SharedWorld class.
+@param seed The seed.
+@param numRooms The number of rooms.
+@details The floor is made for the world alone rather than taken from FloorTemplate::shared, since its rooms will
+change and a shared template is read by games that must never see them change.
+*/
+SharedWorld::SharedWorld(unsigned int seed, int numRooms) : floor(std::make_shared<FloorTemplate>(seed, numRooms))
+{
+    for (size_t i = 0; i < floor->getDungeon().getRooms().size(); i++)
+    {
+        places.emplace_back(new Place());
+    }
+}
+
+/*!
+@brief Get the floor.
+@return The floor.
+*/
+const std::shared_ptr<FloorTemplate> &SharedWorld::getFloor() const
+{
+    return floor;
+}
+
+/*!
+@brief Move a player into a room.
+@param member The player.
+@param roomId The room's id.
+@details Moving into the room the player is already in does nothing.
+*/
+void SharedWorld::enter(Member &member, int roomId)
+{
+    Place *next = place(roomId);
+    if (next == nullptr || member.room.load() == roomId)
+    {
+        return;
+    }
+    leave(member);
+    std::lock_guard<std::mutex> lock(next->lock);
+    for (Member *other : next->members)
+    {
+        other->deliver(member.name + " has arrived.");
+    }
+    next->members.push_back(&member);
+    member.room.store(roomId);
+}
+
+/*!
+@brief Take a player out of the world.
+@param member The player.
+*/
+void SharedWorld::leave(Member &member)
+{
+    Place *previous = place(member.room.load());
+    if (previous == nullptr)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(previous->lock);
+    previous->members.erase(std::remove(previous->members.begin(), previous->members.end(), &member), previous->members.end());
+    for (Member *other : previous->members)
+    {
+        other->deliver(member.name + " has left.");
+    }
+    member.room.store(-1);
+}
+
+/*!
+@brief Tell the players in a room what has happened there.
+@param roomId The room's id.
+@param message The message.
+@param from The player it happened to, or nullptr.
+@return The number of players told.
+*/
+int SharedWorld::broadcast(int roomId, const std::string &message, const Member *from)
+{
+    Place *here = place(roomId);
+    if (here == nullptr)
+    {
+        return 0;
+    }
+    int told = 0;
+    std::lock_guard<std::mutex> lock(here->lock);
+    for (Member *other : here->members)
+    {
+        if (other != from)
+        {
+            other->deliver(message);
+            told++;
+        }
+    }
+    return told;
+}
+
+/*!
+@brief Get the players in a room.
+@param roomId The room's id.
+@return Their names, in the order they arrived.
+*/
+std::vector<std::string> SharedWorld::present(int roomId) const
+{
+    std::vector<std::string> names;
+    Place *here = place(roomId);
+    if (here != nullptr)
+    {
+        std::lock_guard<std::mutex> lock(here->lock);
+        for (Member *member : here->members)
+        {
+            names.push_back(member->name);
+        }
+    }
+    return names;
+}
+
+/*!
+@brief Get the players in a room.
+@param roomId The room's id.
+@return The room's place, or nullptr.
+*/
+SharedWorld::Place *SharedWorld::place(int roomId) const
+{
+    return roomId >= 0 && roomId < (int)places.size() ? places[roomId].get() : nullptr;
+}
+
+/*!
+@brief Make every new game join a world.
+@param world The world, or nullptr.
+*/
+void setSharedWorld(std::shared_ptr<SharedWorld> world)
+{
+    std::lock_guard<std::mutex> lock(worldMutex);
+    current = std::move(world);
+}
+
+/*!
+@brief Get the world new games join.
+@return The world, or nullptr.
+*/
+std::shared_ptr<SharedWorld> getSharedWorld()
+{
+    std::lock_guard<std::mutex> lock(worldMutex);
+    return current;
+}
@@ -0,0 +1,405 @@
+/*!
+@file timer.cpp
+@brief Implementation of the timer facilities.
+@details This file contains the implementation of the TimerQueue and TimerThread classes and the sleep functions.
+Sleeping uses clock_nanosleep on the monotonic clock where it exists, so waits are immune to wall-clock changes
+and cost nothing while blocked.
+*/
+
+#define NOMINMAX
+#include "../lib/timer.h"
+#include "../lib/fiber.h"
+#include <algorithm>
+#include <cerrno>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+/*!
+@brief Order two timers for the heap.
+@param a The first timer.
+@param b The second timer.
+@return True if a should run after b.
+*/
+bool TimerQueue::later(const Timer &a, const Timer &b)
+{
+    return a.due > b.due || (a.due == b.due && a.id > b.id);
+}
+
+/*!
+@brief Schedule a callback at a deadline.
+@param due When the callback should run.
+@param callback The function to run.
+@return The timer's id.
+*/
+TimerQueue::TimerId TimerQueue::schedule(Clock::time_point due, std::function<void()> callback)
+{
+    TimerId id = nextId++;
+    heap.push_back(Timer{due, id, std::move(callback)});
+    std::push_heap(heap.begin(), heap.end(), later);
+    live.insert(id);
+    return id;
+}
+
+/*!
+@brief Schedule a callback after a delay.
+@param milliseconds How long from now the callback should run.
+@param callback The function to run.
+@return The timer's id.
+*/
+TimerQueue::TimerId TimerQueue::scheduleAfter(int milliseconds, std::function<void()> callback)
+{
+    return schedule(Clock::now() + std::chrono::milliseconds(milliseconds), std::move(callback));
+}
+
+/*!
+@brief Cancel a timer.
+@param id The timer's id.
+@return True if the timer was pending.
+@details Each rebuild removes at least half the heap, so cancelling stays constant time on average.
+*/
+bool TimerQueue::cancel(TimerId id)
+{
+    if (live.erase(id) == 0)
+    {
+        return false;
+    }
+    // Rebuild the heap once cancelled timers outnumber pending ones, so timers cancelled long before they are due
+    // do not pile up
+    if (heap.size() > 2 * live.size() + 16)
+    {
+        heap.erase(std::remove_if(heap.begin(), heap.end(), [this](const Timer &timer)
+                                  { return live.find(timer.id) == live.end(); }),
+                   heap.end());
+        std::make_heap(heap.begin(), heap.end(), later);
+    }
+    return true;
+}
+
+/*!
+@brief Discard cancelled timers from the top of the heap.
+*/
+void TimerQueue::prune()
+{
+    while (!heap.empty() && live.find(heap.front().id) == live.end())
+    {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        heap.pop_back();
+    }
+}
+
+/*!
+@brief Get the time until the next deadline.
+@param now The current time.
+@return Milliseconds until the earliest timer rounded up, 0 if one is due, or -1 if none are pending.
+@details Rounding up means a poll with this timeout never returns before the deadline and spins.
+*/
+int TimerQueue::nextTimeout(Clock::time_point now)
+{
+    prune();
+    if (heap.empty())
+    {
+        return -1;
+    }
+    if (heap.front().due <= now)
+    {
+        return 0;
+    }
+    auto wait = std::chrono::duration_cast<std::chrono::microseconds>(heap.front().due - now).count();
+    return (int)std::min<long long>((wait + 999) / 1000, 1 << 30);
+}
+
+/*!
+@brief Remove the timers that are due.
+@param now The current time.
+@return The callbacks of the due timers, earliest first.
+*/
+std::vector<std::function<void()>> TimerQueue::takeDue(Clock::time_point now)
+{
+    std::vector<std::function<void()>> due;
+    prune();
+    while (!heap.empty() && heap.front().due <= now)
+    {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        Timer timer = std::move(heap.back());
+        heap.pop_back();
+        if (live.erase(timer.id))
+        {
+            due.push_back(std::move(timer.callback));
+        }
+        prune();
+    }
+    return due;
+}
+
+/*!
+@brief Run the timers that are due.
+@param now The current time.
+@return The number of callbacks run.
+*/
+size_t TimerQueue::runDue(Clock::time_point now)
+{
+    std::vector<std::function<void()>> due = takeDue(now);
+    for (std::function<void()> &callback : due)
+    {
+        callback();
+    }
+    return due.size();
+}
+
+/*!
+@brief Get the number of pending timers.
+@return The number of timers that have neither run nor been cancelled.
+*/
+size_t TimerQueue::size() const
+{
+    return live.size();
+}
+
+/*!
+@brief Constructor for the TimerThread class.
+@details Creates the wake-up pipe and starts the thread.
+*/
+TimerThread::TimerThread() : stopping(false)
+{
+#ifndef _WIN32
+    if (pipe(wakePipe) != 0)
+    {
+        wakePipe[0] = wakePipe[1] = -1;
+    }
+    else
+    {
+        fcntl(wakePipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(wakePipe[1], F_SETFL, O_NONBLOCK);
+    }
+#endif
+    worker = std::thread(&TimerThread::run, this);
+}
+
+/*!
+@brief Destructor for the TimerThread class.
+*/
+TimerThread::~TimerThread()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake();
+    worker.join();
+#ifndef _WIN32
+    if (wakePipe[0] >= 0)
+    {
+        close(wakePipe[0]);
+        close(wakePipe[1]);
+    }
+#endif
+}
+
+/*!
+@brief Get the shared timer thread.
+@return The instance used by the whole program.
+*/
+TimerThread &TimerThread::shared()
+{
+    static TimerThread instance;
+    return instance;
+}
+
+/*!
+@brief Schedule a callback after a delay.
+@param milliseconds How long from now the callback should run.
+@param callback The function to run on the timer thread.
+@return The timer's id.
+*/
+TimerQueue::TimerId TimerThread::after(int milliseconds, std::function<void()> callback)
+{
+    return at(TimerQueue::Clock::now() + std::chrono::milliseconds(milliseconds), std::move(callback));
+}
+
+/*!
+@brief Schedule a callback at a deadline.
+@param due When the callback should run.
+@param callback The function to run on the timer thread.
+@return The timer's id.
+@details The thread is only woken if the new timer is now the earliest, since otherwise its current wait already
+ends in time.
+*/
+TimerQueue::TimerId TimerThread::at(TimerQueue::Clock::time_point due, std::function<void()> callback)
+{
+    TimerQueue::TimerId id;
+    bool earliest;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        TimerQueue::Clock::time_point now = TimerQueue::Clock::now();
+        int before = queue.nextTimeout(now);
+        id = queue.schedule(due, std::move(callback));
+        earliest = before < 0 || due < now + std::chrono::milliseconds(before);
+    }
+    if (earliest)
+    {
+        wake();
+    }
+    return id;
+}
+
+/*!
+@brief Cancel a timer.
+@param id The timer's id.
+@return True if the timer had not started running.
+*/
+bool TimerThread::cancel(TimerQueue::TimerId id)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return queue.cancel(id);
+}
+
+/*!
+@brief Get the number of pending timers.
+@return The number of timers waiting to run.
+*/
+size_t TimerThread::pending()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return queue.size();
+}
+
+/*!
+@brief Interrupt the thread's current wait.
+*/
+void TimerThread::wake()
+{
+#ifdef _WIN32
+    wakeup.notify_one();
+#else
+    char byte = 1;
+    if (wakePipe[1] >= 0 && write(wakePipe[1], &byte, 1) < 0)
+    {
+        // The pipe is full, so a wake-up is already pending
+    }
+#endif
+}
+
+/*!
+@brief Wait for deadlines and run callbacks until stopped.
+@details Callbacks run without the lock held, so they can schedule further timers.
+*/
+void TimerThread::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping)
+    {
+        int timeout = queue.nextTimeout(TimerQueue::Clock::now());
+        if (timeout != 0)
+        {
+#ifdef _WIN32
+            if (timeout < 0)
+            {
+                wakeup.wait(lock);
+            }
+            else
+            {
+                wakeup.wait_for(lock, std::chrono::milliseconds(timeout));
+            }
+#else
+            lock.unlock();
+            pollfd wait = {wakePipe[0], POLLIN, 0};
+            poll(&wait, 1, timeout);
+            if (wait.revents & POLLIN)
+            {
+                char drain[64];
+                while (read(wakePipe[0], drain, sizeof(drain)) > 0)
+                {
+                }
+            }
+            lock.lock();
+#endif
+            continue;
+        }
+
+        std::vector<std::function<void()>> due = queue.takeDue(TimerQueue::Clock::now());
+        lock.unlock();
+        for (std::function<void()> &callback : due)
+        {
+            callback();
+        }
+        lock.lock();
+    }
+}
+
+/*!
+@brief Block until a deadline.
+@param due The deadline.
+@details On Linux this is an absolute clock_nanosleep on CLOCK_MONOTONIC (the clock behind steady_clock), restarted
+if a signal interrupts it. Other systems sleep for the remaining time and re-check. Inside a fiber the fiber is
+suspended instead, so the thread can run other sessions meanwhile.
+*/
+void sleepUntil(TimerQueue::Clock::time_point due)
+{
+#ifdef __linux__
+    if (Fiber::current() != nullptr)
+    {
+        Fiber::sleepUntil(due);
+        return;
+    }
+#endif
+    while (true)
+    {
+        auto left = due - TimerQueue::Clock::now();
+        if (left <= TimerQueue::Clock::duration::zero())
+        {
+            return;
+        }
+#if defined(_WIN32)
+        Sleep((DWORD)std::chrono::duration_cast<std::chrono::milliseconds>(left + std::chrono::microseconds(999)).count());
+#elif defined(__linux__)
+        auto since = due.time_since_epoch();
+        timespec deadline;
+        deadline.tv_sec = (time_t)std::chrono::duration_cast<std::chrono::seconds>(since).count();
+        deadline.tv_nsec = (long)(std::chrono::duration_cast<std::chrono::nanoseconds>(since).count() % 1000000000);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR)
+        {
+        }
+#else
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(left).count();
+        timespec wait;
+        wait.tv_sec = (time_t)(ns / 1000000000);
+        wait.tv_nsec = (long)(ns % 1000000000);
+        nanosleep(&wait, nullptr);
+#endif
+    }
+}
+
+/*!
+@brief Block for a number of milliseconds.
+@param milliseconds How long to sleep.
+*/
+void sleepFor(int milliseconds)
+{
+    if (milliseconds > 0)
+    {
+        sleepUntil(TimerQueue::Clock::now() + std::chrono::milliseconds(milliseconds));
+    }
+}
+
+/*!
+@brief Read the monotonic clock.
+@return Nanoseconds since an arbitrary fixed point.
+@details clock_gettime is called directly so the reading is CLOCK_MONOTONIC whatever steady_clock is built on.
+*/
+long long monotonicNanos()
+{
+#ifdef _WIN32
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+#endif
+}
@@ -7,6 +7,13 @@
 #define NOMINMAX
 #include "../lib/toolkit.h"
 #include "../lib/dependencies.h"
+#include "../lib/renderer.h"
+#include "../lib/timer.h"
+#include "../lib/typewriter.h"
+#include "../lib/headless.h"
+#include <map>
+#include <memory>
+#include <mutex>
 
 #ifdef _WIN32
 /*!
@@ -17,6 +24,10 @@
 // LCOV_EXCL_START
 void SetConsoleSize(int width, int height)
 {
+    if (isHeadless())
+    {
+        return;
+    }
     HWND console = GetConsoleWindow();
     RECT r;
     GetWindowRect(console, &r);
@@ -31,6 +42,10 @@ void SetConsoleSize(int width, int height)
  */
 void SetTerminalSize(int height, int width)
 {
+    if (isHeadless())
+    {
+        return;
+    }
     std::cout << "\033[8;" << height << ";" << width << "t";
 }
 // LCOV_EXCL_STOP
@@ -39,15 +54,18 @@ void SetTerminalSize(int height, int width)
 /*!
  * @brief Creates a delay for a specified amount of time.
  * @param milliseconds The number of milliseconds to delay.
- * @details This function uses a busy-wait loop to create a delay, which can be used to control the timing of text display or other actions.
+ * @details This function sleeps the calling thread, so a waiting session uses no CPU. It can be used to control the timing of text display or other actions.
+ * Anything waiting in the console's output is presented first so the player sees it during the pause.
+ * In headless mode it returns at once.
  */
 void delay(int milliseconds)
 {
-    auto start = std::chrono::high_resolution_clock::now();
-    while (std::chrono::high_resolution_clock::now() - start < std::chrono::milliseconds(milliseconds))
+    if (milliseconds <= 0 || isHeadless())
     {
-        // Busy-waiting loop to create a delay
+        return;
     }
+    console().present();
+    sleepFor(milliseconds);
 }
 /*!
  * @brief Disables user input on the console/terminal.
@@ -56,6 +74,10 @@ void delay(int milliseconds)
 // LCOV_EXCL_START
 void disableInput()
 {
+    if (!console().isStandard())
+    {
+        return;
+    }
 #ifdef _WIN32
     HANDLE hStdin = GetStdHandle(STD_INPUT_HANDLE);
     SetConsoleMode(hStdin, 0);
@@ -75,6 +97,10 @@ void disableInput()
 
 void enableInput()
 {
+    if (!console().isStandard())
+    {
+        return;
+    }
 #ifdef _WIN32
     HANDLE hStdin = GetStdHandle(STD_INPUT_HANDLE);
     SetConsoleMode(hStdin, ENABLE_ECHO_INPUT | ENABLE_INSERT_MODE | ENABLE_LINE_INPUT | ENABLE_MOUSE_INPUT | ENABLE_PROCESSED_INPUT | ENABLE_QUICK_EDIT_MODE | ENABLE_WINDOW_INPUT);
@@ -94,15 +120,13 @@ void enableInput()
  * @param delayTime The delay between each character in milliseconds. Default is 15 milliseconds.
  * @param color The color code for the text. Default is cyan ("\033[36m").
  * @details This function prints text one character at a time, simulating a typing effect, with customizable delay and color.
+ * Characters are written in batches at the frame rate, and pressing a key prints the rest of the text at once.
  */
 void typePrint(const std::string &content, int delayTime, const std::string &color)
 {
-    for (char c : content)
-    {
-        std::cout << color << c << std::flush;
-        delay(delayTime);
-    }
-    std::cout << "\033[37m";
+    Typewriter typewriter;
+    typewriter.append(content, delayTime, color);
+    typewriter.wait();
 }
 
 /*!
@@ -125,6 +149,25 @@ std::string getFileContent(std::string fileName)
 
     return file_contents;
 }
+/*!
+ * @brief Reads a file's lines the first time they are asked for and keeps them.
+ * @param fileName The name of the file to read.
+ * @return The lines.
+ * @details Each list is allocated once and never moves, so callers may hold the reference.
+ */
+const std::vector<std::string> &getFileLines(const std::string &fileName)
+{
+    static std::mutex mutex;
+    static std::map<std::string, std::unique_ptr<const std::vector<std::string>>> *files = new std::map<std::string, std::unique_ptr<const std::vector<std::string>>>();
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unique_ptr<const std::vector<std::string>> &lines = (*files)[fileName];
+    if (!lines)
+    {
+        lines.reset(new std::vector<std::string>(split(getFileContent(fileName), '\n')));
+    }
+    return *lines;
+}
+
 /*!
  * @brief Splits a string into tokens based on a delimiter.
  * @param str The string to split.
@@ -152,13 +195,51 @@ std::vector<std::string> split(const std::string &str, char delimiter)
  */
 void clear(int limit)
 {
+    console().out() << clearSequence(limit);
+}
+
+/*!
+ * @brief Builds the escape sequence used by clear.
+ * @param limit The number of lines to clear.
+ * @return The sequence that moves up and erases each line, or an empty string in headless mode.
+ */
+std::string clearSequence(int limit)
+{
+    std::string sequence;
+    if (isHeadless())
+    {
+        return sequence;
+    }
+    sequence.reserve(limit > 0 ? limit * 10 : 0);
     for (int i = 0; i < limit; i++)
     {
-        std::cout << "\033[A\033[2K\033[G";
-        std::cout.flush();
-        // delay(500);
+        sequence += "\033[A\033[2K\033[G";
     }
+    return sequence;
 }
+/*!
+ * @brief Ends a session once its input runs out.
+ * @details A scripted bot has nothing more to say once its input reaches end of file. Without delays the game would
+ * otherwise spin through its retry loops forever, so a headless process exits, and a session on any other console
+ * throws InputClosed to end just that session.
+ */
+void endOfInputCheck()
+{
+    if (!console().in().eof())
+    {
+        return;
+    }
+    if (!console().isStandard())
+    {
+        throw InputClosed();
+    }
+    if (isHeadless())
+    {
+        std::cout << std::flush;
+        std::exit(0);
+    }
+}
+
 /*!
  * @brief Gets a full line of user input from the console.
  * @return A string containing the user's input.
@@ -166,8 +247,8 @@ void clear(int limit)
 std::string getUserInputLine()
 {
     std::string input;
-    std::getline(std::cin, input);
-    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Clear the newline character
+    std::getline(console().in(), input); // getline consumes the newline itself
+    endOfInputCheck();
     return input;
 }
 /*!
@@ -177,8 +258,9 @@ std::string getUserInputLine()
 std::string getUserInputToken()
 {
     std::string input;
-    std::cin >> input;
-    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Clear the newline character
+    console().in() >> input;
+    endOfInputCheck();
+    console().in().ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Clear the newline character
     return input;
 }
 /*!
@@ -190,15 +272,39 @@ std::string getUserInputToken()
 
 int generateRandomNumber(int low, int high)
 {
-    // Create a random device and use it to seed the random number generator
-    std::random_device rd;
-    std::mt19937 rng(rd());
-
     // Create a uniform integer distribution between low and high inclusive
     std::uniform_int_distribution<int> dist(low, high);
 
     // Generate and return the random number
-    return dist(rng);
+    return dist(randomEngine());
+}
+
+/*!
+ * @brief Gets the random engine used by the calling thread.
+ * @return A reference to a thread-local Mersenne Twister engine, seeded from std::random_device on first use.
+ * @details Keeping one engine per thread avoids constructing a std::random_device on every call and lets concurrent sessions generate floors independently.
+ */
+std::mt19937 &randomEngine()
+{
+    thread_local std::mt19937 rng(std::random_device{}());
+    return rng;
+}
+
+/*!
+ * @brief Seeds the calling thread's random engine.
+ * @param seed The seed to use.
+ */
+void seedRandom(unsigned int seed)
+{
+    randomEngine().seed(seed);
+}
+
+/*!
+ * @brief Reseeds the calling thread's random engine from std::random_device.
+ */
+void reseedRandom()
+{
+    randomEngine().seed(std::random_device{}());
 }
 /*!
  * @brief Converts a string to an integer.
@@ -260,10 +366,11 @@ std::string toLowerCase(const std::string &str)
 }
 /*!
  * @brief Reads an integer from user input.
+ * @param prompted Called after each prompt, before the answer is read, or nullptr.
  * @return The integer value entered by the user.
  * @details This function ensures that the input is a valid integer, handling errors and prompting the user until a valid input is received.
  */
-int readInt()
+int readInt(const std::function<void()> &prompted)
 {
     int value;
     while (true)
@@ -271,32 +378,37 @@ int readInt()
         try
         {
 
-            std::cout << "Enter your choice: " << std::flush;
+            console().out() << "Enter your choice: " << std::flush;
+            if (prompted)
+            {
+                prompted();
+            }
 
-            std::cin >> value;
+            console().in() >> value;
+            endOfInputCheck();
 
             // Check if the input operation failed (non-integer input)
-            if (std::cin.fail())
+            if (console().in().fail())
             {
                 disableInput();
                 throw std::runtime_error("Invalid input; please enter a valid integer.");
             }
 
             // Clear any remaining input from the buffer
-            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+            console().in().ignore(std::numeric_limits<std::streamsize>::max(), '\n');
 
             // If everything is fine, return the value
             return value;
         }
         catch (const std::runtime_error &e)
         {
-            std::cerr << "Error: " << e.what() << std::endl;
+            console().err() << "Error: " << e.what() << std::endl;
             delay(2000);
             // Clear the error flags
-            std::cin.clear();
+            console().in().clear();
 
             // Discard invalid input
-            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+            console().in().ignore(std::numeric_limits<std::streamsize>::max(), '\n');
             clear(2);
             enableInput();
         }
@@ -309,11 +421,11 @@ int readInt()
  */
 void waitForEnter()
 {
-    std::cout << "Press Enter to continue...";
+    console().out() << "Press Enter to continue...";
     // system("stty -echo -icanon");
 
     // std::cin.ignore(); // Waits for the user to press Ente
-    std::cin.get();
+    console().in().get();
 
     // system("stty echo icanon");
 }
@@ -0,0 +1,256 @@
+/*!
+@file typewriter.cpp
+@brief Implements the Typewriter class for the Valeris game.
+@details The animation runs on the shared timer thread. Each frame writes every character that is due on the text's
+own timeline, so a slow frame catches up in one batch instead of drifting, and a keypress writes the rest at once.
+*/
+
+#define NOMINMAX
+#include "../lib/typewriter.h"
+#include "../lib/renderer.h"
+#include "../lib/toolkit.h"
+#include "../lib/headless.h"
+#include "../lib/fiber.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#include <conio.h>
+#else
+#include <poll.h>
+#endif
+
+/*!
+@brief Constructor for the Typewriter class.
+@param out The stream to write to.
+@param frameMs The shortest time between batches.
+*/
+Typewriter::Typewriter(std::ostream &out, int frameMs)
+    : state(std::make_shared<State>())
+{
+    state->out = &out;
+    state->frameMs = std::max(1, frameMs);
+}
+
+/*!
+@brief Destructor for the Typewriter class.
+@details Skipping here means text that was started is never lost, and no timer callback writes after the owner has gone.
+*/
+Typewriter::~Typewriter()
+{
+    if (state->started)
+    {
+        skip();
+    }
+}
+
+/*!
+@brief Queues text to animate.
+@param text The text.
+@param msPerChar The delay before each character.
+@param color A colour sequence written before the text, or empty.
+@details In headless mode the text is queued without delay or colour, so it is written as soon as the animation starts.
+*/
+void Typewriter::append(const std::string &text, int msPerChar, const std::string &color)
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (isHeadless())
+    {
+        state->segments.push_back({text, 0, ""});
+        state->complete = false;
+        return;
+    }
+    state->segments.push_back({text, std::max(0, msPerChar), color});
+    state->complete = false;
+}
+
+/*!
+@brief Starts animating the queued text on the timer thread.
+*/
+void Typewriter::start()
+{
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (state->started)
+        {
+            return;
+        }
+        state->started = true;
+        state->segmentStart = TimerQueue::Clock::now();
+    }
+    advance(state, false);
+}
+
+/*!
+@brief Writes all remaining text immediately.
+*/
+void Typewriter::skip()
+{
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (state->timer != 0)
+        {
+            TimerThread::shared().cancel(state->timer);
+            state->timer = 0;
+        }
+        state->started = true;
+    }
+    advance(state, true);
+}
+
+/*!
+@brief Checks whether all queued text has been written.
+@return True once the animation has finished or been skipped.
+*/
+bool Typewriter::done()
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->complete;
+}
+
+/*!
+@brief Blocks until the animation finishes.
+@param skipOnKey If true and the text goes to std::cout with a terminal for input, a keypress completes the text at once.
+@details Input is polled in short slices with echo off, so the key that skips is swallowed rather than left for the
+next prompt.
+*/
+void Typewriter::wait(bool skipOnKey)
+{
+    if (!state->started)
+    {
+        start();
+    }
+// LCOV_EXCL_START
+#ifdef _WIN32
+    if (skipOnKey && !isHeadless() && state->out == &std::cout && _isatty(_fileno(stdin)))
+    {
+        while (!done())
+        {
+            if (_kbhit())
+            {
+                _getch();
+                skip();
+            }
+            sleepFor(20);
+        }
+    }
+#else
+    if (skipOnKey && !isHeadless() && state->out == &std::cout && isatty(STDIN_FILENO))
+    {
+        disableInput();
+        while (!done())
+        {
+            pollfd input = {STDIN_FILENO, POLLIN, 0};
+            if (poll(&input, 1, 20) > 0 && (input.revents & POLLIN))
+            {
+                char key;
+                if (read(STDIN_FILENO, &key, 1) > 0)
+                {
+                    skip();
+                }
+            }
+        }
+        enableInput();
+    }
+#endif
+    // LCOV_EXCL_STOP
+#ifdef __linux__
+    // A fiber must not block its thread, so it checks once a frame instead of waiting on the condition
+    while (Fiber::current() != nullptr && !done())
+    {
+        sleepFor(state->frameMs);
+    }
+#endif
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [this]
+                         { return state->complete; });
+}
+
+/*!
+@brief Gets the number of batches written.
+@return How many separate writes the animation has made.
+*/
+size_t Typewriter::batches()
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->batches;
+}
+
+/*!
+@brief Writes everything due and schedules the next frame.
+@param state The animation.
+@param all True to write all remaining text regardless of time.
+@details The next frame is at least frameMs away, but no later than the next character's deadline, so fast text is
+batched to the frame rate while slow text still appears exactly on time.
+*/
+void Typewriter::advance(const std::shared_ptr<State> &state, bool all)
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (state->complete)
+    {
+        return;
+    }
+    state->timer = 0;
+
+    TimerQueue::Clock::time_point now = TimerQueue::Clock::now();
+    std::string batch;
+    int untilNext = 0;
+    while (state->segment < state->segments.size())
+    {
+        const Segment &segment = state->segments[state->segment];
+        if (state->offset == 0 && !segment.color.empty())
+        {
+            batch += segment.color;
+        }
+
+        size_t due = segment.text.size();
+        if (!all && segment.msPerChar > 0)
+        {
+            long long elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - state->segmentStart).count();
+            due = std::min(due, static_cast<size_t>(std::max(0LL, elapsed / segment.msPerChar + 1)));
+        }
+        if (due > state->offset)
+        {
+            batch.append(segment.text, state->offset, due - state->offset);
+            state->offset = due;
+        }
+
+        if (state->offset < segment.text.size())
+        {
+            TimerQueue::Clock::time_point next = state->segmentStart + std::chrono::milliseconds(segment.msPerChar * static_cast<long long>(state->offset));
+            untilNext = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(next - now).count());
+            break;
+        }
+
+        if (!segment.color.empty())
+        {
+            batch += "\033[37m";
+        }
+        state->segmentStart += std::chrono::milliseconds(segment.msPerChar * static_cast<long long>(segment.text.size()));
+        state->segment++;
+        state->offset = 0;
+    }
+
+    if (!batch.empty())
+    {
+        *state->out << batch;
+        state->batches++;
+        if (state->out == &std::cout)
+        {
+            presentFrame();
+        }
+        else
+        {
+            state->out->flush();
+        }
+    }
+
+    if (state->segment < state->segments.size())
+    {
+        std::shared_ptr<State> keep = state;
+        state->timer = TimerThread::shared().after(std::max(state->frameMs, untilNext), [keep]
+                                                   { advance(keep, false); });
+        return;
+    }
+    state->complete = true;
+    state->finished.notify_all();
+}
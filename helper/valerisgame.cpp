@@ -6,223 +6,667 @@
 
 #include "../lib/valerisgame.h"
 #include "../lib/combat.h"
+#include "../lib/hibernation.h"
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+
+#ifdef __linux__
+#include "../lib/fiber.h"
+#endif
+
+namespace
+{
+    const unsigned long long StateVersion = 2; //!< The first field of a saved game, changed whenever the layout changes.
+}
 
 /*!
  * @brief Constructor for the ValerisGame class.
  * @details Initializes the game by generating a dungeon floor with a specified number of rooms and setting the current room to the starting point.
+ * While an event seed is set the floor is the event's shared template instead, and only the player's changes to it are the game's own.
+ * While a shared world is set the game joins it, and the player's changes go to the rooms every player in the world sees.
+ * Nothing is read or printed, so the game can be built while other output is on screen; the player's name is asked for in start.
+ * @param io The session's input and output.
  */
-ValerisGame::ValerisGame()
+ValerisGame::ValerisGame(Console &io)
+    : player(""), io(io), queued(commands), exploring(false), moved(false), interrupted(false), numVisitedRooms(0), sharedFloor(false)
 {
-    numRooms = 20;                                 //!< Sets the number of rooms in the dungeon.
-    currentRoom = dungeon.generateFloor(numRooms); //!< Generates the dungeon floor and sets the starting room.
+    // Commands live as long as the game, so add them before the floor's allocations rather than in the gaps those leave
+    registerCommands();
+    numRooms = 20; //!< Sets the number of rooms in the dungeon.
+    world = getSharedWorld();
+    if (world)
+    {
+        numRooms = world->getFloor()->getNumRooms();
+        floor.reset(new FloorOverlay(world->getFloor(), true));
+    }
+    else
+    {
+        unsigned int seed = static_cast<unsigned int>(std::time(0));
+        sharedFloor = getEventSeed(seed);
+        floor.reset(new FloorOverlay(sharedFloor ? FloorTemplate::shared(seed, numRooms) : std::make_shared<const FloorTemplate>(seed, numRooms)));
+    }
+    currentRoom = floor->getTemplate().getStartRoom(); //!< Sets the starting room.
 }
 
 /*!
- * @brief Starts the game and manages the main exploration loop.
- * @details The start method enters a loop where the player explores the dungeon, moves between rooms, and interacts with the game world. The player can move in cardinal directions, engage in combat, play games, or view help information.
+ * @brief Destructor for the ValerisGame class.
+ * @details A game that ends while hibernating, such as when its server shuts down, leaves no file behind.
+ */
+ValerisGame::~ValerisGame()
+{
+    if (member)
+    {
+        world->leave(*member);
+    }
+    if (!hibernatedPath.empty())
+    {
+        std::string state;
+        takeHibernated(hibernatedPath, state);
+    }
+}
+
+/*!
+ * @brief Starts the game on its console.
+ * @param color The color of the text.
+ * @details The console is bound to the calling thread for the length of the game, so every module the game calls reads and writes through it.
  */
-// LCOV_EXCL_START
 void ValerisGame::start(const std::string &color)
 {
-    bool exploring = true; //!< Flag to control the exploration loop.
-    bool codeGuessed = false;
-    int numVistedRooms = 0;
-    while (exploring)
+    Console::Binding binding(io);
+    try
     {
-        // dungeon.traverseAndPrint(currentRoom);
-        std::cout << dungeon.getMap(currentRoom) << std::endl;
-        std::cout << color + currentRoom->roomContent.getRoomDesc() << ".\n\n";
-        currentRoom->displayAvailableDirections();
+        play(color);
+    }
+    catch (const InputClosed &)
+    {
+        // The player went away; only this session ends
+    }
+    if (member)
+    {
+        world->leave(*member);
+    }
+    io.present();
+}
+
+/*!
+ * @brief Manages the main exploration loop.
+ * @param color The color of the text.
+ * @details The loop lets the player explore the dungeon, move between rooms, and interact with the game world. Each line the player types is split into steps by the command queue and each step is handed to the command registry, so the loop itself does not know which actions exist.
+ * Chained steps run back to back and the view is drawn only once the queue is empty, so a line such as "n;n;e" redraws once. A step that fails, walks into enemies, or ends the game drops the rest of the chain.
+ */
+// LCOV_EXCL_START
+void ValerisGame::play(const std::string &color)
+{
+    this->color = color;
+    if (player.getName().empty())
+    {
+        player.getNameFromUser();
+        clear(2);
+    }
+    if (world && !member)
+    {
+        member.reset(new SharedWorld::Member(player.getName()));
+    }
+    if (member)
+    {
+        world->enter(*member, currentRoom->id);
+    }
 
-        if (!currentRoom->roomContent.getVisited())
+    exploring = true; //!< Flag to control the exploration loop.
+    queued.clear();
+    while (exploring)
+    {
+        if (!floor->getVisited(currentRoom->id))
         {
-            currentRoom->roomContent.setVisited(true);
-            numVistedRooms += 1;
+            floor->setVisited(currentRoom->id);
+            numVisitedRooms += 1;
         }
-
-        std::string fightString = "";
-        std::string playString = "";
-        std::string searchString = "";
-        std::string bidString = "";
-        std::string finishedString = "";
-
-        if (currentRoom->roomContent.getRoomType() == 0)
+        if (queued.empty())
         {
-            fightString = ", /fight";
+            readActions();
         }
-        if (currentRoom->roomContent.getRoomType() == 1)
+
+        moved = false;
+        interrupted = false;
+        CommandRegistry::Result result = commands.dispatch(queued.pop());
+        switch (result)
         {
-            playString = ", /play";
+        case CommandRegistry::Result::Ran:
+            break;
+        case CommandRegistry::Result::BadArguments:
+            console().out() << "That action does not take those arguments." << std::endl;
+            break;
+        default:
+            console().out() << "Invalid direction. Please enter N, S, E, W, or Q." << std::endl;
+            break;
         }
-        if (currentRoom->roomContent.getRoomType() == 2 && !codeGuessed)
+
+        if (!moved)
         {
-            playString = ", /play";
+            // Other actions print their own output, so draw the next view in full from wherever the cursor is
+            screen.invalidate();
         }
-        else if (currentRoom->roomContent.getRoomType() == 2 && codeGuessed)
+        if (result != CommandRegistry::Result::Ran || interrupted || !exploring)
         {
-            searchString = ", /search";
+            size_t dropped = queued.clear();
+            if (dropped > 0 && exploring)
+            {
+                std::string message = "Stopped with " + std::to_string(dropped) + " queued action" + (dropped == 1 ? "" : "s") + " left.\n";
+                console().out() << message;
+                screen.written(message);
+            }
         }
-        if (currentRoom->roomContent.getRoomType() == 1 && player.getCoins() >= 10)
+    }
+}
+// LCOV_EXCL_STOP
+
+/*!
+ * @brief Reads the next line from the player and queues it.
+ * @details Draws the exploration view first, so it is drawn once for each line however many steps the line holds.
+ */
+// LCOV_EXCL_START
+void ValerisGame::readActions()
+{
+    while (queued.empty())
+    {
+        // dungeon.traverseAndPrint(currentRoom);
+        showMessages();
+        screen.begin();
+        screen.draw(floor->getMap(currentRoom) + "\n");
+        screen.draw(color + currentRoom->roomContent.getRoomDesc() + ".\n\n");
+        screen.draw(currentRoom->getAvailableDirections());
+        screen.draw("Other Avalible Actions: " + commands.listed(", ") + "\nEnter Action : ");
+        console().out() << screen.present();
+
+        std::string action; //!< The player's input for movement or action.
+        do
+        {
+            waitForPlayer();
+            action = getUserInputLine();
+        } while (CommandArgs(action).command().empty());
+        screen.inputLine();
+        console().out() << "\n";
+        screen.written("\n");
+
+        std::string message;
+        switch (queued.push(action))
         {
-            bidString = ", /gamble";
+        case CommandQueue::Pushed::Queued:
+            break;
+        case CommandQueue::Pushed::Defined:
+            message = "Macro saved.";
+            break;
+        case CommandQueue::Pushed::Removed:
+            message = "Macro removed.";
+            break;
+        case CommandQueue::Pushed::Rejected:
+            message = "A macro needs a one-word name that is not already an action.";
+            break;
+        case CommandQueue::Pushed::TooLong:
+            message = "That is too many actions at once.";
+            break;
         }
-        if (numVistedRooms == numRooms)
+        if (!message.empty())
         {
-            finishedString = ", /finish";
+            console().out() << message << "\n";
+            screen.written(message + "\n");
         }
+    }
+}
+// LCOV_EXCL_STOP
+
+/*!
+ * @brief Waits for the player's next input, hibernating if none comes in time.
+ * @details The wait costs nothing on a server, where it parks the session's fiber. Input that cannot be polled, such
+ * as a pipe, is always ready, so a scripted game never hibernates. This is the game's turn: everything it needs to
+ * carry on is in its saved state, so a session being handed to another process is handed off here.
+ */
+void ValerisGame::waitForPlayer()
+{
+    int idle = getHibernation().idleMilliseconds;
+    if (idle <= 0 && io.isStandard())
+    {
+        return;
+    }
+    io.present();
+    if (idle > 0 && !io.waitForTurn(idle))
+    {
+        hibernate();
+    }
+    io.waitForTurn(-1);
+    wake();
+    if (io.handoffRequested())
+    {
+        throw SessionHandoff(saveState());
+    }
+}
+
+/*!
+ * @brief Writes the game to disk and frees what can be rebuilt from it.
+ * @details The player, commands and macros are small and stay in memory. The dungeon, the screen's picture of the
+ * terminal and the deep parts of the fiber's stack are freed. The stack's pages go back to the kernel at once, and the
+ * heap's when the game server next trims it.
+ */
+void ValerisGame::hibernate()
+{
+    std::string path = storeHibernated(saveState());
+    if (path.empty())
+    {
+        return;
+    }
+    hibernatedPath = path;
+    if (member)
+    {
+        world->leave(*member);
+    }
+    floor.reset();
+    currentRoom = nullptr;
+    screen = Screen();
+#ifdef __linux__
+    Fiber::trimStack();
+#endif
+}
+
+/*!
+ * @brief Restores the game from its file.
+ * @details If the file cannot be read the game has nothing to carry on from, so the session ends as if its input had
+ * closed.
+ */
+void ValerisGame::wake()
+{
+    if (hibernatedPath.empty())
+    {
+        return;
+    }
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    std::string state;
+    bool read = takeHibernated(hibernatedPath, state);
+    hibernatedPath.clear();
+    if (!read || !restoreState(state))
+    {
+        throw InputClosed();
+    }
+    recordRestore(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count());
+}
+
+/*!
+ * @brief Records everything needed to carry on the game.
+ * @return The record.
+ */
+std::string ValerisGame::saveState()
+{
+    wake();
+    BlobWriter out;
+    out.putUnsigned(StateVersion);
+    out.putUnsigned(floor->getTemplate().getSeed());
+    out.putInt(numRooms);
+    out.putUnsigned(world ? 2 : sharedFloor ? 1 : 0);
+    out.putInt(currentRoom->id);
+    out.putInt(numVisitedRooms);
+    out.putString(color);
+    FloorDelta delta = floor->captureDelta();
+    out.putFlags(delta.visited);
+    out.putFlags(delta.cleared);
+    out.putFlags(delta.looted);
+    out.putFlags(delta.solved);
+    player.save(out);
+    out.putString(queued.macros());
+    return out.data();
+}
 
-        std::cout << "Other Avalible Actions: Q, /help, /heal, /stats, /inventory" + fightString + playString + searchString + bidString + finishedString + "\nEnter Action : ";
-        std::string direction = getUserInputToken(); //!< Gets the player's input for movement or action.
-        std::cout << "\n";
+/*!
+ * @brief Replaces the game with a recorded one.
+ * @param state The record.
+ * @return False if it is malformed.
+ * @details Everything is read and the floor rebuilt before anything is replaced, so a bad record leaves the game as
+ * it was. A game on a shared floor rejoins the template the other players hold, which is only generated again if
+ * none of them still do. A game in a shared world can only be restored into the same world, which holds its floor. Generating a floor reseeds the thread's random engine, so it is reseeded again afterwards.
+ */
+bool ValerisGame::restoreState(const std::string &state)
+{
+    BlobReader in(state);
+    if (in.getUnsigned() != StateVersion)
+    {
+        return false;
+    }
+    unsigned int seed = (unsigned int)in.getUnsigned();
+    int rooms = (int)in.getInt();
+    unsigned long long kind = in.getUnsigned();
+    int roomId = (int)in.getInt();
+    int visitedRooms = (int)in.getInt();
+    std::string savedColor = in.getString();
+    FloorDelta delta;
+    delta.visited = in.getFlags();
+    delta.cleared = in.getFlags();
+    delta.looted = in.getFlags();
+    delta.solved = in.getFlags();
+    Player savedPlayer("");
+    if (!savedPlayer.load(in))
+    {
+        return false;
+    }
+    std::string macros = in.getString();
+    if (!in.ok() || !in.atEnd() || rooms <= 0)
+    {
+        return false;
+    }
 
-        // Convert direction to uppercase for consistent comparisons
-        std::string upperDirection = toUpperCase(direction);
+    std::shared_ptr<SharedWorld> joined = kind == 2 ? (world ? world : getSharedWorld()) : nullptr;
+    if (kind > 2 || (kind == 2 && (!joined || joined->getFloor()->getSeed() != seed || joined->getFloor()->getNumRooms() != rooms)))
+    {
+        return false;
+    }
+    std::unique_ptr<FloorOverlay> restored;
+    if (kind == 2)
+    {
+        restored.reset(new FloorOverlay(joined->getFloor(), true));
+    }
+    else
+    {
+        restored.reset(new FloorOverlay(kind == 1 ? FloorTemplate::shared(seed, rooms) : std::make_shared<const FloorTemplate>(seed, rooms)));
+    }
+    reseedRandom();
+    if (restored->getRoom(roomId) == nullptr)
+    {
+        return false;
+    }
+    restored->applyDelta(delta);
 
-        if (upperDirection == "N")
+    floor = std::move(restored);
+    currentRoom = floor->getRoom(roomId);
+    sharedFloor = kind == 1;
+    if (member && world != joined)
+    {
+        world->leave(*member);
+        member.reset();
+    }
+    world = joined;
+    if (member)
+    {
+        world->enter(*member, currentRoom->id);
+    }
+    numRooms = rooms;
+    numVisitedRooms = visitedRooms;
+    color = savedColor;
+    player = savedPlayer;
+    for (const std::string &line : split(queued.macros(), '\n'))
+    {
+        queued.undefine(line.substr(0, line.find(" = ")));
+    }
+    for (const std::string &line : split(macros, '\n'))
+    {
+        size_t equals = line.find(" = ");
+        if (equals != std::string::npos)
         {
-            bool empty = true;
-            if (currentRoom->roomContent.getRoomType() == 0)
-            {
-                std::vector<EnemyStruct> enemies = currentRoom->roomContent.getEnemies();
-                if (!enemies.empty())
-                {
-                    std::cout << "There are enemies in the room!" << std::endl;
-                    delay(2000);
-                    clear(1);
-                    empty = false;
-                }
-            }
-            if (empty)
-            {
-                if (currentRoom->north)
-                {
-                    currentRoom = currentRoom->north; //!< Move the player to the room to the north.
-                    codeGuessed = false;
-                }
-                else
-                {
-                    std::cout << "You can't move North." << std::endl;
-                    delay(3000);
-                    clear(1);
-                }
-                clear(14);
-            }
+            queued.define(line.substr(0, equals), line.substr(equals + 3));
         }
-        else if (upperDirection == "S")
+    }
+    screen.invalidate();
+    return true;
+}
+
+/*!
+ * @brief Carries on a restored game on its console.
+ * @details The player already has a name, so the game goes straight to the view of the room they were in.
+ */
+void ValerisGame::resume()
+{
+    start(color);
+}
+
+/*!
+ * @brief Checks whether the game is hibernating.
+ * @return True while it is.
+ */
+bool ValerisGame::isHibernating() const
+{
+    return !hibernatedPath.empty();
+}
+
+/*!
+ * @brief Gets the actions the player can type.
+ * @return The command registry.
+ */
+CommandRegistry &ValerisGame::getCommands()
+{
+    return commands;
+}
+
+/*!
+ * @brief Gets the queue of chained steps and the player's macros.
+ * @return The queue.
+ */
+CommandQueue &ValerisGame::getQueue()
+{
+    return queued;
+}
+
+/*!
+ * @brief Moves the player through a door unless enemies block the way.
+ * @param next The room behind the door, or nullptr if there is no door.
+ * @param direction The direction's name.
+ * @details Blocked moves and moves into a room with enemies interrupt a chain of steps.
+ */
+// LCOV_EXCL_START
+void ValerisGame::move(const Room *next, const std::string &direction)
+{
+    moved = true;
+    if (currentRoom->roomContent.getRoomType() == 0 && !currentRoom->roomContent.getEnemies().empty())
+    {
+        interrupted = true;
+        notice("There are enemies in the room!", 2000);
+    }
+    else if (next)
+    {
+        currentRoom = floor->getRoom(next->id); //!< Move the player to the room behind the door, or their copy of it.
+        if (member)
         {
-            bool empty = true;
-            if (currentRoom->roomContent.getRoomType() == 0)
-            {
-                std::vector<EnemyStruct> enemies = currentRoom->roomContent.getEnemies();
-                if (!enemies.empty())
-                {
-                    std::cout << "There are enemies in the room!" << std::endl;
-                    delay(2000);
-                    clear(1);
-                    empty = false;
-                }
-            }
-            if (empty)
-            {
-                if (currentRoom->south)
-                {
-                    currentRoom = currentRoom->south; //!< Move the player to the room to the south.
-                    codeGuessed = false;
-                }
-                else
-                {
-                    std::cout << "You can't move South." << std::endl;
-                    delay(3000);
-                    clear(1);
-                }
-                clear(14);
-            }
+            world->enter(*member, currentRoom->id);
         }
-        else if (upperDirection == "E")
+        // Stop a chain of moves at the first room with enemies, so the player sees them before acting
+        interrupted = currentRoom->roomContent.getRoomType() == 0 && !currentRoom->roomContent.getEnemies().empty();
+    }
+    else
+    {
+        interrupted = true;
+        notice("You can't move " + direction + ".", 3000);
+    }
+}
+// LCOV_EXCL_STOP
+
+/*!
+ * @brief Gets the current room for a change, giving the player their own copy of it first.
+ * @return The copy's content.
+ */
+RoomContent &ValerisGame::changeRoom()
+{
+    Room *copy = floor->edit(currentRoom->id);
+    currentRoom = copy;
+    return copy->roomContent;
+}
+
+/*!
+ * @brief Gets a mini-game to play.
+ * @param game The room's game.
+ * @return The room's game, or in a shared world a copy of it, since other players may be playing it too.
+ */
+Game *ValerisGame::playable(Game *game)
+{
+    if (!world)
+    {
+        return game;
+    }
+    borrowed = game->clone();
+    return borrowed.get();
+}
+
+/*!
+ * @brief Tells the other players in the room what the player has done.
+ * @param message The message.
+ */
+void ValerisGame::announce(const std::string &message)
+{
+    if (member)
+    {
+        world->broadcast(currentRoom->id, message, member.get());
+    }
+}
+
+/*!
+ * @brief Prints what other players have done in the player's room since the view was last drawn.
+ */
+void ValerisGame::showMessages()
+{
+    if (!member)
+    {
+        return;
+    }
+    for (const std::string &message : member->takeMessages())
+    {
+        std::string line = message + "\n";
+        console().out() << line;
+        screen.written(line);
+    }
+}
+
+/*!
+ * @brief Adds the game's actions to the command registry.
+ * @details Commands are offered in the order they are added. The directions are shown by the room instead, so they are never listed.
+ */
+// LCOV_EXCL_START
+void ValerisGame::registerCommands()
+{
+    auto never = []
+    { return false; };
+    commands.add("N", [this](const CommandArgs &)
+                 { move(currentRoom->north, "North"); }, nullptr, never);
+    commands.add("S", [this](const CommandArgs &)
+                 { move(currentRoom->south, "South"); }, nullptr, never);
+    commands.add("E", [this](const CommandArgs &)
+                 { move(currentRoom->east, "East"); }, nullptr, never);
+    commands.add("W", [this](const CommandArgs &)
+                 { move(currentRoom->west, "West"); }, nullptr, never);
+
+    commands.add("Q", [this](const CommandArgs &)
+                 {
+                     exploring = false; //!< Exits the exploration loop and ends the game.
+                     console().out() << "Exiting dungeon exploration." << std::endl; });
+    commands.add("/help", [](const CommandArgs &)
+                 { console().out() << getFileContent("../reasources/help.txt") << std::endl; }); //!< Displays help information from a file.
+    commands.add("/heal", [this](const CommandArgs &)
+                 {
+                     player.heal();
+                     clear(14); });
+    commands.add("/stats", [this](const CommandArgs &)
+                 { player.displayStats(); });
+    commands.add("/inventory", [this](const CommandArgs &)
+                 { player.printInventory(); });
+    commands.add("/macros", [this](const CommandArgs &)
+                 {
+                     std::string list = queued.macros();
+                     console().out() << (list.empty() ? "No macros. Define one with: /name = action;action\n" : list) << std::flush; });
+
+    commands.add(
+        "/fight", [this](const CommandArgs &)
         {
-            bool empty = true;
-            if (currentRoom->roomContent.getRoomType() == 0)
+            console().out() << "\033[37m";
+            std::vector<EnemyStruct> enemies = currentRoom->roomContent.getEnemies();
+            while (!enemies.empty())
             {
-                std::vector<EnemyStruct> enemies = currentRoom->roomContent.getEnemies();
-                if (!enemies.empty())
+                EnemyStruct enemy = enemies.front();
+                int enemyHealth = enemy.health;
+                bool state = combatV1(player.getCurrHealth(), enemyHealth, 3000, enemy.name, player.getDamage(), enemy.attack, player.getResistance()); //!< Initiates combat with the enemy.
+                if (!state)
                 {
-                    std::cout << "There are enemies in the room!" << std::endl;
-                    delay(2000);
-                    clear(1);
-                    empty = false;
+                    exploring = false; //!< Death ends the game and anything still queued.
+                    break;
                 }
+                enemies.erase(enemies.begin());
+                console().out() << "Healing..." << std::endl;
+                player.heal();
+                delay(500);
+                clear(6);
             }
-            if (empty)
+            if (exploring)
             {
-                if (currentRoom->east)
+                // In a shared world a player who dies leaves the enemies for the others
+                RoomContent &room = changeRoom();
+                if (room.clearEnemies())
                 {
-                    currentRoom = currentRoom->east; //!< Move the player to the room to the east.
-                    codeGuessed = false;
-                }
-                else
-                {
-                    std::cout << "You can't move East." << std::endl;
-                    delay(3000);
-                    clear(1);
+                    announce(player.getName() + " has defeated the enemies here.");
                 }
+                room.clearText();
             }
-
             clear(14);
-        }
-        else if (upperDirection == "W")
+            console().out() << color; },
+        [this]
+        { return currentRoom->roomContent.getRoomType() == 0; });
+
+    commands.add(
+        "/play", [this](const CommandArgs &)
         {
-            bool empty = true;
-            if (currentRoom->roomContent.getRoomType() == 0)
+            console().out() << "\033[37m";
+            if (currentRoom->roomContent.getRoomType() == 1)
             {
-                std::vector<EnemyStruct> enemies = currentRoom->roomContent.getEnemies();
-                if (!enemies.empty())
+                Game *game = playable(changeRoom().getNPC().gamblingGame.get());
+                while (!game->start())
                 {
-                    std::cout << "There are enemies in the room!" << std::endl;
-                    delay(2000);
-                    clear(1);
-                    empty = false;
+                    //!< Starts the NPC's gambling game if the current room is a gambling room.
                 }
+                clear(14);
+                console().out() << color;
             }
-            if (empty)
+            else
             {
-                if (currentRoom->west)
+                if (!currentRoom->roomContent.getSolved())
                 {
-                    currentRoom = currentRoom->west; //!< Move the player to the room to the west.
-                    codeGuessed = false;
-                }
-                else
-                {
-                    std::cout << "You can't move West." << std::endl;
-                    delay(3000);
-                    clear(1);
+                    RoomContent &room = changeRoom();
+                    if (playable(room.getNonGamblingGame())->start())
+                    {
+                        room.setSolved(true);
+                        announce(player.getName() + " has cracked the safe.");
+                    }
                 }
+                console().out() << color;
                 clear(14);
-            }
-        }
-        else if (upperDirection == "/PLAY" && currentRoom->roomContent.getRoomType() == 1)
+            } },
+        [this]
+        { return currentRoom->roomContent.getRoomType() == 1 || currentRoom->roomContent.getRoomType() == 2; },
+        [this]
+        { return currentRoom->roomContent.getRoomType() == 1 || (currentRoom->roomContent.getRoomType() == 2 && !currentRoom->roomContent.getSolved()); });
+
+    commands.add(
+        "/search", [this](const CommandArgs &)
         {
-            std::cout << "\033[37m";
-            while (!currentRoom->roomContent.getNPC().gamblingGame.get()->start())
+            RoomContent &room = changeRoom();
+            bool wasLooted = room.getLooted();
+            bool safe = room.getRoomType() == 2;
+            room.displayRoomItems();
+            std::vector<std::string> itemsToAdd;
+            int coins = 0;
+            if (room.takeLoot(itemsToAdd, coins))
             {
-                //!< Starts the NPC's gambling game if the current room is a gambling room.
+                for (size_t i = 0; i < itemsToAdd.size(); i++)
+                {
+                    player.addToInventory(itemsToAdd[i]);
+                }
+                player.setCoinsPlus(coins);
+                announce(player.getName() + (safe ? " has emptied the safe." : " has searched the room."));
             }
-            clear(14);
-            std::cout << color;
-        }
-        else if (upperDirection == "/PLAY" && currentRoom->roomContent.getRoomType() == 2)
-        {
-            std::cout << "\033[37m";
-            if (!codeGuessed)
+            else if (!wasLooted)
             {
-                codeGuessed = currentRoom->roomContent.getNonGamblingGame()->start();
-            }
-            std::cout << color;
-            clear(14);
-        }
-        else if (upperDirection == "/GAMBLE" && currentRoom->roomContent.getRoomType() == 1 && player.getCoins() >= 10)
+                console().out() << (safe ? "Someone else emptied the safe first." : "Someone else searched the room first.") << std::endl;
+            } },
+        nullptr,
+        [this]
+        { return currentRoom->roomContent.getRoomType() == 2 && currentRoom->roomContent.getSolved(); });
+
+    commands.add(
+        "/gamble", [this](const CommandArgs &)
         {
-            std::cout << "\033[37m";
-            bool result = currentRoom->roomContent.getNPC().gamblingGame.get()->start();
+            console().out() << "\033[37m";
+            bool result = playable(changeRoom().getNPC().gamblingGame.get())->start();
 
             if (result)
             {
@@ -233,61 +677,14 @@ void ValerisGame::start(const std::string &color)
                 player.setCoinsMinus(10);
             }
             clear(14);
-            std::cout << color;
-        }
-        else if (upperDirection == "/SEARCH")
-        {
-            currentRoom->roomContent.displayRoomItems();
-            std::vector<std::string> itemsToAdd = currentRoom->roomContent.getItems();
-            for (size_t i = 0; i < itemsToAdd.size(); i++)
-            {
-                player.addToInventory(itemsToAdd[i]);
-            }
-            currentRoom->roomContent.emptyItems();
-            player.setCoinsPlus(currentRoom->roomContent.getCoins());
-        }
-        else if (upperDirection == "/HEAL")
-        {
-            player.heal();
-            clear(14);
-        }
-        else if (upperDirection == "/FIGHT" && currentRoom->roomContent.getRoomType() == 0)
-        {
-            std::cout << "\033[37m";
-            std::vector<EnemyStruct> enemies = currentRoom->roomContent.getEnemies();
-            while (!enemies.empty())
-            {
-                EnemyStruct enemy = enemies.front();
-                int enemyHealth = enemy.health;
-                int difficulty = 2000;
-                bool state = combatV1(player.getCurrHealth(), enemyHealth, 3000, enemy.name, player.getDamage(), enemy.attack, player.getResistance()); //!< Initiates combat with the enemy.
-                if (!state)
-                {
-                    exploring = false;
-                    break;
-                }
-                else
-                {
-                    enemies.erase(enemies.begin());
-                }
-                std::cout << "Healing..." << std::endl;
-                player.heal();
-                delay(500);
-                clear(6);
-                difficulty -= 100;
-            }
-            currentRoom->roomContent.clearEnemies();
-            currentRoom->roomContent.clearText();
-            clear(14);
-            std::cout << color;
-        }
-        else if (upperDirection == "/STATS")
-        {
-            player.displayStats();
-        }
-        else if (upperDirection == "/FINISH" && numVistedRooms == numRooms)
+            console().out() << color; },
+        [this]
+        { return currentRoom->roomContent.getRoomType() == 1 && player.getCoins() >= 10; });
+
+    commands.add(
+        "/finish", [this](const CommandArgs &)
         {
-            std::cout << R"(
+        console().out() << R"(
         _________                                     __        .__          __  .__                      
         \_   ___ \  ____   ____    ________________ _/  |_ __ __|  | _____ _/  |_|__| ____   ____   ______
         /    \  \/ /  _ \ /    \  / ___\_  __ \__  \\   __\  |  \  | \__  \\   __\  |/  _ \ /    \ /  ___/
@@ -311,25 +708,24 @@ void ValerisGame::start(const std::string &color)
             delay(5000);
             clear(100);
             exploring = false; //!< Exits the exploration loop and ends the game.
-            std::cout << "Exiting dungeon exploration." << std::endl;
-        }
-        else if (upperDirection == "Q")
-        {
-            exploring = false; //!< Exits the exploration loop and ends the game.
-            std::cout << "Exiting dungeon exploration." << std::endl;
-        }
-        else if (upperDirection == "/HELP")
-        {
-            std::cout << getFileContent("../reasources/help.txt") << std::endl; //!< Displays help information from a file.
-        }
-        else if (upperDirection == "/INVENTORY")
-        {
-            player.printInventory();
-        }
-        else
-        {
-            std::cout << "Invalid direction. Please enter N, S, E, W, or Q." << std::endl;
-        }
-    }
-    // LCOV_EXCL_STOP
-}
\ No newline at end of file
+            console().out() << "Exiting dungeon exploration." << std::endl; },
+        [this]
+        { return numVisitedRooms == numRooms; });
+}
+// LCOV_EXCL_STOP
+
+/*!
+ * @brief Shows a one-line message below the view for a moment and then removes it.
+ * @param message The message to show.
+ * @param milliseconds How long to show it for.
+ */
+// LCOV_EXCL_START
+void ValerisGame::notice(const std::string &message, int milliseconds)
+{
+    console().out() << message << "\n";
+    screen.written(message + "\n");
+    delay(milliseconds);
+    console().out() << clearSequence(1);
+    screen.written(clearSequence(1));
+}
+// LCOV_EXCL_STOP
\ No newline at end of file
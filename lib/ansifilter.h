@@ -0,0 +1,172 @@
+/*!
+ * @file ansifilter.h
+ * @brief Defines the AnsiFilter class for the Valeris game.
+ * @details This file contains the declaration of the AnsiFilter class, which removes redundant ANSI escape sequences
+ * from terminal output without changing what the player sees, and the CoalescingSink that applies it to a console.
+ */
+
+#ifndef ANSIFILTER_H
+#define ANSIFILTER_H
+
+#include <string>
+#include "console.h"
+
+/*!
+ * @class AnsiFilter
+ * @brief Rewrites terminal output with fewer escape bytes.
+ * @details The filter tracks the SGR state (colours and attributes) the terminal is in and the state the output asks
+ * for. Colour changes are held back until a character that shows them is written, so a change that is undone before
+ * anything is drawn costs nothing, several changes in a row become one sequence, and a foreground change is not sent
+ * just to draw spaces. Consecutive cursor movements in the same direction are merged into one sequence. The filter
+ * assumes the terminal starts in its default state and sees everything written to it.
+ */
+class AnsiFilter
+{
+public:
+    /*!
+     * @brief Constructor for the AnsiFilter class.
+     */
+    AnsiFilter();
+
+    /*!
+     * @brief Filters output.
+     * @param data The bytes. An escape sequence may be split across calls.
+     * @param size How many there are.
+     * @param out Where the filtered bytes are appended.
+     */
+    void filter(const char *data, size_t size, std::string &out);
+
+    /*!
+     * @brief Filters a string.
+     * @param text The text.
+     * @param out Where the filtered bytes are appended.
+     */
+    void filter(const std::string &text, std::string &out);
+
+    /*!
+     * @brief Sends held-back colour changes and cursor movement.
+     * @param out Where the bytes are appended.
+     * @details Call at the end of each frame so that text the terminal echoes while the player types appears in the
+     * colour the output last asked for.
+     */
+    void finish(std::string &out);
+
+    /*!
+     * @brief Forgets all state and assumes the terminal is back in its default state.
+     */
+    void reset();
+
+private:
+    /*!
+     * @enum Attribute
+     * @brief SGR attributes, as bits.
+     */
+    enum Attribute
+    {
+        Bold = 1,       //!< SGR 1.
+        Dim = 2,        //!< SGR 2.
+        Italic = 4,     //!< SGR 3.
+        Underline = 8,  //!< SGR 4.
+        Blink = 16,     //!< SGR 5.
+        Reverse = 32,   //!< SGR 7.
+        Hidden = 64,    //!< SGR 8.
+        Strike = 128    //!< SGR 9.
+    };
+
+    /*!
+     * @struct Style
+     * @brief An SGR state.
+     */
+    struct Style
+    {
+        std::string fg;       //!< Foreground parameters such as "36" or "38;5;12", or empty for the default.
+        std::string bg;       //!< Background parameters, or empty for the default.
+        unsigned attrs = 0;   //!< Attribute bits.
+
+        bool operator==(const Style &other) const { return fg == other.fg && bg == other.bg && attrs == other.attrs; }
+        bool operator!=(const Style &other) const { return !(*this == other); }
+    };
+
+    /*!
+     * @enum Parse
+     * @brief Where the filter is within an escape sequence.
+     */
+    enum class Parse
+    {
+        Text,   //!< Ordinary text.
+        Escape, //!< After ESC.
+        Csi     //!< Inside ESC [ ... up to its final byte.
+    };
+
+    /*!
+     * @brief Applies an SGR sequence's parameters to the wanted style.
+     * @param params The parameters between ESC [ and m.
+     * @return False if a parameter is not understood.
+     */
+    bool applySgr(const std::string &params);
+
+    /*!
+     * @brief Handles a complete CSI sequence.
+     * @param out Where bytes are appended.
+     */
+    void csi(std::string &out);
+
+    /*!
+     * @brief Queues a cursor movement.
+     * @param final The sequence's final byte: A, B, C, D or G.
+     * @param count Its parameter.
+     * @param out Where bytes are appended if the queued movement cannot absorb it.
+     */
+    void move(char final, int count, std::string &out);
+
+    /*!
+     * @brief Sends the queued cursor movement.
+     * @param out Where bytes are appended.
+     */
+    void flushMove(std::string &out);
+
+    /*!
+     * @brief Brings the terminal's style up to date.
+     * @param out Where bytes are appended.
+     * @details The shorter of a sequence changing only what differs and a sequence starting with a reset is used.
+     */
+    void flushStyle(std::string &out);
+
+    /*!
+     * @brief Checks whether a blank can be drawn without updating the style.
+     * @return True if the only difference is the foreground colour and nothing makes blanks visible.
+     */
+    bool blankUnaffected() const;
+
+    Style sent;           //!< The style the terminal is in.
+    Style wanted;         //!< The style the output asks for.
+    bool sentUnknown;     //!< Whether a sequence the filter does not understand was passed through.
+    Parse parse;          //!< Escape sequence parser state.
+    std::string sequence; //!< The escape sequence being read, without ESC.
+    char moveFinal;       //!< Final byte of the queued cursor movement, or 0 if there is none.
+    int moveCount;        //!< Count (or column, for G) of the queued movement.
+};
+
+/*!
+ * @class CoalescingSink
+ * @brief Output sink that passes output through an AnsiFilter before another sink.
+ * @details Each write ends a frame, so nothing is held back once a console flushes.
+ */
+class CoalescingSink : public OutputSink
+{
+public:
+    /*!
+     * @brief Constructor for the CoalescingSink class.
+     * @param next Where filtered output goes. It must outlive this sink.
+     */
+    explicit CoalescingSink(OutputSink &next);
+
+    bool write(const char *data, size_t size) override;
+
+private:
+    OutputSink &next;   //!< Where filtered output goes.
+    AnsiFilter ansi;    //!< The filter.
+    std::string buffer; //!< Filtered bytes for the current write.
+};
+
+#endif // ANSIFILTER_H
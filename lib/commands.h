@@ -0,0 +1,375 @@
+/*!
+ * @file commands.h
+ * @brief Defines the command registry for the Valeris game.
+ * @details This file contains the declaration of the CommandArgs, CommandHandler, FunctionCommand,
+ * CommandRegistry and CommandQueue classes. The exploration loop hands each line the player types to a queue, which
+ * splits chained input and expands macros into steps, and runs each step through a registry, which finds the command
+ * through a perfect hash of its case-insensitive name, checks that it is available and has the right number of
+ * arguments, and runs its handler.
+ */
+
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*!
+ * @class CommandArgs
+ * @brief A typed line split into a command and its arguments.
+ * @details The pieces are views into the line, so splitting does not allocate. The line must outlive the arguments.
+ */
+class CommandArgs
+{
+public:
+    static const int MaxArguments = 8; //!< Arguments past this many are counted but not kept.
+
+    /*!
+     * @brief Splits a line on spaces and tabs.
+     * @param line The line. Leading and trailing blanks are ignored.
+     */
+    explicit CommandArgs(std::string_view line);
+
+    /*!
+     * @brief Gets the command word.
+     * @return The first word, or an empty view for a blank line.
+     */
+    std::string_view command() const;
+
+    /*!
+     * @brief Gets the number of arguments after the command.
+     * @return The count, which may be more than MaxArguments.
+     */
+    int count() const;
+
+    /*!
+     * @brief Gets an argument.
+     * @param index The argument's position after the command, from 0.
+     * @return The argument, or an empty view past the last one kept.
+     */
+    std::string_view operator[](int index) const;
+
+    /*!
+     * @brief Gets everything after the command.
+     * @return The rest of the line with the blanks around it removed.
+     */
+    std::string_view rest() const;
+
+    /*!
+     * @brief Reads an argument as a whole number.
+     * @param index The argument's position after the command, from 0.
+     * @param value Set to the number if the argument is one.
+     * @return True if the argument exists and is an optionally signed decimal number that fits in an int.
+     */
+    bool integer(int index, int &value) const;
+
+private:
+    friend class CommandRegistry;
+
+    /*!
+     * @brief Splits a line whose command word has already been found.
+     * @param line The line.
+     * @param end The index just past the command word.
+     */
+    CommandArgs(std::string_view line, size_t end);
+
+    /*!
+     * @brief Finds where the command word ends.
+     * @param line The line.
+     * @return The index just past the command word.
+     */
+    static size_t commandEnd(std::string_view line);
+
+    std::string_view name;                   //!< The command word.
+    std::string_view remainder;              //!< The line after the command.
+    std::string_view arguments[MaxArguments]; //!< The first arguments.
+    int total;                               //!< How many arguments there are.
+};
+
+/*!
+ * @class CommandHandler
+ * @brief What a command does and when it may be used.
+ */
+class CommandHandler
+{
+public:
+    virtual ~CommandHandler() = default;
+
+    /*!
+     * @brief Checks whether the command can be used right now.
+     * @return True by default.
+     */
+    virtual bool available() const;
+
+    /*!
+     * @brief Checks whether the command should be offered to the player right now.
+     * @return Whether it is available, by default.
+     */
+    virtual bool listed() const;
+
+    /*!
+     * @brief Runs the command.
+     * @param args The typed line.
+     */
+    virtual void run(const CommandArgs &args) = 0;
+};
+
+/*!
+ * @class FunctionCommand
+ * @brief Command handler built from functions.
+ */
+class FunctionCommand : public CommandHandler
+{
+public:
+    /*!
+     * @brief Constructor for the FunctionCommand class.
+     * @param action Runs the command.
+     * @param availableWhen Says whether the command can be used, or nullptr if it always can.
+     * @param listedWhen Says whether the command is offered, or nullptr to offer it whenever it is available.
+     */
+    FunctionCommand(std::function<void(const CommandArgs &)> action,
+                    std::function<bool()> availableWhen = nullptr,
+                    std::function<bool()> listedWhen = nullptr);
+
+    bool available() const override;
+    bool listed() const override;
+    void run(const CommandArgs &args) override;
+
+private:
+    std::function<void(const CommandArgs &)> action; //!< Runs the command.
+    std::function<bool()> availableWhen;             //!< Availability predicate, or empty.
+    std::function<bool()> listedWhen;                //!< Listing predicate, or empty.
+};
+
+/*!
+ * @class CommandRegistry
+ * @brief Finds and runs commands by name.
+ * @details Names are matched without regard to case. Whenever a command is added the registry searches for a hash
+ * seed that sends every name to its own slot of a small table, so a lookup hashes the typed word once, reads one
+ * slot and compares one name, without building an uppercased copy of the input.
+ */
+class CommandRegistry
+{
+public:
+    /*!
+     * @enum Result
+     * @brief What dispatch did with a line.
+     */
+    enum class Result
+    {
+        Ran,          //!< The command ran.
+        Empty,        //!< The line was blank.
+        Unknown,      //!< No command has that name.
+        Unavailable,  //!< The command cannot be used right now.
+        BadArguments  //!< The command was given too few or too many arguments.
+    };
+
+    /*!
+     * @brief Adds a command, replacing any with the same name.
+     * @param name The name typed to use it.
+     * @param handler What it does.
+     * @param minArguments The fewest arguments it accepts.
+     * @param maxArguments The most arguments it accepts.
+     */
+    void add(const std::string &name, std::unique_ptr<CommandHandler> handler, int minArguments = 0, int maxArguments = 0);
+
+    /*!
+     * @brief Adds a command made from functions, replacing any with the same name.
+     * @param name The name typed to use it.
+     * @param action Runs the command.
+     * @param availableWhen Says whether the command can be used, or nullptr if it always can.
+     * @param listedWhen Says whether the command is offered, or nullptr to offer it whenever it is available.
+     */
+    void add(const std::string &name, std::function<void(const CommandArgs &)> action,
+             std::function<bool()> availableWhen = nullptr, std::function<bool()> listedWhen = nullptr);
+
+    /*!
+     * @brief Finds a command.
+     * @param name The name in any case.
+     * @return The handler, or nullptr if there is none.
+     */
+    CommandHandler *find(std::string_view name) const;
+
+    /*!
+     * @brief Runs the command a line asks for.
+     * @param line The typed line.
+     * @return What happened.
+     */
+    Result dispatch(std::string_view line) const;
+
+    /*!
+     * @brief Lists the commands on offer.
+     * @param separator Put between names.
+     * @return The names of the listed commands in the order they were added.
+     */
+    std::string listed(const std::string &separator) const;
+
+    /*!
+     * @brief Gets the number of commands.
+     * @return The count.
+     */
+    size_t size() const;
+
+private:
+    /*!
+     * @struct Entry
+     * @brief A registered command.
+     */
+    struct Entry
+    {
+        std::string name;                        //!< The name as registered.
+        std::string folded;                      //!< The name in lowercase.
+        std::unique_ptr<CommandHandler> handler; //!< What it does.
+        int minArguments;                        //!< The fewest arguments accepted.
+        int maxArguments;                        //!< The most arguments accepted.
+    };
+
+    /*!
+     * @brief Hashes a name without regard to case.
+     * @param name The name.
+     * @param seed Varies the hash.
+     * @return The hash.
+     */
+    static unsigned int hash(std::string_view name, unsigned int seed);
+
+    /*!
+     * @brief Finds a seed and table size that give every name its own slot.
+     */
+    void rebuild();
+
+    /*!
+     * @brief Finds a command's entry.
+     * @param name The name in any case.
+     * @return The entry, or nullptr.
+     */
+    const Entry *lookup(std::string_view name) const;
+
+    std::vector<Entry> entries; //!< Commands in the order they were added.
+    std::vector<int> slots;     //!< Index into entries for each hash slot, or -1.
+    unsigned int seed = 0;      //!< Seed that makes the hash perfect for the current names.
+};
+
+/*!
+ * @class CommandQueue
+ * @brief Steps waiting to run, from chained input and macros.
+ * @details A line such as "n;n;e;/search" is split on semicolons into steps. A line such as
+ * "/clear = /fight;/search;/heal" defines a macro instead; typing its name later queues its steps in its place.
+ * Macros may use other macros. Lines are split and expanded once, when they are pushed, so the caller can run the
+ * steps back to back and drop the rest with clear when something interrupts them.
+ */
+class CommandQueue
+{
+public:
+    static const char Separator = ';';   //!< Separates chained steps.
+    static const int MaxDepth = 8;       //!< How deeply macros may use other macros.
+    static const size_t MaxSteps = 64;   //!< The most steps one line may queue.
+
+    /*!
+     * @enum Pushed
+     * @brief What push did with a line.
+     */
+    enum class Pushed
+    {
+        Queued,    //!< The line's steps were queued.
+        Defined,   //!< The line defined a macro.
+        Removed,   //!< The line removed a macro.
+        Rejected,  //!< The line tried to define a macro with a name that is a command or not a single word.
+        TooLong    //!< The line expanded to more than MaxSteps steps, or macros used each other too deeply; nothing was queued.
+    };
+
+    /*!
+     * @brief Constructor for the CommandQueue class.
+     * @param commands The commands, so macros cannot hide one. It must outlive the queue.
+     */
+    explicit CommandQueue(const CommandRegistry &commands);
+
+    /*!
+     * @brief Queues a typed line, or defines a macro if the line has the form "name = steps".
+     * @param line The line.
+     * @return What was done with it.
+     */
+    Pushed push(std::string_view line);
+
+    /*!
+     * @brief Checks whether any steps are waiting.
+     * @return True if none are.
+     */
+    bool empty() const;
+
+    /*!
+     * @brief Gets the number of steps waiting.
+     * @return The count.
+     */
+    size_t size() const;
+
+    /*!
+     * @brief Takes the next step.
+     * @return The step, or an empty string if none are waiting.
+     */
+    std::string pop();
+
+    /*!
+     * @brief Drops every waiting step.
+     * @return How many were dropped.
+     */
+    size_t clear();
+
+    /*!
+     * @brief Defines a macro, replacing any with the same name.
+     * @param name The name typed to use it, matched without regard to case.
+     * @param body The steps, separated by semicolons.
+     * @return False if the name is a command or is not a single word.
+     */
+    bool define(std::string_view name, std::string_view body);
+
+    /*!
+     * @brief Removes a macro.
+     * @param name The macro's name in any case.
+     * @return True if there was one.
+     */
+    bool undefine(std::string_view name);
+
+    /*!
+     * @brief Finds a macro.
+     * @param name The macro's name in any case.
+     * @return Its steps, or nullptr if there is none.
+     */
+    const std::string *macro(std::string_view name) const;
+
+    /*!
+     * @brief Lists the macros.
+     * @return One "name = steps" line for each, in order of name.
+     */
+    std::string macros() const;
+
+private:
+    /*!
+     * @struct Macro
+     * @brief A defined macro.
+     */
+    struct Macro
+    {
+        std::string name; //!< The name as defined.
+        std::string body; //!< The steps.
+    };
+
+    /*!
+     * @brief Splits steps and appends them to a list, expanding macros.
+     * @param text The steps, separated by semicolons.
+     * @param depth How many macros are being expanded already.
+     * @param out Where the steps go.
+     * @return False if the steps would go past MaxSteps or MaxDepth.
+     */
+    bool expand(std::string_view text, int depth, std::vector<std::string> &out) const;
+
+    const CommandRegistry &commands;       //!< The commands macros cannot hide.
+    std::map<std::string, Macro> defined;  //!< Macros by lowercase name.
+    std::deque<std::string> steps;         //!< Steps waiting to run.
+};
+
+#endif // COMMANDS_H
@@ -0,0 +1,230 @@
+/*!
+ * @file compression.h
+ * @brief Declares compressed output for remote sessions.
+ * @details This file contains the Deflater, a small streaming deflate encoder that writes a zlib stream, and the
+ * CompressingSink and TelnetSource that negotiate and apply it on a session the way MUD clients expect from MCCP
+ * version 2: the server offers compression with IAC WILL COMPRESS2, and once the client answers IAC DO COMPRESS2
+ * everything after IAC SB COMPRESS2 IAC SE is one zlib stream.
+ */
+
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "console.h"
+
+/*!
+ * @class Deflater
+ * @brief Streaming deflate encoder producing a zlib stream.
+ * @details Input is matched against the last 32 KiB already compressed, so a redraw that repeats an earlier frame
+ * costs only a few bytes. Matches are coded with the fixed Huffman tables, which keeps the encoder small and needs no
+ * table in the output. Each flush ends with an empty stored block, so the receiver can decode everything sent so far.
+ */
+class Deflater
+{
+public:
+    /*!
+     * @brief Constructor for the Deflater class.
+     */
+    Deflater();
+
+    /*!
+     * @brief Compresses bytes and ends them with a sync flush.
+     * @param data The bytes.
+     * @param size How many there are.
+     * @param out Where compressed bytes are appended. The zlib header is written before the first frame.
+     */
+    void frame(const char *data, size_t size, std::string &out);
+
+    /*!
+     * @brief Ends the stream with a final block and the Adler-32 checksum.
+     * @param out Where the bytes are appended.
+     */
+    void finish(std::string &out);
+
+private:
+    /*!
+     * @brief Appends bits, least significant first.
+     */
+    void putBits(uint32_t value, int count, std::string &out);
+
+    /*!
+     * @brief Appends a Huffman code, which deflate stores most significant bit first.
+     */
+    void putCode(uint32_t code, int length, std::string &out);
+
+    /*!
+     * @brief Appends a literal byte or end-of-block symbol.
+     */
+    void putLiteral(int symbol, std::string &out);
+
+    /*!
+     * @brief Appends a length and distance pair.
+     */
+    void putMatch(int length, int distance, std::string &out);
+
+    /*!
+     * @brief Pads to a byte boundary.
+     */
+    void alignToByte(std::string &out);
+
+    /*!
+     * @brief Hashes the three bytes at an absolute position.
+     */
+    uint32_t hashAt(size_t position) const;
+
+    /*!
+     * @brief Records an absolute position in the hash chains.
+     */
+    void insert(size_t position);
+
+    std::string window;          //!< Recent input, from absolute position base onwards.
+    size_t base;                 //!< Absolute position of window[0].
+    std::vector<int64_t> head;   //!< Most recent absolute position for each hash, or -1.
+    std::vector<int64_t> chain;  //!< Previous absolute position with the same hash, by position modulo 32 KiB.
+    uint32_t bitBuffer;          //!< Bits not yet written.
+    int bitCount;                //!< Number of bits in bitBuffer.
+    uint32_t adlerA;             //!< Adler-32 running sum A.
+    uint32_t adlerB;             //!< Adler-32 running sum B.
+    bool started;                //!< Whether the zlib header has been written.
+    bool finished;               //!< Whether finish has been called.
+};
+
+/*!
+ * @struct CompressionStats
+ * @brief Byte counts for a compressed session.
+ */
+struct CompressionStats
+{
+    unsigned long long rawBytes = 0;  //!< Bytes the game wrote.
+    unsigned long long sentBytes = 0; //!< Bytes passed to the next sink, including negotiation.
+    unsigned long long frames = 0;    //!< Writes that were compressed.
+
+    /*!
+     * @brief Gets the compression ratio.
+     * @return Raw bytes per byte sent, or 1 if nothing has been sent.
+     */
+    double ratio() const { return sentBytes == 0 ? 1.0 : (double)rawBytes / sentBytes; }
+};
+
+/*!
+ * @class CompressingSink
+ * @brief Output sink that compresses a session's output once the client agrees.
+ * @details Output passes through unchanged until accept is called. Every write after that is one compressed frame,
+ * sync flushed, so compression never holds output back.
+ */
+class CompressingSink : public OutputSink
+{
+public:
+    static const unsigned char IAC = 255;       //!< Telnet "interpret as command".
+    static const unsigned char WILL = 251;      //!< Telnet WILL.
+    static const unsigned char WONT = 252;      //!< Telnet WONT.
+    static const unsigned char DO = 253;        //!< Telnet DO.
+    static const unsigned char DONT = 254;      //!< Telnet DONT.
+    static const unsigned char SB = 250;        //!< Telnet subnegotiation begin.
+    static const unsigned char SE = 240;        //!< Telnet subnegotiation end.
+    static const unsigned char COMPRESS2 = 86;  //!< The MCCP version 2 option.
+
+    /*!
+     * @brief Constructor for the CompressingSink class.
+     * @param next Where output goes. It must outlive this sink.
+     */
+    explicit CompressingSink(OutputSink &next);
+
+    /*!
+     * @brief Ends the compressed stream, if there is one.
+     */
+    ~CompressingSink();
+
+    /*!
+     * @brief Offers compression to the client.
+     */
+    void offer();
+
+    /*!
+     * @brief Starts compressing, after the client answered DO.
+     */
+    void accept();
+
+    /*!
+     * @brief Records that the client refused compression.
+     */
+    void decline();
+
+    /*!
+     * @brief Ends the compressed stream. Later output is sent uncompressed.
+     */
+    void end();
+
+    /*!
+     * @brief Checks whether output is being compressed.
+     * @return True between accept and end.
+     */
+    bool compressing();
+
+    /*!
+     * @brief Gets the byte counts.
+     * @return The counts so far.
+     */
+    CompressionStats getStats();
+
+    bool write(const char *data, size_t size) override;
+
+private:
+    /*!
+     * @brief Passes bytes on and counts them.
+     */
+    bool send(const std::string &bytes);
+
+    OutputSink &next;       //!< Where output goes.
+    std::mutex mutex;       //!< Serialises writes with negotiation, which arrives on the input thread.
+    Deflater deflater;      //!< The compressor.
+    bool active;            //!< Whether output is compressed.
+    bool offered;           //!< Whether compression was offered and not yet answered.
+    CompressionStats stats; //!< Byte counts.
+    std::string buffer;     //!< Compressed bytes for the current write.
+};
+
+/*!
+ * @class TelnetSource
+ * @brief Input source that removes Telnet commands from a client's input.
+ * @details Answers to a compression offer are passed to the CompressingSink. Other commands are dropped, and a
+ * doubled IAC is read as a single 255 byte. Carriage returns are dropped, since Telnet clients end lines with CR LF.
+ */
+class TelnetSource : public InputSource
+{
+public:
+    /*!
+     * @brief Constructor for the TelnetSource class.
+     * @param next Where the client's bytes come from. It must outlive this source.
+     * @param compression The sink to tell about compression answers.
+     */
+    TelnetSource(InputSource &next, CompressingSink &compression);
+
+    size_t read(char *buffer, size_t size) override;
+    bool wait(int milliseconds) override;
+
+private:
+    /*!
+     * @enum Parse
+     * @brief Where the source is within a Telnet command.
+     */
+    enum class Parse
+    {
+        Data,        //!< Ordinary input.
+        Command,     //!< After IAC.
+        Option,      //!< After IAC and WILL, WONT, DO or DONT.
+        Subnegotiate,//!< Inside IAC SB ... IAC SE.
+        SubIac       //!< After IAC inside a subnegotiation.
+    };
+
+    InputSource &next;           //!< Where bytes come from.
+    CompressingSink &compression; //!< Told about compression answers.
+    Parse parse;                 //!< Command parser state.
+    unsigned char verb;          //!< The WILL, WONT, DO or DONT being read.
+};
+
+#endif // COMPRESSION_H
@@ -0,0 +1,387 @@
+/*!
+ * @file console.h
+ * @brief Declares the input and output abstraction used by game sessions.
+ * @details Game code reads and writes through console() instead of std::cin and std::cout. A ValerisGame binds its
+ * Console to the thread running it, so several games can run in one process, each on its own thread and each with
+ * its own input and output: standard input and output, in-memory buffers for tests and bots, or a socket.
+ */
+
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+
+/*!
+ * @class InputClosed
+ * @brief Thrown when a session's input ends, so the session can stop without ending the process.
+ * @details It is not a std::runtime_error, so the retry loops that catch bad input do not swallow it.
+ */
+class InputClosed : public std::exception
+{
+public:
+    const char *what() const noexcept override { return "input closed"; }
+};
+
+/*!
+ * @class SessionHandoff
+ * @brief Thrown by a game that stops so another process can carry on its session.
+ * @details Like InputClosed it ends only the session, and it is not a std::runtime_error either. The game throws it at
+ * a point where everything it needs to carry on is in its saved state, once a handoff has been requested.
+ */
+class SessionHandoff : public std::exception
+{
+public:
+    /*!
+     * @brief Constructor for the SessionHandoff class.
+     * @param state What the other process needs to carry on: a game's saved state, or empty at the main menu.
+     */
+    explicit SessionHandoff(std::string state) : saved(std::move(state)) {}
+
+    /*!
+     * @brief Gets what the other process needs to carry on.
+     * @return The state.
+     */
+    const std::string &state() const { return saved; }
+
+    const char *what() const noexcept override { return "session handed off"; }
+
+private:
+    std::string saved; //!< The state.
+};
+
+/*!
+ * @class OutputSink
+ * @brief Somewhere a session's output goes.
+ */
+class OutputSink
+{
+public:
+    virtual ~OutputSink() = default;
+
+    /*!
+     * @brief Writes bytes.
+     * @param data The bytes.
+     * @param size How many there are.
+     * @return False if the output has gone away.
+     */
+    virtual bool write(const char *data, size_t size) = 0;
+};
+
+/*!
+ * @class InputSource
+ * @brief Somewhere a session's input comes from.
+ */
+class InputSource
+{
+public:
+    virtual ~InputSource() = default;
+
+    /*!
+     * @brief Reads bytes, blocking until at least one is available.
+     * @param buffer Where to put them.
+     * @param size The most to read.
+     * @return The number read, or 0 at end of input.
+     */
+    virtual size_t read(char *buffer, size_t size) = 0;
+
+    /*!
+     * @brief Waits until a read would not block.
+     * @param milliseconds The longest to wait, or -1 to wait indefinitely.
+     * @return False if the time ran out first. Sources that cannot tell return true at once.
+     */
+    virtual bool wait(int milliseconds);
+};
+
+/*!
+ * @class MemorySink
+ * @brief Output sink that collects everything written to it.
+ */
+class MemorySink : public OutputSink
+{
+public:
+    bool write(const char *data, size_t size) override;
+
+    /*!
+     * @brief Gets everything written so far.
+     * @return The text.
+     */
+    std::string text() const;
+
+private:
+    mutable std::mutex mutex; //!< Guards collected.
+    std::string collected;    //!< Everything written.
+};
+
+/*!
+ * @class MemorySource
+ * @brief Input source fed from strings.
+ * @details Reads block until text is pushed or the source is closed, so one thread can script a session that another
+ * thread is running.
+ */
+class MemorySource : public InputSource
+{
+public:
+    /*!
+     * @brief Constructor for the MemorySource class.
+     * @param script Input available immediately.
+     * @param closed True if no more input will be pushed, so reads past the script report end of input.
+     */
+    explicit MemorySource(const std::string &script = "", bool closed = true);
+
+    size_t read(char *buffer, size_t size) override;
+    bool wait(int milliseconds) override;
+
+    /*!
+     * @brief Adds input.
+     * @param text The text, usually ending in a newline.
+     */
+    void push(const std::string &text);
+
+    /*!
+     * @brief Ends the input once what has been pushed is read.
+     */
+    void close();
+
+    /*!
+     * @brief Checks whether the session has read everything and is blocked waiting for more.
+     * @return True while a read is waiting for input.
+     */
+    bool waiting();
+
+private:
+    std::mutex mutex;                  //!< Guards the fields below.
+    std::condition_variable available; //!< Signalled by push and close.
+    std::string pending;               //!< Input not yet read.
+    bool closed;                       //!< Whether more input may arrive.
+    int readers = 0;                   //!< Reads currently blocked.
+};
+
+#ifndef _WIN32
+/*!
+ * @class SocketSink
+ * @brief Output sink writing to a connected socket.
+ */
+class SocketSink : public OutputSink
+{
+public:
+    /*!
+     * @brief Constructor for the SocketSink class.
+     * @param fd The socket. It is not closed by the sink.
+     */
+    explicit SocketSink(int fd);
+
+    bool write(const char *data, size_t size) override;
+
+private:
+    int fd; //!< The socket.
+};
+
+/*!
+ * @class SocketSource
+ * @brief Input source reading from a connected socket.
+ */
+class SocketSource : public InputSource
+{
+public:
+    /*!
+     * @brief Constructor for the SocketSource class.
+     * @param fd The socket. It is not closed by the source.
+     */
+    explicit SocketSource(int fd);
+
+    size_t read(char *buffer, size_t size) override;
+    bool wait(int milliseconds) override;
+
+private:
+    int fd; //!< The socket.
+};
+#endif
+
+struct CombatLatency;
+
+/*!
+ * @class Console
+ * @brief A session's input and output streams.
+ * @details The standard console is std::cin and std::cout themselves, so the renderer and anything that redirects
+ * the standard streams keep working. Other consoles wrap an InputSource and an OutputSink in buffered streams; the
+ * input stream is tied to the output stream, so prompts are sent before the session waits for a reply.
+ */
+class Console
+{
+public:
+    /*!
+     * @brief Constructor for the Console class.
+     * @param input Where input comes from. It must outlive the console.
+     * @param output Where output goes. It must outlive the console.
+     */
+    Console(InputSource &input, OutputSink &output);
+
+    /*!
+     * @brief Destructor for the Console class. Sends any buffered output.
+     */
+    ~Console();
+
+    Console(const Console &) = delete;
+    Console &operator=(const Console &) = delete;
+
+    /*!
+     * @brief Gets the console over the process's standard streams.
+     * @return The standard console.
+     */
+    static Console &standard();
+
+    /*!
+     * @brief Checks whether this is the standard console.
+     * @return True for the console returned by standard().
+     */
+    bool isStandard() const;
+
+    /*!
+     * @brief Gets the input stream.
+     * @return std::cin for the standard console.
+     */
+    std::istream &in();
+
+    /*!
+     * @brief Gets the output stream.
+     * @return std::cout for the standard console.
+     */
+    std::ostream &out();
+
+    /*!
+     * @brief Gets the stream for error messages.
+     * @return std::cerr for the standard console, and the output stream otherwise.
+     */
+    std::ostream &err();
+
+    /*!
+     * @brief Sends everything written so far to the player.
+     */
+    void present();
+
+    /*!
+     * @brief Waits until input can be read without blocking.
+     * @param milliseconds The longest to wait, or -1 to wait indefinitely.
+     * @return False if the time ran out first. Input that cannot be polled, such as a pipe into the standard
+     * console, is always reported as ready.
+     */
+    bool waitForInput(int milliseconds);
+
+    /*!
+     * @brief Waits for input at a point where the session could be handed to another process.
+     * @param milliseconds The longest to wait, or -1 to wait indefinitely.
+     * @return False if the time ran out first. It also returns true once a handoff is requested, which the caller
+     * checks with handoffRequested.
+     */
+    bool waitForTurn(int milliseconds);
+
+    /*!
+     * @brief Asks the game to stop at its next turn so its session can be handed to another process, from any thread.
+     */
+    void requestHandoff();
+
+    /*!
+     * @brief Checks whether a handoff has been requested.
+     * @return True once requestHandoff has been called.
+     */
+    bool handoffRequested() const;
+
+    /*!
+     * @brief Checks whether the game is waiting in waitForTurn.
+     * @return True while it is, when a requested handoff should end the wait.
+     */
+    bool atTurn() const;
+
+    /*!
+     * @brief Takes the input that has been read from the source but not by the game.
+     * @return The input, which the game will no longer see. The standard console keeps its input and returns nothing.
+     */
+    std::string takeBufferedInput();
+
+    /*!
+     * @brief Gets the latencies of the session's most recent combat.
+     * @return The record combatV1 last filled in on this console, which stays with the session whichever thread runs it.
+     */
+    CombatLatency &combatLatency();
+
+    /*!
+     * @brief Reads whatever input has arrived, blocking only if there is none.
+     * @param buffer Where to put it.
+     * @param size The most to read.
+     * @return The number of bytes read, or 0 at end of input.
+     */
+    size_t readAvailable(char *buffer, size_t size);
+
+    /*!
+     * @brief Throws away anything typed at the terminal that has not been read yet.
+     * @details Only the standard console on a terminal has such input; scripted and network input is kept.
+     */
+    void discardInput();
+
+    /*!
+     * @class Binding
+     * @brief Makes a console the calling thread's console for as long as the binding exists.
+     */
+    class Binding
+    {
+    public:
+        /*!
+         * @brief Binds a console to the calling thread.
+         * @param console The console.
+         */
+        explicit Binding(Console &console);
+
+        /*!
+         * @brief Restores the console that was bound before.
+         */
+        ~Binding();
+
+        Binding(const Binding &) = delete;
+        Binding &operator=(const Binding &) = delete;
+
+    private:
+        Console *previous; //!< The console bound before.
+    };
+
+private:
+    /*!
+     * @brief Constructor for the standard console.
+     */
+    Console();
+
+    class SinkBuffer;
+    class SourceBuffer;
+
+    std::unique_ptr<SinkBuffer> sinkBuffer;     //!< Buffers output for the sink, or nullptr for the standard console.
+    std::unique_ptr<SourceBuffer> sourceBuffer; //!< Buffers input from the source, or nullptr for the standard console.
+    std::unique_ptr<std::ostream> ownOut;       //!< Stream over sinkBuffer.
+    std::unique_ptr<std::istream> ownIn;        //!< Stream over sourceBuffer.
+    std::istream *input;                        //!< The input stream in use.
+    std::ostream *output;                       //!< The output stream in use.
+    std::atomic<bool> handoff{false};           //!< Whether a handoff has been requested.
+    std::atomic<bool> turn{false};              //!< Whether the game is waiting in waitForTurn.
+    std::unique_ptr<CombatLatency> combat;      //!< The latencies of the most recent combat, made on first use.
+};
+
+/*!
+ * @brief Gets the console bound to the calling thread.
+ * @return The bound console, or the standard console if none is bound.
+ */
+Console &console();
+
+/*!
+ * @brief Replaces the calling thread's console binding.
+ * @param console The console to bind, or nullptr for the standard console.
+ * @return The binding it replaced, or nullptr if there was none.
+ * @details Used by fibers, which take their binding with them while they are switched out.
+ */
+Console *exchangeBoundConsole(Console *console);
+
+#endif // CONSOLE_H
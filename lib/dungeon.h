@@ -13,6 +13,23 @@
 #include <map>
 #include <queue>
 #include "../lib/room.h"
+#include "../lib/flooranalytics.h"
+#include "../lib/roomindex.h"
+#include "../lib/fogofwar.h"
+
+/*!
+ * @struct FloorDelta
+ * @brief Records what the player has changed on a generated floor.
+ * @details Each bitmap is indexed by room id (generation order). Because a floor regenerated from the same seed
+ * produces the same rooms in the same order, a delta is all that needs to be kept to restore a hibernated session's floor.
+ */
+struct FloorDelta
+{
+    std::vector<bool> visited; //!< Rooms the player has entered.
+    std::vector<bool> cleared; //!< Rooms whose enemies have been defeated.
+    std::vector<bool> looted;  //!< Rooms whose items and coins have been taken.
+    std::vector<bool> solved;  //!< Rooms whose safe passcode has been guessed.
+};
 
 /*!
  * @class Dungeon
@@ -29,6 +46,12 @@ public:
      */
     Dungeon();
 
+    /*!
+     * @brief Constructor for a reproducible Dungeon.
+     * @param seed The seed used for every floor generated by this dungeon. The same seed always yields the same floor.
+     */
+    explicit Dungeon(unsigned int seed);
+
     /*!
      * @brief Destructor for the Dungeon class.
      * @details Cleans up any dynamically allocated memory.
@@ -57,11 +80,94 @@ public:
      */
     void linkRooms(Room *room1, Room *room2, int direction); // Making it public for testing
 
+    /*!
+     * @brief Gets a map of the rooms around a room.
+     * @param room The room to center the map on.
+     * @return The map as a string.
+     * @details On a generated floor this also moves the fog-of-war viewpoint to the room, and the map only shows
+     * rooms that are in sight or have been seen before.
+     */
     std::string getMap(Room *room);
 
+    /*!
+     * @brief Gets a map of the rooms around a room as one player sees them.
+     * @param room The room to center the map on.
+     * @param view The player's fog-of-war layer, whose viewpoint is moved to the room.
+     * @param visited The rooms the player has entered, indexed by room id.
+     * @return The map as a string.
+     * @details The floor itself is not changed, so this may be called on a floor shared between players.
+     */
+    std::string getMap(const Room *room, FogOfWar &view, const std::vector<bool> &visited) const;
+
+    /*!
+     * @brief Gets the seed used to generate this dungeon.
+     * @return The generation seed.
+     */
+    unsigned int getSeed() const;
+
+    /*!
+     * @brief Gets every room on the floor in generation order.
+     * @return A reference to the rooms, indexed by Room::id.
+     */
+    const std::vector<Room *> &getRooms() const;
+
+    /*!
+     * @brief Gets a room by its id.
+     * @param id The generation index of the room.
+     * @return A pointer to the room, or nullptr if the id is out of range.
+     */
+    Room *getRoom(int id) const;
+
+    /*!
+     * @brief Gets the room returned by the last call to generateFloor.
+     * @return A pointer to the starting room, or nullptr if no floor has been generated.
+     */
+    Room *getStartRoom() const;
+
+    /*!
+     * @brief Records the player's changes to this floor.
+     * @return The visited, cleared, looted and solved state of every room.
+     */
+    FloorDelta captureDelta();
+
+    /*!
+     * @brief Reapplies previously captured changes to a freshly generated floor.
+     * @param delta The changes recorded by captureDelta on a floor generated from the same seed.
+     */
+    void applyDelta(const FloorDelta &delta);
+
+    /*!
+     * @brief Estimates the memory held by the floor.
+     * @return An approximate number of bytes used by the rooms and their contents.
+     */
+    size_t memoryFootprint();
+
+    /*!
+     * @brief Gets graph statistics for the floor.
+     * @return Room count, diameter, dead ends, average degree and articulation points, kept up to date as rooms are generated and linked.
+     */
+    FloorStats getStats();
+
+    /*!
+     * @brief Gets the spatial index over the floor's rooms.
+     * @return The index, filled as rooms are generated.
+     */
+    const RoomIndex &getIndex() const;
+
+    /*!
+     * @brief Gets the fog-of-war layer for the floor.
+     * @return The layer, built by generateFloor and moved by getMap.
+     */
+    const FogOfWar &getFog() const;
+
 private:
     std::vector<Room *> rooms; //!< A vector containing pointers to all the rooms in the dungeon.
     std::mt19937 rng;          //!< Random number generator for generating random dungeon elements.
+    unsigned int seed;         //!< Seed used to generate the floor.
+    Room *startRoom;           //!< The room returned by generateFloor.
+    FloorAnalytics analytics;  //!< Graph statistics maintained as rooms are generated and linked.
+    RoomIndex index;           //!< Rooms by coordinate and type for spatial queries.
+    FogOfWar fog;              //!< Which rooms are in sight and which have been seen.
 
     /*!
      * @brief Generates a new room.
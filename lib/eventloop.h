@@ -0,0 +1,143 @@
+/*!
+ * @file eventloop.h
+ * @brief Defines the EventLoop class for the Valeris game.
+ * @details This file contains the declaration of the InputEvent structure and the EventLoop class, which waits on a
+ * session's input and its own timers together, so the game can time out a prompt, run timers on the game thread, or
+ * do background work while the player is thinking.
+ */
+
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "console.h"
+#include "timer.h"
+
+/*!
+ * @struct InputEvent
+ * @brief Something the event loop is reporting.
+ */
+struct InputEvent
+{
+    /*!
+     * @enum Type
+     * @brief What happened.
+     */
+    enum Type
+    {
+        Key,     //!< A character arrived.
+        Line,    //!< A line was finished.
+        Timeout, //!< The wait ran out before anything arrived.
+        Closed   //!< The input has ended.
+    };
+
+    Type type;        //!< What happened.
+    char key = 0;      //!< The character, for Key events.
+    std::string line;  //!< The line without its ending, for Line events.
+    long long at = 0;  //!< When the input was read or the wait ended, in monotonicNanos.
+};
+
+/*!
+ * @class EventLoop
+ * @brief Waits for input, timers and timeouts on one thread.
+ * @details Waiting is done with poll on the console's input (or the source's own wait), using the nearest of the
+ * caller's timeout and the next timer as the poll timeout. Timers run on the calling thread between events. While
+ * idle tasks are registered the loop polls without blocking and runs one slice of work at a time, so input is still
+ * picked up promptly.
+ *
+ * Every character is reported as a Key event as it arrives and the finished line as a Line event after its last
+ * Key. On a terminal in its usual line mode characters arrive only when Enter is pressed, so the keys come in a
+ * burst; in raw mode they arrive one at a time.
+ */
+class EventLoop
+{
+public:
+    /*!
+     * @brief Constructor for the EventLoop class.
+     * @param io The console to read. It must outlive the loop.
+     */
+    explicit EventLoop(Console &io = console());
+
+    /*!
+     * @brief Schedules a callback on the loop's thread.
+     * @param milliseconds How long from now the callback should run.
+     * @param callback The function to run. It runs while the loop is waiting in next or nextLine.
+     * @return The timer's id.
+     */
+    TimerQueue::TimerId after(int milliseconds, std::function<void()> callback);
+
+    /*!
+     * @brief Cancels a timer.
+     * @param id The timer's id.
+     * @return True if the timer had not run yet.
+     */
+    bool cancel(TimerQueue::TimerId id);
+
+    /*!
+     * @brief Adds background work to run while no input is waiting.
+     * @param task Runs one small slice of work and returns true while there is more to do.
+     */
+    void whenIdle(std::function<bool()> task);
+
+    /*!
+     * @brief Gets the number of idle tasks that still have work to do.
+     * @return The number of tasks.
+     */
+    size_t idleTasks() const;
+
+    /*!
+     * @brief Waits for the next key, line or timeout.
+     * @param milliseconds The longest to wait, or -1 to wait indefinitely.
+     * @return The event.
+     */
+    InputEvent next(int milliseconds = -1);
+
+    /*!
+     * @brief Waits for a whole line, skipping the keys that make it up.
+     * @param milliseconds The longest to wait for the line to be finished, or -1 to wait indefinitely.
+     * @return A Line, Timeout or Closed event.
+     */
+    InputEvent nextLine(int milliseconds = -1);
+
+    /*!
+     * @brief Throws away the unfinished line and anything typed ahead at the terminal.
+     * @details Used after a timeout, so keys meant for the prompt that timed out do not answer the next one.
+     */
+    void discardInput();
+
+private:
+    Console &io;                                //!< Where input comes from.
+    TimerQueue timers;                          //!< Timers run on the loop's thread.
+    std::vector<std::function<bool()>> idle;    //!< Background work with slices left.
+    size_t nextIdle = 0;                        //!< The idle task to run next, so tasks take turns.
+    std::string received;                       //!< Input read but not yet reported.
+    size_t receivedAt = 0;                      //!< How much of received has been reported.
+    long long receivedTime = 0;                 //!< When received was read, in monotonicNanos.
+    std::string line;                           //!< The line being typed.
+    bool lastWasReturn = false;                 //!< Whether the last character ended a line with a carriage return.
+    bool closed = false;                        //!< Whether the input has ended.
+
+    /*!
+     * @brief Waits for the next key, line or timeout.
+     * @param limited Whether there is a deadline.
+     * @param deadline When to give up, if limited.
+     * @return The event.
+     */
+    InputEvent nextBefore(bool limited, TimerQueue::Clock::time_point deadline);
+
+    /*!
+     * @brief Turns the next received character into an event.
+     * @param event Set to the event, if the character makes one.
+     * @return False if the character was consumed without an event.
+     */
+    bool takeCharacter(InputEvent &event);
+
+    /*!
+     * @brief Runs one slice of the next idle task.
+     */
+    void runIdleSlice();
+};
+
+#endif // EVENTLOOP_H
@@ -0,0 +1,187 @@
+/*!
+ * @file fiber.h
+ * @brief Defines the Fiber class for the Valeris game.
+ * @details This file contains the declaration of the Fiber class, a function running on its own small stack that can
+ * stop part way through and be carried on later by the thread that started it. The game server runs each session's
+ * blocking game code in a fiber, so a session waiting for its player costs a few pages of stack instead of a thread.
+ * Fibers are only available on Linux.
+ *
+ * This is the game's coroutine runtime. The game's loops stay ordinary blocking code and the fiber is suspended at
+ * the points where they wait for input or a timer, instead of the loops being rewritten as C++20 coroutines, which
+ * the C++17 build cannot use.
+ */
+
+#ifndef FIBER_H
+#define FIBER_H
+
+#ifdef __linux__
+
+#include <cstddef>
+#include <exception>
+#include <functional>
+#ifndef __x86_64__
+#include <ucontext.h>
+#endif
+#include "timer.h"
+
+class Console;
+
+/*!
+ * @class Fiber
+ * @brief A function that can suspend itself and be resumed later.
+ * @details A fiber is resumed by an ordinary thread and runs on that thread until it calls suspend, which returns
+ * control to resume. Blocking helpers check Fiber::current, so code inside a fiber that sleeps or waits for input
+ * suspends instead of blocking the thread.
+ *
+ * Each fiber carries the console binding and the exception handling state of the code it runs, so fibers can
+ * switch in the middle of a catch block or with different consoles bound. A suspended fiber may be resumed by a
+ * different thread, but never by two at once. Other thread_local storage is not carried with it, so code in a fiber
+ * must not keep a reference to a thread_local across anything that may suspend.
+ *
+ * On x86-64 a switch saves only the registers a function call must preserve, so suspending and resuming costs about
+ * as much as a few function calls. Other architectures use swapcontext. Stacks are taken from a pool shared by all
+ * threads and returned to it when a fiber is destroyed, so starting a session does not map a new stack.
+ */
+class Fiber
+{
+public:
+    static const size_t DefaultStackBytes = 256 * 1024; //!< Stack reserved for each fiber. Only the pages touched use memory.
+    static const size_t DefaultPooledStacks = 256;      //!< Free stacks kept for reuse by default.
+    static const size_t HotStackBytes = 16 * 1024;      //!< The top of a pooled stack that stays in memory.
+
+    /*!
+     * @brief Constructor for the Fiber class. The function does not start until the first resume.
+     * @param body The function to run.
+     * @param stackBytes The stack to reserve, rounded up to whole pages.
+     */
+    explicit Fiber(std::function<void()> body, size_t stackBytes = DefaultStackBytes);
+
+    /*!
+     * @brief Destructor for the Fiber class. Frees the stack.
+     * @details A fiber destroyed while suspended is abandoned: objects on its stack are not destroyed.
+     */
+    ~Fiber();
+
+    Fiber(const Fiber &) = delete;
+    Fiber &operator=(const Fiber &) = delete;
+
+    /*!
+     * @brief Runs the fiber until it suspends or finishes.
+     * @return True if the fiber suspended and can be resumed again.
+     * @details An exception that escapes the fiber's function is rethrown here.
+     */
+    bool resume();
+
+    /*!
+     * @brief Checks whether the fiber's function has returned.
+     * @return True once it has.
+     */
+    bool finished() const;
+
+    /*!
+     * @brief Gets when the fiber asked to be resumed.
+     * @param due Set to the time passed to suspend, if there was one.
+     * @return False if the fiber is waiting to be woken by something other than time.
+     */
+    bool wakeTime(TimerQueue::Clock::time_point &due) const;
+
+    /*!
+     * @brief Sets what resumes the fiber when a job it waits for finishes.
+     * @param waker Called from any thread, possibly before the fiber has suspended; it must resume the fiber soon
+     * afterwards without running it on the calling thread.
+     */
+    void setWaker(std::function<void()> waker);
+
+    /*!
+     * @brief Gets the fiber running on the calling thread.
+     * @return The fiber, or nullptr outside a fiber.
+     */
+    static Fiber *current();
+
+    /*!
+     * @brief Gets what resumes the running fiber.
+     * @return The function given to setWaker, or an empty one outside a fiber or if none was given.
+     */
+    static std::function<void()> currentWaker();
+
+    /*!
+     * @brief Suspends the running fiber until it is resumed.
+     * @details Whoever resumes the fiber decides when; the caller must check that what it was waiting for happened.
+     */
+    static void suspend();
+
+    /*!
+     * @brief Suspends the running fiber, asking to be resumed at a time.
+     * @param due When to resume it. It may be resumed earlier.
+     */
+    static void suspendUntil(TimerQueue::Clock::time_point due);
+
+    /*!
+     * @brief Suspends the running fiber until a time has passed, however often it is resumed before then.
+     * @param due When to carry on.
+     */
+    static void sleepUntil(TimerQueue::Clock::time_point due);
+
+    /*!
+     * @brief Sets how many free stacks are kept for reuse.
+     * @param stacks The most to keep, or 0 to unmap each stack when its fiber is destroyed.
+     * @details Stacks beyond the new limit are unmapped at once.
+     */
+    static void setPooledStackLimit(size_t stacks);
+
+    /*!
+     * @brief Gets how many free stacks are waiting to be reused.
+     * @return The number of stacks in the pool.
+     */
+    static size_t pooledStacks();
+
+    /*!
+     * @brief Gives the kernel back the running fiber's stack pages below the caller's frame.
+     * @return The number of bytes given back, or 0 outside a fiber.
+     * @details Deep calls made earlier leave their pages in memory. A fiber about to wait a long time can call this
+     * so the wait costs only the stack it is using. The pages read as zero if they are touched again.
+     */
+    static size_t trimStack();
+
+private:
+#ifdef __x86_64__
+    typedef void *Context; //!< A suspended stack's saved stack pointer, with its registers stored on the stack.
+#else
+    typedef ucontext_t Context; //!< A suspended stack's registers.
+#endif
+
+    /*!
+     * @brief Runs the function on the fiber's stack.
+     */
+    static void trampoline();
+
+    /*!
+     * @brief Switches from the fiber back to the thread that resumed it.
+     */
+    void switchOut();
+
+    /*!
+     * @brief Exchanges the thread's per-session state with the fiber's.
+     */
+    void swapThreadState();
+
+    std::function<void()> body;                //!< The function.
+    char *stack;                               //!< The mapping holding the guard page and the stack.
+    size_t mappedBytes;                        //!< The size of the mapping.
+    Context context;                           //!< The fiber's registers while it is suspended.
+    Context caller;                            //!< The resuming thread's registers while the fiber runs.
+    bool started;                              //!< Whether the function has been entered.
+    bool done;                                 //!< Whether the function has returned.
+    bool timed;                                //!< Whether the last suspension gave a time.
+    TimerQueue::Clock::time_point due;         //!< The time given, if timed.
+    std::exception_ptr failure;                //!< An exception that escaped the function.
+    Console *console;                          //!< The fiber's console binding while it is switched out.
+    void *caughtExceptions;                    //!< The fiber's caught-exception stack while it is switched out.
+    unsigned int uncaughtExceptions;           //!< The fiber's count of exceptions in flight while it is switched out.
+    Fiber *outer;                              //!< The fiber that was running when this one was resumed.
+    std::function<void()> waker;               //!< Resumes the fiber, if set.
+};
+
+#endif // __linux__
+
+#endif // FIBER_H
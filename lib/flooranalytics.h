@@ -0,0 +1,146 @@
+/*!
+ * @file flooranalytics.h
+ * @brief Defines the FloorAnalytics class for the Valeris game.
+ * @details This file contains the declaration of the FloorStats structure and the FloorAnalytics class, which track
+ * graph statistics of a dungeon floor while it is being generated so generators can be tuned.
+ */
+
+#ifndef FLOORANALYTICS_H
+#define FLOORANALYTICS_H
+
+#include <array>
+#include <vector>
+
+/*!
+ * @struct FloorStats
+ * @brief Graph statistics of a dungeon floor.
+ */
+struct FloorStats
+{
+    int roomCount = 0;          //!< Number of rooms on the floor.
+    int linkCount = 0;          //!< Number of doors (undirected links) between rooms.
+    int diameter = 0;           //!< Longest shortest path between two rooms, in moves.
+    bool diameterExact = true;  //!< False if a large floor's search ran out of budget and a lower bound is reported.
+    int deadEnds = 0;           //!< Rooms with exactly one door.
+    double averageDegree = 0.0; //!< Average number of doors per room.
+    int articulationPoints = 0; //!< Rooms whose removal would split the floor.
+};
+
+/*!
+ * @class FloorAnalytics
+ * @brief Maintains floor graph statistics as rooms are generated and linked.
+ * @details Room, link, degree and dead-end counts are updated in constant time on every change. Articulation points
+ * and the diameter are also kept up to date while the floor grows as a tree (a new room hanging off an existing one).
+ * A link that closes a loop invalidates them, and they are recomputed on the next query: articulation points with an
+ * iterative Tarjan pass, and the diameter with a bit-parallel multi-source BFS spread over all hardware threads. Small
+ * floors run that BFS from every room; larger ones use iFUB, which only needs the eccentricities of the rooms farthest
+ * from a central room until its upper and lower bounds meet.
+ */
+class FloorAnalytics
+{
+public:
+    /*!
+     * @brief Constructor for the FloorAnalytics class.
+     * @param exactDiameterLimit Largest floor, in rooms, whose diameter is recomputed with a BFS from every room.
+     */
+    explicit FloorAnalytics(int exactDiameterLimit = 4096);
+
+    /*!
+     * @brief Records a new room.
+     * @param id The id of the room. Ids are expected to be handed out in order starting at 0.
+     */
+    void onRoomAdded(int id);
+
+    /*!
+     * @brief Records a link between two rooms.
+     * @param from The id of the first room.
+     * @param to The id of the second room.
+     * @param direction The direction from the first room to the second (0 = north, 1 = south, 2 = west, 3 = east).
+     */
+    void onLink(int from, int to, int direction);
+
+    /*!
+     * @brief Gets the current statistics, recomputing anything that a loop has invalidated.
+     * @return The floor statistics.
+     */
+    FloorStats getStats();
+
+    /*!
+     * @brief Forces a full recompute of the diameter and articulation points.
+     */
+    void recompute();
+
+    /*!
+     * @brief Checks whether the next query will need a recompute.
+     * @return True if the diameter or articulation points are out of date.
+     */
+    bool needsRecompute() const;
+
+private:
+    std::vector<std::array<int, 4>> neighbours; //!< Linked room ids per direction, -1 for a wall.
+    std::vector<int> degree;                    //!< Number of doors of each room.
+    std::vector<bool> articulation;             //!< Whether each room is an articulation point.
+    std::vector<int> distA;                     //!< Distance of each room from the first diameter endpoint.
+    std::vector<int> distB;                     //!< Distance of each room from the second diameter endpoint.
+    int links;                                  //!< Number of undirected links.
+    int deadEnds;                               //!< Number of rooms with one door.
+    int articulationCount;                      //!< Number of articulation points.
+    int diameter;                               //!< Current diameter (or lower bound).
+    bool diameterExact;                         //!< Whether the diameter is exact.
+    int endA;                                   //!< First endpoint of the diameter.
+    int endB;                                   //!< Second endpoint of the diameter.
+    bool diameterDirty;                         //!< Whether the diameter must be recomputed.
+    bool articulationDirty;                     //!< Whether the articulation points must be recomputed.
+    int exactDiameterLimit;                     //!< Largest floor with a BFS from every room on recompute.
+
+    /*!
+     * @brief Updates the degree and dead-end counts of a room.
+     * @param id The room whose degree changes.
+     * @param change The change in degree, +1 or -1.
+     */
+    void adjustDegree(int id, int change);
+
+    /*!
+     * @brief Updates the diameter and articulation points after a room was hung off an existing one.
+     * @param parent The existing room.
+     * @param leaf The new room.
+     */
+    void attachLeaf(int parent, int leaf);
+
+    /*!
+     * @brief Recomputes the articulation points with an iterative Tarjan search.
+     */
+    void recomputeArticulation();
+
+    /*!
+     * @brief Recomputes the diameter with a parallel multi-source BFS.
+     */
+    void recomputeDiameter();
+
+    /*!
+     * @brief Finds the diameter of one connected part of the floor with iFUB.
+     * @param start A room in that part.
+     * @param reached Set for every room in that part.
+     * @param budget BFS sources that may still be used, reduced by those this search uses.
+     * @param exact Cleared if the budget ran out and the result is only a lower bound.
+     * @return The diameter of that part.
+     */
+    int componentDiameter(int start, std::vector<bool> &reached, int &budget, bool &exact) const;
+
+    /*!
+     * @brief Runs a single-source BFS.
+     * @param source The room to start from.
+     * @param dist Receives the distance of every room, -1 if unreachable.
+     * @return The id of a farthest room from the source.
+     */
+    int bfs(int source, std::vector<int> &dist) const;
+
+    /*!
+     * @brief Runs bit-parallel BFS from batches of up to 64 sources on several threads.
+     * @param sources The rooms to start from.
+     * @return The largest eccentricity among the sources.
+     */
+    int multiSourceEccentricity(const std::vector<int> &sources) const;
+};
+
+#endif // FLOORANALYTICS_H
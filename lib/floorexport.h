@@ -0,0 +1,123 @@
+/*!
+ * @file floorexport.h
+ * @brief Declares the floor exporter for the Valeris game.
+ * @details This file contains the BufferedWriter class and the functions that stream a dungeon floor to disk as
+ * Graphviz DOT or newline-delimited JSON for debugging generation.
+ */
+
+#ifndef FLOOREXPORT_H
+#define FLOOREXPORT_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "../lib/dungeon.h"
+
+/*!
+ * @class BufferedWriter
+ * @brief Writes to a file through a fixed-size buffer.
+ * @details Output is collected in a buffer allocated once at construction and handed to the file in whole-buffer
+ * writes, so memory use does not depend on how much is written. Numbers are formatted straight into the buffer.
+ */
+class BufferedWriter
+{
+public:
+    /*!
+     * @brief Constructor for the BufferedWriter class.
+     * @param file The open file to write to. The writer does not close it.
+     * @param capacity The size of the buffer in bytes.
+     */
+    explicit BufferedWriter(std::FILE *file, size_t capacity = 1 << 16);
+
+    /*!
+     * @brief Destructor for the BufferedWriter class.
+     * @details Flushes any buffered output.
+     */
+    ~BufferedWriter();
+
+    /*!
+     * @brief Writes raw bytes.
+     * @param data The bytes to write.
+     * @param size The number of bytes.
+     */
+    void write(const char *data, size_t size);
+
+    /*!
+     * @brief Writes a string.
+     * @param text The string to write.
+     */
+    void write(const std::string &text);
+
+    /*!
+     * @brief Writes a null-terminated string.
+     * @param text The string to write.
+     */
+    void write(const char *text);
+
+    /*!
+     * @brief Writes a single character.
+     * @param c The character to write.
+     */
+    void put(char c);
+
+    /*!
+     * @brief Writes an integer in decimal.
+     * @param value The integer to write.
+     */
+    void writeInt(long long value);
+
+    /*!
+     * @brief Writes text with JSON and DOT string escaping, without the surrounding quotes.
+     * @param text The text to escape.
+     * @param length The number of characters of text to write.
+     */
+    void writeEscaped(const char *text, size_t length);
+
+    /*!
+     * @brief Hands buffered output to the file.
+     * @return True if every write so far has succeeded.
+     */
+    bool flush();
+
+    /*!
+     * @brief Gets the number of bytes written.
+     * @return The total bytes accepted by the writer.
+     */
+    size_t bytesWritten() const;
+
+private:
+    std::FILE *file;          //!< Destination file.
+    std::vector<char> buffer; //!< Fixed-size output buffer.
+    size_t used;              //!< Bytes currently buffered.
+    size_t total;             //!< Bytes accepted so far.
+    bool ok;                  //!< Whether every write has succeeded.
+};
+
+/*!
+ * @brief Streams a floor as a Graphviz DOT graph.
+ * @param dungeon The floor to export.
+ * @param writer The writer to send the graph to.
+ * @details Each room becomes a node pinned at its coordinates and labelled with its type, enemies and items. Each
+ * door becomes one undirected edge.
+ */
+void exportFloorDot(Dungeon &dungeon, BufferedWriter &writer);
+
+/*!
+ * @brief Streams a floor as newline-delimited JSON.
+ * @param dungeon The floor to export.
+ * @param writer The writer to send the records to.
+ * @details Writes one JSON object per room holding its id, coordinates, type, visited flag, enemies, items and the ids
+ * of the rooms it links to.
+ */
+void exportFloorJson(Dungeon &dungeon, BufferedWriter &writer);
+
+/*!
+ * @brief Exports a floor to a file.
+ * @param dungeon The floor to export.
+ * @param fileName The file to create.
+ * @param format Either "dot" or "json".
+ * @return True if the file was written successfully.
+ */
+bool exportFloor(Dungeon &dungeon, const std::string &fileName, const std::string &format);
+
+#endif // FLOOREXPORT_H
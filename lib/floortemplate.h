@@ -0,0 +1,214 @@
+/*!
+ * @file floortemplate.h
+ * @brief Declares shared floor templates and the per-player overlays on them for the Valeris game.
+ * @details For an event every player starts on the same seeded floor. Rather than each game generating its own copy,
+ * the floor is generated once as a template that nobody changes, and each game keeps an overlay holding only what its
+ * player has changed: the rooms entered, the fog of war and private copies of the rooms fought in, searched or played
+ * in. A game's memory then grows with what its player has done rather than with the size of the floor.
+ */
+
+#ifndef FLOORTEMPLATE_H
+#define FLOORTEMPLATE_H
+
+#include "dungeon.h"
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*!
+ * @class FloorTemplate
+ * @brief A generated floor that is never changed after generation.
+ * @details Templates from shared are kept in a process-wide registry for as long as a game holds them, so every game
+ * asking for the same seed and size gets the same floor. A template's rooms may be read from any thread; changing
+ * one must go through a FloorOverlay. Only a SharedWorld's template is changed after generation, by overlays that write
+ * through to it.
+ */
+class FloorTemplate
+{
+public:
+    /*!
+     * @brief Constructor for the FloorTemplate class.
+     * @param seed The seed to generate the floor from.
+     * @param numRooms The number of rooms to generate.
+     */
+    FloorTemplate(unsigned int seed, int numRooms);
+
+    /*!
+     * @brief Gets the template for a seed, generating it if no game holds it yet.
+     * @param seed The seed.
+     * @param numRooms The number of rooms.
+     * @return The template shared by every game on this floor.
+     */
+    static std::shared_ptr<const FloorTemplate> shared(unsigned int seed, int numRooms);
+
+    /*!
+     * @brief Gets a room by its id.
+     * @param id The room's generation index.
+     * @return The room, or nullptr if there is none with that id. It is shared by every game on the floor.
+     */
+    const Room *getRoom(int id) const;
+
+    /*!
+     * @brief Gets a room to change in place.
+     * @param id The room's generation index.
+     * @return The room, or nullptr if there is none with that id.
+     * @details Only reachable through a template held without const, which only a SharedWorld has.
+     */
+    Room *editRoom(int id);
+
+    /*!
+     * @brief Gets the room every player starts in.
+     * @return The starting room.
+     */
+    const Room *getStartRoom() const;
+
+    /*!
+     * @brief Gets the seed the floor was generated from.
+     * @return The seed.
+     */
+    unsigned int getSeed() const;
+
+    /*!
+     * @brief Gets the number of rooms the floor was asked for.
+     * @return The number of rooms.
+     */
+    int getNumRooms() const;
+
+    /*!
+     * @brief Gets the generated floor.
+     * @return The floor. Its rooms must not be changed.
+     */
+    const Dungeon &getDungeon() const;
+
+    /*!
+     * @brief Estimates the memory used by the floor.
+     * @return The approximate number of bytes.
+     */
+    size_t memoryFootprint() const;
+
+private:
+    std::unique_ptr<Dungeon> dungeon; //!< The floor.
+    int numRooms;                     //!< The number of rooms the floor was asked for.
+};
+
+/*!
+ * @class FloorOverlay
+ * @brief One player's changes to a floor template.
+ * @details Reads fall through to the template until the player changes a room; edit then gives the player a copy of
+ * it, whose mini-games are cloned, and later reads find the copy. Visited flags and the fog of war are kept as bits
+ * beside the copies, since entering a room changes nothing else about it.
+ *
+ * Rooms returned by getRoom keep the template's door pointers, so a door must be followed by looking its room's id up
+ * again rather than by using the pointer directly.
+ */
+class FloorOverlay
+{
+public:
+    /*!
+     * @brief Constructor for the FloorOverlay class. The player's changes are kept in copies of the rooms.
+     * @param floor The template to lay the changes over.
+     */
+    explicit FloorOverlay(std::shared_ptr<const FloorTemplate> floor);
+
+    /*!
+     * @brief Constructor for the FloorOverlay class, for a floor whose rooms the player may change.
+     * @param floor The template.
+     * @param writeThrough Whether changes go to the template's rooms themselves, for a floor players share.
+     */
+    FloorOverlay(std::shared_ptr<FloorTemplate> floor, bool writeThrough);
+
+    /*!
+     * @brief Gets the template.
+     * @return The template.
+     */
+    const FloorTemplate &getTemplate() const;
+
+    /*!
+     * @brief Gets a room as the player sees it.
+     * @param id The room's id.
+     * @return The player's copy if they have changed the room, otherwise the template's room, or nullptr if there is
+     * no room with that id. Changing the room must go through edit.
+     */
+    const Room *getRoom(int id) const;
+
+    /*!
+     * @brief Gets a room the player is about to change.
+     * @param id The room's id.
+     * @return The player's copy of the room, made now if there was none, or nullptr if there is no room with that id.
+     * An overlay that writes through returns the template's room.
+     */
+    Room *edit(int id);
+
+    /*!
+     * @brief Checks whether the player has entered a room.
+     * @param id The room's id.
+     * @return True if they have.
+     */
+    bool getVisited(int id) const;
+
+    /*!
+     * @brief Records that the player has entered a room.
+     * @param id The room's id.
+     */
+    void setVisited(int id);
+
+    /*!
+     * @brief Gets a map of the rooms around a room as the player sees them.
+     * @param room The room to center the map on.
+     * @return The map as a string.
+     */
+    std::string getMap(const Room *room);
+
+    /*!
+     * @brief Records the player's changes.
+     * @return The changes, in the same form as Dungeon::captureDelta. An overlay that writes through records only the
+     * rooms entered, since the rest belongs to the shared floor.
+     */
+    FloorDelta captureDelta() const;
+
+    /*!
+     * @brief Reapplies recorded changes.
+     * @param delta The changes. Bits for rooms that do not exist on the floor are ignored.
+     */
+    void applyDelta(const FloorDelta &delta);
+
+    /*!
+     * @brief Gets the number of rooms the player has their own copy of.
+     * @return The number of copies.
+     */
+    size_t changedRooms() const;
+
+    /*!
+     * @brief Estimates the memory used by the player's changes, not counting the template.
+     * @return The approximate number of bytes.
+     */
+    size_t memoryFootprint() const;
+
+private:
+    std::shared_ptr<const FloorTemplate> floor;   //!< The template.
+    std::shared_ptr<FloorTemplate> target;        //!< The template changes go to, or nullptr to copy rooms instead.
+    std::map<int, std::unique_ptr<Room>> changed; //!< The player's copies of the rooms they have changed, by id.
+    std::vector<bool> visited;                    //!< The rooms the player has entered, by id.
+    FogOfWar fog;                                 //!< What the player has seen.
+};
+
+/*!
+ * @brief Makes every game started from now on play the shared floor for a seed, for the whole process.
+ * @param seed The event's seed.
+ */
+void setEventSeed(unsigned int seed);
+
+/*!
+ * @brief Makes every game started from now on generate a floor of its own again.
+ */
+void clearEventSeed();
+
+/*!
+ * @brief Gets the event's seed.
+ * @param seed Set to the seed if there is an event.
+ * @return True if there is an event.
+ */
+bool getEventSeed(unsigned int &seed);
+
+#endif // FLOORTEMPLATE_H
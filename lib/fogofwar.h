@@ -0,0 +1,130 @@
+/*!
+ * @file fogofwar.h
+ * @brief Defines the FogOfWar class for the Valeris game.
+ * @details This file contains the declaration of the FogOfWar class, which tracks which rooms of a floor the player
+ * can currently see and which they have seen before. Rooms, doors and visibility are stored as bit-packed rows so
+ * that sight is propagated 64 rooms at a time with word shifts.
+ */
+
+#ifndef FOGOFWAR_H
+#define FOGOFWAR_H
+
+#include <cstdint>
+#include <vector>
+#include "../lib/room.h"
+
+/*!
+ * @class FogOfWar
+ * @brief Line-of-sight and explored-room layer over a floor.
+ * @details The floor's bounding box is stored as rows of 64-bit words, one bit per coordinate, with separate rows
+ * for occupied cells, doors to the east and doors to the north. A missing door is a wall. From the player's room,
+ * sight spreads outwards one room at a time through doors, never turning back towards the player, up to the sight
+ * radius in each axis. This lets the player see along corridors and into open areas but not around corners that
+ * double back or through walls. Moving only recomputes the square window around the old and new positions.
+ */
+class FogOfWar
+{
+public:
+    /*!
+     * @brief Constructor for the FogOfWar class.
+     * @param sightRadius How many rooms away the player can see along each axis.
+     */
+    explicit FogOfWar(int sightRadius = 2);
+
+    /*!
+     * @brief Builds the occupancy and door rows for a floor.
+     * @param rooms The rooms of the floor. Rooms already marked visited start out explored.
+     * @details Clears the current view; call moveTo afterwards to see from a room.
+     */
+    void build(const std::vector<Room *> &rooms);
+
+    /*!
+     * @brief Checks whether a coordinate holds a room known to the layer.
+     * @param x The x-coordinate.
+     * @param y The y-coordinate.
+     * @return True if a room was at (x, y) when the layer was built.
+     */
+    bool contains(int x, int y) const;
+
+    /*!
+     * @brief Moves the viewpoint and updates what is visible and explored.
+     * @param x The x-coordinate of the player's room.
+     * @param y The y-coordinate of the player's room.
+     */
+    void moveTo(int x, int y);
+
+    /*!
+     * @brief Checks whether a room is in sight from the current viewpoint.
+     * @param x The x-coordinate.
+     * @param y The y-coordinate.
+     * @return True if the room is currently visible.
+     */
+    bool isVisible(int x, int y) const;
+
+    /*!
+     * @brief Checks whether a room has ever been in sight.
+     * @param x The x-coordinate.
+     * @param y The y-coordinate.
+     * @return True if the room has been seen.
+     */
+    bool isExplored(int x, int y) const;
+
+    /*!
+     * @brief Marks a room as explored without moving the viewpoint.
+     * @param x The x-coordinate.
+     * @param y The y-coordinate.
+     */
+    void reveal(int x, int y);
+
+    /*!
+     * @brief Counts the rooms currently in sight.
+     * @return The number of visible rooms.
+     */
+    int visibleCount() const;
+
+    /*!
+     * @brief Gets the sight radius.
+     * @return How many rooms away the player can see along each axis.
+     */
+    int getSightRadius() const;
+
+private:
+    int sightRadius;                   //!< How many rooms away the player can see along each axis.
+    int minX;                          //!< Smallest x-coordinate on the floor.
+    int minY;                          //!< Smallest y-coordinate on the floor.
+    int width;                         //!< Number of columns in the bounding box.
+    int height;                        //!< Number of rows in the bounding box.
+    int wordsPerRow;                   //!< 64-bit words per row.
+    std::vector<uint64_t> occupied;    //!< Bit set where a room exists.
+    std::vector<uint64_t> openEast;    //!< Bit set where a room has a door to the room east of it.
+    std::vector<uint64_t> openNorth;   //!< Bit set where a room has a door to the room north of it.
+    std::vector<uint64_t> visible;     //!< Bit set where a room is currently in sight.
+    std::vector<uint64_t> explored;    //!< Bit set where a room has been in sight.
+    std::vector<uint64_t> reach;       //!< Scratch rows for one quadrant of the sight window.
+    std::vector<uint64_t> spread;      //!< Scratch row for shifting along a row.
+    bool hasView;                      //!< Whether moveTo has been called since build.
+    int viewRow;                       //!< Row of the current viewpoint.
+    int viewCol;                       //!< Column of the current viewpoint.
+
+    /*!
+     * @brief Converts a coordinate to a bit position.
+     * @return False if the coordinate is outside the bounding box.
+     */
+    bool locate(int x, int y, int &row, int &col) const;
+
+    /*!
+     * @brief Clears the visible bits in the window around a viewpoint.
+     */
+    void clearWindow(int row, int col);
+
+    /*!
+     * @brief Spreads sight into one quadrant of the window around a viewpoint.
+     * @param row The viewpoint row.
+     * @param col The viewpoint column.
+     * @param stepX 1 to spread east, -1 to spread west.
+     * @param stepY 1 to spread north, -1 to spread south.
+     */
+    void castQuadrant(int row, int col, int stepX, int stepY);
+};
+
+#endif // FOGOFWAR_H
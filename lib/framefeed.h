@@ -0,0 +1,174 @@
+/*!
+ * @file framefeed.h
+ * @brief Declares the frame feed that spectators of a session watch.
+ * @details This file contains the FrameFeed, which keeps the recent output of one session as shared, immutable frames
+ * for any number of read-only spectators, and the FeedSink that publishes a console's output to it on the way to the
+ * player.
+ */
+
+#ifndef FRAMEFEED_H
+#define FRAMEFEED_H
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "console.h"
+
+/*!
+ * @struct FeedStats
+ * @brief Counts kept by a FrameFeed.
+ */
+struct FeedStats
+{
+    unsigned long long published = 0; //!< Writes published, watched or not.
+    unsigned long long frames = 0;    //!< Frames made for spectators.
+    unsigned long long dropped = 0;   //!< Frames spectators fell too far behind to be sent.
+    unsigned long long keyframes = 0; //!< Keyframes made, each shared by every spectator resynchronised at that point.
+};
+
+/*!
+ * @class FrameFeed
+ * @brief One session's output, kept for the spectators watching it.
+ * @details Each write the player's console makes is copied once into an immutable frame, and every spectator is given
+ * the same shared pointer to it, so sending a frame to a hundred spectators costs no more memory than sending it to
+ * one. The feed keeps only the last few frames. A spectator is just a sequence number into them: one that falls
+ * behind the oldest frame kept is given a keyframe instead, which clears the screen and redraws the end of the
+ * player's recent output, and carries on from the newest frame.
+ *
+ * Publishing never waits for a spectator, so a slow one cannot hold the player up. While nobody watches, the feed makes
+ * no frames and only keeps the recent output a keyframe is drawn from. Every member may be called from any thread.
+ */
+class FrameFeed
+{
+public:
+    //! A frame, shared by every spectator sent it.
+    typedef std::shared_ptr<const std::string> Frame;
+
+    /*!
+     * @brief Constructor for the FrameFeed class.
+     * @param maxFrames The most frames kept for spectators who are behind.
+     * @param maxBytes The most bytes of frames kept; the newest frame is kept whatever its size.
+     * @param historyBytes How much of the recent output a keyframe redraws.
+     */
+    explicit FrameFeed(size_t maxFrames = 64, size_t maxBytes = 256 * 1024, size_t historyBytes = 4096);
+
+    /*!
+     * @brief Publishes output the player has been sent.
+     * @param data The bytes.
+     * @param size How many there are.
+     */
+    void publish(const char *data, size_t size);
+
+    /*!
+     * @brief Adds a spectator.
+     * @param keyframe Set to a keyframe showing the player's recent output.
+     * @return The spectator's cursor: the sequence number of the first frame after the keyframe.
+     */
+    unsigned long long join(Frame &keyframe);
+
+    /*!
+     * @brief Removes a spectator.
+     */
+    void leave();
+
+    /*!
+     * @brief Takes the frames a spectator has not been sent.
+     * @param cursor The spectator's cursor, moved past the frames taken.
+     * @param out Where the frames are appended.
+     * @param most The most frames to take.
+     * @return The number of frames the spectator missed. If it is more than 0, a keyframe was appended in their place.
+     */
+    size_t collect(unsigned long long &cursor, std::vector<Frame> &out, size_t most);
+
+    /*!
+     * @brief Gets the sequence number the next frame will have.
+     * @return The sequence number.
+     */
+    unsigned long long head() const;
+
+    /*!
+     * @brief Gets the number of spectators.
+     * @return The number of spectators.
+     */
+    size_t watchers() const;
+
+    /*!
+     * @brief Sets what to call after a frame is published while the feed is watched.
+     * @param listener The function, called on the publishing thread without the feed's lock held. It must be set
+     * before anything is published.
+     */
+    void setListener(std::function<void()> listener);
+
+    /*!
+     * @brief Marks the feed as finished, once the session has ended.
+     */
+    void close();
+
+    /*!
+     * @brief Checks whether the session has ended.
+     * @return True if close has been called.
+     */
+    bool closed() const;
+
+    /*!
+     * @brief Gets the feed's counts.
+     * @return A copy of the counts.
+     */
+    FeedStats stats() const;
+
+private:
+    /*!
+     * @brief Gets a keyframe for the output so far, making it if the output has changed since the last one.
+     * @return The keyframe. The feed's lock must be held.
+     */
+    Frame keyframe();
+
+    size_t maxFrames;                //!< The most frames kept.
+    size_t maxBytes;                 //!< The most bytes of frames kept.
+    size_t historyBytes;             //!< How much output a keyframe redraws.
+    mutable std::mutex mutex;        //!< Guards the fields below.
+    std::deque<Frame> frames;        //!< The frames kept, oldest first.
+    size_t frameBytes = 0;           //!< The bytes in frames.
+    unsigned long long next = 0;     //!< The sequence number of the next frame.
+    std::string history;             //!< The recent output, at least historyBytes of it once there is that much.
+    Frame cached;                    //!< The last keyframe made.
+    unsigned long long cachedAt = 0; //!< The value of next when cached was made.
+    size_t spectators = 0;           //!< The number of spectators.
+    bool ended = false;              //!< Whether close has been called.
+    FeedStats counts;                //!< The feed's counts.
+    std::function<void()> listener;  //!< Called after a watched publish.
+};
+
+/*!
+ * @class FeedSink
+ * @brief Passes a console's output on and publishes it to a FrameFeed.
+ * @details The sink sits under the console and before any compression, so spectators are sent the same plain bytes
+ * whether or not the player's client compresses, and each flush of the console becomes one frame.
+ */
+class FeedSink : public OutputSink
+{
+public:
+    /*!
+     * @brief Constructor for the FeedSink class.
+     * @param next Where output goes to the player.
+     * @param feed The feed to publish it to.
+     */
+    FeedSink(OutputSink &next, FrameFeed &feed);
+
+    /*!
+     * @brief Writes bytes to the player and publishes them.
+     * @param data The bytes.
+     * @param size How many there are.
+     * @return What writing them to the player returned.
+     */
+    bool write(const char *data, size_t size) override;
+
+private:
+    OutputSink &next; //!< Where output goes to the player.
+    FrameFeed &feed;  //!< The feed.
+};
+
+#endif // FRAMEFEED_H
@@ -0,0 +1,90 @@
+/*!
+ * @file handoff.h
+ * @brief Declares how a live session is handed from one server process to another.
+ * @details For a rolling upgrade the old process hands each live session to the new one over a local Unix socket,
+ * and the player stays connected throughout. A session goes over as one HandoffRecord: the connection itself, passed
+ * as a file descriptor with SCM_RIGHTS, the state its game was saved in, the input the game had not read yet and the
+ * output the player had not been sent yet. On the socket each record is a 4-byte length and a blob written with
+ * BlobWriter, sent by one sendmsg carrying the descriptor. The receiving server sends back one HandoffAck for each
+ * session once it has carried on, so the sender can keep only a few sessions waiting at a time.
+ */
+
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <deque>
+#include <string>
+#include <vector>
+
+const char HandoffAck = 6; //!< Sent back on the socket for each session carried on.
+
+/*!
+ * @struct HandoffRecord
+ * @brief One session on its way between processes.
+ */
+struct HandoffRecord
+{
+    int fd = -1;             //!< The player's connection.
+    std::string state;       //!< What the game needs to carry on, as thrown in a SessionHandoff.
+    std::string input;       //!< Input the game has not read yet.
+    std::string output;      //!< Output the player has not been sent yet, ending any compressed stream.
+    bool compressed = false; //!< Whether the player's client had agreed to compression.
+    long long pausedAt = 0;  //!< When the game stopped, in steady clock nanoseconds, which every process on a machine shares.
+};
+
+/*!
+ * @brief Writes a record, without its descriptor.
+ * @param record The record.
+ * @return The blob.
+ */
+std::string encodeHandoff(const HandoffRecord &record);
+
+/*!
+ * @brief Reads a record written by encodeHandoff.
+ * @param bytes The blob.
+ * @param record Set to the record, leaving its descriptor alone.
+ * @return False if the blob is malformed or from another version.
+ */
+bool decodeHandoff(const std::string &bytes, HandoffRecord &record);
+
+#ifdef __linux__
+/*!
+ * @brief Sends a record and its descriptor.
+ * @param channel A blocking, connected Unix stream socket.
+ * @param record The record. Its descriptor is still open afterwards and may be closed once this returns.
+ * @return False if the record could not be sent, with errno set.
+ */
+bool sendHandoff(int channel, const HandoffRecord &record);
+
+/*!
+ * @class HandoffReader
+ * @brief Reads records from a non-blocking Unix stream socket, however the bytes arrive.
+ */
+class HandoffReader
+{
+public:
+    HandoffReader() = default;
+
+    /*!
+     * @brief Destructor for the HandoffReader class. Closes descriptors whose records never arrived whole.
+     */
+    ~HandoffReader();
+
+    HandoffReader(const HandoffReader &) = delete;
+    HandoffReader &operator=(const HandoffReader &) = delete;
+
+    /*!
+     * @brief Reads what has arrived.
+     * @param channel The socket.
+     * @param records Where whole records are appended. Each owns its descriptor.
+     * @return False once the other process has closed the socket or sent something malformed.
+     */
+    bool receive(int channel, std::vector<HandoffRecord> &records);
+
+private:
+    std::string buffer;   //!< Bytes of records not yet whole.
+    std::deque<int> fds;  //!< Descriptors received for those records, in order.
+};
+#endif
+
+#endif // HANDOFF_H
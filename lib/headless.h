@@ -0,0 +1,104 @@
+/*!
+ * @file headless.h
+ * @brief Declares headless mode for the Valeris game.
+ * @details In headless mode the game runs without a terminal: delays, typing effects, clears and terminal resizing do
+ * nothing, colours and cursor movement are not generated, and output goes to a HeadlessSink. It is meant for bots,
+ * load tests and CI, where the speed of a session should depend only on the game logic.
+ */
+
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <iostream>
+#include <streambuf>
+
+/*!
+ * @brief Turns headless mode on or off for the whole process.
+ * @param on True to run headless.
+ */
+void setHeadless(bool on);
+
+/*!
+ * @brief Checks whether the game is running headless.
+ * @return True in headless mode.
+ */
+bool isHeadless();
+
+/*!
+ * @class HeadlessSink
+ * @brief Output sink for headless mode.
+ * @details With no target the sink discards everything (a null sink). With a target it forwards plain text and drops
+ * escape sequences, so literal colour codes written by the game never reach a bot or a capture buffer.
+ */
+class HeadlessSink : public std::streambuf
+{
+public:
+    /*!
+     * @brief Constructor for the HeadlessSink class.
+     * @param target Where plain text is forwarded, or nullptr to discard all output.
+     */
+    explicit HeadlessSink(std::streambuf *target = nullptr);
+
+    /*!
+     * @brief Destructor for the HeadlessSink class. Uninstalls the sink.
+     */
+    ~HeadlessSink();
+
+    /*!
+     * @brief Turns on headless mode and routes std::cout through the sink.
+     */
+    void install();
+
+    /*!
+     * @brief Restores std::cout. Headless mode stays on.
+     */
+    void uninstall();
+
+    /*!
+     * @brief Gets the number of bytes written to the sink.
+     * @return Bytes received, including dropped escape sequences.
+     */
+    unsigned long long received() const;
+
+    /*!
+     * @brief Gets the number of bytes passed on to the target.
+     * @return Bytes forwarded; always 0 for a null sink.
+     */
+    unsigned long long forwarded() const;
+
+protected:
+    /*!
+     * @brief Accepts one character.
+     */
+    int_type overflow(int_type ch) override;
+
+    /*!
+     * @brief Accepts a run of characters, forwarding the plain text between escape sequences in one call.
+     */
+    std::streamsize xsputn(const char *s, std::streamsize count) override;
+
+    /*!
+     * @brief Flushes the target.
+     */
+    int sync() override;
+
+private:
+    /*!
+     * @enum Parse
+     * @brief Where the sink is within an escape sequence.
+     */
+    enum class Parse
+    {
+        Text,   //!< Ordinary text.
+        Escape, //!< After ESC.
+        Csi     //!< Inside ESC [ ... up to its final byte.
+    };
+
+    std::streambuf *target;          //!< Where plain text goes, or nullptr.
+    std::streambuf *previous;        //!< std::cout's buffer before install, or nullptr when not installed.
+    Parse parse;                     //!< Escape sequence parser state.
+    unsigned long long bytesIn;      //!< Bytes received.
+    unsigned long long bytesOut;     //!< Bytes forwarded.
+};
+
+#endif // HEADLESS_H
@@ -0,0 +1,180 @@
+/*!
+ * @file hibernation.h
+ * @brief Declares session hibernation for the Valeris game.
+ * @details A game whose player has typed nothing for a while writes what it needs to carry on to a small file and
+ * frees its dungeon. The next line the player types restores it: the floor is regenerated from its seed and the
+ * player's changes are reapplied, so a server's memory grows with the players who are playing rather than with those
+ * who are connected. This file holds the binary format the state is written in and the process-wide settings.
+ */
+
+#ifndef HIBERNATION_H
+#define HIBERNATION_H
+
+#include <string>
+#include <vector>
+
+/*!
+ * @class BlobWriter
+ * @brief Builds a compact binary record.
+ * @details Integers are written as base-128 varints, signed ones zigzag encoded first, so small values take one
+ * byte. Strings are length prefixed and flags are packed eight to a byte.
+ */
+class BlobWriter
+{
+public:
+    /*!
+     * @brief Writes an unsigned integer.
+     * @param value The value.
+     */
+    void putUnsigned(unsigned long long value);
+
+    /*!
+     * @brief Writes a signed integer.
+     * @param value The value.
+     */
+    void putInt(long long value);
+
+    /*!
+     * @brief Writes a string.
+     * @param value The string. It may hold any bytes.
+     */
+    void putString(const std::string &value);
+
+    /*!
+     * @brief Writes a list of flags.
+     * @param flags The flags.
+     */
+    void putFlags(const std::vector<bool> &flags);
+
+    /*!
+     * @brief Gets the record written so far.
+     * @return The bytes.
+     */
+    const std::string &data() const;
+
+private:
+    std::string bytes; //!< The record.
+};
+
+/*!
+ * @class BlobReader
+ * @brief Reads a record built by BlobWriter.
+ * @details Reading past the end or reading a malformed value marks the reader as failed and returns zero or empty
+ * values from then on, so a caller can read everything and check ok once at the end.
+ */
+class BlobReader
+{
+public:
+    /*!
+     * @brief Constructor for the BlobReader class.
+     * @param bytes The record. It must outlive the reader.
+     */
+    explicit BlobReader(const std::string &bytes);
+
+    /*!
+     * @brief Reads an unsigned integer.
+     * @return The value, or 0 on failure.
+     */
+    unsigned long long getUnsigned();
+
+    /*!
+     * @brief Reads a signed integer.
+     * @return The value, or 0 on failure.
+     */
+    long long getInt();
+
+    /*!
+     * @brief Reads a string.
+     * @return The string, or an empty one on failure.
+     */
+    std::string getString();
+
+    /*!
+     * @brief Reads a list of flags.
+     * @return The flags, or an empty list on failure.
+     */
+    std::vector<bool> getFlags();
+
+    /*!
+     * @brief Checks whether every read so far succeeded.
+     * @return False once a read has failed.
+     */
+    bool ok() const;
+
+    /*!
+     * @brief Checks whether the whole record has been read.
+     * @return True if nothing is left.
+     */
+    bool atEnd() const;
+
+private:
+    const std::string &bytes; //!< The record.
+    size_t position;          //!< The next byte to read.
+    bool failed;              //!< Whether a read has failed.
+};
+
+/*!
+ * @struct HibernationSettings
+ * @brief When and where idle games hibernate.
+ */
+struct HibernationSettings
+{
+    int idleMilliseconds = 0;  //!< How long a game waits for input before hibernating, or 0 to never hibernate.
+    std::string directory = "."; //!< Where hibernated games are written.
+};
+
+/*!
+ * @struct HibernationStats
+ * @brief Counts kept across every game in the process.
+ */
+struct HibernationStats
+{
+    unsigned long long hibernated = 0;       //!< Times a game has hibernated.
+    unsigned long long restored = 0;         //!< Times a game has been restored.
+    unsigned long long failed = 0;           //!< Hibernations that could not be written or restores that could not be read.
+    size_t sleeping = 0;                     //!< Games hibernating now.
+    size_t bytesOnDisk = 0;                  //!< The size of their files together.
+    long long lastRestoreMicroseconds = 0;   //!< How long the latest restore took.
+    long long slowestRestoreMicroseconds = 0; //!< The longest any restore took.
+};
+
+/*!
+ * @brief Sets when and where idle games hibernate, for the whole process.
+ * @param settings The settings. Games read them each time they wait for input.
+ */
+void setHibernation(const HibernationSettings &settings);
+
+/*!
+ * @brief Gets the hibernation settings.
+ * @return A copy of the settings.
+ */
+HibernationSettings getHibernation();
+
+/*!
+ * @brief Gets the hibernation counts.
+ * @return A snapshot of the counts.
+ */
+HibernationStats hibernationStats();
+
+/*!
+ * @brief Writes a hibernated game to a new file.
+ * @param blob The game's state.
+ * @return The file's path, or an empty string if it could not be written.
+ */
+std::string storeHibernated(const std::string &blob);
+
+/*!
+ * @brief Reads a hibernated game back and deletes its file.
+ * @param path The path returned by storeHibernated.
+ * @param blob Set to the game's state.
+ * @return False if the file could not be read.
+ */
+bool takeHibernated(const std::string &path, std::string &blob);
+
+/*!
+ * @brief Records how long a restore took.
+ * @param microseconds The time from the player's input to the game being ready.
+ */
+void recordRestore(long long microseconds);
+
+#endif // HIBERNATION_H
@@ -0,0 +1,175 @@
+/*!
+ * @file keyreader.h
+ * @brief Defines the raw-mode key reader and reaction timing for the Valeris game.
+ * @details This file contains the declaration of the KeyReader class, which reads an answer key by key with the
+ * terminal out of line mode, and of the LatencyHistogram and CombatLatency types that collect how quickly the player
+ * answered during one combat.
+ */
+
+#ifndef KEYREADER_H
+#define KEYREADER_H
+
+#include <string>
+#include <vector>
+#include "console.h"
+#include "eventloop.h"
+
+/*!
+ * @struct Reaction
+ * @brief How the player answered one prompt.
+ * @details Times are measured from the moment read was called to the moment the bytes were read from the input.
+ */
+struct Reaction
+{
+    std::string answer;          //!< The text typed, without the Enter.
+    bool timedOut = false;       //!< Whether the time ran out before Enter was pressed.
+    bool closed = false;         //!< Whether the input ended.
+    long long firstKeyNanos = -1; //!< Time to the first key, or -1 if no key arrived.
+    long long completeNanos = -1; //!< Time to Enter, or -1 if the answer was not finished.
+};
+
+/*!
+ * @class KeyReader
+ * @brief Reads answers one key at a time with arrival timestamps.
+ * @details On a terminal the reader puts standard input in non-canonical mode with disableInput for as long as it
+ * exists and echoes the keys itself, so each key is read, and timed, the moment it is pressed. Other consoles are
+ * read as they are; their keys are timed when they arrive at the server.
+ */
+class KeyReader
+{
+public:
+    /*!
+     * @brief Constructor for the KeyReader class. Switches a terminal to raw mode.
+     * @param io The console to read. It must outlive the reader.
+     */
+    explicit KeyReader(Console &io = console());
+
+    /*!
+     * @brief Destructor for the KeyReader class. Restores line mode with enableInput.
+     */
+    ~KeyReader();
+
+    KeyReader(const KeyReader &) = delete;
+    KeyReader &operator=(const KeyReader &) = delete;
+
+    /*!
+     * @brief Reads one answer.
+     * @param milliseconds The longest to wait for Enter, or -1 to wait indefinitely.
+     * @return The answer and its timings. Keys typed for an answer that timed out are thrown away.
+     */
+    Reaction read(int milliseconds);
+
+    /*!
+     * @brief Checks whether the terminal is in raw mode.
+     * @return True if keys are read and echoed one at a time.
+     */
+    bool raw() const;
+
+    /*!
+     * @brief Gets the event loop the reader waits in.
+     * @return The loop, for scheduling timers or idle work while an answer is awaited.
+     */
+    EventLoop &events();
+
+private:
+    Console &io;    //!< Where answers come from.
+    EventLoop loop; //!< Delivers keys with their arrival times.
+    bool rawMode;   //!< Whether disableInput was called.
+};
+
+/*!
+ * @class LatencyHistogram
+ * @brief Counts latencies in fixed-width buckets.
+ */
+class LatencyHistogram
+{
+public:
+    /*!
+     * @brief Constructor for the LatencyHistogram class.
+     * @param bucketMilliseconds The width of each bucket.
+     * @param buckets The number of buckets; longer latencies are counted as overflow.
+     */
+    explicit LatencyHistogram(int bucketMilliseconds = 25, int buckets = 80);
+
+    /*!
+     * @brief Records a latency.
+     * @param nanos The latency in nanoseconds.
+     */
+    void add(long long nanos);
+
+    /*!
+     * @brief Gets the number of latencies recorded.
+     * @return The count, including overflow.
+     */
+    unsigned long long count() const;
+
+    /*!
+     * @brief Gets a bucket's count.
+     * @param bucket The bucket's index.
+     * @return The number of latencies in [bucket * width, (bucket + 1) * width) milliseconds.
+     */
+    unsigned long long bucket(int bucket) const;
+
+    /*!
+     * @brief Gets the number of latencies past the last bucket.
+     * @return The overflow count.
+     */
+    unsigned long long overflow() const;
+
+    /*!
+     * @brief Gets the mean latency.
+     * @return The mean in milliseconds, or 0 if nothing was recorded.
+     */
+    double meanMilliseconds() const;
+
+    /*!
+     * @brief Estimates a percentile from the buckets.
+     * @param fraction The percentile as a fraction, such as 0.95.
+     * @return The upper edge of the bucket holding it in milliseconds, the largest latency if it is in the overflow,
+     * or 0 if nothing was recorded.
+     */
+    double percentileMilliseconds(double fraction) const;
+
+    /*!
+     * @brief Formats the histogram as a JSON object.
+     * @return The object. Trailing empty buckets are left out of "counts".
+     */
+    std::string toJson() const;
+
+private:
+    int width;                                //!< Bucket width in milliseconds.
+    std::vector<unsigned long long> counts;   //!< Count per bucket.
+    unsigned long long over = 0;              //!< Count past the last bucket.
+    unsigned long long total = 0;             //!< Count of every latency.
+    long long sumNanos = 0;                   //!< Sum of every latency.
+    long long largestNanos = 0;               //!< The largest latency.
+};
+
+/*!
+ * @struct CombatLatency
+ * @brief The reaction times of one combat.
+ */
+struct CombatLatency
+{
+    std::string enemy;          //!< Who was fought.
+    int turns = 0;              //!< Prompts shown.
+    int timeouts = 0;           //!< Prompts that ran out of time.
+    LatencyHistogram firstKey;  //!< Time from prompt to first key.
+    LatencyHistogram complete;  //!< Time from prompt to Enter.
+
+    /*!
+     * @brief Formats the record as one line of JSON.
+     * @return The line, without a newline.
+     */
+    std::string toJson() const;
+};
+
+/*!
+ * @brief Appends a combat's latencies to a newline-delimited JSON file.
+ * @param path The file to append to.
+ * @param latency The record.
+ * @return True if the line was written.
+ */
+bool appendCombatLatency(const std::string &path, const CombatLatency &latency);
+
+#endif // KEYREADER_H
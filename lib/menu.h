@@ -13,13 +13,15 @@
 #include <vector>
 #include <string>
 #include <iomanip>
+#include <functional>
 
 /*!
  * @brief Displays the introductory text for the game.
  * @param delayTime The time delay between each printed character in milliseconds.
  * @param color The color code for the text.
+ * @param whileAnimating Work to run while the text animates. It must not write to std::cout.
  */
-void displayIntro(int delayTime, const std::string &color);
+void displayIntro(int delayTime, const std::string &color, const std::function<void()> &whileAnimating = nullptr);
 
 /*!
  * @brief Displays the game menu.
@@ -35,6 +37,14 @@ void Displayj();
  */
 void StartGame(const std::string &color);
 
+/*!
+ * @brief Displays the introduction and starts a new game.
+ * @param delayTime The time delay between each printed character of the introduction in milliseconds.
+ * @param color The color of the text
+ * @details The dungeon is generated while the introduction is still being typed.
+ */
+void StartGameWithIntro(int delayTime, const std::string &color);
+
 /*!
  * @brief Loads a saved game.
  * @details This function retrieves and resumes a previously saved game session.
@@ -65,4 +75,16 @@ std::string getColor(int colorChoice, const std::string &color);
 
 void DisplayOption();
 
+/*!
+ * @brief Runs the main menu until the player exits.
+ * @details The menu, and any game started from it, reads and writes the calling thread's console.
+ */
+void RunMainMenu();
+
+/*!
+ * @brief Carries on a session handed over from another process, then runs the main menu.
+ * @param state The state its game was handed off with, or empty if the player was at the main menu.
+ */
+void ResumeMainMenu(const std::string &state);
+
 #endif // MENU_H
@@ -13,6 +13,7 @@
 #include "../lib/dependencies.h"
 #include <vector>
 #include <string>
+#include <memory>
 #include <iostream>
 #include <random>
 #include <iomanip>
@@ -45,6 +46,12 @@ public:
      * @return A string representing the name of the game.
      */
     virtual std::string getGameName() = 0;
+
+    /*!
+     * @brief Copies the game, including a game in progress.
+     * @return The copy.
+     */
+    virtual std::unique_ptr<Game> clone() const = 0;
 };
 
 /*!
@@ -116,6 +123,12 @@ public:
      * @return A string representing the name of the game.
      */
     std::string getGameName() override;
+
+    /*!
+     * @brief Copies the game.
+     * @return The copy.
+     */
+    std::unique_ptr<Game> clone() const override;
 };
 
 /*!
@@ -189,6 +202,12 @@ public:
      * @return A string representing the name of the game.
      */
     std::string getGameName() override;
+
+    /*!
+     * @brief Copies the game.
+     * @return The copy.
+     */
+    std::unique_ptr<Game> clone() const override;
 };
 
 /*!
@@ -270,6 +289,12 @@ public:
      */
     std::string getGameName() override;
 
+    /*!
+     * @brief Copies the game.
+     * @return The copy.
+     */
+    std::unique_ptr<Game> clone() const override;
+
     /*!
      * @brief Initializes the game state.
      * @return The maximum number of rounds for the game.
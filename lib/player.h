@@ -12,6 +12,9 @@
 #include <iostream>
 #include "../lib/toolkit.h" // Assuming this header file contains the declaration of getUserInputToken()
 
+class BlobWriter;
+class BlobReader;
+
 /*!
  * @class Player
  * @brief Manages player attributes and actions.
@@ -38,6 +41,12 @@ public:
      */
     Player();
 
+    /*!
+     * @brief Constructor for the Player class that does not prompt.
+     * @param name The player's name. It may be empty and asked for later with getNameFromUser.
+     */
+    explicit Player(const std::string &name);
+
     /*!
      * @brief Destructor for the Player class.
      */
@@ -156,6 +165,19 @@ public:
     bool setCoinsMinus(int c);
 
     void heal();
+
+    /*!
+     * @brief Writes everything about the player to a record.
+     * @param out The record.
+     */
+    void save(BlobWriter &out) const;
+
+    /*!
+     * @brief Replaces everything about the player with what save wrote.
+     * @param in The record.
+     * @return False if the record was malformed, in which case the player is unchanged.
+     */
+    bool load(BlobReader &in);
 };
 
 #endif // PLAYER_H
@@ -0,0 +1,153 @@
+/*!
+ * @file renderer.h
+ * @brief Defines the Renderer class for the Valeris game.
+ * @details This file contains the declaration of the Renderer class, which collects everything written to std::cout
+ * into a frame and sends the whole frame to the terminal with a single write when the game next waits for the player.
+ */
+
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include "ansifilter.h"
+
+/*!
+ * @struct FrameStats
+ * @brief Counters for the frames a Renderer has presented.
+ */
+struct FrameStats
+{
+    unsigned long long frames = 0;   //!< Number of non-empty frames presented.
+    unsigned long long bytes = 0;    //!< Total bytes written.
+    unsigned long long rawBytes = 0; //!< Total bytes the game wrote, before redundant escapes were removed.
+    unsigned long long syscalls = 0; //!< Total write calls made.
+    size_t lastFrameBytes = 0;       //!< Bytes in the most recent frame.
+    int lastFrameSyscalls = 0;       //!< Write calls used for the most recent frame.
+    size_t largestFrameBytes = 0;    //!< Bytes in the largest frame so far.
+};
+
+/*!
+ * @class Renderer
+ * @brief Frame buffer that std::cout can be routed through.
+ * @details Once installed, text, cursor movement and clears written to std::cout are appended to the current frame
+ * instead of reaching the terminal. std::flush and std::endl no longer cause output; the frame is presented with one
+ * write when input is read from std::cin, when std::cerr is used, when delay is called, or when present is called.
+ */
+class Renderer : public std::streambuf
+{
+public:
+    /*!
+     * @brief Constructor for the Renderer class.
+     * @param fd The file descriptor frames are written to.
+     */
+    explicit Renderer(int fd = 1);
+
+    /*!
+     * @brief Destructor for the Renderer class. Presents any pending output and uninstalls the renderer.
+     */
+    ~Renderer();
+
+    /*!
+     * @brief Routes std::cout through the renderer and presents frames before std::cin and std::cerr are used.
+     */
+    void install();
+
+    /*!
+     * @brief Restores std::cout and the stream ties saved by install, presenting any pending output first.
+     */
+    void uninstall();
+
+    /*!
+     * @brief Writes the pending frame to the file descriptor.
+     * @return False if the write failed. The frame is discarded either way.
+     */
+    bool present();
+
+    /*!
+     * @brief Turns removal of redundant escape sequences on or off. It is on by default.
+     * @param on True to pass frames through an AnsiFilter.
+     */
+    void setCoalescing(bool on);
+
+    /*!
+     * @brief Gets the number of bytes waiting to be presented.
+     * @return The size of the pending frame.
+     */
+    size_t pending() const;
+
+    /*!
+     * @brief Gets the frame counters.
+     * @return The counters since construction or the last resetStats.
+     */
+    const FrameStats &getStats() const;
+
+    /*!
+     * @brief Resets the frame counters.
+     */
+    void resetStats();
+
+    /*!
+     * @brief Gets the installed renderer.
+     * @return The renderer std::cout is routed through, or nullptr.
+     */
+    static Renderer *active();
+
+protected:
+    /*!
+     * @brief Appends a character to the frame.
+     */
+    int_type overflow(int_type ch) override;
+
+    /*!
+     * @brief Appends characters to the frame.
+     */
+    std::streamsize xsputn(const char *s, std::streamsize n) override;
+
+    /*!
+     * @brief Ignores flushes from std::cout so that a frame is not split.
+     */
+    int sync() override;
+
+private:
+    /*!
+     * @class Presenter
+     * @brief Stream buffer whose flush presents the owning renderer's frame.
+     * @details std::cin and std::cerr are tied to a stream using this buffer, so the frame is shown before the
+     * player is asked for input or an error is printed.
+     */
+    class Presenter : public std::streambuf
+    {
+    public:
+        explicit Presenter(Renderer &owner);
+
+    protected:
+        int sync() override;
+
+    private:
+        Renderer &owner; //!< The renderer to present.
+    };
+
+    int fd;                        //!< Where frames are written.
+    std::string frame;             //!< Output waiting to be presented.
+    std::string filtered;          //!< The frame after filtering, kept to reuse its allocation.
+    AnsiFilter ansi;               //!< Removes redundant escape sequences.
+    bool coalescing;               //!< Whether frames are filtered.
+    FrameStats stats;              //!< Frame counters.
+    Presenter presenter;           //!< Buffer that presents on flush.
+    std::ostream presentStream;    //!< Stream that std::cin and std::cerr are tied to while installed.
+    std::streambuf *previousCout;  //!< std::cout's buffer before install.
+    std::ostream *previousCinTie;  //!< std::cin's tie before install.
+    std::ostream *previousCerrTie; //!< std::cerr's tie before install.
+    bool installed;                //!< Whether std::cout is routed through this renderer.
+
+    static Renderer *current; //!< The installed renderer.
+};
+
+/*!
+ * @brief Presents the installed renderer's pending frame, if a renderer is installed.
+ */
+void presentFrame();
+
+#endif // RENDERER_H
@@ -11,6 +11,8 @@
 #include <vector>
 #include <string>
 #include <iostream>
+#include <atomic>
+#include <mutex>
 #include "../lib/minigames.h"
 #include "player.h"
 
@@ -49,6 +51,11 @@ struct NPC
  * @brief Manages the content within a room, including items, enemies, and NPCs.
  * @details The RoomContent class is responsible for handling the contents of a room,
  * such as items that can be collected, enemies that can be fought, and NPCs that can be interacted with.
+ *
+ * Players sharing a world may change the same room from different threads, so each room has its own lock and the
+ * methods that read or change its items, enemies, coins or description take it. Players in different rooms never wait
+ * for each other. The flags are atomic, so checking them takes no lock. The mini-games are not guarded; a player in a
+ * shared world plays a copy of them.
  */
 class RoomContent
 {
@@ -59,6 +66,12 @@ public:
      */
     RoomContent();
 
+    /*!
+     * @brief Copy constructor for RoomContent.
+     * @param other The room content to copy. Its mini-games are cloned rather than shared.
+     */
+    RoomContent(const RoomContent &other);
+
     /*!
      * @brief Clears the room content, making it empty.
      */
@@ -92,13 +105,13 @@ public:
      * @brief Gets the type of the room.
      * @return An integer representing the room type.
      */
-    int getRoomType();
+    int getRoomType() const;
 
     /*!
      * @brief Gets the description of the room.
      * @return A string containing the room description.
      */
-    std::string getRoomDesc();
+    std::string getRoomDesc() const;
 
     /*!
      * @brief Gets the NPC in the room.
@@ -108,11 +121,22 @@ public:
 
     /*!
      * @brief Gets the enemies in the room.
-     * @return A vector of enemies present in the room.
+     * @return A copy of the enemies present in the room, so another player clearing them cannot change it.
      */
-    std::vector<EnemyStruct> getEnemies();
+    std::vector<EnemyStruct> getEnemies() const;
 
-    void clearEnemies();
+    /*!
+     * @brief Calls a function with each enemy in the room, without copying them.
+     * @param visit Called in order while the room's lock is held, so it must not use the room itself.
+     */
+    template <typename Visitor>
+    void forEachEnemy(Visitor visit) const;
+
+    /*!
+     * @brief Removes the room's enemies.
+     * @return True if this call cleared them, false if they had already been cleared.
+     */
+    bool clearEnemies();
 
     void clearText();
 
@@ -127,13 +151,13 @@ public:
      * @brief Gets the coordinates for this room.
      * @return The coordinates for this room
      */
-    std::pair<int, int> getCoordinates();
+    std::pair<int, int> getCoordinates() const;
 
     /*!
      * @brief Gets whether or not the room has been visited
      * @return Whether or not the room has been visited
      */
-    bool getVisited();
+    bool getVisited() const;
 
     /*!
      * @brief Sets whether or not the room has been visited
@@ -143,7 +167,18 @@ public:
 
     Game *getNonGamblingGame();
 
-    std::vector<std::string> getItems();
+    /*!
+     * @brief Gets the items in the room.
+     * @return A copy of the items available in the room.
+     */
+    std::vector<std::string> getItems() const;
+
+    /*!
+     * @brief Calls a function with each item in the room, without copying them.
+     * @param visit Called in order while the room's lock is held, so it must not use the room itself.
+     */
+    template <typename Visitor>
+    void forEachItem(Visitor visit) const;
 
     void displayRoomItems();
 
@@ -153,6 +188,38 @@ public:
 
     bool emptyItems();
 
+    /*!
+     * @brief Takes the room's items and coins, unless someone already has.
+     * @param taken Set to the items.
+     * @param takenCoins Set to the coins.
+     * @return True if this call looted the room. Of several players searching at once, exactly one gets the loot.
+     */
+    bool takeLoot(std::vector<std::string> &taken, int &takenCoins);
+
+    /*!
+     * @brief Gets whether the enemies in this room have been cleared.
+     * @return True once clearEnemies has been called.
+     */
+    bool getCleared() const;
+
+    /*!
+     * @brief Gets whether the items and coins in this room have been taken.
+     * @return True once the room has been searched or collected.
+     */
+    bool getLooted() const;
+
+    /*!
+     * @brief Gets whether the safe in this room has been cracked.
+     * @return True if the passcode for this room's safe has been guessed.
+     */
+    bool getSolved() const;
+
+    /*!
+     * @brief Sets whether the safe in this room has been cracked.
+     * @param isSolved Whether or not the passcode has been guessed.
+     */
+    void setSolved(bool isSolved);
+
 private:
     std::vector<std::string> items;   //!< Items available in the room.
     std::vector<EnemyStruct> enemies; //!< Enemies present in the room.
@@ -161,11 +228,35 @@ private:
     int roomType;                     //!< The type of the room.
     std::string roomDesc;             //!< Description of the room.
     std::pair<int, int> cords;        //!< (x,y) Coordinates of room
-    bool visited;                     //!< Whether or not the room has been visited
+    std::atomic<bool> visited;        //!< Whether or not the room has been visited
     std::unique_ptr<Game> nonGambilingGame;
     int coins;
+    std::atomic<bool> cleared; //!< Whether or not the enemies have been defeated
+    std::atomic<bool> looted;  //!< Whether or not the items and coins have been taken
+    std::atomic<bool> solved;  //!< Whether or not the safe passcode has been guessed
+    mutable std::mutex lock;   //!< Guards the items, enemies, coins and description while players share the room.
 };
 
+template <typename Visitor>
+void RoomContent::forEachEnemy(Visitor visit) const
+{
+    std::lock_guard<std::mutex> hold(lock);
+    for (const EnemyStruct &enemy : enemies)
+    {
+        visit(enemy);
+    }
+}
+
+template <typename Visitor>
+void RoomContent::forEachItem(Visitor visit) const
+{
+    std::lock_guard<std::mutex> hold(lock);
+    for (const std::string &item : items)
+    {
+        visit(item);
+    }
+}
+
 /*!
  * @class Room
  * @brief Represents a room in the dungeon.
@@ -185,11 +276,18 @@ public:
     Room *west;              //!< Pointer to the room to the west.
     Room *east;              //!< Pointer to the room to the east.
     RoomContent roomContent; //!< The content of the room.
+    int id;                  //!< Index of the room in its floor's generation order, -1 if not owned by a Dungeon.
 
     /*!
      * @brief Displays the available directions the player can move in.
      */
     void displayAvailableDirections();
+
+    /*!
+     * @brief Describes the available directions the player can move in.
+     * @return The line printed by displayAvailableDirections.
+     */
+    std::string getAvailableDirections() const;
 };
 
 #endif // ROOM_H
\ No newline at end of file
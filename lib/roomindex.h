@@ -0,0 +1,173 @@
+/*!
+ * @file roomindex.h
+ * @brief Defines the RoomIndex class for the Valeris game.
+ * @details This file contains the declaration of the RoomIndex class, a uniform grid over room coordinates with a
+ * secondary grid per room type, used to answer radius, rectangle and nearest-room queries without scanning a floor.
+ */
+
+#ifndef ROOMINDEX_H
+#define ROOMINDEX_H
+
+#include <unordered_map>
+#include <vector>
+#include "../lib/room.h"
+
+/*!
+ * @enum RoomFilter
+ * @brief Conditions on a room's current state that a query can require. Values can be combined with |.
+ */
+enum RoomFilter
+{
+    AnyRoom = 0,     //!< No condition.
+    WithEnemies = 1, //!< The room still has enemies.
+    Unvisited = 2,   //!< The player has not entered the room.
+    Visited = 4,     //!< The player has entered the room.
+    Unsolved = 8,    //!< The room's safe has not been cracked.
+    WithItems = 16   //!< The room still has items to collect.
+};
+
+/*!
+ * @struct RoomQuery
+ * @brief Selects which rooms a spatial query returns.
+ */
+struct RoomQuery
+{
+    int roomType = -1;        //!< Only rooms of this type (see RoomContent::getRoomType), or -1 for every type.
+    unsigned int filters = 0; //!< RoomFilter conditions that must all hold.
+};
+
+/*!
+ * @class RoomIndex
+ * @brief Spatial index over the rooms of a floor.
+ * @details Rooms are bucketed into square grid cells by their coordinates, once in a grid holding every room and once
+ * in a grid per room type. Coordinates and types never change after generation, so buckets are filled when a room is
+ * generated and never need rebuilding. Conditions that do change (enemies, visited, solved, items) are read from the
+ * room when a candidate is checked, so query results always reflect the current room state. Distances are Euclidean
+ * in room units.
+ */
+class RoomIndex
+{
+public:
+    /*!
+     * @brief Constructor for the RoomIndex class.
+     * @param cellSize The width and height of a grid cell in rooms.
+     */
+    explicit RoomIndex(int cellSize = 8);
+
+    /*!
+     * @brief Adds a room to the index.
+     * @param room The room, which must already have its coordinates.
+     */
+    void insert(Room *room);
+
+    /*!
+     * @brief Removes every room from the index.
+     */
+    void clear();
+
+    /*!
+     * @brief Gets the number of indexed rooms.
+     * @return The number of rooms.
+     */
+    size_t size() const;
+
+    /*!
+     * @brief Gets the room at a coordinate.
+     * @param x The x-coordinate.
+     * @param y The y-coordinate.
+     * @return The room at (x, y), or nullptr if there is none.
+     */
+    Room *at(int x, int y) const;
+
+    /*!
+     * @brief Finds the rooms within a radius of a point.
+     * @param x The x-coordinate of the centre.
+     * @param y The y-coordinate of the centre.
+     * @param radius The largest distance to include.
+     * @param query The room type and state conditions.
+     * @return The matching rooms, nearest first.
+     */
+    std::vector<Room *> withinRadius(int x, int y, int radius, const RoomQuery &query = RoomQuery()) const;
+
+    /*!
+     * @brief Finds the rooms inside a rectangle.
+     * @param minX The smallest x-coordinate to include.
+     * @param minY The smallest y-coordinate to include.
+     * @param maxX The largest x-coordinate to include.
+     * @param maxY The largest y-coordinate to include.
+     * @param query The room type and state conditions.
+     * @return The matching rooms in no particular order.
+     */
+    std::vector<Room *> inRect(int minX, int minY, int maxX, int maxY, const RoomQuery &query = RoomQuery()) const;
+
+    /*!
+     * @brief Finds the rooms nearest to a point.
+     * @param x The x-coordinate of the point.
+     * @param y The y-coordinate of the point.
+     * @param k The number of rooms to return.
+     * @param query The room type and state conditions.
+     * @return Up to k matching rooms, nearest first.
+     */
+    std::vector<Room *> nearest(int x, int y, int k, const RoomQuery &query = RoomQuery()) const;
+
+    /*!
+     * @brief Checks a room against a query.
+     * @param room The room to check.
+     * @param query The room type and state conditions.
+     * @return True if the room matches.
+     */
+    static bool matches(Room *room, const RoomQuery &query);
+
+private:
+    /*!
+     * @struct Entry
+     * @brief A room and its coordinates, stored in a grid cell.
+     */
+    struct Entry
+    {
+        Room *room; //!< The indexed room.
+        int x;      //!< The room's x-coordinate.
+        int y;      //!< The room's y-coordinate.
+    };
+
+    /*!
+     * @struct Grid
+     * @brief Grid cells and the range of cell coordinates in use.
+     */
+    struct Grid
+    {
+        std::unordered_map<long long, std::vector<Entry>> cells; //!< Rooms by cell key.
+        int minCellX = 0;                                        //!< Smallest occupied cell column.
+        int minCellY = 0;                                        //!< Smallest occupied cell row.
+        int maxCellX = -1;                                       //!< Largest occupied cell column.
+        int maxCellY = -1;                                       //!< Largest occupied cell row.
+    };
+
+    int cellSize;                                  //!< Width and height of a cell in rooms.
+    Grid all;                                      //!< Every room.
+    std::vector<Grid> byType;                      //!< Rooms grouped by room type.
+    std::unordered_map<long long, Room *> byCoord; //!< Rooms by exact coordinate.
+
+    /*!
+     * @brief Packs two coordinates into a single key.
+     */
+    static long long key(int x, int y);
+
+    /*!
+     * @brief Gets the cell column or row containing a coordinate.
+     */
+    int cellOf(int v) const;
+
+    /*!
+     * @brief Adds an entry to a grid.
+     */
+    void add(Grid &grid, const Entry &entry);
+
+    /*!
+     * @brief Picks the grid to search for a query.
+     * @return The per-type grid, the full grid, or nullptr if the type has no rooms.
+     */
+    const Grid *gridFor(const RoomQuery &query) const;
+};
+
+#endif // ROOMINDEX_H
@@ -0,0 +1,465 @@
+/*!
+ * @file scheduler.h
+ * @brief Defines the work-stealing task scheduler for the Valeris game.
+ * @details This file contains the declaration of the WorkStealingDeque class template, a Chase-Lev deque, the Scheduler
+ * class, which runs tasks on a fixed pool of threads that take work from each other when they run out, and the Job
+ * class template, a handle to the result of a task. The game server runs its sessions on a Scheduler, and background
+ * work such as generating the next floor is spawned on one.
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/*!
+ * @class WorkStealingDeque
+ * @brief A Chase-Lev deque of pointers: one owner pushes and pops at the bottom, any thread steals from the top.
+ * @details The owner's push and pop take no lock and only contend with thieves over the last item. The ring of slots
+ * doubles when it fills; old rings are kept until the deque is destroyed, since a thief may still be reading one.
+ * @tparam T The type pointed to. The deque never owns or deletes the items.
+ */
+template <typename T>
+class WorkStealingDeque
+{
+public:
+    /*!
+     * @brief Constructor for the WorkStealingDeque class.
+     * @param capacity The initial number of slots, rounded up to a power of two.
+     */
+    explicit WorkStealingDeque(size_t capacity = 64) : top(0), bottom(0)
+    {
+        size_t slots = 2;
+        while (slots < capacity)
+        {
+            slots *= 2;
+        }
+        rings.emplace_back(new Ring(slots));
+        ring.store(rings.back().get(), std::memory_order_relaxed);
+    }
+
+    WorkStealingDeque(const WorkStealingDeque &) = delete;
+    WorkStealingDeque &operator=(const WorkStealingDeque &) = delete;
+
+    /*!
+     * @brief Adds an item at the bottom. Only the owner may call this.
+     * @param item The item.
+     */
+    void push(T *item)
+    {
+        long b = bottom.load(std::memory_order_relaxed);
+        long t = top.load(std::memory_order_acquire);
+        Ring *current = ring.load(std::memory_order_relaxed);
+        if (b - t > (long)current->mask)
+        {
+            current = grow(current, t, b);
+        }
+        current->put(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    /*!
+     * @brief Takes the item at the bottom, the one pushed most recently. Only the owner may call this.
+     * @return The item, or nullptr if the deque is empty.
+     */
+    T *pop()
+    {
+        long b = bottom.load(std::memory_order_relaxed) - 1;
+        Ring *current = ring.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long t = top.load(std::memory_order_relaxed);
+        if (t > b)
+        {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        T *item = current->get(b);
+        if (t == b)
+        {
+            // The last item: race the thieves for it
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                item = nullptr;
+            }
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    /*!
+     * @brief Takes the item at the top, the one pushed longest ago. Any thread may call this.
+     * @return The item, or nullptr if the deque is empty or another thread took the item first.
+     */
+    T *steal()
+    {
+        long t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long b = bottom.load(std::memory_order_acquire);
+        if (t >= b)
+        {
+            return nullptr;
+        }
+        T *item = ring.load(std::memory_order_acquire)->get(t);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return nullptr;
+        }
+        return item;
+    }
+
+    /*!
+     * @brief Gets the number of items, which may already be out of date when other threads are using the deque.
+     * @return The number of items.
+     */
+    size_t size() const
+    {
+        long b = bottom.load(std::memory_order_relaxed);
+        long t = top.load(std::memory_order_relaxed);
+        return b > t ? (size_t)(b - t) : 0;
+    }
+
+private:
+    /*!
+     * @struct Ring
+     * @brief A power-of-two array of slots indexed modulo its size.
+     */
+    struct Ring
+    {
+        /*!
+         * @brief Constructor for the Ring struct.
+         * @param slots The number of slots, a power of two.
+         */
+        explicit Ring(size_t slots) : mask(slots - 1), items(new std::atomic<T *>[slots]) {}
+
+        T *get(long index) const { return items[index & mask].load(std::memory_order_relaxed); }
+        void put(long index, T *item) { items[index & mask].store(item, std::memory_order_relaxed); }
+
+        size_t mask;                               //!< The number of slots less one.
+        std::unique_ptr<std::atomic<T *>[]> items; //!< The slots.
+    };
+
+    /*!
+     * @brief Replaces the ring with one twice the size holding the same items.
+     * @param current The full ring.
+     * @param t The top index.
+     * @param b The bottom index.
+     * @return The new ring.
+     */
+    Ring *grow(Ring *current, long t, long b)
+    {
+        Ring *larger = new Ring((current->mask + 1) * 2);
+        for (long i = t; i < b; i++)
+        {
+            larger->put(i, current->get(i));
+        }
+        rings.emplace_back(larger);
+        ring.store(larger, std::memory_order_release);
+        return larger;
+    }
+
+    alignas(64) std::atomic<long> top;       //!< The next item to steal. Only ever increases.
+    alignas(64) std::atomic<long> bottom;    //!< One past the last item pushed.
+    std::atomic<Ring *> ring;                //!< The ring in use.
+    std::vector<std::unique_ptr<Ring>> rings; //!< Every ring the deque has used, freed with the deque.
+};
+
+/*!
+ * @struct SchedulerStats
+ * @brief Counts kept by a Scheduler.
+ */
+struct SchedulerStats
+{
+    /*!
+     * @struct Worker
+     * @brief Counts for one worker thread.
+     */
+    struct Worker
+    {
+        unsigned long long executed = 0;      //!< Tasks run.
+        unsigned long long stolen = 0;        //!< Tasks taken from other workers' queues.
+        unsigned long long failedSteals = 0;  //!< Searches of the other workers that found nothing to take.
+        size_t queueDepth = 0;                //!< Tasks waiting in the worker's queues now.
+        size_t peakQueueDepth = 0;            //!< The most tasks that have waited in its queues at once.
+    };
+
+    std::vector<Worker> workers;       //!< Counts for each worker.
+    unsigned long long submitted = 0;  //!< Tasks submitted.
+    unsigned long long executed = 0;   //!< Tasks run, over all workers.
+    unsigned long long steals = 0;     //!< Tasks stolen, over all workers.
+    size_t queued = 0;                 //!< Tasks waiting now, over all workers.
+};
+
+template <typename T>
+class Job;
+
+/*!
+ * @class Scheduler
+ * @brief Runs tasks on a fixed pool of threads that steal work from each other.
+ * @details Each worker has a WorkStealingDeque for tasks submitted by its own tasks, run newest first while their data
+ * is still in its cache, and an inbox for tasks submitted from other threads. A worker with nothing to do steals the
+ * oldest task from another worker's deque or inbox, so a heavy task such as generating a floor does not hold up cheap
+ * ones queued behind it. Workers with nothing to steal sleep until a task is submitted.
+ *
+ * A task can be given an affinity, the index of the worker it should preferably run on. It goes to that worker's
+ * inbox and only runs elsewhere if another worker runs out of work first.
+ */
+class Scheduler
+{
+public:
+    /*!
+     * @brief Constructor for the Scheduler class. Starts the workers.
+     * @param workers The number of worker threads, at least 1.
+     */
+    explicit Scheduler(int workers);
+
+    /*!
+     * @brief Destructor for the Scheduler class. Stops the workers.
+     */
+    ~Scheduler();
+
+    Scheduler(const Scheduler &) = delete;
+    Scheduler &operator=(const Scheduler &) = delete;
+
+    /*!
+     * @brief Queues a task.
+     * @param task The function to run.
+     * @param affinity The worker to prefer, or -1 for the calling worker, or for any worker when called from
+     * another thread.
+     */
+    void submit(std::function<void()> task, int affinity = -1);
+
+    /*!
+     * @brief Queues a function and returns a handle to its result.
+     * @param function The function to run.
+     * @param affinity The worker to prefer, as for submit.
+     * @return The handle.
+     */
+    template <typename F>
+    Job<typename std::invoke_result<F>::type> spawn(F function, int affinity = -1);
+
+    /*!
+     * @brief Runs every task already queued, including any they queue, then stops the workers.
+     * @details Tasks submitted after stop has returned are never run.
+     */
+    void stop();
+
+    /*!
+     * @brief Gets the number of workers.
+     * @return The number of worker threads.
+     */
+    int workerCount() const;
+
+    /*!
+     * @brief Gets the scheduler's counts.
+     * @return A snapshot of the counts.
+     */
+    SchedulerStats stats() const;
+
+    /*!
+     * @brief Gets the scheduler whose worker is the calling thread.
+     * @return The scheduler, or nullptr on any other thread.
+     */
+    static Scheduler *current();
+
+    /*!
+     * @brief Gets the index of the calling worker in its scheduler.
+     * @return The index, or -1 if the calling thread is not a worker.
+     */
+    static int currentWorker();
+
+    /*!
+     * @brief Gets the scheduler for background work started by the calling thread.
+     * @return The current scheduler on a worker, and otherwise a scheduler shared by the whole program with one
+     * worker per processor, started on first use.
+     */
+    static Scheduler &nearest();
+
+    /*!
+     * @brief Gets what resumes the calling fiber once a job it waits for has finished.
+     * @return The running fiber's waker, or an empty function outside a fiber or in one without a waker, where the
+     * caller should block instead.
+     */
+    static std::function<void()> jobWaker();
+
+    /*!
+     * @brief Suspends the calling fiber until its waker resumes it.
+     */
+    static void parkForJob();
+
+private:
+    class Worker;
+
+    /*!
+     * @struct Task
+     * @brief A queued function.
+     */
+    struct Task
+    {
+        std::function<void()> run; //!< The function.
+    };
+
+    /*!
+     * @brief Runs tasks on a worker thread until the scheduler stops.
+     * @param index The worker's index.
+     */
+    void work(int index);
+
+    /*!
+     * @brief Finds a task for a worker: its own newest, then its inbox, then another worker's oldest.
+     * @param index The worker's index.
+     * @return The task, or nullptr if none was found.
+     */
+    Task *find(int index);
+
+    /*!
+     * @brief Sleeps a worker until it is woken, unless there is work.
+     * @param index The worker's index.
+     */
+    void idle(int index);
+
+    /*!
+     * @brief Wakes a worker if it is sleeping.
+     * @param index The worker's index.
+     * @return True if it was sleeping.
+     */
+    bool wake(int index);
+
+    /*!
+     * @brief Wakes one sleeping worker, if there is one.
+     */
+    void wakeAny();
+
+    std::vector<std::unique_ptr<Worker>> workers; //!< The workers.
+    std::atomic<long> pending;                     //!< Tasks queued and not yet taken by a worker.
+    std::atomic<int> sleepers;                     //!< Workers sleeping or about to.
+    std::atomic<unsigned long long> submitted;     //!< Tasks submitted.
+    std::atomic<unsigned> nextWorker;              //!< The inbox for the next task with no affinity.
+    std::atomic<bool> stopping;                    //!< Set by stop.
+    std::mutex stopMutex;                          //!< Serialises stop.
+};
+
+/*!
+ * @class Job
+ * @brief A handle to the result of a function spawned on a Scheduler.
+ * @details The function runs once, either on a worker or, if no worker has started it by the time get is called, on
+ * the caller, so waiting for a job never waits for the queue.
+ * @tparam T The function's result.
+ */
+template <typename T>
+class Job
+{
+public:
+    /*!
+     * @brief Checks whether the handle refers to a job.
+     * @return False for a default-constructed handle or once get has been called.
+     */
+    bool valid() const { return state != nullptr; }
+
+    /*!
+     * @brief Checks whether the result is ready.
+     * @return True once the function has returned or thrown.
+     */
+    bool ready() const
+    {
+        return state && state->result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    /*!
+     * @brief Gets the result, running the function here if no worker has started it.
+     * @return The result. An exception thrown by the function is rethrown.
+     * @details Inside a fiber with a waker the fiber is parked while another thread finishes the function, and the
+     * thread that finishes it calls the waker, so the thread that ran the fiber can run other sessions meanwhile.
+     */
+    T get()
+    {
+        std::shared_ptr<State> taken = std::move(state);
+        taken->run();
+        std::function<void()> waker = Scheduler::jobWaker();
+        while (true)
+        {
+            {
+                std::lock_guard<std::mutex> lock(taken->mutex);
+                if (taken->result.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+                {
+                    break;
+                }
+                taken->onDone = waker;
+            }
+            if (!waker)
+            {
+                taken->result.wait();
+                break;
+            }
+            Scheduler::parkForJob();
+        }
+        return taken->result.get();
+    }
+
+private:
+    friend class Scheduler;
+
+    /*!
+     * @struct State
+     * @brief The function and its result, shared by the handle and the queued task.
+     */
+    struct State
+    {
+        std::packaged_task<T()> task;      //!< The function.
+        std::future<T> result;             //!< Its result.
+        std::atomic<bool> claimed{false};  //!< Whether a thread has started the function.
+        std::mutex mutex;                  //!< Guards onDone.
+        std::function<void()> onDone;      //!< Resumes a fiber parked in get, if one is.
+
+        /*!
+         * @brief Runs the function unless another thread has, then wakes a fiber waiting for it.
+         */
+        void run()
+        {
+            if (!claimed.exchange(true))
+            {
+                task();
+                std::function<void()> waiting;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    waiting.swap(onDone);
+                }
+                if (waiting)
+                {
+                    waiting();
+                }
+            }
+        }
+    };
+
+    std::shared_ptr<State> state; //!< The shared state, or nullptr.
+};
+
+template <typename F>
+Job<typename std::invoke_result<F>::type> Scheduler::spawn(F function, int affinity)
+{
+    typedef typename std::invoke_result<F>::type Result;
+    std::shared_ptr<typename Job<Result>::State> state = std::make_shared<typename Job<Result>::State>();
+    state->task = std::packaged_task<Result()>(std::move(function));
+    state->result = state->task.get_future();
+    submit([state]
+           { state->run(); },
+           affinity);
+    Job<Result> job;
+    job.state = state;
+    return job;
+}
+
+#endif // SCHEDULER_H
@@ -0,0 +1,180 @@
+/*!
+ * @file screen.h
+ * @brief Defines the Screen class for the Valeris game.
+ * @details This file contains the declaration of the Screen class, a double-buffered model of a block of terminal
+ * lines. Each frame is drawn into the back buffer and only the cells that differ from what the terminal already
+ * shows are sent, using short relative cursor movements.
+ */
+
+#ifndef SCREEN_H
+#define SCREEN_H
+
+#include <string>
+#include <vector>
+
+/*!
+ * @class Screen
+ * @brief Diff-based renderer for a region of the terminal.
+ * @details The region starts at the line the cursor is on when the screen is first presented (or after
+ * invalidate) and grows downwards. Positions are tracked relative to that line with cursor-up/down and
+ * column sequences, so the region keeps working in a scrolling terminal without an alternate screen.
+ * Text may contain newlines, SGR colour sequences and the cursor-up, column and erase-line sequences used
+ * by clear(). Output written to the terminal outside present must be reported with written, inputLine or
+ * invalidate so the front buffer keeps matching the terminal.
+ */
+class Screen
+{
+public:
+    /*!
+     * @brief Constructor for the Screen class.
+     * @param width The terminal width in columns. Longer lines wrap, as they would on the terminal.
+     */
+    explicit Screen(int width = 137);
+
+    /*!
+     * @brief Starts a new frame with an empty back buffer and the pen at the top left.
+     */
+    void begin();
+
+    /*!
+     * @brief Draws text into the back buffer at the pen position.
+     * @param text The text to draw.
+     */
+    void draw(const std::string &text);
+
+    /*!
+     * @brief Ends the frame.
+     * @return The bytes that update the terminal from the front buffer to the back buffer, leaving the cursor at the
+     * end of the drawn text. Write them to the terminal.
+     */
+    std::string present();
+
+    /*!
+     * @brief Reports text that was written to the terminal outside present.
+     * @param text The text, applied to the front buffer at the cursor.
+     */
+    void written(const std::string &text);
+
+    /*!
+     * @brief Reports that the player typed a line: the rest of the cursor's line is unknown and the cursor moved to
+     * the start of the next line.
+     */
+    void inputLine();
+
+    /*!
+     * @brief Forgets the terminal contents. The next present draws the whole frame starting at the cursor's line.
+     */
+    void invalidate();
+
+    /*!
+     * @brief Gets the terminal width.
+     * @return The width in columns.
+     */
+    int getWidth() const;
+
+private:
+    /*!
+     * @struct Cell
+     * @brief One character position.
+     */
+    struct Cell
+    {
+        char32_t ch;          //!< The character, or Screen::Unknown if the terminal contents are not known.
+        unsigned short style; //!< Index into Screen::styles.
+
+        bool operator==(const Cell &other) const { return ch == other.ch && style == other.style; }
+        bool operator!=(const Cell &other) const { return !(*this == other); }
+    };
+
+    /*!
+     * @struct Pen
+     * @brief A cursor position and the style of text written there.
+     */
+    struct Pen
+    {
+        int row = 0;              //!< Line within the region.
+        int col = 0;              //!< Column, or width after writing the last column.
+        unsigned short style = 0; //!< Index into Screen::styles.
+    };
+
+    /*!
+     * @struct Style
+     * @brief A combination of SGR attributes and colours.
+     */
+    struct Style
+    {
+        std::string fg;     //!< Foreground colour parameters, empty for the default.
+        std::string bg;     //!< Background colour parameters, empty for the default.
+        unsigned int attrs; //!< Bit n set for SGR attribute n (bold, underline, reverse, ...).
+        std::string sgr;    //!< Sequence that selects exactly this style from any other.
+    };
+
+    typedef std::vector<std::vector<Cell>> Buffer;
+
+    static const char32_t Unknown = 0xFFFFFFFF; //!< Marks a cell whose terminal contents are not known.
+
+    int width;                           //!< Terminal width in columns.
+    Buffer front;                        //!< What the terminal shows.
+    Buffer back;                         //!< The frame being drawn.
+    Pen backPen;                         //!< Where the next draw goes.
+    Pen cursor;                          //!< The terminal's cursor and current style.
+    bool cursorStyleKnown;               //!< Whether cursor.style matches the terminal.
+    int rowsOnTerminal;                  //!< Region lines that exist on the terminal, so cursor-down can reach them.
+    bool valid;                          //!< Whether the front buffer matches the terminal.
+    std::vector<Style> styles;           //!< Every style seen so far, index 0 is the default.
+
+    /*!
+     * @brief Applies text to a buffer as a terminal would.
+     * @param terminal True if the buffer is the front buffer, so new lines count as existing on the terminal.
+     * @return False if the text contained a sequence the screen cannot model.
+     */
+    bool apply(Buffer &buffer, Pen &pen, const std::string &text, bool terminal);
+
+    /*!
+     * @brief Applies an SGR parameter list to a style.
+     * @return The index of the resulting style.
+     */
+    unsigned short applySgr(unsigned short style, const std::string &params);
+
+    /*!
+     * @brief Checks whether a style changes how a blank cell looks.
+     */
+    bool paintsBlank(unsigned short style) const;
+
+    /*!
+     * @brief Checks whether a cell can be written without changing the terminal's style.
+     */
+    bool inCursorStyle(const Cell &cell) const;
+
+    /*!
+     * @brief Gets a blank cell.
+     */
+    static Cell blank();
+
+    /*!
+     * @brief Moves the terminal cursor, appending the shortest sequence to out.
+     */
+    void moveTo(std::string &out, int row, int col);
+
+    /*!
+     * @brief Moves the terminal cursor, rewriting a short gap of unchanged cells if that is shorter.
+     */
+    void advanceTo(std::string &out, int row, int col);
+
+    /*!
+     * @brief Sets the terminal style, appending the sequence to out if needed.
+     */
+    void setStyle(std::string &out, unsigned short style);
+
+    /*!
+     * @brief Appends a character to out as UTF-8 and advances the cursor.
+     */
+    void put(std::string &out, const Cell &cell);
+
+    /*!
+     * @brief Appends a character to out as UTF-8.
+     */
+    static void encode(std::string &out, char32_t ch);
+};
+
+#endif // SCREEN_H
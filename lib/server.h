@@ -0,0 +1,356 @@
+/*!
+ * @file server.h
+ * @brief Defines the multi-session game server for the Valeris game.
+ * @details This file contains the declaration of the ServerOptions and ServerStats structures and the GameServer
+ * class, which accepts many players on one TCP or Unix socket and runs all of their sessions in one process, and
+ * optionally spectators who watch them on another. Live sessions can be handed from one server process to another
+ * without disconnecting their players. The server is only available on Linux.
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#ifdef __linux__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "fiber.h"
+#include "handoff.h"
+#include "scheduler.h"
+#include "timer.h"
+
+/*!
+ * @struct ServerOptions
+ * @brief How a GameServer listens and runs sessions.
+ */
+struct ServerOptions
+{
+    std::string unixPath;                        //!< Listen on this Unix socket instead of TCP, if not empty.
+    std::string host = "127.0.0.1";              //!< The TCP address to listen on.
+    int port = 4000;                             //!< The TCP port to listen on, or 0 for any free port.
+    int workers = 2;                             //!< Threads running sessions and the background work they start.
+    size_t stackBytes = Fiber::DefaultStackBytes; //!< Stack reserved for each session.
+    bool compression = false;                    //!< Whether to offer MCCP compression to Telnet clients.
+    size_t maxPendingOutput = 1 << 20;           //!< Unsent output allowed before a client is treated as gone.
+    std::string spectatorUnixPath;               //!< Accept spectators on this Unix socket, if not empty.
+    int spectatorPort = -1;                      //!< Accept spectators on this TCP port, 0 for any free port, or -1 for none.
+    size_t spectatorFrames = 64;                 //!< Frames kept for a spectator who is behind before they get a keyframe.
+    std::string handoffPath;                     //!< Accept sessions handed off by another server on this Unix socket, if not empty.
+    bool sharePort = false;                      //!< Let another server bind the same TCP port, so one can take over from this one.
+};
+
+/*!
+ * @struct ServerStats
+ * @brief Counts kept by a GameServer.
+ */
+struct ServerStats
+{
+    size_t connected = 0;              //!< Sessions open now.
+    size_t peakConnected = 0;          //!< The most sessions open at once.
+    unsigned long long accepted = 0;   //!< Connections accepted.
+    unsigned long long finished = 0;   //!< Sessions whose game has ended.
+    unsigned long long resumes = 0;    //!< Times a worker resumed a session.
+    size_t spectators = 0;             //!< Spectators watching a session now.
+    unsigned long long dropped = 0;    //!< Frames spectators were too far behind to be sent.
+    unsigned long long keyframes = 0;  //!< Keyframes sent to spectators joining or catching up.
+    unsigned long long handedOff = 0;  //!< Sessions handed off to another server.
+    unsigned long long adopted = 0;    //!< Sessions taken over from another server.
+    unsigned long long slowestPauseMicroseconds = 0; //!< The longest an adopted session's game was stopped between servers.
+    unsigned long long totalPauseMicroseconds = 0;   //!< The time every adopted session's game was stopped, summed.
+};
+
+/*!
+ * @class GameServer
+ * @brief Runs many players' sessions in one process.
+ * @details One reactor thread owns every socket. It waits in epoll for connections, input and room to write, never
+ * blocks, and keeps each session's unread input and unsent output. The sessions' game code runs on a work-stealing
+ * Scheduler with a small fixed pool of workers. Each session's game runs in a Fiber that is suspended whenever it
+ * waits for input or sleeps, so a worker moves on to the next task and an idle player holds no thread at all.
+ *
+ * Each resume is queued with the session's last worker as its affinity, so the session usually stays on one worker
+ * and keeps its caches warm, but a worker that runs out of work takes sessions queued behind a heavy turn elsewhere.
+ * Input is passed through a TelnetSource, so Telnet clients and plain sockets both work.
+ *
+ * Spectators connect to a socket of their own, choose a live session by its number, and are then sent everything its
+ * player sees and nothing they type is read. Each session's output is published to a FrameFeed, and the reactor sends
+ * each spectator the feed's shared frames directly, so a frame is copied once however many watch it. A spectator whose
+ * socket is full is simply not sent anything until epoll says it has room, and is then sent a keyframe if the frames it
+ * missed are gone; the player's output never waits for a spectator.
+ *
+ * For a rolling upgrade a new server is started with a handoff socket, and the old one is asked to hand its sessions
+ * off to it. The old server stops accepting, and asks each session's game to stop at its next turn: the main menu or
+ * the wait for the player's next action, where everything the game needs is in its saved state. The socket, the saved
+ * state and any unread input and unsent output then go to the new server as a HandoffRecord, and the new server carries
+ * the game on from its state. Sessions are asked a few at a time, and the next is asked only as the new server
+ * acknowledges one it has run, so each one is stopped only for its own transfer rather than behind all the others.
+ */
+class GameServer
+{
+public:
+    /*!
+     * @brief Constructor for the GameServer class.
+     * @param options How to listen and run sessions.
+     * @param session The code each session runs, with its console bound. It runs the main menu by default.
+     * @param resume The code a session handed over from another server runs, given the state its game was handed off
+     * with. It carries on the game and then runs the main menu by default.
+     */
+    explicit GameServer(const ServerOptions &options = ServerOptions(), std::function<void()> session = nullptr,
+                        std::function<void(const std::string &)> resume = nullptr);
+
+    /*!
+     * @brief Destructor for the GameServer class. Stops the server.
+     */
+    ~GameServer();
+
+    GameServer(const GameServer &) = delete;
+    GameServer &operator=(const GameServer &) = delete;
+
+    /*!
+     * @brief Opens the listening socket and starts the reactor and workers.
+     * @return False if the socket could not be opened; the reason is printed to standard error.
+     */
+    bool start();
+
+    /*!
+     * @brief Waits until the server is stopped.
+     */
+    void wait();
+
+    /*!
+     * @brief Closes every connection and stops the threads.
+     * @details Sessions still running have their input closed and are given a moment to end.
+     */
+    void stop();
+
+    /*!
+     * @brief Hands every live session off to another server, from any thread.
+     * @param path The Unix socket the other server accepts handoffs on.
+     * @param timeoutMs The longest to wait for the sessions to go.
+     * @return The number of sessions handed off, or -1 if the other server could not be reached. The server accepts no
+     * more players either way, and should be stopped afterwards; a session that never reached a turn in time is ended
+     * by stop as usual.
+     */
+    int handOff(const std::string &path, int timeoutMs = 10000);
+
+    /*!
+     * @brief Gets the TCP port the server is listening on.
+     * @return The port, or 0 for a Unix socket or before start.
+     */
+    int port() const;
+
+    /*!
+     * @brief Gets the TCP port spectators connect to.
+     * @return The port, or 0 for a Unix socket, when spectators are not accepted, or before start.
+     */
+    int spectatorPort() const;
+
+    /*!
+     * @brief Gets the server's counts.
+     * @return A copy of the counts.
+     */
+    ServerStats stats() const;
+
+    /*!
+     * @brief Gets the counts of the scheduler running the sessions.
+     * @return A snapshot of the counts, kept after the server stops.
+     */
+    SchedulerStats schedulerStats() const;
+
+private:
+    class Session;
+    struct Spectator;
+    struct Channel;
+
+    /*!
+     * @brief Opens a listening socket.
+     * @param unixPath The Unix socket to listen on, or empty for TCP.
+     * @param port The TCP port.
+     * @param bound Set to the TCP port bound.
+     * @return The socket, or -1 if it could not be opened; the reason is printed to standard error.
+     */
+    int openListener(const std::string &unixPath, int port, int &bound);
+
+    /*!
+     * @brief Runs the reactor until the server stops.
+     */
+    void react();
+
+    /*!
+     * @brief Gives memory freed by hibernated games back to the kernel, if any have hibernated since the last time.
+     */
+    void trimHeap();
+
+    /*!
+     * @brief Accepts every waiting connection.
+     */
+    void acceptAll();
+
+    /*!
+     * @brief Makes a session for a connected socket and registers it with epoll.
+     * @param fd The socket.
+     * @param body The code its fiber runs, with its console bound.
+     * @return The session, not yet queued to run.
+     */
+    std::shared_ptr<Session> openSession(int fd, std::function<void()> body);
+
+    /*!
+     * @brief Reads everything waiting on a session's socket.
+     * @param session The session.
+     */
+    void receive(const std::shared_ptr<Session> &session);
+
+    /*!
+     * @brief Sends as much of a session's output as the socket will take and updates its epoll interest.
+     * @param session The session.
+     */
+    void flush(const std::shared_ptr<Session> &session);
+
+    /*!
+     * @brief Closes a session's socket and forgets it.
+     * @param session The session.
+     */
+    void close(const std::shared_ptr<Session> &session);
+
+    /*!
+     * @brief Accepts every waiting spectator and asks them which session to watch.
+     */
+    void acceptSpectators();
+
+    /*!
+     * @brief Reads everything waiting on a spectator's socket, attaching them to the session they choose.
+     * @param fd The spectator's socket.
+     */
+    void receiveSpectator(int fd);
+
+    /*!
+     * @brief Sends a spectator as many of their session's frames as their socket will take.
+     * @param fd The spectator's socket. The spectator is closed once the session has ended and they have seen it all.
+     */
+    void pump(int fd);
+
+    /*!
+     * @brief Sends frames to every spectator of a session who is not waiting for room to write.
+     * @param session The session.
+     */
+    void pumpWatchers(const std::shared_ptr<Session> &session);
+
+    /*!
+     * @brief Closes a spectator's socket and forgets them.
+     * @param fd The spectator's socket.
+     */
+    void dropSpectator(int fd);
+
+    /*!
+     * @brief Stops accepting players and starts asking sessions to stop for a handoff, on the reactor.
+     */
+    void beginHandoff();
+
+    /*!
+     * @brief Asks the next sessions in line to stop for a handoff, while fewer than a few are on their way.
+     */
+    void askForHandoffs();
+
+    /*!
+     * @brief Sends a session whose game has stopped for a handoff to the other server, then forgets it.
+     * @param session The session.
+     */
+    void transfer(const std::shared_ptr<Session> &session);
+
+    /*!
+     * @brief Reads the acknowledgements the other server has sent for sessions it has carried on.
+     */
+    void receiveAcks();
+
+    /*!
+     * @brief Accepts every waiting connection from a server handing sessions off.
+     */
+    void acceptHandoffs();
+
+    /*!
+     * @brief Reads the records waiting on a handoff connection and carries on their sessions.
+     * @param fd The connection.
+     */
+    void receiveHandoffs(int fd);
+
+    /*!
+     * @brief Carries on a session handed off by another server.
+     * @param record The session's record.
+     * @param channel The connection it came on, acknowledged once the session has run.
+     */
+    void adopt(const HandoffRecord &record, const std::shared_ptr<Channel> &channel);
+
+    /*!
+     * @brief Asks the reactor to look at a session, from any thread.
+     * @param session The session, which has output to send or has ended.
+     */
+    void notify(const std::shared_ptr<Session> &session);
+
+    /*!
+     * @brief Records that a session's game has ended, from its worker.
+     * @param session The session, which is closed once its output is sent.
+     */
+    void sessionEnded(const std::shared_ptr<Session> &session);
+
+    /*!
+     * @brief Counts a fiber resume, from a worker.
+     */
+    void countResume();
+
+    /*!
+     * @brief Queues a session to be resumed, from any thread.
+     * @param session The session, whose input has arrived or whose timer is due.
+     */
+    void post(const std::shared_ptr<Session> &session);
+
+    /*!
+     * @brief Resumes a session's fiber until it next waits, on a worker.
+     * @param session The session.
+     */
+    void run(const std::shared_ptr<Session> &session);
+
+    ServerOptions options;                                        //!< How to listen and run sessions.
+    std::function<void()> session;                                //!< The code each session runs.
+    std::function<void(const std::string &)> resume;              //!< The code each adopted session runs.
+    int listener;                                                 //!< The listening socket, or -1.
+    int epoll;                                                    //!< The epoll instance, or -1.
+    int wakeup;                                                   //!< Event descriptor that interrupts epoll_wait, or -1.
+    int boundPort;                                                //!< The TCP port in use.
+    int spectatorListener;                                        //!< The spectators' listening socket, or -1.
+    int boundSpectatorPort;                                       //!< The spectators' TCP port in use.
+    int handoffListener;                                          //!< The socket handoffs are accepted on, or -1.
+    std::atomic<int> handoffChannel;                              //!< The connection sessions are handed off on, or -1. Set by handOff.
+    std::thread reactor;                                          //!< Runs react.
+    std::unique_ptr<Scheduler> scheduler;                         //!< Runs sessions, while the server is started.
+    std::unique_ptr<TimerThread> timers;                          //!< Wakes sleeping sessions, while the server is started.
+    std::unordered_map<int, std::shared_ptr<Session>> sessions;   //!< Open sessions by socket, used only by the reactor.
+    std::unordered_map<int, std::unique_ptr<Spectator>> spectators; //!< Spectators by socket, used only by the reactor.
+    std::unordered_map<int, std::shared_ptr<Channel>> channels;   //!< Connections handing sessions over, used only by the reactor.
+    std::deque<std::weak_ptr<Session>> handoffQueue;              //!< Sessions not yet asked to stop, used only by the reactor.
+    size_t handoffsInFlight;                                      //!< Sessions stopping or sent and not yet acknowledged, used only by the reactor.
+    bool handingOff;                                              //!< Whether the server has begun handing off, used only by the reactor.
+    std::atomic<bool> handoffAsked;                               //!< Set by handOff for the reactor.
+    std::mutex pendingMutex;                                      //!< Guards pending.
+    std::vector<std::shared_ptr<Session>> pending;                //!< Sessions the reactor has been asked to look at.
+    std::atomic<bool> stopping;                                   //!< Set by stop.
+    std::mutex stateMutex;                                        //!< Guards stopped, and scheduler against job wakers.
+    std::condition_variable stateChanged;                         //!< Signalled when the server has stopped.
+    bool stopped;                                                 //!< Whether stop has finished.
+    size_t nextWorker;                                            //!< The home worker of the next session.
+    unsigned long long lastSession;                               //!< The number given to the last session accepted.
+    unsigned long long trimmedAfter;                              //!< Hibernations counted at the last trim, used only by the reactor.
+    mutable std::mutex statsMutex;                                //!< Guards counts and lastSchedulerStats.
+    ServerStats counts;                                           //!< The server's counts.
+    SchedulerStats lastSchedulerStats;                            //!< The scheduler's counts when it was stopped.
+};
+
+#endif // __linux__
+
+#endif // SERVER_H
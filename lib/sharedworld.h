@@ -0,0 +1,151 @@
+/*!
+ * @file sharedworld.h
+ * @brief Declares the SharedWorld class for the Valeris game.
+ * @details In a shared world every player explores the same floor and sees what the others have done: enemies one
+ * player defeats are gone for everyone, and a safe only one of them empties. The world tracks which players are in
+ * each room so that what happens in a room can be told to the players there.
+ */
+
+#ifndef SHAREDWORLD_H
+#define SHAREDWORLD_H
+
+#include "floortemplate.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*!
+ * @class SharedWorld
+ * @brief A floor several players explore at once, and who is in each of its rooms.
+ * @details Each room has its own lock for its list of players, as RoomContent has for its contents, so players in
+ * different rooms never wait for each other. A player's messages are queued on their Member and read by their own
+ * game, so no thread writes to another player's console.
+ */
+class SharedWorld
+{
+public:
+    /*!
+     * @class Member
+     * @brief A player in the world.
+     */
+    class Member
+    {
+    public:
+        /*!
+         * @brief Constructor for the Member class.
+         * @param name The player's name, used in messages to the others.
+         */
+        explicit Member(const std::string &name);
+
+        /*!
+         * @brief Gets the player's name.
+         * @return The name.
+         */
+        const std::string &getName() const;
+
+        /*!
+         * @brief Gets the room the player is in.
+         * @return The room's id, or -1 if they are not in the world.
+         */
+        int getRoom() const;
+
+        /*!
+         * @brief Takes the messages sent to the player since the last call.
+         * @return The messages, oldest first.
+         */
+        std::vector<std::string> takeMessages();
+
+    private:
+        friend class SharedWorld;
+
+        /*!
+         * @brief Queues a message for the player.
+         * @param message The message.
+         */
+        void deliver(const std::string &message);
+
+        std::string name;                //!< The player's name.
+        std::atomic<int> room;           //!< The room the player is in, or -1.
+        std::mutex inboxLock;            //!< Guards inbox.
+        std::vector<std::string> inbox;  //!< Messages not yet taken.
+    };
+
+    /*!
+     * @brief Constructor for the SharedWorld class.
+     * @param seed The seed to generate the floor from.
+     * @param numRooms The number of rooms.
+     */
+    SharedWorld(unsigned int seed, int numRooms);
+
+    /*!
+     * @brief Gets the floor.
+     * @return The floor. Its rooms are changed by the players through FloorOverlays that write through to it.
+     */
+    const std::shared_ptr<FloorTemplate> &getFloor() const;
+
+    /*!
+     * @brief Moves a player into a room, telling the players in the room they left and the room they entered.
+     * @param member The player.
+     * @param roomId The room's id.
+     */
+    void enter(Member &member, int roomId);
+
+    /*!
+     * @brief Takes a player out of the world, telling the players in their room.
+     * @param member The player. Nothing happens if they are not in the world.
+     */
+    void leave(Member &member);
+
+    /*!
+     * @brief Tells the players in a room what has happened there.
+     * @param roomId The room's id.
+     * @param message The message.
+     * @param from The player it happened to, who is not told, or nullptr to tell everyone.
+     * @return The number of players told.
+     */
+    int broadcast(int roomId, const std::string &message, const Member *from = nullptr);
+
+    /*!
+     * @brief Gets the players in a room.
+     * @param roomId The room's id.
+     * @return Their names.
+     */
+    std::vector<std::string> present(int roomId) const;
+
+private:
+    /*!
+     * @struct Place
+     * @brief The players in one room.
+     */
+    struct Place
+    {
+        mutable std::mutex lock;        //!< Guards members.
+        std::vector<Member *> members;  //!< The players in the room.
+    };
+
+    std::shared_ptr<FloorTemplate> floor;       //!< The floor, the only template whose rooms change.
+    std::vector<std::unique_ptr<Place>> places; //!< The players in each room, by room id.
+
+    /*!
+     * @brief Gets the players in a room.
+     * @param roomId The room's id.
+     * @return The room's place, or nullptr if there is no such room.
+     */
+    Place *place(int roomId) const;
+};
+
+/*!
+ * @brief Makes every game started from now on join a world, for the whole process.
+ * @param world The world, or nullptr for every game to have a floor of its own again.
+ */
+void setSharedWorld(std::shared_ptr<SharedWorld> world);
+
+/*!
+ * @brief Gets the world new games join.
+ * @return The world, or nullptr if there is none.
+ */
+std::shared_ptr<SharedWorld> getSharedWorld();
+
+#endif // SHAREDWORLD_H
@@ -0,0 +1,210 @@
+/*!
+ * @file timer.h
+ * @brief Defines the timer facilities for the Valeris game.
+ * @details This file contains the declaration of the TimerQueue class, a min-heap of deadlines that an event loop
+ * can drive with poll timeouts, the TimerThread class, which runs timer callbacks on a background thread, and
+ * sleep functions that block the calling thread without using the CPU.
+ */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#ifdef _WIN32
+#include <condition_variable>
+#endif
+
+/*!
+ * @class TimerQueue
+ * @brief Min-heap of timers ordered by deadline.
+ * @details The queue does not wait by itself. Its owner asks for the time until the next deadline (in the form
+ * poll expects), waits that long for other events, and then runs whatever is due. Cancelled timers stay in the
+ * heap until they reach the top and are then discarded, or until they outnumber the pending ones and the heap is
+ * rebuilt without them, so cancel is constant time on average and the heap stays at most about twice as large as
+ * the number of pending timers.
+ */
+class TimerQueue
+{
+public:
+    typedef std::chrono::steady_clock Clock; //!< Clock used for all deadlines.
+    typedef unsigned long long TimerId;      //!< Identifies a scheduled timer. 0 is never used.
+
+    /*!
+     * @brief Schedules a callback at a deadline.
+     * @param due When the callback should run.
+     * @param callback The function to run.
+     * @return The timer's id.
+     */
+    TimerId schedule(Clock::time_point due, std::function<void()> callback);
+
+    /*!
+     * @brief Schedules a callback after a delay.
+     * @param milliseconds How long from now the callback should run.
+     * @param callback The function to run.
+     * @return The timer's id.
+     */
+    TimerId scheduleAfter(int milliseconds, std::function<void()> callback);
+
+    /*!
+     * @brief Cancels a timer.
+     * @param id The timer's id.
+     * @return True if the timer was still pending.
+     */
+    bool cancel(TimerId id);
+
+    /*!
+     * @brief Gets the time until the next deadline.
+     * @param now The current time.
+     * @return Milliseconds until the earliest timer, rounded up; 0 if one is due; -1 if none are pending.
+     */
+    int nextTimeout(Clock::time_point now);
+
+    /*!
+     * @brief Removes the timers that are due.
+     * @param now The current time.
+     * @return The callbacks of the due timers in deadline order, for the caller to run.
+     */
+    std::vector<std::function<void()>> takeDue(Clock::time_point now);
+
+    /*!
+     * @brief Runs the timers that are due.
+     * @param now The current time.
+     * @return The number of callbacks run.
+     */
+    size_t runDue(Clock::time_point now);
+
+    /*!
+     * @brief Gets the number of pending timers.
+     * @return The number of timers that have neither run nor been cancelled.
+     */
+    size_t size() const;
+
+private:
+    /*!
+     * @struct Timer
+     * @brief A scheduled callback.
+     */
+    struct Timer
+    {
+        Clock::time_point due;          //!< When to run.
+        TimerId id;                     //!< The timer's id, which also breaks ties in scheduling order.
+        std::function<void()> callback; //!< What to run.
+    };
+
+    /*!
+     * @brief Orders the heap so the earliest deadline is on top.
+     */
+    static bool later(const Timer &a, const Timer &b);
+
+    /*!
+     * @brief Discards cancelled timers from the top of the heap.
+     */
+    void prune();
+
+    std::vector<Timer> heap;           //!< Timers, earliest deadline first.
+    std::unordered_set<TimerId> live;  //!< Ids of timers that have not run or been cancelled.
+    TimerId nextId = 1;                //!< Id for the next timer.
+};
+
+/*!
+ * @class TimerThread
+ * @brief Runs timer callbacks on a background thread.
+ * @details The thread sleeps in poll on a wake-up pipe with the queue's next timeout, so it uses no CPU while
+ * waiting. Scheduling an earlier timer writes to the pipe to shorten the wait. Callbacks run on the timer thread,
+ * one at a time, and may schedule or cancel timers.
+ */
+class TimerThread
+{
+public:
+    /*!
+     * @brief Constructor for the TimerThread class. Starts the thread.
+     */
+    TimerThread();
+
+    /*!
+     * @brief Destructor for the TimerThread class. Stops the thread; pending timers do not run.
+     */
+    ~TimerThread();
+
+    /*!
+     * @brief Schedules a callback after a delay.
+     * @param milliseconds How long from now the callback should run.
+     * @param callback The function to run on the timer thread.
+     * @return The timer's id.
+     */
+    TimerQueue::TimerId after(int milliseconds, std::function<void()> callback);
+
+    /*!
+     * @brief Schedules a callback at a deadline.
+     * @param due When the callback should run.
+     * @param callback The function to run on the timer thread.
+     * @return The timer's id.
+     */
+    TimerQueue::TimerId at(TimerQueue::Clock::time_point due, std::function<void()> callback);
+
+    /*!
+     * @brief Cancels a timer.
+     * @param id The timer's id.
+     * @return True if the timer had not started running.
+     */
+    bool cancel(TimerQueue::TimerId id);
+
+    /*!
+     * @brief Gets the number of pending timers.
+     * @return The number of timers waiting to run.
+     */
+    size_t pending();
+
+    /*!
+     * @brief Gets the timer thread shared by the whole program.
+     * @return The shared instance, started on first use.
+     */
+    static TimerThread &shared();
+
+private:
+    /*!
+     * @brief Waits for deadlines and runs callbacks until stopped.
+     */
+    void run();
+
+    /*!
+     * @brief Interrupts the thread's current wait.
+     */
+    void wake();
+
+    TimerQueue queue;  //!< Pending timers, guarded by mutex.
+    std::mutex mutex;  //!< Guards queue and stopping.
+    bool stopping;     //!< Set to make the thread exit.
+    std::thread worker; //!< The timer thread.
+#ifdef _WIN32
+    std::condition_variable wakeup; //!< Signalled to interrupt the wait.
+#else
+    int wakePipe[2]; //!< Written to interrupt the wait.
+#endif
+};
+
+/*!
+ * @brief Blocks the calling thread until a deadline without using the CPU.
+ * @param due The deadline on TimerQueue::Clock.
+ */
+void sleepUntil(TimerQueue::Clock::time_point due);
+
+/*!
+ * @brief Blocks the calling thread for a number of milliseconds without using the CPU.
+ * @param milliseconds How long to sleep.
+ */
+void sleepFor(int milliseconds);
+
+/*!
+ * @brief Reads CLOCK_MONOTONIC, or the steady clock where it does not exist.
+ * @return Nanoseconds since an arbitrary fixed point, for measuring intervals.
+ */
+long long monotonicNanos();
+
+#endif // TIMER_H
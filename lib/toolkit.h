@@ -14,6 +14,9 @@
 #include <string>
 #include <vector>
 #include <chrono>
+#include <functional>
+#include <random>
+#include "console.h"
 
 #ifdef _WIN32
 #include <windows.h>
@@ -60,6 +63,14 @@ void typePrint(const std::string &content, int delayTime = 15, const std::string
  */
 std::string getFileContent(std::string fileName);
 
+/*!
+ * @brief Read a file's lines once and keep them for the rest of the process.
+ * @param fileName The name of the file to read.
+ * @return The lines, as split(getFileContent(fileName), '\n') would give them. The list is never changed or freed.
+ * @details Meant for the game's resource files, which room generation reads for every room.
+ */
+const std::vector<std::string> &getFileLines(const std::string &fileName);
+
 /*!
  * @brief Split a string by a delimiter.
  * @param str The string to split.
@@ -71,9 +82,23 @@ std::vector<std::string> split(const std::string &str, char delimiter);
 /*!
  * @brief Clear the console up to a certain limit.
  * @param limit The number of lines to clear.
+ * @details The whole sequence is written to std::cout at once and is not flushed, so it joins the current frame.
  */
 void clear(int limit);
 
+/*!
+ * @brief Build the escape sequence that clear writes.
+ * @param limit The number of lines to clear.
+ * @return The sequence, so callers can also pass it to a Screen.
+ */
+std::string clearSequence(int limit);
+
+/*!
+ * @brief Handle the calling thread's console reaching end of input.
+ * @details A headless process exits. A session on any console other than the standard one throws InputClosed.
+ */
+void endOfInputCheck();
+
 /*!
  * @brief Get a full line of user input.
  * @return The user's input as a string.
@@ -94,6 +119,25 @@ std::string getUserInputToken();
  */
 int generateRandomNumber(int low, int high);
 
+/*!
+ * @brief Get the random engine shared by the calling thread.
+ * @details generateRandomNumber and the room generators draw from this engine, so seeding it makes floor generation reproducible.
+ * @return A reference to the calling thread's random engine.
+ */
+std::mt19937 &randomEngine();
+
+/*!
+ * @brief Seed the calling thread's random engine.
+ * @param seed The seed to use. The same seed always reproduces the same sequence of random numbers.
+ */
+void seedRandom(unsigned int seed);
+
+/*!
+ * @brief Reseed the calling thread's random engine from std::random_device.
+ * @details Used after a seeded generation pass so that gameplay randomness is not predictable from the floor seed.
+ */
+void reseedRandom();
+
 /*!
  * @brief Convert a string to an integer.
  * @param str The string to convert.
@@ -118,9 +162,10 @@ std::string toLowerCase(const std::string &str);
 
 /*!
  * @brief Read an integer from user input.
+ * @param prompted Called after each prompt, before the answer is read.
  * @return The integer value entered by the user.
  */
-int readInt();
+int readInt(const std::function<void()> &prompted = nullptr);
 
 /*!
  * @brief Disable user input.
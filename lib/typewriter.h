@@ -0,0 +1,121 @@
+/*!
+ * @file typewriter.h
+ * @brief Defines the Typewriter class for the Valeris game.
+ * @details This file contains the declaration of the Typewriter class, which animates text one character at a time
+ * on the timer thread so the calling thread stays free, and which the player can skip with a keypress.
+ */
+
+#ifndef TYPEWRITER_H
+#define TYPEWRITER_H
+
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "../lib/timer.h"
+#include "../lib/console.h"
+
+/*!
+ * @class Typewriter
+ * @brief Timed text animation written in batches.
+ * @details Text is queued as segments, each with its own per-character delay and colour. Once started, the timer
+ * thread wakes at most once per frame, writes every character that has become due since the last frame in one
+ * batch and presents the renderer's frame. Nothing else may write to the output stream until the animation is done,
+ * but the starting thread can do other work (such as generating the dungeon) in the meantime.
+ */
+class Typewriter
+{
+public:
+    /*!
+     * @brief Constructor for the Typewriter class.
+     * @param out The stream to write to.
+     * @param frameMs The shortest time between batches.
+     */
+    explicit Typewriter(std::ostream &out = console().out(), int frameMs = 33);
+
+    /*!
+     * @brief Destructor for the Typewriter class. Writes any remaining text at once.
+     */
+    ~Typewriter();
+
+    /*!
+     * @brief Queues text to animate.
+     * @param text The text.
+     * @param msPerChar The delay before each character. 0 writes the text in one go.
+     * @param color A colour sequence written before the text, or empty. Coloured text is followed by "\033[37m".
+     */
+    void append(const std::string &text, int msPerChar, const std::string &color = "");
+
+    /*!
+     * @brief Starts animating the queued text on the timer thread.
+     */
+    void start();
+
+    /*!
+     * @brief Writes all remaining text immediately.
+     */
+    void skip();
+
+    /*!
+     * @brief Checks whether all queued text has been written.
+     * @return True once the animation has finished or been skipped.
+     */
+    bool done();
+
+    /*!
+     * @brief Blocks until the animation finishes.
+     * @param skipOnKey If true and input is a terminal, a keypress completes the text at once.
+     */
+    void wait(bool skipOnKey = true);
+
+    /*!
+     * @brief Gets the number of batches written.
+     * @return How many separate writes the animation has made.
+     */
+    size_t batches();
+
+private:
+    /*!
+     * @struct Segment
+     * @brief Text with its timing and colour.
+     */
+    struct Segment
+    {
+        std::string text;  //!< The characters to write.
+        int msPerChar;     //!< Delay before each character.
+        std::string color; //!< Colour sequence, or empty.
+    };
+
+    /*!
+     * @struct State
+     * @brief Animation state shared with timer callbacks, so a late callback never outlives it.
+     */
+    struct State
+    {
+        std::ostream *out;                           //!< Where text is written.
+        int frameMs;                                 //!< Shortest time between batches.
+        std::mutex mutex;                            //!< Guards every field below.
+        std::condition_variable finished;            //!< Signalled when the animation completes.
+        std::vector<Segment> segments;               //!< Queued text.
+        size_t segment = 0;                          //!< Segment being written.
+        size_t offset = 0;                           //!< Characters of the current segment already written.
+        TimerQueue::Clock::time_point segmentStart;  //!< When the current segment's first character was due.
+        bool started = false;                        //!< Whether start has been called.
+        bool complete = false;                       //!< Whether all text has been written.
+        TimerQueue::TimerId timer = 0;               //!< The pending frame timer.
+        size_t batches = 0;                          //!< Number of batches written.
+    };
+
+    /*!
+     * @brief Writes everything due by a time and schedules the next frame.
+     * @param state The animation.
+     * @param all True to write all remaining text regardless of time.
+     */
+    static void advance(const std::shared_ptr<State> &state, bool all);
+
+    std::shared_ptr<State> state; //!< The animation.
+};
+
+#endif // TYPEWRITER_H
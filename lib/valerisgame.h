@@ -6,8 +6,12 @@
 
 #include "toolkit.h"
 #include "player.h"
-#include "dungeon.h"
+#include "floortemplate.h"
+#include "sharedworld.h"
+#include "screen.h"
+#include "commands.h"
 #include "dependencies.h"
+#include <memory>
 
 /*!
  * @class ValerisGame
@@ -19,21 +23,156 @@ class ValerisGame
 {
 private:
     Player player;     //!< The player object representing the player in the game.
-    Dungeon dungeon;   //!< The dungeon object representing the dungeon environment.
-    Room *currentRoom; //!< Pointer to the current room in the dungeon.
+    std::unique_ptr<FloorOverlay> floor; //!< The player's view of the dungeon floor, or nullptr while hibernating.
+    const Room *currentRoom; //!< Pointer to the current room in the dungeon. Changing it goes through changeRoom.
     int numRooms;      //!< The number of rooms in the dungeon.
+    Screen screen;     //!< Redraws only the parts of the exploration view that changed between moves.
+    Console &io;       //!< The session's input and output, bound to the thread while the game runs.
+    CommandRegistry commands; //!< The actions the player can type in the exploration view.
+    CommandQueue queued;      //!< Steps from chained input and macros still to run.
+    std::string color;        //!< The text colour chosen in the menu.
+    bool exploring;           //!< Whether the exploration loop should keep going.
+    bool moved;               //!< Whether the last action only moved (or tried to move) the player, so the next view can be diffed against this one.
+    bool interrupted;         //!< Whether something happened that should stop the rest of a chain, such as walking into enemies.
+    int numVisitedRooms;      //!< The number of rooms the player has entered.
+    std::string hibernatedPath; //!< The file holding the game while it hibernates, empty while it is awake.
+    bool sharedFloor;           //!< Whether the floor's template is shared with other games.
+    std::shared_ptr<SharedWorld> world;      //!< The world the game plays in, or nullptr if its floor is its own.
+    std::unique_ptr<SharedWorld::Member> member; //!< The player in the world, once they have a name.
+    std::unique_ptr<Game> borrowed;          //!< The copy of a mini-game being played in a shared world.
+
+    /*!
+     * @brief Adds the game's actions to the command registry.
+     */
+    void registerCommands();
+
+    /*!
+     * @brief Moves the player through a door unless enemies block the way.
+     * @param next The room behind the door, or nullptr if there is no door.
+     * @param direction The direction's name, for the message when there is no door.
+     */
+    void move(const Room *next, const std::string &direction);
+
+    /*!
+     * @brief Gets the current room for a change.
+     * @return The content of the player's own copy of the room, so the floor's template is never changed.
+     */
+    RoomContent &changeRoom();
+
+    /*!
+     * @brief Gets a mini-game to play.
+     * @param game The room's game.
+     * @return The game itself, or a copy of it in a shared world.
+     */
+    Game *playable(Game *game);
+
+    /*!
+     * @brief Tells the other players in the room what the player has done.
+     * @param message The message.
+     */
+    void announce(const std::string &message);
+
+    /*!
+     * @brief Prints the messages other players have sent to this one.
+     */
+    void showMessages();
+
+    /*!
+     * @brief Reads the next line from the player and queues it.
+     * @details Draws the exploration view first. Lines that define macros are handled here and another line is read.
+     */
+    void readActions();
+
+    /*!
+     * @brief Waits for the player's next input, hibernating if none comes for the configured time.
+     * @details Returns once input has arrived, with the game awake again.
+     */
+    void waitForPlayer();
+
+    /*!
+     * @brief Writes the game to disk and frees the dungeon and the screen.
+     * @details If the state cannot be written the game stays awake.
+     */
+    void hibernate();
+
+    /*!
+     * @brief Restores a hibernating game from its file.
+     */
+    void wake();
+
+    /*!
+     * @brief Shows a one-line message below the view for a moment and then removes it.
+     * @param message The message to show.
+     * @param milliseconds How long to show it for.
+     */
+    void notice(const std::string &message, int milliseconds);
+
+    /*!
+     * @brief Runs the exploration loop on the bound console.
+     * @param color the color of the text
+     */
+    void play(const std::string &color);
 
 public:
     /*!
      * @brief Constructor for the ValerisGame class.
      * @details Initializes the player, dungeon, and other game-related entities.
+     * @param io The session's input and output. It must outlive the game.
      */
-    ValerisGame();
+    explicit ValerisGame(Console &io = Console::standard());
+
+    /*!
+     * @brief Destructor for the ValerisGame class. Deletes the game's file if it is hibernating.
+     */
+    ~ValerisGame();
+
+    ValerisGame(const ValerisGame &) = delete;
+    ValerisGame &operator=(const ValerisGame &) = delete;
 
     /*!
      * @brief Starts the game.
      * @param color the color of the text
      * @details This method begins the game loop, allowing the player to explore the dungeon and interact with the environment.
+     * All game input and output goes through the game's console, so games on different threads do not share streams.
+     * The game ends early if the console's input closes.
      */
     void start(const std::string &color);
+
+    /*!
+     * @brief Gets the actions the player can type.
+     * @return The registry, so new commands can be added before the game starts.
+     */
+    CommandRegistry &getCommands();
+
+    /*!
+     * @brief Gets the queue of chained steps and the player's macros.
+     * @return The queue, so macros can be defined before the game starts.
+     */
+    CommandQueue &getQueue();
+
+    /*!
+     * @brief Records everything needed to carry on the game.
+     * @return A compact binary record: the floor's seed and the player's changes to it, the current room, the player
+     * and the macros. A hibernating game is woken first.
+     */
+    std::string saveState();
+
+    /*!
+     * @brief Replaces the game with one recorded by saveState.
+     * @param state The record.
+     * @return False if the record is malformed, in which case the game is unchanged.
+     * @details The floor is regenerated from its seed and the recorded changes are reapplied to it.
+     */
+    bool restoreState(const std::string &state);
+
+    /*!
+     * @brief Carries on a game restored by restoreState, in the colour it was played in.
+     */
+    void resume();
+
+    /*!
+     * @brief Checks whether the game is hibernating.
+     * @return True while its state is on disk and its dungeon is freed.
+     */
+    bool isHibernating() const;
 };
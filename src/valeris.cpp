@@ -12,21 +12,159 @@
 #include "../lib/room.h"
 #include "../lib/dungeon.h"
 #include "../lib/menu.h"
+#include "../lib/renderer.h"
+#include "../lib/headless.h"
+#include "../lib/server.h"
+#include "../lib/hibernation.h"
+#include "../lib/floortemplate.h"
+#include "../lib/sharedworld.h"
+#include <cstdlib>
+#include <cstring>
+#ifdef __linux__
+#include <signal.h>
+#endif
 
 /*!
  * @brief Main function of the game.
  * @details The main function initializes the game, sets up the console or terminal,
  * and displays the main menu. It also handles user input and navigates to different game functionalities.
+ * Passing --headless runs the game with no terminal output at all, and --headless=text writes plain text without
+ * colours or cursor movement; both skip every delay and exit when standard input ends.
+ * Passing --serve runs a game server instead of a local game: "--serve 4000" listens on TCP port 4000 of the local
+ * machine and "--serve unix:/tmp/valeris.sock" on a Unix socket, where players connect with telnet, nc or socat.
+ * --workers N sets the number of threads running sessions and --compress offers MCCP compression.
+ * --hibernate MINUTES writes a game whose player has typed nothing for that long to disk until they type again, in the
+ * directory given by --hibernate-dir (the current one by default).
+ * --event-seed N starts every player on the same floor, generated once from seed N and shared between their games.
+ * --shared-world N puts every player in one world generated from seed N, where they see each other and what the others
+ * have done.
+ * --spectators PORT, or --spectators unix:PATH, accepts spectators there, who choose a live session by its number and
+ * watch it without being able to type into it.
+ * For a rolling upgrade, start the old server with --handoff-to unix:PATH and the new one, on the same port, with
+ * --accept-handoff unix:PATH. Sending the old server SIGUSR1 hands every live session to the new one, whose players
+ * stay connected, and the old server then exits.
  *
+ * @param argc The number of command line arguments.
+ * @param argv The command line arguments.
  * @return Returns 0 upon successful execution.
  */
-int main()
+int main(int argc, char *argv[])
 {
-  int j;               //!< Stores the user's menu selection.
-  bool running = true; //!< Controls the main loop for the game.
+  std::string mode = argc > 1 ? argv[1] : ""; //!< Selects headless mode.
+  bool headless = mode == "--headless" || mode == "--headless=text";
 
-  int delayTime = 0;              //!< Delay time for displaying text.
-  std::string color = "\033[36m"; //!< Color code for text display.
+  if (mode == "--serve")
+  {
+#ifdef __linux__
+    ServerOptions options;
+    HibernationSettings hibernation;
+    std::string handoffTo;
+    for (int i = 2; i < argc; i++)
+    {
+      if (std::strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
+      {
+        options.workers = std::atoi(argv[++i]);
+      }
+      else if (std::strcmp(argv[i], "--compress") == 0)
+      {
+        options.compression = true;
+      }
+      else if (std::strcmp(argv[i], "--hibernate") == 0 && i + 1 < argc)
+      {
+        hibernation.idleMilliseconds = (int)(std::atof(argv[++i]) * 60000);
+      }
+      else if (std::strcmp(argv[i], "--hibernate-dir") == 0 && i + 1 < argc)
+      {
+        hibernation.directory = argv[++i];
+      }
+      else if (std::strcmp(argv[i], "--event-seed") == 0 && i + 1 < argc)
+      {
+        setEventSeed((unsigned int)std::strtoul(argv[++i], nullptr, 10));
+      }
+      else if (std::strcmp(argv[i], "--shared-world") == 0 && i + 1 < argc)
+      {
+        setSharedWorld(std::make_shared<SharedWorld>((unsigned int)std::strtoul(argv[++i], nullptr, 10), 20));
+      }
+      else if (std::strcmp(argv[i], "--spectators") == 0 && i + 1 < argc)
+      {
+        const char *where = argv[++i];
+        if (std::strncmp(where, "unix:", 5) == 0)
+        {
+          options.spectatorUnixPath = where + 5;
+        }
+        else
+        {
+          options.spectatorPort = std::atoi(where);
+        }
+      }
+      else if (std::strcmp(argv[i], "--accept-handoff") == 0 && i + 1 < argc)
+      {
+        const char *where = argv[++i];
+        options.handoffPath = std::strncmp(where, "unix:", 5) == 0 ? where + 5 : where;
+        options.sharePort = true;
+      }
+      else if (std::strcmp(argv[i], "--handoff-to") == 0 && i + 1 < argc)
+      {
+        const char *where = argv[++i];
+        handoffTo = std::strncmp(where, "unix:", 5) == 0 ? where + 5 : where;
+        options.sharePort = true;
+      }
+      else if (std::strncmp(argv[i], "unix:", 5) == 0)
+      {
+        options.unixPath = argv[i] + 5;
+      }
+      else
+      {
+        options.port = std::atoi(argv[i]);
+      }
+    }
+    setHibernation(hibernation);
+    // Blocked before any thread starts, so every thread leaves SIGUSR1 to sigwait
+    sigset_t handoffSignal;
+    sigemptyset(&handoffSignal);
+    sigaddset(&handoffSignal, SIGUSR1);
+    if (!handoffTo.empty())
+    {
+      pthread_sigmask(SIG_BLOCK, &handoffSignal, nullptr);
+    }
+    GameServer server(options);
+    if (!server.start())
+    {
+      return 1;
+    }
+    std::cout << "Valeris server listening on "
+              << (options.unixPath.empty() ? options.host + ":" + std::to_string(server.port()) : options.unixPath)
+              << " with " << options.workers << " workers" << std::endl;
+    if (handoffTo.empty())
+    {
+      server.wait();
+      return 0;
+    }
+    int signal = 0;
+    sigwait(&handoffSignal, &signal);
+    int handedOff = server.handOff(handoffTo);
+    if (handedOff >= 0)
+    {
+      std::cout << "Handed " << handedOff << " sessions off to " << handoffTo << std::endl;
+    }
+    server.stop();
+    return handedOff >= 0 ? 0 : 1;
+#else
+    std::cerr << "Server mode is only available on Linux." << std::endl;
+    return 1;
+#endif
+  }
+
+  Renderer renderer;                                                      //!< Collects each frame of output and writes it to the terminal in one call.
+  HeadlessSink sink(mode == "--headless=text" ? std::cout.rdbuf() : nullptr); //!< Replaces the renderer in headless mode.
+  if (headless)
+  {
+    sink.install();
+  }
+  else
+  {
+    renderer.install();
+  }
 
 #ifdef _WIN32
   SetConsoleSize(1200, 600);
@@ -37,45 +175,18 @@ int main()
   /*!
    * @brief Main game loop.
    * @details This loop keeps the game running until the user chooses to exit.
-   * Depending on the user's input, it can start a new game, load a saved game,
-   * display instructions, or modify accessibility settings.
+   * Depending on the user's input, it can start a new game, display instructions, or modify accessibility settings.
    */
-  while (running)
-  {
-    Displayj();    //!< Display the main menu.
-    j = readInt(); //!< Read user's menu selection.
-
-    switch (j)
-    {
-    case 1:
-      clear(10);
-      displayIntro(delayTime, color); //!< Display the game introduction.
-      StartGame(color);               //!< Start a new game.
-      break;
-    // case 2:
-    //   clear(10);
-    //   LoadSavedGame(); //!< Load a previously saved game.
-    //   break;
-    case 2:
-      clear(11);
-      DisplayInstructionsText(); //!< Display the instructions for the game.
-      break;
-    case 3:
-      clear(10);
-      Accessiblity(delayTime, color); //!< Access and modify accessibility options.
-      break;
-    case 4:
-      std::cout << "Exiting Game. We hope you enjoyed the Game Play." << std::endl;
-      running = false; //!< Exit the game loop.
-      break;
-    default:
-      std::cout << "Error: An invalid choice has been entered. Please try again." << std::endl;
-      delay(2000);
-      clear(12);
-      break;
-    }
+  RunMainMenu();
 
-    std::cout << std::endl;
+  sink.uninstall();
+  renderer.uninstall();
+  if (!headless && std::getenv("VALERIS_RENDER_STATS"))
+  {
+    const FrameStats &stats = renderer.getStats();
+    std::cerr << "frames: " << stats.frames << ", bytes: " << stats.bytes << " (" << stats.rawBytes << " before coalescing)"
+              << ", syscalls: " << stats.syscalls
+              << ", largest frame: " << stats.largestFrameBytes << " bytes" << std::endl;
   }
 
   return 0;
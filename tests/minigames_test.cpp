@@ -15,7 +15,27 @@
 #include "../lib/weapon.h"
 #include "../lib/enemies.h"
 #include "../lib/menu.h"
+#include "../lib/handoff.h"
+#include "../lib/framefeed.h"
+#include "../lib/sharedworld.h"
+#include "../lib/floortemplate.h"
+#include "../lib/hibernation.h"
+#include "../lib/scheduler.h"
+#include "../lib/commands.h"
+#include "../lib/keyreader.h"
+#include "../lib/eventloop.h"
+#include "../lib/compression.h"
+#include "../lib/ansifilter.h"
+#include "../lib/valerisgame.h"
+#include "../lib/headless.h"
+#include "../lib/typewriter.h"
+#include "../lib/timer.h"
+#include "../lib/screen.h"
+#include "../lib/renderer.h"
+#include "../lib/floorexport.h"
 #include <algorithm>
+#include <atomic>
+#include <ctime>
 #include <cctype>
 #include <regex>
 #include <cassert>
@@ -24,6 +44,16 @@
 
 #include "custom_test_framework.h"
 #include <sstream>
+#include <thread>
+#ifndef _WIN32
+#include <sys/socket.h>
+#endif
+#ifdef __linux__
+#include "../lib/server.h"
+#include <cstring>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
 
 // void testTicTacToeInitialization()
 // {
@@ -1405,6 +1435,2204 @@ void testOneDirection()
     // Expect "You can move: North"
     ASSERT_EQUAL("You can move: North\n", result);
 }
+// Seeded floor tests
+void testSeededFloorIsReproducible()
+{
+    Dungeon first(1234);
+    Dungeon second(1234);
+    Room *firstStart = first.generateFloor(20);
+    Room *secondStart = second.generateFloor(20);
+
+    ASSERT_EQUAL(firstStart->id, secondStart->id);
+    ASSERT_EQUAL(first.getRooms().size(), second.getRooms().size());
+    for (size_t i = 0; i < first.getRooms().size(); i++)
+    {
+        RoomContent &a = first.getRooms()[i]->roomContent;
+        RoomContent &b = second.getRooms()[i]->roomContent;
+        ASSERT(a.getCoordinates() == b.getCoordinates());
+        ASSERT_EQUAL(a.getRoomType(), b.getRoomType());
+        ASSERT_EQUAL(a.getRoomDesc(), b.getRoomDesc());
+        ASSERT(a.getItems() == b.getItems());
+    }
+}
+
+// Floor analytics tests
+void testFloorAnalyticsTree()
+{
+    FloorAnalytics analytics;
+    for (int i = 0; i < 4; i++)
+    {
+        analytics.onRoomAdded(i);
+    }
+    // A corridor running east: 0 - 1 - 2 - 3
+    analytics.onLink(0, 1, 3);
+    analytics.onLink(1, 2, 3);
+    analytics.onLink(2, 3, 3);
+
+    // Each room lengthened the corridor from one end, so it became the new end without a recompute
+    ASSERT(!analytics.needsRecompute());
+    FloorStats stats = analytics.getStats();
+    ASSERT_EQUAL(4, stats.roomCount);
+    ASSERT_EQUAL(3, stats.linkCount);
+    ASSERT_EQUAL(3, stats.diameter);
+    ASSERT_EQUAL(2, stats.deadEnds);
+    ASSERT_EQUAL(2, stats.articulationPoints);
+    ASSERT(stats.diameterExact);
+}
+
+void testFloorAnalyticsLoop()
+{
+    FloorAnalytics analytics;
+    for (int i = 0; i < 4; i++)
+    {
+        analytics.onRoomAdded(i);
+    }
+    // A 2x2 square: 0 (0,0), 1 (1,0), 2 (1,1), 3 (0,1)
+    analytics.onLink(0, 1, 3);
+    analytics.onLink(1, 2, 0);
+    analytics.onLink(2, 3, 2);
+    analytics.onLink(3, 0, 1);
+
+    ASSERT(analytics.needsRecompute());
+    FloorStats stats = analytics.getStats();
+    ASSERT_EQUAL(4, stats.linkCount);
+    ASSERT_EQUAL(2, stats.diameter);
+    ASSERT_EQUAL(0, stats.deadEnds);
+    ASSERT_EQUAL(0, stats.articulationPoints);
+    ASSERT(!analytics.needsRecompute());
+}
+
+void testFloorAnalyticsLargeFloorExact()
+{
+    // Limits of 0 and 100 send the same floor through iFUB and through a BFS from every room
+    FloorAnalytics bounded(0);
+    FloorAnalytics everyRoom(100);
+    const int side = 6;
+    for (int i = 0; i < side * side; i++)
+    {
+        bounded.onRoomAdded(i);
+        everyRoom.onRoomAdded(i);
+    }
+    // A 6x6 grid with every door open except a wall splitting the bottom row
+    for (int y = 0; y < side; y++)
+    {
+        for (int x = 0; x < side; x++)
+        {
+            int id = y * side + x;
+            if (x + 1 < side && !(y == 0 && x == 2))
+            {
+                bounded.onLink(id, id + 1, 3);
+                everyRoom.onLink(id, id + 1, 3);
+            }
+            if (y + 1 < side)
+            {
+                bounded.onLink(id, id + side, 0);
+                everyRoom.onLink(id, id + side, 0);
+            }
+        }
+    }
+
+    FloorStats stats = bounded.getStats();
+    ASSERT_EQUAL(everyRoom.getStats().diameter, stats.diameter);
+    ASSERT_EQUAL(10, stats.diameter);
+    ASSERT(stats.diameterExact);
+}
+
+void testDungeonStatsMatchFloor()
+{
+    Dungeon dungeon(99);
+    Room *startRoom = dungeon.generateFloor(30);
+    FloorStats stats = dungeon.getStats();
+
+    ASSERT_EQUAL(dungeon.numRooms(startRoom), stats.roomCount);
+    ASSERT(stats.diameter > 0);
+    ASSERT(stats.averageDegree >= 2.0 * (stats.roomCount - 1) / stats.roomCount);
+}
+
+// Floor export tests
+void testExportFloorJson()
+{
+    Dungeon dungeon(7);
+    dungeon.generateFloor(12);
+    ASSERT(exportFloor(dungeon, "floor_export_test.tmp", "json"));
+
+    std::vector<std::string> lines = split(getFileContent("floor_export_test.tmp"), '\n');
+    std::remove("floor_export_test.tmp");
+    ASSERT_EQUAL(12, lines.size());
+    ASSERT_EQUAL(0, lines[0].find("{\"id\":0,\"x\":0,\"y\":0,\"type\":\""));
+    ASSERT(lines[0].find("\"links\":{") != std::string::npos);
+}
+
+void testExportFloorDot()
+{
+    Dungeon dungeon(7);
+    dungeon.generateFloor(12);
+    ASSERT(exportFloor(dungeon, "floor_export_test.tmp", "dot"));
+
+    std::string dot = getFileContent("floor_export_test.tmp");
+    std::remove("floor_export_test.tmp");
+    ASSERT_EQUAL(0, dot.find("graph floor {"));
+    ASSERT(dot.find("r11 [pos=") != std::string::npos);
+    ASSERT(dot.find(" -- r") != std::string::npos);
+    ASSERT(!exportFloor(dungeon, "floor_export_test.tmp", "xml"));
+}
+
+void testBufferedWriterEscapes()
+{
+    std::FILE *file = std::fopen("writer_test.tmp", "wb");
+    {
+        BufferedWriter writer(file, 64);
+        std::string text = "say \"hi\"\\\n";
+        for (int i = 0; i < 20; i++)
+        {
+            writer.writeEscaped(text.data(), text.size());
+        }
+        writer.writeInt(-42);
+        ASSERT_EQUAL(20 * 14 + 3, writer.bytesWritten());
+    }
+    std::fclose(file);
+    std::string written = getFileContent("writer_test.tmp");
+    std::remove("writer_test.tmp");
+    ASSERT_EQUAL(0, written.find("say \\\"hi\\\"\\\\\\nsay"));
+    ASSERT(written.find("-42") != std::string::npos);
+}
+
+void testRoomIndexNearestMatchesScan()
+{
+    Dungeon dungeon(7u);
+    dungeon.generateFloor(300);
+    const RoomIndex &index = dungeon.getIndex();
+    ASSERT_EQUAL((size_t)300, index.size());
+
+    RoomQuery query;
+    query.roomType = 1;
+    std::vector<Room *> found = index.nearest(3, -2, 5, query);
+
+    std::vector<long long> expected;
+    for (Room *room : dungeon.getRooms())
+    {
+        if (room->roomContent.getRoomType() == 1)
+        {
+            std::pair<int, int> cords = room->roomContent.getCoordinates();
+            long long dx = cords.first - 3, dy = cords.second + 2;
+            expected.push_back(dx * dx + dy * dy);
+        }
+    }
+    std::sort(expected.begin(), expected.end());
+    ASSERT_EQUAL(std::min((size_t)5, expected.size()), found.size());
+    for (size_t i = 0; i < found.size(); i++)
+    {
+        std::pair<int, int> cords = found[i]->roomContent.getCoordinates();
+        long long dx = cords.first - 3, dy = cords.second + 2;
+        ASSERT_EQUAL(expected[i], dx * dx + dy * dy);
+        ASSERT_EQUAL(1, found[i]->roomContent.getRoomType());
+    }
+}
+
+void testRoomIndexFiltersFollowRoomState()
+{
+    Dungeon dungeon(11u);
+    Room *start = dungeon.generateFloor(120);
+    const RoomIndex &index = dungeon.getIndex();
+    std::pair<int, int> startCords = start->roomContent.getCoordinates();
+    ASSERT(index.at(startCords.first, startCords.second) == start);
+
+    RoomQuery query;
+    query.roomType = 0;
+    query.filters = WithEnemies;
+    std::vector<Room *> before = index.withinRadius(0, 0, 20, query);
+    size_t scanned = 0;
+    for (Room *room : dungeon.getRooms())
+    {
+        std::pair<int, int> cords = room->roomContent.getCoordinates();
+        if (room->roomContent.getRoomType() == 0 && !room->roomContent.getEnemies().empty() &&
+            cords.first * cords.first + cords.second * cords.second <= 400)
+        {
+            scanned++;
+        }
+    }
+    ASSERT_EQUAL(scanned, before.size());
+    if (!before.empty())
+    {
+        before[0]->roomContent.clearEnemies();
+        ASSERT_EQUAL(before.size() - 1, index.withinRadius(0, 0, 20, query).size());
+    }
+
+    RoomQuery unvisited;
+    unvisited.filters = Unvisited;
+    size_t all = index.inRect(-1000, -1000, 1000, 1000, unvisited).size();
+    ASSERT_EQUAL((size_t)120, all);
+    start->roomContent.setVisited(true);
+    ASSERT_EQUAL((size_t)119, index.inRect(-1000, -1000, 1000, 1000, unvisited).size());
+    ASSERT_EQUAL((size_t)1, index.inRect(startCords.first, startCords.second, startCords.first, startCords.second).size());
+}
+
+static Room *placeRoom(std::vector<Room *> &rooms, int x, int y)
+{
+    Room *room = new Room();
+    room->roomContent.addCoordinates(x, y);
+    rooms.push_back(room);
+    return room;
+}
+
+void testFogOfWarWallsBlockSight()
+{
+    std::vector<Room *> rooms;
+    Room *origin = placeRoom(rooms, 0, 0);
+    Room *east1 = placeRoom(rooms, 1, 0);
+    Room *east2 = placeRoom(rooms, 2, 0);
+    Room *east3 = placeRoom(rooms, 3, 0);
+    Room *north = placeRoom(rooms, 0, 1);
+    Room *northEast = placeRoom(rooms, 1, 1);
+    Room *corner = placeRoom(rooms, 1, -1);
+    Room *behindCorner = placeRoom(rooms, 0, -1);
+    placeRoom(rooms, -1, 0); // Walled off from the origin
+
+    origin->east = east1;
+    east1->west = origin;
+    east1->east = east2;
+    east2->west = east1;
+    east2->east = east3;
+    east3->west = east2;
+    origin->north = north;
+    north->south = origin;
+    north->east = northEast;
+    northEast->west = north;
+    east1->south = corner;
+    corner->north = east1;
+    corner->west = behindCorner;
+    behindCorner->east = corner;
+
+    FogOfWar fog(2);
+    fog.build(rooms);
+    fog.moveTo(0, 0);
+    ASSERT(fog.isVisible(0, 0));
+    ASSERT(fog.isVisible(2, 0));
+    ASSERT(!fog.isVisible(3, 0));
+    ASSERT(fog.isVisible(1, 1));
+    ASSERT(fog.isVisible(1, -1));
+    ASSERT(!fog.isVisible(0, -1));
+    ASSERT(!fog.isVisible(-1, 0));
+    ASSERT_EQUAL(6, fog.visibleCount());
+
+    fog.moveTo(3, 0);
+    ASSERT(!fog.isVisible(0, 0));
+    ASSERT(fog.isExplored(0, 0));
+    ASSERT(fog.isVisible(3, 0));
+    ASSERT(!fog.isExplored(0, -1));
+
+    for (Room *room : rooms)
+    {
+        delete room;
+    }
+}
+
+void testFogOfWarCrossesWords()
+{
+    std::vector<Room *> rooms;
+    for (int x = 0; x < 200; x++)
+    {
+        placeRoom(rooms, x, 0);
+        if (x > 0)
+        {
+            rooms[x - 1]->east = rooms[x];
+            rooms[x]->west = rooms[x - 1];
+        }
+    }
+
+    FogOfWar fog(70);
+    fog.build(rooms);
+    fog.moveTo(60, 0);
+    ASSERT_EQUAL(131, fog.visibleCount());
+    ASSERT(fog.isVisible(0, 0));
+    ASSERT(fog.isVisible(130, 0));
+    ASSERT(!fog.isVisible(131, 0));
+
+    for (Room *room : rooms)
+    {
+        delete room;
+    }
+}
+
+void testDungeonMapUsesFog()
+{
+    Dungeon dungeon(5u);
+    Room *start = dungeon.generateFloor(50);
+    dungeon.getMap(start);
+    std::pair<int, int> cords = start->roomContent.getCoordinates();
+    ASSERT(dungeon.getFog().isVisible(cords.first, cords.second));
+    ASSERT(dungeon.getFog().isExplored(cords.first, cords.second));
+}
+
+void testRendererSingleWritePerFrame()
+{
+    int fds[2];
+    ASSERT(pipe(fds) == 0);
+    Renderer renderer(fds[1]);
+    std::ostream out(&renderer);
+    out << "map" << std::endl;
+    out << "desc" << std::flush;
+    out << "prompt";
+    ASSERT_EQUAL((unsigned long long)0, renderer.getStats().syscalls);
+    size_t expected = renderer.pending();
+
+    ASSERT(renderer.present());
+    ASSERT_EQUAL(1, renderer.getStats().lastFrameSyscalls);
+    ASSERT_EQUAL(expected, renderer.getStats().lastFrameBytes);
+    ASSERT_EQUAL((size_t)0, renderer.pending());
+
+    char buffer[256];
+    ssize_t got = read(fds[0], buffer, sizeof(buffer));
+    ASSERT_EQUAL(std::string("map\ndescprompt"), std::string(buffer, got));
+    close(fds[0]);
+    close(fds[1]);
+}
+
+void testRendererPresentsBeforeInput()
+{
+    int fds[2];
+    ASSERT(pipe(fds) == 0);
+    std::streambuf *originalCout = std::cout.rdbuf();
+    {
+        Renderer renderer(fds[1]);
+        renderer.install();
+        ASSERT(Renderer::active() == &renderer);
+        std::cout << "Enter Action : " << std::flush;
+        std::cout << std::endl;
+        ASSERT_EQUAL((unsigned long long)0, renderer.getStats().frames);
+        std::cin.tie()->flush();
+        ASSERT_EQUAL((unsigned long long)1, renderer.getStats().frames);
+        ASSERT_EQUAL((unsigned long long)1, renderer.getStats().syscalls);
+        renderer.uninstall();
+        ASSERT(Renderer::active() == nullptr);
+    }
+    ASSERT(std::cout.rdbuf() == originalCout);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// Applies cursor movement, erase-line and text to a plain list of lines, ignoring colours
+static void emulateTerminal(std::vector<std::string> &lines, int &row, int &col, const std::string &bytes)
+{
+    for (size_t i = 0; i < bytes.size(); i++)
+    {
+        if (lines.size() <= (size_t)row)
+        {
+            lines.resize(row + 1);
+        }
+        char c = bytes[i];
+        if (c == '\033')
+        {
+            size_t end = i + 2;
+            while (!isalpha((unsigned char)bytes[end]))
+            {
+                end++;
+            }
+            std::string params = bytes.substr(i + 2, end - i - 2);
+            int n = params.empty() ? 1 : std::max(1, atoi(params.c_str()));
+            switch (bytes[end])
+            {
+            case 'A':
+                row -= n;
+                break;
+            case 'B':
+                row += n;
+                break;
+            case 'G':
+                col = n - 1;
+                break;
+            case 'K':
+                if (params == "2")
+                {
+                    lines[row].clear();
+                }
+                else if ((int)lines[row].size() > col)
+                {
+                    lines[row].resize(col);
+                }
+                break;
+            }
+            i = end;
+        }
+        else if (c == '\n')
+        {
+            row++;
+            col = 0;
+        }
+        else if (c == '\r')
+        {
+            col = 0;
+        }
+        else
+        {
+            if ((int)lines[row].size() <= col)
+            {
+                lines[row].resize(col + 1, ' ');
+            }
+            lines[row][col++] = c;
+        }
+    }
+    if (lines.size() <= (size_t)row)
+    {
+        lines.resize(row + 1);
+    }
+}
+
+static std::string trimRight(std::string line)
+{
+    while (!line.empty() && line.back() == ' ')
+    {
+        line.pop_back();
+    }
+    return line;
+}
+
+void testScreenDiffMatchesFullDraw()
+{
+    Screen screen(40);
+    std::vector<std::string> lines;
+    int row = 0, col = 0;
+    const char *frames[] = {
+        "\033[37m+ - - +\n| X * |\n+ - - +\n\n\033[36mA room.\n\nEnter Action : ",
+        "\033[37m+ - - +\n| * X |\n+ - - +\n\n\033[36mA room with a safe.\n\nEnter Action : ",
+        "\033[37m+ - - +\n| * * |\n+ - - +\n\n\033[36mA room.\n\nEnter Action : ",
+    };
+
+    size_t firstBytes = 0;
+    for (int f = 0; f < 3; f++)
+    {
+        screen.begin();
+        screen.draw(frames[f]);
+        std::string bytes = screen.present();
+        if (f == 0)
+        {
+            firstBytes = bytes.size();
+        }
+        else
+        {
+            ASSERT(bytes.size() < firstBytes);
+        }
+        emulateTerminal(lines, row, col, bytes);
+
+        std::vector<std::string> expected = split(std::regex_replace(frames[f], std::regex("\033\\[[0-9;]*m"), ""), '\n');
+        for (size_t i = 0; i < expected.size(); i++)
+        {
+            ASSERT_EQUAL(trimRight(expected[i]), trimRight(lines[i]));
+        }
+        ASSERT_EQUAL((int)expected.size() - 1, row);
+        ASSERT_EQUAL((int)expected.back().size(), col);
+
+        // The player types a move and the game prints a blank line
+        emulateTerminal(lines, row, col, "n\n\n");
+        screen.inputLine();
+        screen.written("\n");
+    }
+
+    // Nothing changed, so only the cursor has to move back up to the prompt
+    screen.begin();
+    screen.draw(frames[2]);
+    std::string bytes = screen.present();
+    ASSERT(bytes.find("Enter") == std::string::npos);
+    emulateTerminal(lines, row, col, bytes);
+    ASSERT_EQUAL(std::string("Enter Action :"), trimRight(lines[6]));
+    ASSERT_EQUAL(std::string(""), trimRight(lines[7]));
+}
+
+void testScreenInvalidateRedraws()
+{
+    Screen screen(20);
+    screen.begin();
+    screen.draw("abc");
+    std::string first = screen.present();
+    ASSERT_EQUAL(std::string("\r\033[0mabc\033[K"), first);
+
+    screen.begin();
+    screen.draw("abc");
+    ASSERT_EQUAL(std::string(""), screen.present());
+
+    screen.invalidate();
+    screen.begin();
+    screen.draw("abc");
+    ASSERT(screen.present().find("abc") != std::string::npos);
+}
+
+void testTimerQueueOrderAndCancel()
+{
+    TimerQueue queue;
+    TimerQueue::Clock::time_point start = TimerQueue::Clock::now();
+    std::string fired;
+    queue.schedule(start + std::chrono::milliseconds(30), [&]()
+                   { fired += "c"; });
+    TimerQueue::TimerId b = queue.schedule(start + std::chrono::milliseconds(20), [&]()
+                                           { fired += "b"; });
+    queue.schedule(start + std::chrono::milliseconds(10), [&]()
+                   { fired += "a"; });
+
+    ASSERT_EQUAL(10, queue.nextTimeout(start));
+    ASSERT(queue.cancel(b));
+    ASSERT(!queue.cancel(b));
+    ASSERT_EQUAL((size_t)2, queue.size());
+
+    ASSERT_EQUAL((size_t)1, queue.runDue(start + std::chrono::milliseconds(25)));
+    ASSERT_EQUAL(5, queue.nextTimeout(start + std::chrono::milliseconds(25)));
+    ASSERT_EQUAL((size_t)1, queue.runDue(start + std::chrono::milliseconds(30)));
+    ASSERT_EQUAL(std::string("ac"), fired);
+    ASSERT_EQUAL(-1, queue.nextTimeout(start));
+
+    // Cancelling many timers long before they are due rebuilds the heap without them, keeping the rest in order
+    std::vector<TimerQueue::TimerId> distant;
+    for (int i = 0; i < 100; i++)
+    {
+        distant.push_back(queue.schedule(start + std::chrono::hours(1), [&]()
+                                         { fired += "x"; }));
+    }
+    queue.schedule(start + std::chrono::milliseconds(50), [&]()
+                   { fired += "e"; });
+    queue.schedule(start + std::chrono::milliseconds(40), [&]()
+                   { fired += "d"; });
+    for (TimerQueue::TimerId id : distant)
+    {
+        ASSERT(queue.cancel(id));
+    }
+    ASSERT_EQUAL((size_t)2, queue.size());
+    ASSERT_EQUAL(10, queue.nextTimeout(start + std::chrono::milliseconds(30)));
+    ASSERT_EQUAL((size_t)2, queue.runDue(start + std::chrono::hours(2)));
+    ASSERT_EQUAL(std::string("acde"), fired);
+}
+
+void testSleepUsesNoCpu()
+{
+    std::clock_t cpuBefore = std::clock();
+    auto wallBefore = std::chrono::steady_clock::now();
+    sleepFor(200);
+    double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wallBefore).count();
+    double cpuMs = 1000.0 * (std::clock() - cpuBefore) / CLOCKS_PER_SEC;
+    ASSERT(wallMs >= 200);
+    ASSERT(cpuMs < 50);
+}
+
+void testTimerThreadRunsCallbacks()
+{
+    TimerThread timers;
+    std::atomic<int> fired(0);
+    timers.after(50, [&]()
+                 { fired += 1; });
+    TimerQueue::TimerId cancelled = timers.after(20, [&]()
+                                                 { fired += 100; });
+    timers.after(10, [&]()
+                 { fired += 10; });
+    ASSERT(timers.cancel(cancelled));
+    sleepFor(150);
+    ASSERT_EQUAL(11, fired.load());
+    ASSERT_EQUAL((size_t)0, timers.pending());
+}
+
+void testTypewriterSkipWritesEverything()
+{
+    std::stringstream out;
+    Typewriter typewriter(out);
+    typewriter.append("A long line of text", 1000, "\033[36m");
+    typewriter.append("\n", 0);
+    typewriter.start();
+    typewriter.skip();
+
+    ASSERT(typewriter.done());
+    ASSERT_EQUAL(out.str(), std::string("\033[36mA long line of text\033[37m\n"));
+    typewriter.wait(false);
+    ASSERT_EQUAL(out.str(), std::string("\033[36mA long line of text\033[37m\n"));
+}
+
+void testTypewriterBatchesToFrames()
+{
+    std::stringstream out;
+    std::string text(60, 'x');
+    Typewriter typewriter(out, 30);
+    typewriter.append(text, 2);
+    typewriter.start();
+    typewriter.wait(false);
+
+    ASSERT_EQUAL(out.str(), text);
+    ASSERT(typewriter.batches() < text.size() / 4);
+}
+
+void testTypewriterLeavesCallerFree()
+{
+    std::stringstream out;
+    Typewriter typewriter(out);
+    typewriter.append("abcdefghij", 20);
+    typewriter.start();
+
+    bool workedWhileTyping = !typewriter.done();
+    typewriter.wait(false);
+
+    ASSERT(workedWhileTyping);
+    ASSERT_EQUAL(out.str(), std::string("abcdefghij"));
+}
+
+void testHeadlessSinkStripsEscapes()
+{
+    std::stringstream captured;
+    HeadlessSink sink(captured.rdbuf());
+    std::ostream out(&sink);
+    out << "\033[36mHello\033[37m, " << "\033[A\033[2K\033" << "[Gworld" << '\n';
+
+    ASSERT_EQUAL(captured.str(), std::string("Hello, world\n"));
+    ASSERT_EQUAL(sink.forwarded(), (unsigned long long)13);
+
+    HeadlessSink null;
+    std::ostream discard(&null);
+    discard << "\033[31mgone";
+    ASSERT_EQUAL(null.received(), (unsigned long long)9);
+    ASSERT_EQUAL(null.forwarded(), (unsigned long long)0);
+}
+
+void testHeadlessSkipsTerminalWork()
+{
+    setHeadless(true);
+    std::string sequence = clearSequence(5);
+    auto start = std::chrono::steady_clock::now();
+    delay(2000);
+    long long waited = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+    std::stringstream out;
+    Typewriter typewriter(out);
+    typewriter.append("typed", 500, "\033[36m");
+    typewriter.start();
+    bool typedAtOnce = typewriter.done();
+
+    Screen screen(20);
+    screen.begin();
+    screen.draw("\033[34mmap\033[37m\n  \033[36mroom\n");
+    std::string frame = screen.present();
+    setHeadless(false);
+
+    ASSERT_EQUAL(sequence, std::string(""));
+    ASSERT(waited < 100);
+    ASSERT(typedAtOnce);
+    ASSERT_EQUAL(out.str(), std::string("typed"));
+    ASSERT_EQUAL(frame, std::string("map\n  room\n"));
+}
+
+void testConsoleReadsAndWritesMemory()
+{
+    MemorySource input("7\nwest\n");
+    MemorySink output;
+    int value = 0;
+    std::string token;
+    {
+        Console session(input, output);
+        Console::Binding binding(session);
+        ASSERT(!console().isStandard());
+        value = readInt();
+        token = getUserInputToken();
+        console().out() << "value " << value << "\n";
+    }
+
+    ASSERT(console().isStandard());
+    ASSERT_EQUAL(value, 7);
+    ASSERT_EQUAL(token, std::string("west"));
+    ASSERT_EQUAL(output.text(), std::string("Enter your choice: value 7\n"));
+}
+
+void testConsoleRunsConcurrentGames()
+{
+    std::stringstream stdoutCapture;
+    std::streambuf *coutBackup = std::cout.rdbuf(stdoutCapture.rdbuf());
+
+    MemorySource aliceInput("Alice\n/stats\n");
+    MemorySource bobInput("Bob\n/stats\n");
+    MemorySink aliceOutput;
+    MemorySink bobOutput;
+    Console alice(aliceInput, aliceOutput);
+    Console bob(bobInput, bobOutput);
+
+    std::thread first([&alice]
+                      { ValerisGame game(alice); game.start("\033[36m"); });
+    std::thread second([&bob]
+                       { ValerisGame game(bob); game.start("\033[36m"); });
+    first.join();
+    second.join();
+    std::cout.rdbuf(coutBackup);
+
+    ASSERT(aliceOutput.text().find("Players Name: Alice") != std::string::npos);
+    ASSERT(aliceOutput.text().find("Bob") == std::string::npos);
+    ASSERT(bobOutput.text().find("Players Name: Bob") != std::string::npos);
+    ASSERT(bobOutput.text().find("Alice") == std::string::npos);
+    ASSERT_EQUAL(stdoutCapture.str(), std::string(""));
+}
+
+#ifndef _WIN32
+void testConsoleOverSocket()
+{
+    int fds[2];
+    ASSERT_EQUAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    SocketSource serverInput(fds[0]);
+    SocketSink serverOutput(fds[0]);
+    SocketSource clientInput(fds[1]);
+    SocketSink clientOutput(fds[1]);
+    Console server(serverInput, serverOutput);
+    Console client(clientInput, clientOutput);
+
+    client.out() << "north\n" << std::flush;
+    std::string command;
+    std::getline(server.in(), command);
+    server.out() << "You went " << command << "\n" << std::flush;
+    std::string reply;
+    std::getline(client.in(), reply);
+    close(fds[0]);
+    close(fds[1]);
+
+    ASSERT_EQUAL(command, std::string("north"));
+    ASSERT_EQUAL(reply, std::string("You went north"));
+}
+#endif
+
+void testAnsiFilterDropsRedundantEscapes()
+{
+    AnsiFilter ansi;
+    std::string out;
+    ansi.filter("\033[36mH\033[36mi\033[37m \033[36mthere\033[1m\033[31m!\033[0m", out);
+    ansi.finish(out);
+    ASSERT_EQUAL(out, std::string("\033[36mHi there\033[1;31m!\033[0m"));
+
+    // A style set before a frame ends is sent, so echoed input appears in it
+    out.clear();
+    ansi.filter("\033[33mEnter: ", out);
+    ansi.finish(out);
+    ASSERT_EQUAL(out, std::string("\033[33mEnter: "));
+}
+
+void testAnsiFilterMergesCursorMoves()
+{
+    AnsiFilter ansi;
+    std::string out;
+    ansi.filter("\033[A\033", out);
+    ansi.filter("[A\033[3C\033[G\033[5Gx\033[2Ky", out);
+    ansi.finish(out);
+    ASSERT_EQUAL(out, std::string("\033[2A\033[5Gx\033[2Ky"));
+}
+
+void testCoalescingSinkKeepsText()
+{
+    MemorySink plain;
+    CoalescingSink sink(plain);
+    std::string raw = "\033[37m+ - +\033[34mX\033[37m|\033[37m\n\033[36mroom\033[38;5;12m\033[21mdouble";
+    ASSERT(sink.write(raw.data(), raw.size()));
+    ASSERT_EQUAL(normalizeString(plain.text()), normalizeString(raw));
+    ASSERT(plain.text().size() < raw.size());
+}
+
+// Decodes the zlib streams Deflater writes: fixed-Huffman and stored blocks only
+static std::string inflateFixed(const std::string &stream, size_t &offset, bool &finalSeen)
+{
+    static const int lengthBase[] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const int lengthExtra[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const int distanceBase[] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+    static const int distanceExtra[] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+    static std::string history;
+    size_t bit = offset * 8;
+    auto bits = [&](int count)
+    {
+        int value = 0;
+        for (int i = 0; i < count; i++, bit++)
+        {
+            value |= ((stream[bit / 8] >> (bit % 8)) & 1) << i;
+        }
+        return value;
+    };
+    auto code = [&](int count)
+    {
+        int value = 0;
+        for (int i = 0; i < count; i++, bit++)
+        {
+            value = (value << 1) | ((stream[bit / 8] >> (bit % 8)) & 1);
+        }
+        return value;
+    };
+    if (offset == 0)
+    {
+        history.clear();
+        bit += 16;
+    }
+    std::string out;
+    while (true)
+    {
+        finalSeen = bits(1) == 1;
+        int type = bits(2);
+        if (type == 0)
+        {
+            bit = (bit + 7) / 8 * 8;
+            int length = (unsigned char)stream[bit / 8] | ((unsigned char)stream[bit / 8 + 1] << 8);
+            bit += 32;
+            out += stream.substr(bit / 8, length);
+            history += stream.substr(bit / 8, length);
+            bit += length * 8;
+            offset = bit / 8;
+            return out;
+        }
+        while (true)
+        {
+            int symbol = code(7);
+            if (symbol <= 0x17)
+            {
+                symbol += 256;
+            }
+            else
+            {
+                symbol = (symbol << 1) | code(1);
+                if (symbol >= 0x30 && symbol <= 0xbf)
+                {
+                    symbol -= 0x30;
+                }
+                else if (symbol >= 0xc0 && symbol <= 0xc7)
+                {
+                    symbol = symbol - 0xc0 + 280;
+                }
+                else
+                {
+                    symbol = ((symbol << 1) | code(1)) - 0x190 + 144;
+                }
+            }
+            if (symbol < 256)
+            {
+                out += (char)symbol;
+                history += (char)symbol;
+            }
+            else if (symbol == 256)
+            {
+                break;
+            }
+            else
+            {
+                int length = lengthBase[symbol - 257] + bits(lengthExtra[symbol - 257]);
+                int distanceCode = code(5);
+                int distance = distanceBase[distanceCode] + bits(distanceExtra[distanceCode]);
+                for (int i = 0; i < length; i++)
+                {
+                    char c = history[history.size() - distance];
+                    out += c;
+                    history += c;
+                }
+            }
+        }
+        if (finalSeen)
+        {
+            offset = (bit + 7) / 8;
+            return out;
+        }
+    }
+}
+
+void testDeflaterFramesDecodeIndependently()
+{
+    std::string banner = getFileContent("../reasources/intro.txt");
+    Deflater deflater;
+    std::string stream;
+    std::vector<size_t> frameEnds;
+    for (int frame = 0; frame < 3; frame++)
+    {
+        deflater.frame(banner.data(), banner.size(), stream);
+        frameEnds.push_back(stream.size());
+        ASSERT_EQUAL(stream.substr(stream.size() - 4), std::string("\x00\x00\xff\xff", 4));
+    }
+    deflater.finish(stream);
+
+    ASSERT_EQUAL((unsigned char)stream[0], (unsigned char)0x78);
+    size_t offset = 0;
+    bool finalSeen = false;
+    for (int frame = 0; frame < 3; frame++)
+    {
+        ASSERT_EQUAL(inflateFixed(stream, offset, finalSeen), banner);
+        ASSERT_EQUAL(offset, frameEnds[frame]);
+    }
+    // A repeated frame is only a handful of back-references
+    ASSERT(frameEnds[2] - frameEnds[1] < banner.size() / 20);
+    ASSERT(frameEnds[0] < banner.size());
+}
+
+void testCompressionNegotiatedOverTelnet()
+{
+    std::string client = std::string({(char)255, (char)253, (char)86}) + "n\r\n";
+    MemorySource wireIn(client);
+    MemorySink wireOut;
+    CompressingSink compression(wireOut);
+    TelnetSource telnet(wireIn, compression);
+    std::string line;
+    {
+        Console session(telnet, compression);
+        compression.offer();
+        ASSERT(!compression.compressing());
+        std::getline(session.in(), line);
+        session.out() << "You go north.\n" << std::flush;
+    }
+    compression.end();
+
+    ASSERT_EQUAL(line, std::string("n"));
+    std::string sent = wireOut.text();
+    std::string negotiation = std::string({(char)255, (char)251, (char)86, (char)255, (char)250, (char)86, (char)255, (char)240});
+    ASSERT_EQUAL(sent.substr(0, negotiation.size()), negotiation);
+    size_t offset = 0;
+    bool finalSeen = false;
+    ASSERT_EQUAL(inflateFixed(sent.substr(negotiation.size()), offset, finalSeen), std::string("You go north.\n"));
+    CompressionStats stats = compression.getStats();
+    ASSERT_EQUAL(stats.frames, (unsigned long long)1);
+    ASSERT_EQUAL(stats.sentBytes, (unsigned long long)sent.size());
+}
+
+void testEventLoopKeysLinesAndTimers()
+{
+    MemorySource input("", false);
+    MemorySink output;
+    Console session(input, output);
+    EventLoop loop(session);
+    std::vector<std::string> fired;
+    loop.after(20, [&]
+               { fired.push_back("input"); input.push("ab\r\nc\n"); });
+    loop.after(5, [&]
+               { fired.push_back("early"); });
+
+    std::vector<InputEvent> events;
+    for (int i = 0; i < 5; i++)
+    {
+        events.push_back(loop.next(1000));
+    }
+    ASSERT_EQUAL(fired.size(), (size_t)2);
+    ASSERT_EQUAL(fired[0], std::string("early"));
+    ASSERT(events[0].type == InputEvent::Key && events[0].key == 'a');
+    ASSERT(events[1].type == InputEvent::Key && events[1].key == 'b');
+    ASSERT(events[2].type == InputEvent::Line && events[2].line == "ab");
+    ASSERT(events[3].type == InputEvent::Key && events[3].key == 'c');
+    ASSERT(events[4].type == InputEvent::Line && events[4].line == "c");
+
+    auto start = std::chrono::steady_clock::now();
+    InputEvent timeout = loop.nextLine(30);
+    long long waited = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    ASSERT(timeout.type == InputEvent::Timeout);
+    ASSERT(waited >= 30);
+
+    input.push("partial");
+    input.close();
+    InputEvent last = loop.nextLine();
+    ASSERT(last.type == InputEvent::Line && last.line == "partial");
+    ASSERT(loop.next().type == InputEvent::Closed);
+}
+
+void testEventLoopIdleWorkYieldsToInput()
+{
+    MemorySource input("", false);
+    MemorySink output;
+    Console session(input, output);
+    EventLoop loop(session);
+    int slices = 0;
+    loop.whenIdle([&]
+                  {
+                      if (++slices == 50)
+                      {
+                          input.push("go\n");
+                      }
+                      return slices < 100000; });
+    InputEvent event = loop.nextLine();
+    ASSERT(event.type == InputEvent::Line && event.line == "go");
+    ASSERT(slices >= 50 && slices < 60);
+    ASSERT_EQUAL(loop.idleTasks(), (size_t)1);
+
+    int finite = 0;
+    loop.whenIdle([&]
+                  { return ++finite < 3; });
+    loop.nextLine(20);
+    ASSERT_EQUAL(finite, 3);
+    ASSERT_EQUAL(loop.idleTasks(), (size_t)1);
+}
+
+void testCombatTurnEndsOnTimeout()
+{
+    setHeadless(true);
+    MemorySource input("", false);
+    MemorySink output;
+    Console session(input, output);
+    int health = 10;
+    bool won;
+    auto start = std::chrono::steady_clock::now();
+    {
+        Console::Binding binding(session);
+        won = combatV1(&health, 100, 100, "Test Enemy", 20, 10, 0);
+    }
+    long long waited = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    setHeadless(false);
+
+    ASSERT(!won);
+    ASSERT_EQUAL(health, 0);
+    ASSERT(waited >= 1100 && waited < 3000);
+    ASSERT(input.waiting() == false);
+    ASSERT(output.text().find("You Died!") != std::string::npos);
+    ASSERT_EQUAL(session.combatLatency().enemy, std::string("Test Enemy"));
+    ASSERT_EQUAL(session.combatLatency().turns, 1);
+    ASSERT_EQUAL(session.combatLatency().timeouts, 1);
+    ASSERT_EQUAL(session.combatLatency().firstKey.count(), 0ULL);
+    ASSERT(&Console::standard().combatLatency() != &session.combatLatency());
+}
+
+void testKeyReaderTimesFirstKeyAndEnter()
+{
+    MemorySource input("", false);
+    MemorySink output;
+    Console session(input, output);
+    KeyReader reader(session);
+    ASSERT(!reader.raw());
+
+    reader.events().after(20, [&]
+                          { input.push("co"); });
+    reader.events().after(60, [&]
+                          { input.push("unter\n"); });
+    Reaction counter = reader.read(1000);
+    ASSERT_EQUAL(counter.answer, std::string("counter"));
+    ASSERT(counter.firstKeyNanos >= 20000000LL && counter.firstKeyNanos < 60000000LL);
+    ASSERT(counter.completeNanos >= 60000000LL);
+    ASSERT(!counter.timedOut);
+
+    reader.events().after(10, [&]
+                          { input.push("par"); });
+    Reaction late = reader.read(40);
+    ASSERT(late.timedOut);
+    ASSERT(late.firstKeyNanos >= 10000000LL);
+    ASSERT_EQUAL(late.completeNanos, -1LL);
+
+    input.push("kick\n");
+    Reaction kick = reader.read(1000);
+    ASSERT_EQUAL(kick.answer, std::string("kick"));
+    ASSERT_EQUAL(kick.firstKeyNanos, kick.completeNanos);
+
+    input.close();
+    ASSERT(reader.read(1000).closed);
+}
+
+void testLatencyHistogramExport()
+{
+    CombatLatency latency;
+    latency.enemy = "Goblin \"Grim\"";
+    latency.turns = 4;
+    latency.timeouts = 1;
+    latency.complete.add(10000000LL);
+    latency.complete.add(30000000LL);
+    latency.complete.add(30000000LL);
+    latency.complete.add(3000000000LL);
+
+    ASSERT_EQUAL(latency.complete.count(), 4ULL);
+    ASSERT_EQUAL(latency.complete.bucket(0), 1ULL);
+    ASSERT_EQUAL(latency.complete.bucket(1), 2ULL);
+    ASSERT_EQUAL(latency.complete.overflow(), 1ULL);
+    ASSERT_EQUAL(latency.complete.percentileMilliseconds(0.5), 50.0);
+    ASSERT_EQUAL(latency.complete.percentileMilliseconds(0.95), 3000.0);
+    ASSERT_EQUAL(latency.complete.meanMilliseconds(), 767.5);
+    ASSERT_EQUAL(latency.firstKey.percentileMilliseconds(0.5), 0.0);
+
+    std::string json = latency.toJson();
+    ASSERT(json.find("\"enemy\": \"Goblin \\\"Grim\\\"\"") != std::string::npos);
+    ASSERT(json.find("\"counts\": [1, 2]") != std::string::npos);
+    ASSERT(json.find("\"first_key\": {\"bucket_ms\": 25, \"counts\": []") != std::string::npos);
+
+    std::string path = "reaction_log_test.jsonl";
+    std::remove(path.c_str());
+    ASSERT(appendCombatLatency(path, latency));
+    ASSERT(appendCombatLatency(path, latency));
+    std::ifstream log(path);
+    std::string first, second, extra;
+    std::getline(log, first);
+    std::getline(log, second);
+    ASSERT(!std::getline(log, extra));
+    log.close();
+    std::remove(path.c_str());
+    ASSERT_EQUAL(first, json);
+    ASSERT_EQUAL(second, json);
+}
+
+void testCommandRegistryDispatch()
+{
+    CommandRegistry registry;
+    std::vector<std::string> ran;
+    bool open = false;
+    registry.add("N", [&](const CommandArgs &)
+                 { ran.push_back("north"); });
+    registry.add("/fight", [&](const CommandArgs &)
+                 { ran.push_back("fight"); }, [&]
+                 { return open; });
+    registry.add("/hidden", [&](const CommandArgs &)
+                 { ran.push_back("hidden"); }, nullptr, []
+                 { return false; });
+    int steps = 0;
+    registry.add("/walk", std::unique_ptr<CommandHandler>(new FunctionCommand([&](const CommandArgs &args)
+                                                                            { args.integer(0, steps); })),
+                 1, 1);
+
+    ASSERT(registry.dispatch("n") == CommandRegistry::Result::Ran);
+    ASSERT(registry.dispatch("  N  ") == CommandRegistry::Result::Ran);
+    ASSERT(registry.dispatch("/FIGHT") == CommandRegistry::Result::Unavailable);
+    open = true;
+    ASSERT(registry.dispatch("/Fight") == CommandRegistry::Result::Ran);
+    ASSERT(registry.dispatch("north") == CommandRegistry::Result::Unknown);
+    ASSERT(registry.dispatch("   ") == CommandRegistry::Result::Empty);
+    ASSERT(registry.dispatch("n now") == CommandRegistry::Result::BadArguments);
+    ASSERT(registry.dispatch("/walk") == CommandRegistry::Result::BadArguments);
+    ASSERT(registry.dispatch("/walk 12") == CommandRegistry::Result::Ran);
+    ASSERT_EQUAL(steps, 12);
+    ASSERT_EQUAL(ran.size(), (size_t)3);
+    ASSERT_EQUAL(ran[2], std::string("fight"));
+    ASSERT_EQUAL(registry.listed(", "), std::string("N, /fight, /walk"));
+
+    registry.add("/FIGHT", [&](const CommandArgs &)
+                 { ran.push_back("replaced"); });
+    ASSERT_EQUAL(registry.size(), (size_t)4);
+    registry.dispatch("/fight");
+    ASSERT_EQUAL(ran.back(), std::string("replaced"));
+
+    CommandArgs args("  /give  sword   -3 x99999999999 ");
+    ASSERT_EQUAL(std::string(args.command()), std::string("/give"));
+    ASSERT_EQUAL(args.count(), 3);
+    ASSERT_EQUAL(std::string(args.rest()), std::string("sword   -3 x99999999999"));
+    int value = 0;
+    ASSERT(!args.integer(0, value));
+    ASSERT(args.integer(1, value));
+    ASSERT_EQUAL(value, -3);
+    ASSERT(!args.integer(2, value));
+    ASSERT(!args.integer(3, value));
+}
+
+void testCommandRegistryPerfectHash()
+{
+    CommandRegistry registry;
+    int hits = 0;
+    for (int i = 0; i < 300; i++)
+    {
+        registry.add("/cmd" + std::to_string(i), [&hits](const CommandArgs &)
+                     { hits++; });
+    }
+    for (int i = 0; i < 300; i++)
+    {
+        std::string upper = "/CMD" + std::to_string(i);
+        ASSERT(registry.find(upper) != nullptr);
+        ASSERT(registry.dispatch(upper) == CommandRegistry::Result::Ran);
+    }
+    ASSERT_EQUAL(hits, 300);
+    ASSERT(registry.find("/cmd300") == nullptr);
+    ASSERT(registry.find("/cmd") == nullptr);
+    ASSERT(registry.find("") == nullptr);
+}
+
+void testValerisGameAcceptsNewCommands()
+{
+    MemorySource input("Alice\n/wave twice\n/WAVE\nq\n");
+    MemorySink output;
+    Console session(input, output);
+    ValerisGame game(session);
+    game.getCommands().add("/wave", [](const CommandArgs &)
+                           { console().out() << "You wave at the walls." << std::endl; });
+    game.start("\033[36m");
+
+    std::string text = output.text();
+    ASSERT(text.find(", /wave\nEnter Action") != std::string::npos);
+    ASSERT(text.find("That action does not take those arguments.") != std::string::npos);
+    ASSERT(text.find("You wave at the walls.") != std::string::npos);
+    ASSERT(text.find("Exiting dungeon exploration.") != std::string::npos);
+}
+
+void testCommandQueueChainsAndMacros()
+{
+    CommandRegistry registry;
+    registry.add("N", [](const CommandArgs &) {});
+    CommandQueue queue(registry);
+
+    ASSERT(queue.push(" n; n ;;e;/search 2 ") == CommandQueue::Pushed::Queued);
+    ASSERT_EQUAL(queue.size(), (size_t)4);
+    ASSERT_EQUAL(queue.pop(), std::string("n"));
+    ASSERT_EQUAL(queue.pop(), std::string("n"));
+    ASSERT_EQUAL(queue.pop(), std::string("e"));
+    ASSERT_EQUAL(queue.pop(), std::string("/search 2"));
+    ASSERT(queue.empty());
+    ASSERT_EQUAL(queue.pop(), std::string(""));
+
+    ASSERT(queue.push("/clear = /fight;/search;/heal") == CommandQueue::Pushed::Defined);
+    ASSERT(queue.push("/Loop=n;/CLEAR") == CommandQueue::Pushed::Defined);
+    ASSERT(queue.empty());
+    ASSERT(queue.macro("/LOOP") != nullptr);
+    ASSERT(queue.push("/loop;s") == CommandQueue::Pushed::Queued);
+    ASSERT_EQUAL(queue.size(), (size_t)5);
+    ASSERT_EQUAL(queue.pop(), std::string("n"));
+    ASSERT_EQUAL(queue.pop(), std::string("/fight"));
+    ASSERT_EQUAL(queue.clear(), (size_t)3);
+    ASSERT_EQUAL(queue.macros(), std::string("/clear = /fight;/search;/heal\n/Loop = n;/CLEAR\n"));
+
+    ASSERT(queue.push("n = s") == CommandQueue::Pushed::Rejected);
+    ASSERT(queue.push("/self = /self") == CommandQueue::Pushed::Defined);
+    ASSERT(queue.push("/self") == CommandQueue::Pushed::TooLong);
+    ASSERT(queue.empty());
+    ASSERT(queue.push("/self =") == CommandQueue::Pushed::Removed);
+    ASSERT(queue.push("/self =") == CommandQueue::Pushed::Rejected);
+    std::string many;
+    for (size_t i = 0; i <= CommandQueue::MaxSteps; i++)
+    {
+        many += "n;";
+    }
+    ASSERT(queue.push(many) == CommandQueue::Pushed::TooLong);
+    ASSERT(queue.empty());
+}
+
+void testValerisGameRunsChainedCommands()
+{
+    MemorySource input("Alice\n/wave;/wave;/nope;/wave\n/w2 = /wave;/wave\n/W2\nq\n");
+    MemorySink output;
+    Console session(input, output);
+    ValerisGame game(session);
+    int waves = 0;
+    game.getCommands().add("/wave", [&waves](const CommandArgs &)
+                           { waves++; });
+    game.start("\033[36m");
+
+    std::string text = output.text();
+    ASSERT_EQUAL(waves, 4);
+    ASSERT(text.find("Stopped with 1 queued action left.") != std::string::npos);
+    ASSERT(text.find("Macro saved.") != std::string::npos);
+    ASSERT(text.find("Exiting dungeon exploration.") != std::string::npos);
+    ASSERT(game.getQueue().macro("/w2") != nullptr);
+}
+
+#ifdef __linux__
+// Connects a blocking client to a server's Unix socket
+static int connectToServer(const std::string &path)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    if (connect(fd, (sockaddr *)&address, sizeof(address)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Reads from a client until the text has arrived or the server closes the connection
+static std::string readUntil(int fd, const std::string &text)
+{
+    std::string received;
+    char buffer[1024];
+    while (text.empty() || received.find(text) == std::string::npos)
+    {
+        ssize_t count = recv(fd, buffer, sizeof(buffer), 0);
+        if (count <= 0)
+        {
+            break;
+        }
+        received.append(buffer, count);
+    }
+    return received;
+}
+
+void testGameServerMultiplexesSessions()
+{
+    ServerOptions options;
+    options.unixPath = "/tmp/valeris_test_" + std::to_string(getpid()) + ".sock";
+    options.workers = 1;
+    options.stackBytes = 64 * 1024;
+    GameServer server(options, []
+                      {
+                          console().out() << "Name? " << std::flush;
+                          std::string name = getUserInputLine();
+                          sleepFor(5);
+                          console().out() << "Hello " << name << "\n" << std::flush; });
+    ASSERT(server.start());
+
+    const int clients = 200;
+    std::vector<int> fds;
+    for (int i = 0; i < clients; i++)
+    {
+        fds.push_back(connectToServer(options.unixPath));
+        ASSERT(fds.back() >= 0);
+    }
+    for (int i = 0; i < clients; i++)
+    {
+        ASSERT(readUntil(fds[i], "Name? ").find("Name? ") != std::string::npos);
+    }
+    ASSERT_EQUAL(server.stats().connected, (size_t)clients);
+
+    // Every session is parked on one worker; answer them in reverse, one with a Telnet command in the middle
+    for (int i = clients - 1; i >= 0; i--)
+    {
+        std::string answer = i == 7 ? std::string("pla\xff\xfb\x01yer7\r\n") : "player" + std::to_string(i) + "\n";
+        ASSERT(send(fds[i], answer.data(), answer.size(), 0) == (ssize_t)answer.size());
+    }
+    for (int i = 0; i < clients; i++)
+    {
+        std::string reply = readUntil(fds[i], "");
+        ASSERT_EQUAL(reply, "Hello player" + std::to_string(i) + "\n");
+        close(fds[i]);
+    }
+
+    ServerStats stats = server.stats();
+    ASSERT_EQUAL(stats.accepted, (unsigned long long)clients);
+    ASSERT_EQUAL(stats.finished, (unsigned long long)clients);
+    ASSERT_EQUAL(stats.peakConnected, (size_t)clients);
+    server.stop();
+}
+
+void testGameServerRunsMenuAndGame()
+{
+    ServerOptions options;
+    options.unixPath = "/tmp/valeris_menu_" + std::to_string(getpid()) + ".sock";
+    options.workers = 2;
+    GameServer server(options);
+    ASSERT(server.start());
+
+    int alice = connectToServer(options.unixPath);
+    int idle = connectToServer(options.unixPath);
+    ASSERT(alice >= 0 && idle >= 0);
+    ASSERT(readUntil(idle, "Enter your choice: ").find("VALERIS GAME MENU") != std::string::npos);
+    std::string script = "1\nAlice\n/stats\nq\n4\n";
+    ASSERT(send(alice, script.data(), script.size(), 0) == (ssize_t)script.size());
+    std::string transcript = readUntil(alice, "");
+    close(alice);
+
+    ASSERT(transcript.find("Players Name: Alice") != std::string::npos);
+    ASSERT(transcript.find("Exiting dungeon exploration.") != std::string::npos);
+    ASSERT(transcript.find("Exiting Game.") != std::string::npos);
+    ASSERT_EQUAL(server.stats().connected, (size_t)1);
+    server.stop();
+    ASSERT_EQUAL(readUntil(idle, ""), std::string(""));
+    close(idle);
+}
+#endif
+
+#ifdef __linux__
+void testFiberSwitchKeepsEachFibersState()
+{
+    std::vector<std::string> seen;
+    auto body = [&seen](const std::string &name)
+    {
+        return [&seen, name]
+        {
+            double total = 0.5;
+            try
+            {
+                throw std::runtime_error(name);
+            }
+            catch (const std::runtime_error &)
+            {
+                for (int i = 0; i < 3; i++)
+                {
+                    Fiber::suspend();
+                    total *= 2;
+                }
+                try
+                {
+                    throw;
+                }
+                catch (const std::runtime_error &e)
+                {
+                    seen.push_back(std::string(e.what()) + " " + std::to_string((int)total));
+                }
+            }
+        };
+    };
+    Fiber first(body("first"));
+    Fiber second(body("second"));
+    while (first.resume() | second.resume())
+    {
+    }
+    ASSERT(first.finished() && second.finished());
+    ASSERT_EQUAL(seen.size(), (size_t)2);
+    ASSERT_EQUAL(seen[0], std::string("first 4"));
+    ASSERT_EQUAL(seen[1], std::string("second 4"));
+    ASSERT(std::current_exception() == nullptr);
+
+    Fiber failing([]
+                  { throw std::logic_error("escaped"); });
+    bool rethrown = false;
+    try
+    {
+        failing.resume();
+    }
+    catch (const std::logic_error &)
+    {
+        rethrown = true;
+    }
+    ASSERT(rethrown);
+}
+
+void testFiberStacksArePooled()
+{
+    Fiber::setPooledStackLimit(0);
+    Fiber::setPooledStackLimit(2);
+    {
+        Fiber a([] {}), b([] {}), c([] {});
+        a.resume();
+    }
+    ASSERT_EQUAL(Fiber::pooledStacks(), (size_t)2);
+
+    int runs = 0;
+    {
+        Fiber reused([&runs]
+                     {
+                         // Touches both ends of a 64 KiB frame, so a reused stack must be usable all the way down
+                         volatile char frame[64 * 1024];
+                         frame[0] = 1;
+                         frame[sizeof(frame) - 1] = 1;
+                         runs += frame[0] & frame[sizeof(frame) - 1]; });
+        ASSERT_EQUAL(Fiber::pooledStacks(), (size_t)1);
+        ASSERT(!reused.resume());
+    }
+    {
+        Fiber larger([&runs]
+                     { runs++; },
+                     Fiber::DefaultStackBytes * 2);
+        ASSERT(!larger.resume());
+    }
+    ASSERT_EQUAL(runs, 2);
+    ASSERT_EQUAL(Fiber::pooledStacks(), (size_t)2);
+    Fiber::setPooledStackLimit(Fiber::DefaultPooledStacks);
+}
+#endif
+
+void testWorkStealingDeque()
+{
+    WorkStealingDeque<int> deque(2);
+    std::vector<int> values(100);
+    for (int i = 0; i < 100; i++)
+    {
+        values[i] = i;
+        deque.push(&values[i]);
+    }
+    ASSERT_EQUAL(deque.size(), (size_t)100);
+    ASSERT_EQUAL(*deque.pop(), 99);
+    ASSERT_EQUAL(*deque.steal(), 0);
+    ASSERT_EQUAL(*deque.steal(), 1);
+    ASSERT_EQUAL(deque.size(), (size_t)97);
+
+    // Thieves and the owner race for every item; each must be taken exactly once
+    std::vector<std::atomic<int>> taken(20000);
+    std::vector<int> items(taken.size());
+    WorkStealingDeque<int> shared;
+    std::atomic<bool> done(false);
+    std::vector<std::thread> thieves;
+    for (int t = 0; t < 3; t++)
+    {
+        thieves.emplace_back([&]
+                             {
+                                 while (!done || shared.size() > 0)
+                                 {
+                                     if (int *item = shared.steal())
+                                     {
+                                         taken[*item]++;
+                                     }
+                                 } });
+    }
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        items[i] = (int)i;
+        shared.push(&items[i]);
+        if (i % 3 == 0)
+        {
+            if (int *item = shared.pop())
+            {
+                taken[*item]++;
+            }
+        }
+    }
+    done = true;
+    for (std::thread &thief : thieves)
+    {
+        thief.join();
+    }
+    bool once = true;
+    for (std::atomic<int> &count : taken)
+    {
+        once = once && count == 1;
+    }
+    ASSERT(once);
+}
+
+void testSchedulerStealsQueuedWork()
+{
+    Scheduler scheduler(2);
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool blocking = false;
+    bool release = false;
+    scheduler.submit([&]
+                     {
+                         std::unique_lock<std::mutex> lock(mutex);
+                         blocking = true;
+                         changed.notify_all();
+                         changed.wait(lock, [&] { return release; }); },
+                     0);
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&]
+                     { return blocking; });
+    }
+
+    // Worker 0 is busy, so the work queued for it has to be stolen
+    std::atomic<int> ran(0);
+    std::vector<Job<int>> jobs;
+    for (int i = 0; i < 10; i++)
+    {
+        jobs.push_back(scheduler.spawn([&ran, i]
+                                       {
+                                           ran++;
+                                           return Scheduler::currentWorker() * 100 + i; },
+                                       0));
+    }
+    auto giveUp = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (ran < 10 && std::chrono::steady_clock::now() < giveUp)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    bool onOtherWorker = true;
+    for (int i = 0; i < 10; i++)
+    {
+        onOtherWorker = onOtherWorker && jobs[i].ready() && jobs[i].get() == 100 + i;
+    }
+    ASSERT(onOtherWorker);
+    ASSERT(!jobs[0].valid());
+    SchedulerStats stats = scheduler.stats();
+    ASSERT_EQUAL(stats.workers.size(), (size_t)2);
+    ASSERT_EQUAL(stats.workers[1].stolen, (unsigned long long)10);
+    ASSERT(stats.workers[0].peakQueueDepth >= 1);
+
+    // A job no worker has started runs on the thread asking for it
+    Job<int> pending = scheduler.spawn([]
+                                       { return Scheduler::currentWorker(); },
+                                       0);
+    int where = pending.get();
+    ASSERT(where == -1 || where == 1);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        release = true;
+    }
+    changed.notify_all();
+    scheduler.stop();
+    stats = scheduler.stats();
+    ASSERT_EQUAL(stats.submitted, (unsigned long long)12);
+    ASSERT_EQUAL(stats.queued, (size_t)0);
+    ASSERT(Scheduler::current() == nullptr);
+}
+
+#ifdef __linux__
+void testJobParksWaitingFiber()
+{
+    Scheduler scheduler(1);
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool started = false;
+    bool release = false;
+    Job<int> job = scheduler.spawn([&]
+                                   {
+                                       std::unique_lock<std::mutex> lock(mutex);
+                                       started = true;
+                                       changed.notify_all();
+                                       changed.wait(lock, [&] { return release; });
+                                       return 42; });
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&]
+                     { return started; });
+    }
+
+    // The worker has the job, so the fiber parks until finishing it calls the waker
+    std::atomic<int> woken(0);
+    int result = 0;
+    Fiber fiber([&]
+                { result = job.get(); });
+    fiber.setWaker([&]
+                   { woken++; });
+    ASSERT(fiber.resume());
+    TimerQueue::Clock::time_point due;
+    ASSERT(!fiber.wakeTime(due));
+    ASSERT_EQUAL(woken.load(), 0);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        release = true;
+    }
+    changed.notify_all();
+    auto giveUp = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (woken == 0 && std::chrono::steady_clock::now() < giveUp)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_EQUAL(woken.load(), 1);
+    ASSERT(!fiber.resume());
+    ASSERT_EQUAL(result, 42);
+    scheduler.stop();
+}
+#endif
+
+void testBlobRoundTrip()
+{
+    BlobWriter out;
+    out.putUnsigned(0);
+    out.putUnsigned(300);
+    out.putInt(-2);
+    out.putInt(1LL << 40);
+    out.putString(std::string("a\0b", 3));
+    out.putFlags({true, false, true, true, false, false, false, false, true, false, true});
+    ASSERT_EQUAL(out.data().size(), (size_t)(1 + 2 + 1 + 6 + 4 + 3));
+
+    BlobReader in(out.data());
+    ASSERT_EQUAL(in.getUnsigned(), 0ULL);
+    ASSERT_EQUAL(in.getUnsigned(), 300ULL);
+    ASSERT_EQUAL(in.getInt(), -2LL);
+    ASSERT_EQUAL(in.getInt(), 1LL << 40);
+    ASSERT_EQUAL(in.getString(), std::string("a\0b", 3));
+    std::vector<bool> flags = in.getFlags();
+    ASSERT_EQUAL(flags.size(), (size_t)11);
+    ASSERT(flags[0] && !flags[1] && flags[3] && flags[8] && !flags[9] && flags[10]);
+    ASSERT(in.ok() && in.atEnd());
+
+    std::string truncated = out.data().substr(0, 12);
+    BlobReader shortRecord(truncated);
+    shortRecord.getUnsigned();
+    shortRecord.getUnsigned();
+    shortRecord.getInt();
+    shortRecord.getInt();
+    ASSERT_EQUAL(shortRecord.getString(), std::string(""));
+    ASSERT(!shortRecord.ok());
+}
+
+void testGameStateSurvivesRestore()
+{
+    MemorySource input("Alice\n/m = /stats;/stats\nq\n");
+    MemorySink output;
+    Console session(input, output);
+    ValerisGame game(session);
+    game.start("\033[36m");
+    std::string state = game.saveState();
+    ASSERT(state.size() < 128);
+
+    MemorySource otherInput("");
+    MemorySink otherOutput;
+    Console other(otherInput, otherOutput);
+    ValerisGame restored(other);
+    ASSERT(restored.restoreState(state));
+    ASSERT_EQUAL(restored.saveState(), state);
+    ASSERT(restored.getQueue().macro("/m") != nullptr);
+
+    ASSERT(!restored.restoreState(state.substr(0, state.size() - 1)));
+    ASSERT(!restored.restoreState("not a game"));
+    ASSERT_EQUAL(restored.saveState(), state);
+}
+
+void testIdleGameHibernatesAndWakes()
+{
+    HibernationSettings settings;
+    settings.idleMilliseconds = 30;
+    setHibernation(settings);
+    HibernationStats before = hibernationStats();
+
+    MemorySource input("Alice\n", false);
+    MemorySink output;
+    Console session(input, output);
+    std::thread player([&session]
+                       { ValerisGame game(session); game.start("\033[36m"); });
+    for (int i = 0; i < 500 && hibernationStats().sleeping == before.sleeping; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    HibernationStats asleep = hibernationStats();
+    input.push("/stats\nq\n");
+    player.join();
+    setHibernation(HibernationSettings());
+    HibernationStats after = hibernationStats();
+
+    ASSERT_EQUAL(asleep.sleeping, before.sleeping + 1);
+    ASSERT(asleep.bytesOnDisk > before.bytesOnDisk);
+    ASSERT_EQUAL(after.sleeping, before.sleeping);
+    ASSERT(after.restored > before.restored);
+    ASSERT(after.lastRestoreMicroseconds < 10000);
+    std::string text = output.text();
+    ASSERT(text.find("Players Name: Alice") != std::string::npos);
+    ASSERT(text.find("Exiting dungeon exploration.") != std::string::npos);
+}
+
+void testSharedFloorTemplate()
+{
+    std::shared_ptr<const FloorTemplate> first = FloorTemplate::shared(4242u, 20);
+    std::shared_ptr<const FloorTemplate> second = FloorTemplate::shared(4242u, 20);
+    ASSERT(first.get() == second.get());
+    ASSERT(FloorTemplate::shared(4243u, 20).get() != first.get());
+
+    Dungeon reference(4242u);
+    reference.generateFloor(20);
+    ASSERT_EQUAL(first->getDungeon().getRooms().size(), reference.getRooms().size());
+    ASSERT_EQUAL(first->getStartRoom()->id, reference.getStartRoom()->id);
+}
+
+void testFloorOverlaysCopyOnWrite()
+{
+    std::shared_ptr<const FloorTemplate> floor = FloorTemplate::shared(99u, 20);
+    int fought = -1;
+    for (Room *room : floor->getDungeon().getRooms())
+    {
+        if (!room->roomContent.getEnemies().empty())
+        {
+            fought = room->id;
+            break;
+        }
+    }
+    ASSERT(fought >= 0);
+    size_t enemies = floor->getRoom(fought)->roomContent.getEnemies().size();
+
+    FloorOverlay first(floor);
+    FloorOverlay second(floor);
+    ASSERT(first.getRoom(fought) == floor->getRoom(fought));
+    size_t untouched = first.memoryFootprint();
+
+    first.setVisited(fought);
+    ASSERT_EQUAL(first.changedRooms(), (size_t)0);
+    first.edit(fought)->roomContent.clearEnemies();
+    ASSERT(first.getRoom(fought) != floor->getRoom(fought));
+    ASSERT(first.getRoom(fought)->roomContent.getEnemies().empty());
+    ASSERT_EQUAL(first.changedRooms(), (size_t)1);
+    ASSERT(first.memoryFootprint() > untouched);
+
+    ASSERT_EQUAL(second.getRoom(fought)->roomContent.getEnemies().size(), enemies);
+    ASSERT(!second.getVisited(fought));
+    ASSERT_EQUAL(floor->getRoom(fought)->roomContent.getEnemies().size(), enemies);
+    ASSERT(!floor->getRoom(fought)->roomContent.getCleared());
+    ASSERT(second.memoryFootprint() < floor->memoryFootprint());
+
+    FloorOverlay restored(floor);
+    restored.applyDelta(first.captureDelta());
+    ASSERT(restored.getVisited(fought));
+    ASSERT(restored.getRoom(fought)->roomContent.getCleared());
+    ASSERT_EQUAL(restored.changedRooms(), (size_t)1);
+
+    // Reads hand out rooms that cannot be changed; only edit gives a room to change
+    static_assert(std::is_same<decltype(floor->getRoom(0)), const Room *>::value, "a shared template's rooms are read-only");
+    static_assert(std::is_same<decltype(first.getRoom(0)), const Room *>::value, "an overlay's reads are read-only");
+
+    // Only an overlay given a template it may change writes through to it
+    std::shared_ptr<FloorTemplate> world = std::make_shared<FloorTemplate>(99u, 20);
+    FloorOverlay copying(world, false);
+    FloorOverlay writing(world, true);
+    ASSERT(copying.edit(fought) != world->getRoom(fought));
+    ASSERT(writing.edit(fought) == world->getRoom(fought));
+    ASSERT_EQUAL(writing.changedRooms(), (size_t)0);
+}
+
+void testEventGamesShareFloor()
+{
+    setEventSeed(31337u);
+    std::shared_ptr<const FloorTemplate> floor = FloorTemplate::shared(31337u, 20);
+    long held = floor.use_count();
+    MemorySource input("");
+    MemorySink output;
+    Console session(input, output);
+    {
+        ValerisGame first(session);
+        ValerisGame second(session);
+        ASSERT_EQUAL(floor.use_count(), held + 2);
+
+        ValerisGame restored(session);
+        clearEventSeed();
+        ASSERT(restored.restoreState(first.saveState()));
+        ASSERT_EQUAL(floor.use_count(), held + 3);
+        ASSERT_EQUAL(restored.saveState(), first.saveState());
+    }
+    ASSERT_EQUAL(floor.use_count(), held);
+}
+
+void testRoomLootTakenOnce()
+{
+    RoomContent room;
+    room.addItem("Potion:health:5");
+    room.addItem("Sword:weapon:3");
+    room.addEnemy({"Goblin", 10, 2});
+    size_t stocked = room.getItems().size();
+    std::vector<std::string> seenItems, seenEnemies, enemyNames;
+    room.forEachItem([&seenItems](const std::string &item)
+                     { seenItems.push_back(item); });
+    room.forEachEnemy([&seenEnemies](const EnemyStruct &enemy)
+                      { seenEnemies.push_back(enemy.name); });
+    for (const EnemyStruct &enemy : room.getEnemies())
+    {
+        enemyNames.push_back(enemy.name);
+    }
+    ASSERT_EQUAL(seenItems, room.getItems());
+    ASSERT_EQUAL(seenEnemies, enemyNames);
+    ASSERT_EQUAL(seenEnemies.back(), std::string("Goblin"));
+    std::atomic<int> looters(0), clearers(0);
+    std::atomic<size_t> itemsTaken(0);
+    std::vector<std::thread> players;
+    for (int i = 0; i < 8; i++)
+    {
+        players.emplace_back([&]
+                             {
+            std::vector<std::string> taken;
+            int coins = 0;
+            if (room.takeLoot(taken, coins))
+            {
+                looters++;
+                itemsTaken += taken.size();
+            }
+            if (room.clearEnemies())
+            {
+                clearers++;
+            } });
+    }
+    for (std::thread &player : players)
+    {
+        player.join();
+    }
+    ASSERT_EQUAL(looters.load(), 1);
+    ASSERT_EQUAL(clearers.load(), 1);
+    ASSERT_EQUAL(itemsTaken.load(), stocked);
+    ASSERT(room.getItems().empty() && room.getEnemies().empty() && room.getLooted() && room.getCleared());
+}
+
+void testSharedWorldBroadcasts()
+{
+    SharedWorld world(8u, 20);
+    int here = world.getFloor()->getStartRoom()->id;
+    int elsewhere = here == 0 ? 1 : 0;
+    SharedWorld::Member alice("Alice"), bob("Bob"), carol("Carol");
+    world.enter(alice, here);
+    world.enter(bob, here);
+    world.enter(carol, elsewhere);
+    ASSERT_EQUAL(alice.takeMessages(), std::vector<std::string>{"Bob has arrived."});
+    ASSERT(bob.takeMessages().empty());
+    ASSERT_EQUAL(world.present(here), (std::vector<std::string>{"Alice", "Bob"}));
+
+    ASSERT_EQUAL(world.broadcast(here, "Bob has defeated the enemies here.", &bob), 1);
+    ASSERT_EQUAL(alice.takeMessages(), std::vector<std::string>{"Bob has defeated the enemies here."});
+    ASSERT(bob.takeMessages().empty() && carol.takeMessages().empty());
+
+    world.enter(bob, elsewhere);
+    ASSERT_EQUAL(alice.takeMessages(), std::vector<std::string>{"Bob has left."});
+    ASSERT_EQUAL(carol.takeMessages(), std::vector<std::string>{"Bob has arrived."});
+    world.leave(alice);
+    ASSERT_EQUAL(alice.getRoom(), -1);
+    ASSERT(world.present(here).empty());
+}
+
+void testWorldGamesRestoreIntoTheirWorld()
+{
+    std::shared_ptr<SharedWorld> world = std::make_shared<SharedWorld>(12u, 20);
+    MemorySource input("");
+    MemorySink output;
+    Console session(input, output);
+    setSharedWorld(world);
+    ValerisGame first(session);
+    std::string state = first.saveState();
+    setSharedWorld(nullptr);
+
+    ValerisGame outside(session);
+    ASSERT(!outside.restoreState(state));
+    setSharedWorld(std::make_shared<SharedWorld>(13u, 20));
+    ASSERT(!outside.restoreState(state));
+    setSharedWorld(world);
+    ASSERT(outside.restoreState(state));
+    ASSERT_EQUAL(outside.saveState(), state);
+    setSharedWorld(nullptr);
+}
+
+void testFrameFeedSharesFrames()
+{
+    FrameFeed feed(8);
+    int woken = 0;
+    feed.setListener([&woken]
+                     { woken++; });
+    feed.publish("before\n", 7);
+    ASSERT_EQUAL(woken, 0);
+    ASSERT_EQUAL(feed.stats().frames, 0ULL);
+
+    // Both spectators join on one keyframe of the output so far
+    FrameFeed::Frame first, second;
+    unsigned long long a = feed.join(first);
+    unsigned long long b = feed.join(second);
+    ASSERT(first.get() == second.get());
+    ASSERT_EQUAL(*first, std::string("\033[2J\033[Hbefore\n"));
+
+    feed.publish("one\n", 4);
+    feed.publish("two\n", 4);
+    ASSERT_EQUAL(woken, 2);
+    std::vector<FrameFeed::Frame> forA, forB;
+    ASSERT_EQUAL(feed.collect(a, forA, 16), (size_t)0);
+    ASSERT_EQUAL(feed.collect(b, forB, 1), (size_t)0);
+    ASSERT_EQUAL(forB.size(), (size_t)1);
+    feed.collect(b, forB, 16);
+    ASSERT_EQUAL(forA.size(), (size_t)2);
+    ASSERT_EQUAL(forB.size(), (size_t)2);
+    for (size_t i = 0; i < forA.size(); i++)
+    {
+        ASSERT(forA[i].get() == forB[i].get());
+    }
+    ASSERT_EQUAL(*forA[1], std::string("two\n"));
+    ASSERT_EQUAL(a, feed.head());
+    ASSERT_EQUAL(feed.stats().frames, 2ULL);
+
+    // Once nobody watches, no frames are made
+    feed.leave();
+    feed.leave();
+    feed.publish("after\n", 6);
+    ASSERT_EQUAL(woken, 2);
+    ASSERT_EQUAL(feed.stats().frames, 2ULL);
+    ASSERT_EQUAL(feed.stats().published, 4ULL);
+}
+
+void testFrameFeedResyncsSlowSpectators()
+{
+    FrameFeed feed(4, 1 << 20, 16);
+    FrameFeed::Frame keyframe;
+    unsigned long long fast = feed.join(keyframe);
+    unsigned long long slow = feed.join(keyframe);
+    unsigned long long slower = slow;
+    std::vector<FrameFeed::Frame> sent;
+    for (int i = 0; i < 10; i++)
+    {
+        std::string line = "line " + std::to_string(i) + "\n";
+        feed.publish(line.data(), line.size());
+        ASSERT_EQUAL(feed.collect(fast, sent, 16), (size_t)0);
+    }
+    ASSERT_EQUAL(sent.size(), (size_t)10);
+
+    // The slow spectator missed the six frames no longer kept and is sent whole lines from the end of the output
+    std::vector<FrameFeed::Frame> late, later;
+    ASSERT_EQUAL(feed.collect(slow, late, 16), (size_t)6);
+    ASSERT_EQUAL(late.size(), (size_t)1);
+    ASSERT_EQUAL(*late[0], std::string("\033[2J\033[Hline 8\nline 9\n"));
+    ASSERT_EQUAL(slow, feed.head());
+    ASSERT_EQUAL(feed.collect(slow, late, 16), (size_t)0);
+    ASSERT_EQUAL(late.size(), (size_t)1);
+
+    // Spectators resynchronised at the same point share the keyframe
+    ASSERT_EQUAL(feed.collect(slower, later, 16), (size_t)6);
+    ASSERT(later[0].get() == late[0].get());
+    FeedStats stats = feed.stats();
+    ASSERT_EQUAL(stats.dropped, 12ULL);
+    ASSERT_EQUAL(stats.keyframes, 2ULL);
+}
+
+#ifdef __linux__
+void testGameServerStreamsToSpectators()
+{
+    ServerOptions options;
+    options.unixPath = "/tmp/valeris_play_" + std::to_string(getpid()) + ".sock";
+    options.spectatorUnixPath = "/tmp/valeris_watch_" + std::to_string(getpid()) + ".sock";
+    options.workers = 1;
+    options.stackBytes = 64 * 1024;
+    options.spectatorFrames = 8;
+    GameServer server(options, []
+                      {
+                          console().out() << "Name? " << std::flush;
+                          std::string name = getUserInputLine();
+                          console().out() << "Hello " << name << "\n" << std::flush;
+                          getUserInputLine();
+                          for (int i = 0; i < 300; i++)
+                          {
+                              console().out() << std::string(2000, (char)('a' + i % 26)) << "\n" << std::flush;
+                          }
+                          console().out() << "Done\n" << std::flush; });
+    ASSERT(server.start());
+
+    int player = connectToServer(options.unixPath);
+    ASSERT(player >= 0);
+    ASSERT(readUntil(player, "Name? ").find("Name? ") != std::string::npos);
+    int fast = connectToServer(options.spectatorUnixPath);
+    int slow = connectToServer(options.spectatorUnixPath);
+    ASSERT(fast >= 0 && slow >= 0);
+    ASSERT(readUntil(fast, "session? ").find("Live sessions: 1\r\n") != std::string::npos);
+    readUntil(slow, "session? ");
+    std::string choices = "7\n1\n";
+    ASSERT(send(fast, choices.data(), choices.size(), 0) == (ssize_t)choices.size());
+    ASSERT(send(slow, "1\n", 2, 0) == 2);
+    std::string joined = readUntil(fast, "Name? ");
+    ASSERT(joined.find("There is no live session 7.") != std::string::npos);
+    ASSERT(joined.find("\033[2J\033[HName? ") != std::string::npos);
+    readUntil(slow, "Name? ");
+    ASSERT_EQUAL(server.stats().spectators, (size_t)2);
+
+    // A spectator's typing never reaches the game
+    std::string typed = "Mallory\n";
+    ASSERT(send(fast, typed.data(), typed.size(), 0) == (ssize_t)typed.size());
+    sleepFor(50);
+    ASSERT(send(player, "Bob\n", 4, 0) == 4);
+    ASSERT(readUntil(player, "Hello Bob\n").find("Hello Bob\n") != std::string::npos);
+    ASSERT(readUntil(fast, "Hello Bob\n").find("Hello Bob\n") != std::string::npos);
+
+    // Neither spectator reads while the player is sent far more than their sockets hold
+    ASSERT(send(player, "go\n", 3, 0) == 3);
+    ASSERT(readUntil(player, "").find("Done\n") != std::string::npos);
+    close(player);
+    for (int watcher : {fast, slow})
+    {
+        std::string seen = readUntil(watcher, "");
+        ASSERT(seen.find("\033[2J\033[H") != std::string::npos);
+        ASSERT(seen.substr(seen.size() - 5) == "Done\n");
+        close(watcher);
+    }
+    ServerStats stats = server.stats();
+    ASSERT(stats.dropped > 0);
+    ASSERT(stats.keyframes > 2);
+    ASSERT_EQUAL(stats.spectators, (size_t)0);
+    server.stop();
+}
+#endif
+
+void testHandoffRecordRoundTrip()
+{
+    HandoffRecord record;
+    record.state = std::string("saved\0game", 10);
+    record.input = "n\n";
+    record.output = "Enter Action : ";
+    record.compressed = true;
+    record.pausedAt = 123456789012LL;
+    std::string bytes = encodeHandoff(record);
+
+    HandoffRecord read;
+    read.fd = 7;
+    ASSERT(decodeHandoff(bytes, read));
+    ASSERT_EQUAL(read.fd, 7);
+    ASSERT(read.state == record.state);
+    ASSERT(read.input == record.input);
+    ASSERT(read.output == record.output);
+    ASSERT(read.compressed);
+    ASSERT_EQUAL(read.pausedAt, record.pausedAt);
+
+    ASSERT(!decodeHandoff(bytes.substr(0, bytes.size() - 1), read));
+    ASSERT(!decodeHandoff(bytes + "x", read));
+    ASSERT(read.state == record.state);
+}
+
+#ifdef __linux__
+void testHandoffPassesConnection()
+{
+    int channel[2];
+    int connection[2];
+    ASSERT_EQUAL(socketpair(AF_UNIX, SOCK_STREAM, 0, channel), 0);
+    ASSERT_EQUAL(socketpair(AF_UNIX, SOCK_STREAM, 0, connection), 0);
+    HandoffRecord first;
+    first.fd = connection[0];
+    first.state = std::string(100000, 's');
+    HandoffRecord second;
+    second.fd = connection[0];
+    second.input = "look\n";
+    ASSERT(sendHandoff(channel[0], first));
+    ASSERT(sendHandoff(channel[0], second));
+    close(channel[0]);
+    close(connection[0]);
+
+    HandoffReader reader;
+    std::vector<HandoffRecord> records;
+    bool open = true;
+    while (open)
+    {
+        open = reader.receive(channel[1], records);
+    }
+    close(channel[1]);
+    ASSERT_EQUAL(records.size(), (size_t)2);
+    ASSERT(records[0].state == first.state);
+    ASSERT(records[1].input == "look\n");
+
+    // Each record's descriptor is the same connection, still open once the sender has closed its own
+    ASSERT(write(records[1].fd, "hi", 2) == 2);
+    char seen[2];
+    ASSERT(read(connection[1], seen, 2) == 2);
+    ASSERT(std::string(seen, 2) == "hi");
+    for (const HandoffRecord &record : records)
+    {
+        close(record.fd);
+    }
+    close(connection[1]);
+}
+
+void testGameServerHandsOffSessions()
+{
+    std::mutex mutex;
+    std::vector<std::string> stopped;
+    std::vector<std::string> resumed;
+    std::function<void(std::string, int)> play = [&mutex, &stopped](std::string name, int turn)
+    {
+        while (true)
+        {
+            console().out() << name << " " << turn << "> " << std::flush;
+            console().present();
+            console().waitForTurn(-1);
+            if (console().handoffRequested())
+            {
+                std::string state = name + ":" + std::to_string(turn);
+                std::lock_guard<std::mutex> lock(mutex);
+                stopped.push_back(state);
+                throw SessionHandoff(state);
+            }
+            getUserInputLine();
+            turn++;
+        }
+    };
+
+    ServerOptions oldOptions;
+    oldOptions.unixPath = "/tmp/valeris_old_" + std::to_string(getpid()) + ".sock";
+    oldOptions.workers = 1;
+    oldOptions.stackBytes = 64 * 1024;
+    ServerOptions newOptions = oldOptions;
+    newOptions.unixPath = "/tmp/valeris_new_" + std::to_string(getpid()) + ".sock";
+    newOptions.handoffPath = "/tmp/valeris_handoff_" + std::to_string(getpid()) + ".sock";
+    GameServer oldServer(oldOptions, [&play]
+                         {
+                             console().out() << "Name? " << std::flush;
+                             play(getUserInputLine(), 0); });
+    GameServer newServer(newOptions, nullptr, [&play, &mutex, &resumed](const std::string &state)
+                         {
+                             {
+                                 std::lock_guard<std::mutex> lock(mutex);
+                                 resumed.push_back(state);
+                             }
+                             size_t colon = state.find(':');
+                             play(state.substr(0, colon), std::atoi(state.c_str() + colon + 1)); });
+    ASSERT(oldServer.start());
+    ASSERT(newServer.start());
+
+    std::vector<int> bots;
+    for (int i = 0; i < 20; i++)
+    {
+        int bot = connectToServer(oldOptions.unixPath);
+        ASSERT(bot >= 0);
+        readUntil(bot, "Name? ");
+        std::string lines = "bot" + std::to_string(i) + "\n" + std::string(i % 3, '\n');
+        ASSERT(send(bot, lines.data(), lines.size(), 0) == (ssize_t)lines.size());
+        std::string prompt = "bot" + std::to_string(i) + " " + std::to_string(i % 3) + "> ";
+        ASSERT(readUntil(bot, prompt).find(prompt) != std::string::npos);
+        bots.push_back(bot);
+    }
+
+    ASSERT_EQUAL(oldServer.handOff(newOptions.handoffPath), 20);
+    ASSERT_EQUAL(oldServer.stats().connected, (size_t)0);
+    ASSERT_EQUAL(oldServer.stats().finished, 0ULL);
+
+    // Every bot carries on in the new server from the turn it was on, on the same connection
+    for (int i = 0; i < 20; i++)
+    {
+        ASSERT(send(bots[i], "\n", 1, 0) == 1);
+        std::string prompt = "bot" + std::to_string(i) + " " + std::to_string(i % 3 + 1) + "> ";
+        ASSERT(readUntil(bots[i], prompt).find(prompt) != std::string::npos);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::sort(stopped.begin(), stopped.end());
+        std::sort(resumed.begin(), resumed.end());
+        ASSERT(stopped == resumed);
+    }
+    ServerStats stats = newServer.stats();
+    ASSERT_EQUAL(stats.adopted, 20ULL);
+    ASSERT_EQUAL(stats.connected, (size_t)20);
+    ASSERT(stats.slowestPauseMicroseconds > 0);
+    for (int bot : bots)
+    {
+        close(bot);
+    }
+    oldServer.stop();
+    newServer.stop();
+}
+#endif
+
 int main()
 {
     TestFramework framework("minigames_test_results.xml");
@@ -1510,6 +3738,111 @@ int main()
     framework.addTest("Room::testAllDirections", testAllDirections);
     framework.addTest("Room::testSomeDirections", testSomeDirections);
     framework.addTest("Room::testOneDirection", testOneDirection);
+    // Seeded floor tests
+    framework.addTest("Seeded Floor Is Reproducible", testSeededFloorIsReproducible);
+
+    // Floor analytics tests
+    framework.addTest("Floor Analytics Tree", testFloorAnalyticsTree);
+    framework.addTest("Floor Analytics Loop", testFloorAnalyticsLoop);
+    framework.addTest("Floor Analytics Large Floor Exact", testFloorAnalyticsLargeFloorExact);
+    framework.addTest("Dungeon Stats Match Floor", testDungeonStatsMatchFloor);
+
+    // Floor export tests
+    framework.addTest("Export Floor JSON", testExportFloorJson);
+    framework.addTest("Export Floor DOT", testExportFloorDot);
+    framework.addTest("Buffered Writer Escapes", testBufferedWriterEscapes);
+
+    framework.addTest("RoomIndex nearest matches a full scan", testRoomIndexNearestMatchesScan);
+    framework.addTest("RoomIndex filters follow room state", testRoomIndexFiltersFollowRoomState);
+
+    framework.addTest("FogOfWar walls block sight", testFogOfWarWallsBlockSight);
+    framework.addTest("FogOfWar crosses word boundaries", testFogOfWarCrossesWords);
+    framework.addTest("Dungeon map uses fog of war", testDungeonMapUsesFog);
+
+    framework.addTest("Renderer writes each frame once", testRendererSingleWritePerFrame);
+    framework.addTest("Renderer presents before input", testRendererPresentsBeforeInput);
+
+    framework.addTest("Screen diff matches a full draw", testScreenDiffMatchesFullDraw);
+    framework.addTest("Screen invalidate redraws", testScreenInvalidateRedraws);
+
+    framework.addTest("TimerQueue order and cancel", testTimerQueueOrderAndCancel);
+    framework.addTest("sleepFor uses no CPU", testSleepUsesNoCpu);
+    framework.addTest("TimerThread runs callbacks", testTimerThreadRunsCallbacks);
+
+    framework.addTest("Typewriter skip writes everything", testTypewriterSkipWritesEverything);
+    framework.addTest("Typewriter batches to frames", testTypewriterBatchesToFrames);
+    framework.addTest("Typewriter leaves caller free", testTypewriterLeavesCallerFree);
+
+    framework.addTest("HeadlessSink strips escapes", testHeadlessSinkStripsEscapes);
+    framework.addTest("Headless mode skips terminal work", testHeadlessSkipsTerminalWork);
+
+    framework.addTest("Console reads and writes memory", testConsoleReadsAndWritesMemory);
+    framework.addTest("Console runs concurrent games", testConsoleRunsConcurrentGames);
+#ifndef _WIN32
+    framework.addTest("Console over socket", testConsoleOverSocket);
+#endif
+
+    framework.addTest("AnsiFilter drops redundant escapes", testAnsiFilterDropsRedundantEscapes);
+    framework.addTest("AnsiFilter merges cursor moves", testAnsiFilterMergesCursorMoves);
+    framework.addTest("CoalescingSink keeps text", testCoalescingSinkKeepsText);
+
+    framework.addTest("Deflater frames decode independently", testDeflaterFramesDecodeIndependently);
+    framework.addTest("Compression negotiated over Telnet", testCompressionNegotiatedOverTelnet);
+
+    framework.addTest("EventLoop keys, lines and timers", testEventLoopKeysLinesAndTimers);
+    framework.addTest("EventLoop idle work yields to input", testEventLoopIdleWorkYieldsToInput);
+    framework.addTest("Combat turn ends on timeout", testCombatTurnEndsOnTimeout);
+
+    framework.addTest("KeyReader times first key and Enter", testKeyReaderTimesFirstKeyAndEnter);
+    framework.addTest("Latency histogram export", testLatencyHistogramExport);
+
+    framework.addTest("CommandRegistry dispatch", testCommandRegistryDispatch);
+    framework.addTest("CommandRegistry perfect hash", testCommandRegistryPerfectHash);
+    framework.addTest("ValerisGame accepts new commands", testValerisGameAcceptsNewCommands);
+
+    framework.addTest("CommandQueue chains and macros", testCommandQueueChainsAndMacros);
+    framework.addTest("ValerisGame runs chained commands", testValerisGameRunsChainedCommands);
+
+#ifdef __linux__
+    framework.addTest("GameServer multiplexes sessions", testGameServerMultiplexesSessions);
+    framework.addTest("GameServer runs menu and game", testGameServerRunsMenuAndGame);
+#endif
+
+#ifdef __linux__
+    framework.addTest("Fiber switch keeps each fiber's state", testFiberSwitchKeepsEachFibersState);
+    framework.addTest("Fiber stacks are pooled", testFiberStacksArePooled);
+#endif
+
+    framework.addTest("WorkStealingDeque pop, steal and races", testWorkStealingDeque);
+    framework.addTest("Scheduler steals queued work", testSchedulerStealsQueuedWork);
+#ifdef __linux__
+    framework.addTest("Job parks a waiting fiber", testJobParksWaitingFiber);
+#endif
+
+    framework.addTest("Blob records round trip", testBlobRoundTrip);
+    framework.addTest("Game state survives a restore", testGameStateSurvivesRestore);
+    framework.addTest("Idle games hibernate and wake", testIdleGameHibernatesAndWakes);
+
+    framework.addTest("Floor templates are shared by seed", testSharedFloorTemplate);
+    framework.addTest("Floor overlays copy rooms on write", testFloorOverlaysCopyOnWrite);
+    framework.addTest("Event games share one floor", testEventGamesShareFloor);
+
+    framework.addTest("Room loot is taken once", testRoomLootTakenOnce);
+    framework.addTest("Shared world broadcasts to the room", testSharedWorldBroadcasts);
+    framework.addTest("World games restore into their world", testWorldGamesRestoreIntoTheirWorld);
+
+    framework.addTest("FrameFeed shares frames", testFrameFeedSharesFrames);
+    framework.addTest("FrameFeed resyncs slow spectators", testFrameFeedResyncsSlowSpectators);
+#ifdef __linux__
+    framework.addTest("GameServer streams to spectators", testGameServerStreamsToSpectators);
+#endif
+
+    framework.addTest("Handoff record round trip", testHandoffRecordRoundTrip);
+#ifdef __linux__
+    framework.addTest("Handoff passes the connection", testHandoffPassesConnection);
+    framework.addTest("GameServer hands off sessions", testGameServerHandsOffSessions);
+#endif
+
     // Run framework
     framework.run();
 